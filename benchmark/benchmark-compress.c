@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <ftw.h>
 
 #include <sys/time.h>
 
@@ -21,15 +22,30 @@ static int use_posix;
 
 static char * input_file;
 static char * output_file = "compress-bench.out";
+static char * methods = "none,quicklz,zlib,lzma";
+static char * compressibilities = "1,2,4,8";
+static size_t file_size_mb = 256;
+static size_t record_size = 32 * 1024;
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
+#define RECORD_MAGIC_BYTE 123
+#define RECORD_MAGIC_SEED 17 
+
 #define echo(...)                                   \
     do {                                            \
         printf(__VA_ARGS__);                        \
         fflush(stdout);                             \
     } while(0)
 
+#define verbose_echo(...)                           \
+    do {                                            \
+        if (verbose) {                              \
+            echo("-- ");                            \
+            echo(__VA_ARGS__);                      \
+        }                                           \
+    } while (0)
+
 static struct option long_options[] =
 {
     {"verbose", no_argument, &verbose, 1},
@@ -37,8 +53,13 @@ static struct option long_options[] =
     {"use-ufs", no_argument, &use_posix, 1},
     {"input-file", required_argument, NULL, 'f'},
     {"output-file", required_argument, NULL, 'o'},
+    {"methods", required_argument, NULL, 'm'},
+    {"compressibility", required_argument, NULL, 'c'},
+    {"file-size-mb", required_argument, NULL, 's'},
+    {"record-size", required_argument, NULL, 'x'},
+    {0, 0, 0, 0}
 };
-static char * opt_string = "vhuf:o:";
+static char * opt_string = "vhuf:o:m:c:s:x:";
 
 static void usage(void)
 {
@@ -51,15 +72,26 @@ static void usage(void)
     "    -u, --use-ufs\n"
     "        perform benchmark on the underlying file system\n"
     "    -f, --input-file\n"
-    "        input file name.\n"
-    "    -o, --input-file\n"
+    "        copy this input file instead of generating data.\n"
+    "    -o, --output-file\n"
     "        output file name.\n"
+    "    -m, --methods\n"
+    "        comma separated compression methods to try.\n"
+    "        default none,quicklz,zlib,lzma\n"
+    "    -c, --compressibility\n"
+    "        comma separated compressibility factors for the\n"
+    "        generated data. default 1,2,4,8\n"
+    "    -s, --file-size-mb\n"
+    "        size of the generated file in mb. default 256\n"
+    "    -x, --record-size\n"
+    "        size of each read and write. default 32k\n"
     );
 }
 
 static int parse_args(int argc, char * argv[])
 {
     int i, c;
+    long n;
 
     while ((c = getopt_long(argc, argv, 
                     opt_string , long_options, &i)) != -1) {
@@ -83,6 +115,28 @@ static int parse_args(int argc, char * argv[])
             }
             output_file = strdup(optarg);
             break;
+        case 'm':
+            methods = strdup(optarg);
+            break;
+        case 'c':
+            compressibilities = strdup(optarg);
+            break;
+        case 's':
+            n = atol(optarg);
+            if (n <= 0) {
+                fprintf(stderr, "file size must be > 0\n");
+                return 1;
+            }
+            file_size_mb = n;
+            break;
+        case 'x':
+            n = atol(optarg);
+            if (n <= 0) {
+                fprintf(stderr, "record size must be > 0\n");
+                return 1;
+            }
+            record_size = n;
+            break;
         case 'u':
             use_posix = 1;
             break;
@@ -108,6 +162,31 @@ static long current_time_usec(void)
     return t.tv_usec + t.tv_sec * 1000000;
 }
 
+/**
+ * Determines what the value of the i'th byte of a record should be,
+ * taken from sandbox/compressibility.c. The first 1 / compressibility
+ * of each record is reproducible garbage that won't compress well,
+ * and the rest is the magic byte, which compresses to almost nothing.
+ * The garbage mixes in the record number so that records don't
+ * repeat each other.
+ */
+static unsigned char calculate_record_byte(size_t record,
+        size_t i, double compressibility)
+{
+    uint64_t value;
+
+    if (i * 1.0 < record_size / compressibility) {
+        value = (record * record_size + i + 1) * 0x9E3779B97F4A7C15ULL;
+        value ^= value >> 29;
+        value *= RECORD_MAGIC_SEED;
+        value ^= value >> 32;
+    } else {
+        value = RECORD_MAGIC_BYTE;
+    }
+
+    return value & 0xFF;
+}
+
 /**
  * Make it so that switching between tokufs and ufs
  * is transparent to the benchmarking code.
@@ -126,16 +205,18 @@ struct benchmark_file
     int (*fsync)(int fd);
 };
 
-static int tokufs_mount_and_open(const char * path, int flags, ...)
+static int tokufs_open(const char * path, int flags, ...)
 {
     int ret;
-    ret = toku_fs_mount(TOKUFS_MOUNT);
-    assert(ret == 0);
     ret = toku_fs_open(path, flags, 0644);
     assert(ret >= 0);
     return ret;
 }
 
+/**
+ * Closing the file and unmounting is the only way to be sure
+ * everything made it to disk, so it counts toward the run time.
+ */
 static int tokufs_close_and_unmount(int fd)
 {
     int ret;
@@ -158,7 +239,7 @@ static int posix_sync_and_close(int fd)
 
 static struct benchmark_file tokufs_file =
 {
-    .open = tokufs_mount_and_open,
+    .open = tokufs_open,
     .close = tokufs_close_and_unmount,
     .pwrite = toku_fs_pwrite,
     .pread = toku_fs_pread
@@ -205,51 +286,190 @@ static void read_input_file_into_memory(
     assert(ret == 0);
 }
 
-static long run_benchmark(struct benchmark_file * file)
+/**
+ * Generate a file's worth of records with the given compressibility.
+ */
+static void generate_input(struct input_file_info * info,
+        double compressibility)
 {
-    const int pagesize = getpagesize();
-    int ret, fd;
-    long start, write_time;
-    struct input_file_info file_info;
-    size_t bytes_written = 0;
+    size_t i, j, num_records;
 
-    printf("reading file into memory...\n");
-    read_input_file_into_memory(&file_info);
+    num_records = file_size_mb * 1024 * 1024 / record_size;
+    info->size = num_records * record_size;
+    info->buf = malloc(info->size);
+    if (info->buf == NULL) {
+        printf("couldn't allocate %ld bytes for the generated file\n",
+                info->size);
+        exit(1);
+    }
+    for (i = 0; i < num_records; i++) {
+        unsigned char * record = (unsigned char *) info->buf + i * record_size;
+        for (j = 0; j < record_size; j++) {
+            record[j] = calculate_record_byte(i, j, compressibility);
+        }
+    }
+}
+
+static long on_disk_bytes;
+
+static int sum_file_bytes(const char * path, const struct stat * st,
+        int flag, struct FTW * ftw)
+{
+    (void) path;
+    (void) ftw;
+    if (flag == FTW_F) {
+        on_disk_bytes += st->st_blocks * 512L;
+    }
+    return 0;
+}
 
-    printf("writing output file...\n");
+/**
+ * Bytes allocated on disk under path, which may be a directory.
+ */
+static long disk_usage(const char * path)
+{
+    int ret;
+
+    on_disk_bytes = 0;
+    ret = nftw(path, sum_file_bytes, 16, FTW_PHYS);
+    assert(ret == 0);
+
+    return on_disk_bytes;
+}
+
+static int remove_file(const char * path, const struct stat * st,
+        int flag, struct FTW * ftw)
+{
+    (void) st;
+    (void) flag;
+    (void) ftw;
+    return remove(path);
+}
+
+/**
+ * Remove path and everything under it, if it exists.
+ */
+static void remove_tree(const char * path)
+{
+    int ret;
+
+    ret = nftw(path, remove_file, 16, FTW_DEPTH | FTW_PHYS);
+    assert(ret == 0 || errno == ENOENT);
+}
+
+/**
+ * Mount tokufs with the given compression method for data blocks.
+ */
+static void tokufs_mount(const char * method)
+{
+    int ret;
+    char optstr[64];
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    snprintf(optstr, sizeof(optstr), "data_compression=%s", method);
+    ret = toku_fs_mount_options_parse(&opts, optstr);
+    if (ret != 0) {
+        printf("unknown compression method %s\n", method);
+        exit(1);
+    }
+    ret = toku_fs_mount_with_options(TOKUFS_MOUNT, &opts);
+    assert(ret == 0);
+}
+
+struct benchmark_result
+{
+    long write_time;
+    long read_time;
+    long disk_bytes;
+};
+
+/**
+ * Write the input out in record size chunks, then read it
+ * back and make sure it came back the same.
+ */
+static void run_benchmark(struct benchmark_file * file,
+        const char * method, struct input_file_info * input,
+        struct benchmark_result * result)
+{
+    int ret, fd;
+    long start;
+    ssize_t n;
+    size_t offset, io_size;
+    char * path, * buf;
+
+    path = output_file;
+    if (!use_posix) {
+        path = malloc(strlen(output_file) + 2);
+        sprintf(path, "/%s", output_file);
+        remove_tree(TOKUFS_MOUNT);
+        tokufs_mount(method);
+    } else {
+        unlink(output_file);
+    }
+
+    verbose_echo("writing %s...\n", path);
     start = current_time_usec();
-    int flags = O_CREAT | O_TRUNC | O_WRONLY;
-    fd = file->open(output_file, flags, 0644);
+    fd = file->open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
     assert(fd >= 0);
-
-    while (bytes_written < file_info.size) {
-        const int iosize = 8 * pagesize;
-        const int bytes_left = file_info.size - bytes_written;
-        int write_size = MIN(bytes_left, iosize);
-        ssize_t n = file->pwrite(fd, file_info.buf + bytes_written, 
-                write_size, bytes_written);
-        if (n != write_size) {
-            printf("wrote %ld bytes, wanted %d, errno %d\n", n, write_size, errno);
+    for (offset = 0; offset < input->size; offset += n) {
+        io_size = MIN(input->size - offset, record_size);
+        n = file->pwrite(fd, input->buf + offset, io_size, offset);
+        if (n != (ssize_t) io_size) {
+            printf("wrote %ld bytes, wanted %lu, errno %d\n",
+                    n, io_size, errno);
         }
-        assert(n == write_size);
-        bytes_written += n;
+        assert(n == (ssize_t) io_size);
     }
+    ret = file->close(fd);
+    assert(ret == 0);
+    result->write_time = current_time_usec() - start;
 
+    result->disk_bytes = disk_usage(use_posix ? output_file : TOKUFS_MOUNT);
+
+    verbose_echo("reading %s...\n", path);
+    if (!use_posix) {
+        tokufs_mount(method);
+    }
+    buf = malloc(record_size);
+    start = current_time_usec();
+    fd = file->open(path, O_RDONLY, 0644);
+    assert(fd >= 0);
+    for (offset = 0; offset < input->size; offset += n) {
+        io_size = MIN(input->size - offset, record_size);
+        n = file->pread(fd, buf, io_size, offset);
+        assert(n == (ssize_t) io_size);
+        assert(memcmp(buf, input->buf + offset, io_size) == 0);
+    }
     ret = file->close(fd);
     assert(ret == 0);
-    write_time = current_time_usec() - start;
-    printf("done.\n");
-    printf("time %ld usec, %lf MBs/sec\n", 
-            write_time, file_info.size / (write_time * 1.0));
+    result->read_time = current_time_usec() - start;
+    free(buf);
 
-    free(file_info.buf);
-    return write_time;
+    if (!use_posix) {
+        free(path);
+    }
+}
+
+static void print_result(const char * method, const char * data,
+        size_t size, struct benchmark_result * result)
+{
+    echo("%-10s %-8s %12.3lf %12.3lf %14ld %8.2lf\n",
+            method, data,
+            size / (result->write_time * 1.0),
+            size / (result->read_time * 1.0),
+            result->disk_bytes,
+            result->disk_bytes > 0 ? size / (result->disk_bytes * 1.0) : 0);
 }
 
 int main(int argc, char * argv[])
 {
     int ret;
+    char * method, * method_saveptr, * methods_buf;
+    char * factor, * factor_saveptr, * factors_buf;
     struct benchmark_file * file;
+    struct benchmark_result result;
+    struct input_file_info input;
 
     ret = parse_args(argc, argv);
     if (ret != 0 || help) {
@@ -260,9 +480,20 @@ int main(int argc, char * argv[])
     ret = toku_fs_set_cachesize(64L * 1024 * 1024);
     assert(ret == 0);
 
+    // there is only one way to store a file on the ufs
+    if (use_posix) {
+        methods = "posix";
+    }
+
     echo("compression benchmark\n");
-    echo(" * input file: %s\n", input_file);
+    echo(" * input file: %s\n", input_file != NULL ? input_file : "generated");
+    if (input_file == NULL) {
+        echo(" * generated file size: %lu MB\n", file_size_mb);
+        echo(" * compressibility: %s\n", compressibilities);
+    }
     echo(" * output file: %s\n", output_file);
+    echo(" * record size: %lu\n", record_size);
+    echo(" * methods: %s\n", methods);
     echo(" * file op interface: %s\n", use_posix ? "posix" : "tokufs");
     echo(" * pagesize: %lu\n",
             use_posix ? (size_t) getpagesize() : toku_fs_get_blocksize());
@@ -274,8 +505,47 @@ int main(int argc, char * argv[])
         file = &tokufs_file;
     }
 
-    run_benchmark(file);
+    echo("%-10s %-8s %12s %12s %14s %8s\n", "method", "data",
+            "write MB/s", "read MB/s", "disk bytes", "ratio");
+
+    // an input file has whatever compressibility it has, so the
+    // matrix is just the list of methods.
+    if (input_file != NULL) {
+        read_input_file_into_memory(&input);
+        compressibilities = "file";
+    }
+
+    factors_buf = strdup(compressibilities);
+    for (factor = strtok_r(factors_buf, ",", &factor_saveptr);
+            factor != NULL;
+            factor = strtok_r(NULL, ",", &factor_saveptr)) {
+        if (input_file == NULL) {
+            if (atof(factor) < 1.0) {
+                printf("compressibility must be >= 1\n");
+                exit(1);
+            }
+            generate_input(&input, atof(factor));
+        }
+        methods_buf = strdup(methods);
+        for (method = strtok_r(methods_buf, ",", &method_saveptr);
+                method != NULL;
+                method = strtok_r(NULL, ",", &method_saveptr)) {
+            run_benchmark(file, method, &input, &result);
+            print_result(method, factor, input.size, &result);
+        }
+        free(methods_buf);
+        if (input_file == NULL) {
+            free(input.buf);
+        }
+    }
+    free(factors_buf);
 
+    if (input_file != NULL) {
+        free(input.buf);
+    }
+    if (!use_posix) {
+        remove_tree(TOKUFS_MOUNT);
+    }
 
     return 0;
 }
@@ -7,6 +7,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <assert.h>
+#include <errno.h>
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
@@ -28,14 +29,13 @@
 
 #define progress_printf(...) do { printf(__VA_ARGS__); fflush(stdout); } while(0)
 
-int toku_debug;
-
 static int verbose;
 static int report_progress;
 static int help;
 static int use_posix;
 
 static char * benchmark_root_dir = "benchmark-bucket";
+static char * mount_options;
 static size_t iosize = 512;
 static size_t cachesize = 512L * 1024 * 1024;
 
@@ -50,6 +50,9 @@ static int file_write_flags = O_CREAT | O_WRONLY;
 static int do_pwrite = 1;
 static int do_serial = 1;
 static int do_scan = 0;
+static int do_whole_file = 0;
+static int do_profile = 0;
+static int do_read_back = 0;
 
 static struct option long_options[] =
 {
@@ -69,8 +72,12 @@ static struct option long_options[] =
     {"random", no_argument, &do_serial, 0},
     {"pwrite", no_argument, &do_pwrite, 1},
     {"pread", no_argument, &do_pwrite, 0},
+    {"whole-file", no_argument, &do_whole_file, 1},
+    {"profile", no_argument, &do_profile, 1},
+    {"mount-options", required_argument, NULL, 'o'},
+    {"read-back", no_argument, &do_read_back, 1},
 };
-static char * opt_string = "vhuc:f:s:n:d:m:b:x:";
+static char * opt_string = "vhuc:f:s:n:d:m:b:x:o:";
 
 static void usage(void)
 {
@@ -108,6 +115,20 @@ static void usage(void)
     "        perform pwrites on each file\n"
     "    --pread\n"
     "        perform preads on each file\n"
+    "    --whole-file\n"
+    "        write or read each file in one toku_fs_put_file or\n"
+    "        toku_fs_get_file call, instead of open, IO and close.\n"
+    "        the file size is operations * iosize. tokufs only.\n"
+    "    --profile\n"
+    "        print where the hot path's time went, by operation and\n"
+    "        phase. needs tokufs built with PROFILE=1. tokufs only.\n"
+    "    -o, --mount-options\n"
+    "        mount tokufs with the given key=value,... options, as\n"
+    "        parsed by toku_fs_mount_options_parse. tokufs only.\n"
+    "    --read-back\n"
+    "        after writing, remount for a cold cache and read every\n"
+    "        file back, one leaf directory at a time in name order,\n"
+    "        the way tar or a training data loader would. tokufs only.\n"
     );
 }
 
@@ -187,6 +208,9 @@ static int parse_args(int argc, char * argv[])
             }
             num_operations = n;
             break;
+        case 'o':
+            mount_options = optarg;
+            break;
         case 0:
             break;
         case '?':
@@ -487,6 +511,35 @@ static void benchmark_directory_scan_posix(char * parent,
     assert(ret == 0);
 }
 
+static int benchmark_directory_walk_cb(const char * path,
+        const struct stat * st, void * extra)
+{
+    struct benchmark_directory_scan_info * info = extra;
+
+    (void) path;
+    if (!S_ISDIR(st->st_mode)) {
+        info->total_size += st->st_size;
+    }
+    info->num_files++;
+    return 0;
+}
+
+/**
+ * Same totals as benchmark_directory_scan_tokufs, but from
+ * one range scan per level instead of one readdir per directory.
+ */
+static void benchmark_directory_walk_tokufs(char * parent,
+        struct benchmark_directory_scan_info * info)
+{
+    int ret;
+    struct toku_fs_walk_filter filter;
+
+    memset(&filter, 0, sizeof(filter));
+    filter.min_depth = 1;
+    ret = toku_fs_walk(parent, &filter, benchmark_directory_walk_cb, info);
+    assert(ret == 0);
+}
+
 static void benchmark_directory_scan(struct benchmark_file_ops * file_ops,
         struct benchmark_directory_scan_info * info)
 {
@@ -610,6 +663,32 @@ static char * get_write_buf(void)
     return &random_buf[r];
 }
 
+/**
+ * Write or read a whole file in one call. Writes are built
+ * from the random buffer an iosize at a time, like the
+ * operations they stand in for.
+ */
+static void benchmark_whole_file(enum thread_operation op,
+        const char * filename)
+{
+    int ret;
+    ssize_t n;
+    size_t size = num_operations * iosize;
+    char * buf = malloc(size + 1);
+
+    if (thread_operation_is_writing(op)) {
+        for (int j = 0; j < num_operations; j++) {
+            memcpy(buf + j * iosize, get_write_buf(), iosize);
+        }
+        ret = toku_fs_put_file(filename, buf, size, 0644);
+        assert(ret == 0);
+    } else {
+        n = toku_fs_get_file(filename, buf, size);
+        assert(n == (ssize_t) size);
+    }
+    free(buf);
+}
+
 static void benchmark_thread(void * arg)
 {
     int fd, ret;
@@ -622,6 +701,13 @@ static void benchmark_thread(void * arg)
         const char * parent = info->directories[i % info->num_directories];
         char * filename = generate_random_name(parent);
 
+        if (do_whole_file) {
+            benchmark_whole_file(info->op, filename);
+            free(filename);
+            maybe_report_file_create_progress(i);
+            continue;
+        }
+
         fd = info->file_ops->open(filename, 
                 thread_operation_is_writing(info->op) ?
                 file_write_flags : file_read_flags, 0644);
@@ -666,6 +752,132 @@ static void benchmark_thread(void * arg)
     free(info);
 }
 
+static void mount_tokufs(void)
+{
+    int ret;
+    struct toku_fs_mount_options opts;
+
+    // the defaults pick up the cachesize set in main
+    toku_fs_mount_options_init(&opts);
+    if (mount_options != NULL) {
+        ret = toku_fs_mount_options_parse(&opts, mount_options);
+        if (ret != 0) {
+            printf("invalid mount options %s\n", mount_options);
+            exit(1);
+        }
+    }
+    ret = toku_fs_mount_with_options("bstore-env.mount", &opts);
+    assert(ret == 0);
+}
+
+static uint64_t files_read_back;
+
+/**
+ * Open, read and close every file of one directory, in the
+ * order readdir gives them, which is name order.
+ */
+static void read_back_directory(const char * dir, char * buf)
+{
+    int ret, fd;
+    ssize_t n;
+    size_t size = num_operations * iosize;
+    struct toku_dircursor cursor;
+    int num_entries = 4 * getpagesize() / sizeof(struct toku_dirent);
+    struct toku_dirent * dirents = malloc(num_entries *
+            sizeof(struct toku_dirent));
+    int keep_reading = 1;
+
+    ret = toku_fs_opendir(dir, &cursor);
+    assert(ret == 0);
+    do {
+        int entries_read = 0;
+        ret = toku_fs_readdir(&cursor, dirents, num_entries, &entries_read);
+        if (ret == 0) {
+            keep_reading = 0;
+        } else if (ret < 0) {
+            break;
+        }
+        for (int i = 0; i < entries_read; i++) {
+            struct toku_dirent * d = &dirents[i];
+            if (!S_ISDIR(d->st.st_mode)) {
+                fd = toku_fs_open(d->filename, O_RDONLY, 0);
+                assert(fd >= 0);
+                if (size > 0) {
+                    n = toku_fs_pread(fd, buf, size, 0);
+                    assert(n == (ssize_t) size);
+                }
+                ret = toku_fs_close(fd);
+                assert(ret == 0);
+                (void) __sync_fetch_and_add(&files_read_back, 1);
+            }
+            free(d->filename);
+        }
+    } while (keep_reading);
+    free(dirents);
+    ret = toku_fs_closedir(&cursor);
+    assert(ret == 0);
+}
+
+struct read_back_info {
+    struct leaf_directories * leaves;
+    int first;
+};
+
+static void read_back_thread(void * arg)
+{
+    struct read_back_info * info = arg;
+    char * buf = malloc(num_operations * iosize + 1);
+
+    for (int i = info->first; i < info->leaves->num_entries;
+            i += num_threads) {
+        read_back_directory(info->leaves->array[i], buf);
+    }
+    free(buf);
+    free(info);
+}
+
+/**
+ * Remount so nothing is cached, then read every file back with
+ * each thread taking its share of the leaf directories.
+ */
+static void read_back_files(struct threadpool * tp,
+        struct leaf_directories * leaves)
+{
+    int ret;
+    long start, elapsed_time;
+    struct read_back_info * info;
+    struct toku_fs_stats * stats = malloc(sizeof(struct toku_fs_stats));
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+    mount_tokufs();
+    ret = toku_fs_reset_stats();
+    assert(ret == 0);
+
+    printf("Reading every file back, one directory at a time\n");
+    files_read_back = 0;
+    start = toku_current_time_usec();
+    for (int i = 0; i < num_threads; i++) {
+        info = malloc(sizeof(struct read_back_info));
+        info->leaves = leaves;
+        info->first = i;
+        toku_threadpool_dispatch(tp, read_back_thread, info);
+    }
+    ret = toku_threadpool_wait(tp);
+    assert(ret == 0);
+    elapsed_time = toku_current_time_usec() - start;
+
+    assert(files_read_back == (uint64_t) num_files);
+    printf("read back %d files in %ld usec, %lf files/sec\n", num_files,
+            elapsed_time, num_files / (elapsed_time / 1000000.0));
+    ret = toku_fs_get_stats(stats);
+    assert(ret == 0);
+    printf("directory prefetches %lu, dropped %lu, files read ahead %lu\n",
+            stats->dir_prefetches, stats->dir_prefetches_dropped,
+            stats->dir_prefetch_files);
+    free(stats);
+}
+
 static void do_meta_scan(struct benchmark_file_ops * file_ops)
 {
     long start, end;
@@ -682,6 +894,19 @@ static void do_meta_scan(struct benchmark_file_ops * file_ops)
             scan_info.num_files / ((end - start) / 1000000.0));
     printf("total size of all files not including metadata %lu\n",
             scan_info.total_size);
+
+    if (file_ops == &tokufs_file) {
+        printf("Walking the same tree one level at a time\n");
+        struct benchmark_directory_scan_info walk_info;
+        memset(&walk_info, 0, sizeof(walk_info));
+        start = toku_current_time_usec();
+        benchmark_directory_walk_tokufs(benchmark_root_dir, &walk_info);
+        end = toku_current_time_usec();
+        assert(walk_info.num_files == scan_info.num_files);
+        printf("walked %ld files in %ld usec, %lf files/second\n",
+                walk_info.num_files, end - start,
+                walk_info.num_files / ((end - start) / 1000000.0));
+    }
 }
 
 static void run_benchmarks(struct benchmark_file_ops * file_ops)
@@ -813,11 +1038,30 @@ static void run_benchmarks(struct benchmark_file_ops * file_ops)
         printf("throughput: %lf MB/sec\n", bytes / (elapsed_time * 1.0));
     }
 
+    if (do_read_back) {
+        read_back_files(&tp, &leaves);
+    }
+
     ret = toku_threadpool_destroy(&tp);
     free_leaf_directories(&leaves);
     assert(ret == 0);
 }
 
+/**
+ * Print where the hot path's time went, by operation and phase.
+ */
+static void print_profile(void)
+{
+    int ret;
+
+    ret = toku_fs_print_profile(stdout);
+    if (ret == -ENOSYS) {
+        printf("Phase profile: not built in, rebuild tokufs with PROFILE=1\n");
+    } else {
+        assert(ret == 0);
+    }
+}
+
 static void handle_sigusr1(int sig)
 {
     assert(sig == SIGUSR1);
@@ -854,6 +1098,18 @@ int main(int argc, char * argv[])
         usage();
         exit(ret);
     }
+    if (do_whole_file && use_posix) {
+        printf("--whole-file only works on tokufs\n");
+        exit(1);
+    }
+    if ((do_read_back || mount_options != NULL) && use_posix) {
+        printf("--read-back and --mount-options only work on tokufs\n");
+        exit(1);
+    }
+    if (do_read_back && !do_pwrite) {
+        printf("--read-back reads back what --pwrite wrote\n");
+        exit(1);
+    }
     if (num_threads > num_files) {
         printf("cannot have more threads (%d) than files (%d)\n",
                 num_threads, num_files);
@@ -864,7 +1120,6 @@ int main(int argc, char * argv[])
         report_progress = 1;
     }
 
-    toku_debug = verbose != 0;
     setup_signal_handlers();
     invocation_str = toku_strcombine(argv, argc);
     ret = gethostname(hostname, 256);
@@ -897,6 +1152,9 @@ int main(int argc, char * argv[])
     printf(" * size of each file: %lu\n", num_operations * iosize);
     printf(" * filesystem pagesize: %d\n", pgsize);
     printf(" * cachesize: %lu MB\n", use_posix ? 0 : cachesize / (1024*1024));
+    printf(" * mount options: %s\n", mount_options != NULL ?
+            mount_options : "default");
+    printf(" * read back? %s\n", do_read_back ? "yes" : "no");
     printf(" * verbose? %s\n", verbose ? "yes" : "no");
     printf(" * report progress? %s\n", report_progress ? "yes" : "no");
 
@@ -906,14 +1164,16 @@ int main(int argc, char * argv[])
     if (use_posix) {
         file_ops = &posix_file;
     } else {
-        ret = toku_fs_mount("bstore-env.mount");
-        assert(ret == 0);
+        mount_tokufs();
         file_ops = &tokufs_file;
     }
 
     run_benchmarks(file_ops);
 
     if (!use_posix) {
+        if (do_profile) {
+            print_profile();
+        }
         long start = toku_current_time_usec();
         ret = toku_fs_unmount();
         assert(ret == 0);
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <assert.h>
+#include <errno.h>
 
 #include <unistd.h>
 #include <signal.h>
@@ -20,6 +21,7 @@ static int verbose;
 static int help;
 static int use_ufs;
 static int do_drop_caches;
+static int do_profile;
 
 static int do_serial_read;
 static int do_serial_write;
@@ -30,6 +32,7 @@ static size_t num_records = 256 * 1024;
 static size_t record_size = 512;
 static size_t compressibility = 1;
 static size_t cachesize_mb = 128;
+static char * mount_options;
 
 #define RANDOM_TABLE_SIZE   (32*1024*1024)
 static char * random_table;
@@ -68,12 +71,14 @@ static struct option long_options[] =
     {"compressibility", required_argument, NULL, 'c'},
     {"output-file", required_argument, NULL, 'o'},
     {"cache-size-mb", required_argument, NULL, 'm'},
+    {"mount-options", required_argument, NULL, 'O'},
     {"serial-read", no_argument, &do_serial_read, 1},
     {"serial-write", no_argument, &do_serial_write, 1},
     {"random-read", no_argument, &do_random_read, 1},
-    {"random-write", no_argument, &do_random_write, 1}
+    {"random-write", no_argument, &do_random_write, 1},
+    {"profile", no_argument, &do_profile, 1}
 };
-static char * opt_string = "vhudf:n:x:o:t:m:";
+static char * opt_string = "vhudf:n:x:o:t:m:O:";
 
 static void usage(void)
 {
@@ -98,6 +103,9 @@ static void usage(void)
     "        would likely reduce by a given factor\n"
     "    -m, --cache-size-mb\n"
     "        set the cache size in mb for non ufs runs\n"
+    "    -O, --mount-options\n"
+    "        comma separated tokufs mount options, ie:\n"
+    "        data_nodesize=4M,data_basementsize=128k,data_fanout=16\n"
     "    --serial-read\n"
     "        perform the serial read benchmark. target file required\n"
     "        if no write benchmark is specified\n"
@@ -108,6 +116,9 @@ static void usage(void)
     "        if no write benchmark is specified\n"
     "    --random-write\n"
     "        perform the random write benchmark\n"
+    "    --profile\n"
+    "        print where the hot path's time went, by operation and\n"
+    "        phase. needs tokufs built with PROFILE=1.\n"
     "Note: If none of serial/random read/write are specified,\n"
     "      all are assumed.\n"
     );
@@ -154,6 +165,9 @@ static int parse_args(int argc, char * argv[])
         case 'm':
             cachesize_mb = atol(optarg);
             break;
+        case 'O':
+            mount_options = strdup(optarg);
+            break;
         case 'u':
             use_ufs = 1;
             break;
@@ -769,6 +783,68 @@ static void run_benchmarks(struct benchmark_file * file)
     }
 }
 
+static double hit_ratio(uint64_t hits, uint64_t misses)
+{
+    return hits + misses > 0 ? hits / ((hits + misses) * 1.0) : 0;
+}
+
+/**
+ * Report how well each cache did, to help size meta_cachesize.
+ */
+static void print_cache_stats(void)
+{
+    int ret;
+    struct toku_fs_stats stats;
+
+    ret = toku_fs_get_stats(&stats);
+    assert(ret == 0);
+    echo("Cache hit ratios:\n");
+    echo(" * engine:         %.4lf (%lu hits, %lu misses)\n",
+            hit_ratio(stats.cache_hits, stats.cache_misses),
+            stats.cache_hits, stats.cache_misses);
+    echo(" * metadata:       %.4lf (%lu hits, %lu misses)\n",
+            hit_ratio(stats.meta_cache_hits, stats.meta_cache_misses),
+            stats.meta_cache_hits, stats.meta_cache_misses);
+}
+
+/**
+ * Print what the engine wrote to disk for what the benchmark wrote,
+ * the numbers iostat was used for.
+ */
+static void print_engine_status(void)
+{
+    int ret;
+    struct toku_fs_engine_status status;
+
+    ret = toku_fs_engine_status(&status);
+    assert(ret == 0);
+    echo("Engine:\n");
+    echo(" * write amp:      %.2lf (%lu bytes written, %lu to disk)\n",
+            status.write_amplification, status.bytes_written,
+            status.disk_bytes_written);
+    echo(" * space amp:      %.2lf (%lu file bytes)\n",
+            status.space_amplification, status.file_bytes);
+    echo(" * compression:    %.2lf data, %.2lf meta\n",
+            status.data.compression, status.meta.compression);
+    echo(" * checkpoints:    %lu (%lu seconds)\n",
+            status.checkpoints, status.checkpoint_secs);
+}
+
+/**
+ * Print where the hot path's time went, by operation and phase.
+ */
+static void print_profile(void)
+{
+    int ret;
+
+    ret = toku_fs_print_profile(stdout);
+    if (ret == -ENOSYS) {
+        echo("Phase profile: not built in, rebuild tokufs with PROFILE=1\n");
+    } else {
+        assert(ret == 0);
+    }
+}
+
 static void handle_sigusr1(int sig)
 {
     size_t bytes_done;
@@ -856,6 +932,8 @@ int main(int argc, char * argv[])
             use_ufs ? (size_t) getpagesize() : toku_fs_get_blocksize());
     if (!use_ufs) {
     echo(" * Cache size: %lu MB\n", cachesize_mb);
+    echo(" * Mount options: %s\n",
+            mount_options != NULL ? mount_options : "defaults");
     echo(" * Underlying store: TokuFS\n");
     }
     echo(" * Verbose? %s\n", verbose ? "yes" : "no");
@@ -874,7 +952,16 @@ int main(int argc, char * argv[])
         file = &ufs_file;
         file->path = output_file;
     } else {
-        ret = toku_fs_mount(TOKUFS_MOUNT);
+        struct toku_fs_mount_options opts;
+        toku_fs_mount_options_init(&opts);
+        if (mount_options != NULL) {
+            ret = toku_fs_mount_options_parse(&opts, mount_options);
+            if (ret != 0) {
+                fprintf(stderr, "bad mount options %s\n", mount_options);
+                exit(1);
+            }
+        }
+        ret = toku_fs_mount_with_options(TOKUFS_MOUNT, &opts);
         assert(ret == 0);
         file = &tokufs_file;
         file->path = malloc(strlen(output_file) + 2);
@@ -886,6 +973,11 @@ int main(int argc, char * argv[])
 
     if (!use_ufs) {
         free(file->path);
+        print_cache_stats();
+        print_engine_status();
+        if (do_profile) {
+            print_profile();
+        }
         long start = current_time_us();
         ret = toku_fs_unmount();
         assert(ret == 0);
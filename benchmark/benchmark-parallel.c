@@ -0,0 +1,307 @@
+/**
+ * TokuFS
+ *
+ * How fast one thread streams a big file through tokufs as the
+ * library is given more threads to split the work across. At
+ * each thread count the file is written anew, then read with a
+ * fresh mount, so the first pass reads from a cold cache and the
+ * second from a warm one.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <ftw.h>
+
+#include <sys/time.h>
+
+#include <tokufs.h>
+
+#define TOKUFS_MOUNT "parallel-bench.mount"
+#define BENCH_FILE "/parallel-bench"
+
+static int help;
+static int drop_caches;
+
+static char * thread_counts = "1,2,4,8,16";
+static size_t file_size_mb = 256;
+static size_t io_size = 64L * 1024 * 1024;
+static size_t cachesize = 1024L * 1024 * 1024;
+static size_t parallel_read = 1024 * 1024;
+static size_t parallel_write = 1024 * 1024;
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+#define echo(...)                                   \
+    do {                                            \
+        printf(__VA_ARGS__);                        \
+        fflush(stdout);                             \
+    } while(0)
+
+static struct option long_options[] =
+{
+    {"help", no_argument, &help, 1},
+    {"drop-caches", no_argument, &drop_caches, 1},
+    {"threads", required_argument, NULL, 't'},
+    {"file-size-mb", required_argument, NULL, 's'},
+    {"io-size", required_argument, NULL, 'b'},
+    {"cachesize", required_argument, NULL, 'c'},
+    {"parallel-read", required_argument, NULL, 'p'},
+    {"parallel-write", required_argument, NULL, 'w'},
+    {0, 0, 0, 0}
+};
+static char * opt_string = "hdt:s:b:c:p:w:";
+
+static void usage(void)
+{
+    printf(
+    "usage:\n"
+    "    -h, --help\n"
+    "        print this help and quit.\n"
+    "    -d, --drop-caches\n"
+    "        drop the os page cache before each cold pass too.\n"
+    "        needs root.\n"
+    "    -t, --threads\n"
+    "        comma separated thread counts to try. 1 reads and\n"
+    "        writes without splitting, n > 1 splits across n - 1\n"
+    "        workers and the calling thread. default 1,2,4,8,16\n"
+    "    -s, --file-size-mb\n"
+    "        size of the file in mb. default 256\n"
+    "    -b, --io-size\n"
+    "        size of each read and write. default 64m\n"
+    "    -c, --cachesize\n"
+    "        tokufs cache size. default 1g, enough for the file\n"
+    "        to be read warm\n"
+    "    -p, --parallel-read\n"
+    "        the parallel_read mount option. default 1m\n"
+    "    -w, --parallel-write\n"
+    "        the parallel_write mount option. default 1m\n"
+    );
+}
+
+static int parse_args(int argc, char * argv[])
+{
+    int i, c;
+    long n;
+
+    while ((c = getopt_long(argc, argv,
+                    opt_string, long_options, &i)) != -1) {
+        switch (c) {
+        case 0:
+            break;
+        case 'h':
+            help = 1;
+            break;
+        case 'd':
+            drop_caches = 1;
+            break;
+        case 't':
+            thread_counts = strdup(optarg);
+            break;
+        case 's':
+        case 'b':
+        case 'c':
+        case 'p':
+        case 'w':
+            n = atol(optarg);
+            if (n <= 0) {
+                fprintf(stderr, "-%c must be > 0\n", c);
+                return 1;
+            }
+            if (c == 's') {
+                file_size_mb = n;
+            } else if (c == 'b') {
+                io_size = n;
+            } else if (c == 'c') {
+                cachesize = n;
+            } else if (c == 'p') {
+                parallel_read = n;
+            } else {
+                parallel_write = n;
+            }
+            break;
+        case '?':
+        default:
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Get the current time in microseconds
+ */
+static long current_time_usec(void)
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_usec + t.tv_sec * 1000000;
+}
+
+static int remove_file(const char * path, const struct stat * st,
+        int flag, struct FTW * ftw)
+{
+    (void) st;
+    (void) flag;
+    (void) ftw;
+    return remove(path);
+}
+
+/**
+ * Remove path and everything under it, if it exists.
+ */
+static void remove_tree(const char * path)
+{
+    int ret;
+
+    ret = nftw(path, remove_file, 16, FTW_DEPTH | FTW_PHYS);
+    assert(ret == 0 || errno == ENOENT);
+}
+
+/**
+ * Mount tokufs so that reads and writes use the given number
+ * of threads.
+ */
+static void tokufs_mount(int threads)
+{
+    int ret;
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    opts.cachesize = cachesize;
+    opts.workers = threads > 1 ? threads - 1 : 1;
+    opts.parallel_read = threads > 1 ? parallel_read : 0;
+    opts.parallel_write = threads > 1 ? parallel_write : 0;
+    ret = toku_fs_mount_with_options(TOKUFS_MOUNT, &opts);
+    assert(ret == 0);
+}
+
+static void drop_os_cache(void)
+{
+    FILE * f;
+
+    sync();
+    f = fopen("/proc/sys/vm/drop_caches", "w");
+    if (f == NULL) {
+        perror("/proc/sys/vm/drop_caches");
+        exit(1);
+    }
+    fprintf(f, "3\n");
+    fclose(f);
+}
+
+/**
+ * Write a new file in io size pieces and return how many GB per
+ * second went in. Every 4k of it is different and half
+ * compressible, so the engine has real work to do reading it back.
+ * The data is made up front so only the writes are timed.
+ */
+static double write_file(char * buf)
+{
+    int ret, fd;
+    long start, elapsed;
+    size_t size = file_size_mb * 1024 * 1024;
+    uint64_t * words = (uint64_t *) buf;
+
+    for (size_t i = 0; i < io_size / sizeof(uint64_t); i++) {
+        words[i] = i % 2 ? (i / 512 + 1) * 0x9E3779B97F4A7C15ULL : 0;
+    }
+    ret = toku_fs_unlink(BENCH_FILE);
+    assert(ret == 0 || ret == -ENOENT);
+    fd = toku_fs_open(BENCH_FILE, O_CREAT, 0644);
+    assert(fd >= 0);
+    start = current_time_usec();
+    for (size_t offset = 0; offset < size; offset += io_size) {
+        size_t n = MIN(io_size, size - offset);
+        // so no two pieces are the same
+        words[0] = offset + 1;
+        ret = toku_fs_pwrite(fd, buf, n, offset);
+        assert(ret == (int) n);
+    }
+    elapsed = current_time_usec() - start;
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+
+    return elapsed > 0 ? (double) size / elapsed / 1000 : 0;
+}
+
+/**
+ * Read the whole file in io size pieces and return how many
+ * GB per second came back.
+ */
+static double read_file(int fd, char * buf)
+{
+    int ret;
+    long start, elapsed;
+    size_t size = file_size_mb * 1024 * 1024;
+
+    start = current_time_usec();
+    for (size_t offset = 0; offset < size; offset += io_size) {
+        size_t n = MIN(io_size, size - offset);
+        ret = toku_fs_pread(fd, buf, n, offset);
+        assert(ret == (int) n);
+    }
+    elapsed = current_time_usec() - start;
+
+    return elapsed > 0 ? (double) size / elapsed / 1000 : 0;
+}
+
+int main(int argc, char * argv[])
+{
+    int ret, fd, threads;
+    char * counts, * tok, * saveptr, * buf;
+    double write, cold, warm;
+
+    if (parse_args(argc, argv) != 0 || help) {
+        usage();
+        return help ? 0 : 1;
+    }
+
+    remove_tree(TOKUFS_MOUNT);
+    buf = malloc(io_size);
+
+    echo("%zumb file, %zu byte reads and writes\n", file_size_mb, io_size);
+    echo("%8s %12s %12s %12s\n", "threads", "write GB/s", "cold GB/s",
+            "warm GB/s");
+    counts = strdup(thread_counts);
+    for (tok = strtok_r(counts, ",", &saveptr); tok != NULL;
+            tok = strtok_r(NULL, ",", &saveptr)) {
+        threads = atoi(tok);
+        if (threads <= 0) {
+            fprintf(stderr, "bad thread count %s\n", tok);
+            return 1;
+        }
+        tokufs_mount(threads);
+        write = write_file(buf);
+        ret = toku_fs_unmount();
+        assert(ret == 0);
+
+        if (drop_caches) {
+            drop_os_cache();
+        }
+        tokufs_mount(threads);
+        fd = toku_fs_open(BENCH_FILE, 0, 0);
+        assert(fd >= 0);
+        cold = read_file(fd, buf);
+        warm = read_file(fd, buf);
+        ret = toku_fs_close(fd);
+        assert(ret == 0);
+        ret = toku_fs_unmount();
+        assert(ret == 0);
+        echo("%8d %12.3f %12.3f %12.3f\n", threads, write, cold, warm);
+    }
+    free(counts);
+    free(buf);
+    remove_tree(TOKUFS_MOUNT);
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+/**
+ * TokuFS
+ *
+ * Compare how fast the library's work-stealing pool and the
+ * benchmark's threadpool get through many small tasks, at a range
+ * of thread counts.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include <sys/time.h>
+
+#include "../src/workpool.h"
+#include "threadpool.h"
+
+static int help;
+
+static char * thread_counts = "1,2,4,8,16,32,64";
+static long num_tasks = 1000000;
+static long batch_size = 1000;
+static long task_work = 0;
+static int num_submitters = 1;
+
+static struct option long_options[] =
+{
+    {"help", no_argument, &help, 1},
+    {"threads", required_argument, NULL, 't'},
+    {"tasks", required_argument, NULL, 'n'},
+    {"batch", required_argument, NULL, 'b'},
+    {"work", required_argument, NULL, 'w'},
+    {"submitters", required_argument, NULL, 's'},
+    {0, 0, 0, 0}
+};
+static char * opt_string = "ht:n:b:w:s:";
+
+static void usage(void)
+{
+    printf(
+    "usage:\n"
+    "    -h, --help\n"
+    "        print this help and quit.\n"
+    "    -t, --threads\n"
+    "        comma separated worker thread counts to try.\n"
+    "        default 1,2,4,8,16,32,64\n"
+    "    -n, --tasks\n"
+    "        tasks to run at each thread count. default 1000000\n"
+    "    -b, --batch\n"
+    "        tasks submitted before each wait. default 1000\n"
+    "    -w, --work\n"
+    "        loop iterations each task spins for. default 0\n"
+    "    -s, --submitters\n"
+    "        threads submitting at once. default 1. the threadpool\n"
+    "        only takes one, so it's left out of runs with more.\n"
+    );
+}
+
+static int parse_args(int argc, char * argv[])
+{
+    int i, c;
+    long n;
+
+    while ((c = getopt_long(argc, argv,
+                    opt_string, long_options, &i)) != -1) {
+        switch (c) {
+        case 0:
+            break;
+        case 'h':
+            help = 1;
+            break;
+        case 't':
+            thread_counts = strdup(optarg);
+            break;
+        case 'n':
+        case 'b':
+        case 's':
+            n = atol(optarg);
+            if (n <= 0) {
+                fprintf(stderr, "-%c must be > 0\n", c);
+                return 1;
+            }
+            if (c == 'n') {
+                num_tasks = n;
+            } else if (c == 'b') {
+                batch_size = n;
+            } else {
+                num_submitters = n;
+            }
+            break;
+        case 'w':
+            task_work = atol(optarg);
+            break;
+        case '?':
+        default:
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static long current_time_usec(void)
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_usec + t.tv_sec * 1000000;
+}
+
+static void task(void * arg)
+{
+    volatile long i;
+    (void) arg;
+
+    for (i = 0; i < task_work; i++);
+}
+
+struct submitter {
+    pthread_t thread;
+    struct workpool * workpool;
+    struct threadpool * threadpool;
+};
+
+static void * submit_work(void * arg)
+{
+    long i, tasks = num_tasks / num_submitters;
+    struct submitter * s = arg;
+    struct workpool_batch batch;
+
+    toku_workpool_batch_init(&batch);
+    for (i = 1; i <= tasks; i++) {
+        if (s->workpool != NULL) {
+            toku_workpool_submit(s->workpool, &batch, task, NULL);
+        } else {
+            toku_threadpool_dispatch(s->threadpool, task, NULL);
+        }
+        if (i % batch_size == 0 || i == tasks) {
+            if (s->workpool != NULL) {
+                toku_workpool_wait(s->workpool, &batch);
+            } else {
+                toku_threadpool_wait(s->threadpool);
+            }
+        }
+    }
+    toku_workpool_batch_destroy(&batch);
+
+    return NULL;
+}
+
+/**
+ * Run every task through one of the pools and return how many
+ * it got through each second.
+ */
+static double run(struct workpool * workpool, struct threadpool * threadpool)
+{
+    int i, ret;
+    long start, elapsed;
+    struct submitter * submitters;
+
+    submitters = calloc(num_submitters, sizeof(struct submitter));
+    start = current_time_usec();
+    for (i = 0; i < num_submitters; i++) {
+        submitters[i].workpool = workpool;
+        submitters[i].threadpool = threadpool;
+        ret = pthread_create(&submitters[i].thread, NULL,
+                submit_work, &submitters[i]);
+        assert(ret == 0);
+    }
+    for (i = 0; i < num_submitters; i++) {
+        ret = pthread_join(submitters[i].thread, NULL);
+        assert(ret == 0);
+    }
+    elapsed = current_time_usec() - start;
+    free(submitters);
+
+    return elapsed > 0 ?
+        (double) (num_tasks / num_submitters * num_submitters) *
+        1000000 / elapsed : 0;
+}
+
+int main(int argc, char * argv[])
+{
+    int threads;
+    char * counts, * tok, * saveptr;
+    double workpool_rate, threadpool_rate;
+    struct workpool * workpool;
+    struct threadpool threadpool;
+
+    if (parse_args(argc, argv) != 0 || help) {
+        usage();
+        return help ? 0 : 1;
+    }
+
+    printf("%d submitters, %ld tasks in batches of %ld, %ld work each\n",
+            num_submitters, num_tasks, batch_size, task_work);
+    printf("%8s %16s %16s %8s\n", "threads", "workpool/s",
+            "threadpool/s", "speedup");
+    counts = strdup(thread_counts);
+    for (tok = strtok_r(counts, ",", &saveptr); tok != NULL;
+            tok = strtok_r(NULL, ",", &saveptr)) {
+        threads = atoi(tok);
+        if (threads <= 0) {
+            fprintf(stderr, "bad thread count %s\n", tok);
+            return 1;
+        }
+        workpool = toku_workpool_create(threads);
+        workpool_rate = run(workpool, NULL);
+        toku_workpool_destroy(workpool);
+
+        threadpool_rate = 0;
+        if (num_submitters == 1) {
+            toku_threadpool_init(&threadpool, threads);
+            threadpool_rate = run(NULL, &threadpool);
+            toku_threadpool_destroy(&threadpool);
+        }
+
+        if (threadpool_rate > 0) {
+            printf("%8d %16.0f %16.0f %8.2f\n", threads, workpool_rate,
+                    threadpool_rate, workpool_rate / threadpool_rate);
+        } else {
+            printf("%8d %16.0f %16s %8s\n", threads, workpool_rate, "-", "-");
+        }
+        fflush(stdout);
+    }
+    free(counts);
+
+    return 0;
+}
@@ -31,3 +31,22 @@ for mnt in $mounts ; do
     done
 done
 
+
+# tokufs, reading every file back in directory order after writing
+# it, with the directory prefetch on and then off. the files are
+# small enough to be inline, so the prefetch reads their metadata.
+for prefetch in 64 0 ; do
+    echo "Running benchmarks on tokufs, dir_prefetch=$prefetch"
+    for num_threads in $thread_counts ; do
+        rm -rf bstore-env.mount
+        cmd="./benchmark-fs-threaded --files $num_files -d $dir_depth --iosize $iosize --operations $operations --threads $num_threads --dir /microfile-bucket --read-back -o dir_prefetch=$prefetch"
+        echo $cmd
+        (
+            $cmd
+        ) | tee -a tokufs-prefetch$prefetch-$num_threads.results
+        if [ $? != 0 ] ; then
+            echo "got error $?"
+            return $?
+        fi
+    done
+done
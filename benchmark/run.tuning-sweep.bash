@@ -0,0 +1,48 @@
+#!/bin/bash
+
+if [ ! -e benchmark-fs ] ; then
+    echo "make benchmark-fs first. cowardly not doing it here."
+    exit 1
+fi
+
+# benchmark parameters. the defaults write and read back one
+# 20 GB file sequentially, override them from the environment.
+record_size=${record_size:-"65536"}
+num_records=${num_records:-"327680"}
+cachesize_mb=${cachesize_mb:-"1024"}
+nodesizes=${nodesizes:-"1M 4M 16M 64M"}
+basementsizes=${basementsizes:-"64k 128k 512k 4M"}
+fanouts=${fanouts:-"16"}
+
+results="tuning-sweep.$(date +%s).results"
+mnt="dumpfile.mount"
+
+printf "%-10s %-10s %-8s %16s %16s\n" nodesize basement fanout \
+    "write MB/s" "read MB/s" | tee $results
+
+for nodesize in $nodesizes ; do
+    for basementsize in $basementsizes ; do
+        for fanout in $fanouts ; do
+            # node sizes only apply to new nodes, so each
+            # setting gets a fresh environment.
+            rm -rf $mnt
+            opts="data_nodesize=$nodesize,data_basementsize=$basementsize,data_fanout=$fanout"
+            cmd="./benchmark-fs --serial-write --serial-read -x $record_size -n $num_records -m $cachesize_mb -O $opts"
+            out=$($cmd)
+            if [ $? != 0 ] ; then
+                echo "got error running $cmd"
+                echo "$out"
+                continue
+            fi
+            echo "$cmd" >> $results.log
+            echo "$out" >> $results.log
+            # the serial write results are printed before serial read
+            tput=$(echo "$out" | grep "io throughput" | awk '{ print $4 }')
+            write_tput=$(echo "$tput" | sed -n 1p)
+            read_tput=$(echo "$tput" | sed -n 2p)
+            printf "%-10s %-10s %-8s %16s %16s\n" $nodesize $basementsize \
+                $fanout $write_tput $read_tput | tee -a $results
+        done
+    done
+done
+rm -rf $mnt
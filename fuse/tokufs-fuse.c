@@ -11,6 +11,11 @@
 #include <assert.h>
 #include <errno.h>
 #include <time.h>
+#include <limits.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/statvfs.h>
 
 static int gettid(void)
 {
@@ -23,10 +28,18 @@ static int gettid(void)
 #include <fuse/fuse.h>
 #include <tokufs.h>
 
-static size_t cachesize = 1L * 1024L * 1024 * 1024;
+// from --cache, in bytes, or 0 to leave it to the mount options
+static size_t cachesize;
 static char * env_path = "bstore-env.mount";
+static char * config_path;
 static int verbose;
 
+/**
+ * TokuFS mount options given on the command line, either with
+ * -o key=value or read from the config files.
+ */
+static struct toku_fs_mount_options mount_options;
+
 #define verbose_echo(...)                                   \
     do {                                                    \
         if (verbose) {                                      \
@@ -35,6 +48,203 @@ static int verbose;
         }                                                   \
     } while (0)
 
+/**
+ * Control files sit at the root of the mount but aren't listed
+ * in it. Reading one gives a snapshot of what it shows, taken
+ * when it's opened. Open handles to them get a pointer to a
+ * control_handle with CONTROL_FH set, instead of a tokufs fd.
+ *
+ * CONTROL_CACHESIZE shows the cache size in bytes. Writing a
+ * size to it, with an optional k, m or g suffix, resizes the
+ * cache.
+ *
+ * CONTROL_STATS shows the operation counters, in the format
+ * utils/tokufs-opstats reads. Writing anything to it starts
+ * them over.
+ *
+ * CONTROL_TRACE is a binary dump of the trace rings, for
+ * utils/tokufs-trace. It can't be written.
+ *
+ * CONTROL_ENGINE shows the engine status, for utils/tokufs-engstat.
+ * Its counters start over with CONTROL_STATS's.
+ */
+#define CONTROL_CACHESIZE "/.tokufs_cachesize"
+#define CONTROL_STATS "/.tokufs_stats"
+#define CONTROL_TRACE "/.tokufs_trace"
+#define CONTROL_ENGINE "/.tokufs_engine"
+#define CONTROL_FH (1ULL << 63)
+
+enum control_file {
+    CONTROL_NONE = 0,
+    CONTROL_CACHESIZE_FILE,
+    CONTROL_STATS_FILE,
+    CONTROL_TRACE_FILE,
+    CONTROL_ENGINE_FILE,
+};
+
+struct control_handle {
+    enum control_file file;
+    char * buf;
+    size_t len;
+};
+
+static enum control_file get_control(const char * path)
+{
+    if (strcmp(path, CONTROL_CACHESIZE) == 0) {
+        return CONTROL_CACHESIZE_FILE;
+    } else if (strcmp(path, CONTROL_STATS) == 0) {
+        return CONTROL_STATS_FILE;
+    } else if (strcmp(path, CONTROL_TRACE) == 0) {
+        return CONTROL_TRACE_FILE;
+    } else if (strcmp(path, CONTROL_ENGINE) == 0) {
+        return CONTROL_ENGINE_FILE;
+    }
+    return CONTROL_NONE;
+}
+
+static struct control_handle * get_control_handle(uint64_t fh)
+{
+    if ((fh & CONTROL_FH) == 0) {
+        return NULL;
+    }
+    return (struct control_handle *) (uintptr_t) (fh & ~CONTROL_FH);
+}
+
+/**
+ * Get what the control file shows now into a new buffer.
+ */
+static int control_contents(enum control_file file, char ** buf,
+        size_t * len)
+{
+    int ret = 0;
+    FILE * f;
+
+    f = open_memstream(buf, len);
+    if (f == NULL) {
+        return -ENOMEM;
+    }
+    if (file == CONTROL_CACHESIZE_FILE) {
+        fprintf(f, "%lu\n", toku_fs_get_cachesize());
+    } else if (file == CONTROL_TRACE_FILE) {
+        ret = toku_fs_trace_dump(f);
+    } else if (file == CONTROL_ENGINE_FILE) {
+        ret = toku_fs_dump_engine_status(f);
+    } else {
+        ret = toku_fs_dump_stats(f);
+    }
+    fclose(f);
+
+    return ret;
+}
+
+static int control_getattr(enum control_file file, struct stat * st)
+{
+    int ret;
+    char * buf;
+    size_t len;
+
+    ret = control_contents(file, &buf, &len);
+    if (ret != 0) {
+        return ret;
+    }
+    free(buf);
+    memset(st, 0, sizeof(struct stat));
+    st->st_mode = S_IFREG | 0644;
+    st->st_nlink = 1;
+    st->st_uid = getuid();
+    st->st_gid = getgid();
+    st->st_size = len;
+
+    return 0;
+}
+
+static int control_open(enum control_file file,
+        struct fuse_file_info * info)
+{
+    int ret;
+    struct control_handle * handle;
+
+    handle = malloc(sizeof(struct control_handle));
+    handle->file = file;
+    ret = control_contents(file, &handle->buf, &handle->len);
+    if (ret != 0) {
+        free(handle);
+        return ret;
+    }
+    info->fh = CONTROL_FH | (uintptr_t) handle;
+    // the size from getattr may be stale by the time it's read
+    info->direct_io = 1;
+
+    return 0;
+}
+
+static void control_release(struct control_handle * handle)
+{
+    free(handle->buf);
+    free(handle);
+}
+
+static int control_read(struct control_handle * handle,
+        char * buf, size_t size, off_t offset)
+{
+    if ((size_t) offset >= handle->len) {
+        return 0;
+    }
+    if (size > handle->len - offset) {
+        size = handle->len - offset;
+    }
+    memcpy(buf, handle->buf + offset, size);
+
+    return size;
+}
+
+/**
+ * Parse a size the way the cachesize mount option does, then
+ * resize to it. The whole size has to come in one write.
+ */
+static int control_write_cachesize(const char * buf, size_t size,
+        off_t offset)
+{
+    int ret;
+    char opt[64];
+    struct toku_fs_mount_options opts;
+
+    if (offset != 0 || size + sizeof("cachesize=") > sizeof(opt)) {
+        return -EINVAL;
+    }
+    strcpy(opt, "cachesize=");
+    memcpy(opt + strlen(opt), buf, size);
+    opt[strlen("cachesize=") + size] = '\0';
+    // echo leaves a newline on the end
+    opt[strcspn(opt, "\n")] = '\0';
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_options_parse(&opts, opt);
+    if (ret != 0) {
+        return ret;
+    }
+    verbose_echo("resizing the cache to %lu\n", opts.cachesize);
+    ret = toku_fs_set_cachesize(opts.cachesize);
+
+    return ret == 0 ? (int) size : ret;
+}
+
+static int control_write(struct control_handle * handle,
+        const char * buf, size_t size, off_t offset)
+{
+    int ret;
+
+    if (handle->file == CONTROL_CACHESIZE_FILE) {
+        return control_write_cachesize(buf, size, offset);
+    } else if (handle->file == CONTROL_TRACE_FILE ||
+            handle->file == CONTROL_ENGINE_FILE) {
+        return -EACCES;
+    }
+    verbose_echo("resetting the stats\n");
+    ret = toku_fs_reset_stats();
+
+    return ret == 0 ? (int) size : ret;
+}
+
 static int tokufs_fuse_utimens(const char * path, 
         const struct timespec tv[2])
 {
@@ -55,6 +265,9 @@ static int tokufs_fuse_getattr(const char * path, struct stat * st)
     int ret;
 
     verbose_echo("called with path %s\n", path);
+    if (get_control(path) != CONTROL_NONE) {
+        return control_getattr(get_control(path), st);
+    }
     ret = toku_fs_stat(path, st);
 
     return ret;
@@ -148,11 +361,20 @@ static int tokufs_fuse_open(const char * path,
     int fd;
 
     verbose_echo("called with path %s\n", path);
+    if (get_control(path) != CONTROL_NONE) {
+        return control_open(get_control(path), info);
+    }
 
     fd = toku_fs_open(path, info->flags, 0);
     if (fd >= 0) {
         verbose_echo("fd %d\n", fd);
         info->fh = fd;
+#ifdef O_DIRECT
+        // fuse never passes on fadvise, but O_DIRECT says as much
+        if (info->flags & O_DIRECT) {
+            toku_fs_fadvise(fd, 0, 0, TOKU_FS_ADVICE_DONTNEED);
+        }
+#endif
     }
 
     verbose_echo("returning fd %d\n", fd);
@@ -167,6 +389,10 @@ static int tokufs_fuse_release(const char * path,
 
     verbose_echo("called with path %s, info->fh = %lu\n", 
             path, info->fh);
+    if (get_control_handle(info->fh) != NULL) {
+        control_release(get_control_handle(info->fh));
+        return 0;
+    }
 
     ret = toku_fs_close(info->fh);
 
@@ -180,6 +406,10 @@ static int tokufs_fuse_pread(const char * path, char * buf,
 
     verbose_echo("called with path %s, fd %lu, size %lu, offset %ld\n",
             path, info->fh, size, offset);
+    if (get_control_handle(info->fh) != NULL) {
+        return control_read(get_control_handle(info->fh),
+                buf, size, offset);
+    }
 
     ret = toku_fs_pread(info->fh, buf, size, offset);
     verbose_echo("read %d bytes\n", ret);
@@ -194,6 +424,10 @@ static int tokufs_fuse_pwrite(const char * path, const char * buf,
 
     verbose_echo("called with path %s, fd %lu, size %lu, offset %ld\n",
             path, info->fh, size, offset);
+    if (get_control_handle(info->fh) != NULL) {
+        return control_write(get_control_handle(info->fh),
+                buf, size, offset);
+    }
     ret = toku_fs_pwrite(info->fh, buf, size, offset);
     verbose_echo("wrote %d bytes\n", ret);
 
@@ -205,6 +439,10 @@ static int tokufs_fuse_truncate(const char * path, off_t offset)
     int ret;
 
     verbose_echo("called with path %s, offset %ld\n", path, offset);
+    // opening it for writing with O_TRUNC comes here first
+    if (get_control(path) != CONTROL_NONE) {
+        return 0;
+    }
     ret = toku_fs_truncate(path, offset);
 
     return ret;
@@ -303,6 +541,242 @@ static int tokufs_fuse_readlink(const char * path, char * buf, size_t size)
     return ret;
 }
 
+/**
+ * Report space in blocks. Used space is what the dictionaries
+ * take on disk after compression, and free space is whatever
+ * is left on the file system under the mount.
+ */
+static int tokufs_fuse_statfs(const char * path, struct statvfs * vfs)
+{
+    int ret;
+    struct toku_fs_statfs st;
+    unsigned long bsize = toku_fs_get_blocksize();
+
+    verbose_echo("called with path %s\n", path);
+    ret = toku_fs_statfs(&st);
+    if (ret != 0) {
+        return ret;
+    }
+
+    memset(vfs, 0, sizeof(struct statvfs));
+    vfs->f_bsize = bsize;
+    vfs->f_frsize = bsize;
+    vfs->f_bfree = st.free_bytes / bsize;
+    vfs->f_bavail = vfs->f_bfree;
+    vfs->f_blocks = (st.disk_bytes + bsize - 1) / bsize + vfs->f_bfree;
+    vfs->f_ffree = st.free_files;
+    vfs->f_favail = st.free_files;
+    vfs->f_files = st.files + st.free_files;
+    vfs->f_namemax = NAME_MAX;
+
+    return 0;
+}
+
+/**
+ * Directory usage is exposed as read only extended attributes
+ * on directories, so "getfattr -d" on a directory is an O(1) du.
+ */
+#define XATTR_DU_BYTES "user.tokufs.du_bytes"
+#define XATTR_DU_FILES "user.tokufs.du_files"
+
+/**
+ * Copy an xattr value out, or just its size if size is 0.
+ */
+static int copy_xattr(const char * value, char * buf, size_t size)
+{
+    size_t len = strlen(value);
+
+    if (size == 0) {
+        return len;
+    }
+    if (size < len) {
+        return -ERANGE;
+    }
+    memcpy(buf, value, len);
+
+    return len;
+}
+
+static int tokufs_fuse_getxattr(const char * path, const char * name,
+        char * buf, size_t size)
+{
+    int ret;
+    char value[32];
+    struct toku_fs_dir_usage usage;
+
+    verbose_echo("called with path %s, name %s\n", path, name);
+    ret = toku_fs_dir_usage(path, &usage);
+    if (ret == -ENOTDIR) {
+        return -ENODATA;
+    } else if (ret != 0) {
+        return ret;
+    }
+
+    if (strcmp(name, XATTR_DU_BYTES) == 0) {
+        snprintf(value, sizeof(value), "%lu", usage.bytes);
+    } else if (strcmp(name, XATTR_DU_FILES) == 0) {
+        snprintf(value, sizeof(value), "%lu", usage.files);
+    } else {
+        return -ENODATA;
+    }
+
+    return copy_xattr(value, buf, size);
+}
+
+static int tokufs_fuse_listxattr(const char * path, char * buf, size_t size)
+{
+    int ret;
+    struct toku_fs_dir_usage usage;
+    // names are separated by null bytes
+    static const char names[] = XATTR_DU_BYTES "\0" XATTR_DU_FILES;
+
+    verbose_echo("called with path %s\n", path);
+    ret = toku_fs_dir_usage(path, &usage);
+    if (ret == -ENOTDIR) {
+        return 0;
+    } else if (ret != 0) {
+        return ret;
+    }
+    if (size == 0) {
+        return sizeof(names);
+    }
+    if (size < sizeof(names)) {
+        return -ERANGE;
+    }
+    memcpy(buf, names, sizeof(names));
+
+    return sizeof(names);
+}
+
+/**
+ * SIGHUP reads the config files again and applies what can be
+ * changed while mounted, which is the cache size. The handler
+ * only wakes the reload thread, which does the work.
+ */
+static sem_t reload_sem;
+static pthread_t reload_thread;
+static volatile int reload_stopping;
+
+static void reload_handler(int sig)
+{
+    (void) sig;
+    sem_post(&reload_sem);
+}
+
+static int load_config_file(struct toku_fs_mount_options * opts,
+        const char * path)
+{
+    int ret, line;
+
+    ret = toku_fs_mount_options_load(opts, path, &line);
+    if (ret != 0 && line > 0) {
+        fprintf(stderr, "%s:%d: bad option\n", path, line);
+    } else if (ret != 0) {
+        fprintf(stderr, "Failed to read %s, ret %d\n", path, ret);
+    }
+
+    return ret;
+}
+
+/**
+ * Read the environment's own config file, like toku_fs_mount()
+ * does, if there is one. Then the --config file, so its options
+ * override the environment's.
+ */
+static int load_config(struct toku_fs_mount_options * opts)
+{
+    int ret;
+    char * env_config;
+
+    env_config = malloc(strlen(env_path) + strlen(TOKU_FS_CONFIG_FILE) + 2);
+    sprintf(env_config, "%s/%s", env_path, TOKU_FS_CONFIG_FILE);
+    if (access(env_config, F_OK) == 0) {
+        ret = load_config_file(opts, env_config);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    ret = 0;
+    if (config_path != NULL) {
+        ret = load_config_file(opts, config_path);
+    }
+
+out:
+    free(env_config);
+    return ret;
+}
+
+static void reload_config(void)
+{
+    int ret;
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    ret = load_config(&opts);
+    if (ret != 0) {
+        return;
+    }
+    if (opts.cachesize > 0 && opts.cachesize != toku_fs_get_cachesize()) {
+        printf("Resizing the cache to %lu\n", opts.cachesize);
+        ret = toku_fs_set_cachesize(opts.cachesize);
+        if (ret != 0) {
+            fprintf(stderr, "Failed to resize the cache, ret %d\n", ret);
+        }
+    }
+}
+
+static void * reload_thread_fn(void * arg)
+{
+    (void) arg;
+
+    while (1) {
+        while (sem_wait(&reload_sem) != 0 && errno == EINTR);
+        if (reload_stopping) {
+            break;
+        }
+        reload_config();
+    }
+
+    return NULL;
+}
+
+/**
+ * Fuse sets its own signal handlers before it gets here, and
+ * one of them unmounts on SIGHUP, so ours goes in now.
+ */
+static void * tokufs_fuse_init(struct fuse_conn_info * conn)
+{
+    int ret;
+    struct sigaction sa;
+
+    (void) conn;
+    ret = sem_init(&reload_sem, 0, 0);
+    assert(ret == 0);
+    ret = pthread_create(&reload_thread, NULL, reload_thread_fn, NULL);
+    assert(ret == 0);
+    memset(&sa, 0, sizeof(struct sigaction));
+    sa.sa_handler = reload_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    ret = sigaction(SIGHUP, &sa, NULL);
+    assert(ret == 0);
+
+    return NULL;
+}
+
+static void tokufs_fuse_destroy(void * data)
+{
+    int ret;
+
+    (void) data;
+    signal(SIGHUP, SIG_IGN);
+    reload_stopping = 1;
+    sem_post(&reload_sem);
+    ret = pthread_join(reload_thread, NULL);
+    assert(ret == 0);
+    sem_destroy(&reload_sem);
+}
+
 static struct fuse_operations tokufs_fuse_ops =
 {   
     .utimens = tokufs_fuse_utimens,             /* tokufs_utime */
@@ -323,8 +797,60 @@ static struct fuse_operations tokufs_fuse_ops =
     .access = tokufs_fuse_access,               /* tokufs_access */
     .symlink = tokufs_fuse_symlink,             /* tokufs_symlink */
     .readlink = tokufs_fuse_readlink,           /* tokufs_symlink */
+    .statfs = tokufs_fuse_statfs,               /* tokufs_statfs */
+    .getxattr = tokufs_fuse_getxattr,           /* tokufs_dir_usage */
+    .listxattr = tokufs_fuse_listxattr,         /* tokufs_dir_usage */
+    .init = tokufs_fuse_init,                   /* sighup reload */
+    .destroy = tokufs_fuse_destroy,             /* sighup reload */
 };
 
+/**
+ * Take the tokufs options out of a comma separated -o option
+ * string and leave the rest, which belong to fuse, in the same
+ * buffer. Returns 0 on success, -EINVAL if a tokufs option has
+ * a bad value.
+ */
+static int filter_mount_options(char * optstr)
+{
+    int ret;
+    char * opt, * saveptr, * equals;
+    char * rest = calloc(1, strlen(optstr) + 1);
+
+    ret = 0;
+    for (opt = strtok_r(optstr, ",", &saveptr); opt != NULL;
+            opt = strtok_r(NULL, ",", &saveptr)) {
+        ret = toku_fs_mount_options_parse(&mount_options, opt);
+        if (ret == 0) {
+            verbose_echo("tokufs option %s\n", opt);
+            continue;
+        }
+        // it looked like ours, but the value was bad
+        equals = strchr(opt, '=');
+        if (equals != NULL && (strncmp(opt, "data_", 5) == 0 ||
+                    strncmp(opt, "meta_", 5) == 0 ||
+                    strncmp(opt, "cachesize=", 10) == 0 ||
+                    strncmp(opt, "reclaim_rate=", 13) == 0 ||
+                    strncmp(opt, "fadvise=", 8) == 0 ||
+                    strncmp(opt, "workers=", 8) == 0 ||
+                    strncmp(opt, "parallel_", 9) == 0 ||
+                    strncmp(opt, "dir_prefetch=", 13) == 0 ||
+                    strncmp(opt, "optimize_", 9) == 0)) {
+            printf("invalid tokufs option %s\n", opt);
+            goto out;
+        }
+        ret = 0;
+        if (*rest != '\0') {
+            strcat(rest, ",");
+        }
+        strcat(rest, opt);
+    }
+    strcpy(optstr, rest);
+
+out:
+    free(rest);
+    return ret;
+}
+
 static void usage(void)
 {
     printf(
@@ -334,8 +860,55 @@ static void usage(void)
     "    --env\n"
     "        local direcory where tokufs can find an environment, \n"
     "        or create one if it does not exist\n"
-    "    --cachesize\n"
+    "    --cache\n"
     "        cache size in mb\n"
+    "    --config\n"
+    "        read tokufs mount options from the given file, over\n"
+    "        those in the environment's own " TOKU_FS_CONFIG_FILE ". on\n"
+    "        SIGHUP both are read again and a new cachesize applied.\n"
+    "    -o data_nodesize=N,data_basementsize=N,data_fanout=N\n"
+    "    -o meta_nodesize=N,meta_basementsize=N,meta_fanout=N\n"
+    "    -o data_compression=M,meta_compression=M\n"
+    "        tune the data or meta dictionary. sizes take an\n"
+    "        optional k, m or g suffix. compression is one of\n"
+    "        none, quicklz, zlib, lzma, fast, small. other -o\n"
+    "        options are passed through to fuse.\n"
+    "    -o meta_cachesize=N\n"
+    "        keep N bytes of the cache for metadata alone, so\n"
+    "        streaming reads and writes can't evict it.\n"
+    "    -o reclaim_rate=N\n"
+    "        give back the blocks of removed files at most N\n"
+    "        bytes per second, in the background.\n"
+    "    -o optimize_backlog=N,optimize_idle=S,optimize_rate=N\n"
+    "        flush buffered messages in the background once N\n"
+    "        were sent to a dictionary, or after S idle seconds,\n"
+    "        keeping disk io under optimize_rate bytes per second.\n"
+    "    -o workers=N,parallel_read=N,parallel_write=N\n"
+    "        keep N threads for work that's split up, one per cpu\n"
+    "        by default. reads of at least parallel_read bytes and\n"
+    "        writes of at least parallel_write, 1m by default, are\n"
+    "        split across them.\n"
+    "    -o dir_prefetch=N\n"
+    "        once files of a directory are opened in name order,\n"
+    "        read the next N of them into the cache ahead of the\n"
+    "        opens, 64 by default. 0 turns it off.\n"
+    "    -o fadvise=A\n"
+    "        open every file with the given access advice, one of\n"
+    "        normal, sequential, random or dontneed. files opened\n"
+    "        with O_DIRECT get dontneed.\n"
+    "    " CONTROL_CACHESIZE "\n"
+    "        a file at the root of the mount. read it for the\n"
+    "        cache size in bytes, write a size to resize the cache.\n"
+    "    " CONTROL_STATS "\n"
+    "        a file at the root of the mount with the operation\n"
+    "        counters, for utils/tokufs-opstats. write to it to\n"
+    "        start them over.\n"
+    "    " CONTROL_TRACE "\n"
+    "        a file at the root of the mount with what every\n"
+    "        thread traced lately, for utils/tokufs-trace.\n"
+    "    " CONTROL_ENGINE "\n"
+    "        a file at the root of the mount with the storage\n"
+    "        engine's status, for utils/tokufs-engstat.\n"
     );
 }
 
@@ -343,6 +916,7 @@ int main(int argc, char * argv[])
 {
     int ret;
 
+    toku_fs_mount_options_init(&mount_options);
     for (int i = 0; i < argc; i++) {
         if (strcmp(argv[i], "--verbose") == 0) {
             verbose = 1;
@@ -365,7 +939,17 @@ int main(int argc, char * argv[])
                 printf("invalid argument\n");
                 return -1;
             } else {
-                cachesize = atol(argv[i + 1]);
+                cachesize = atol(argv[i + 1]) * 1024L * 1024;
+            }
+            argv[i] = NULL;
+            argv[i + 1] = NULL;
+            i++;
+        } else if (strcmp(argv[i], "--config") == 0) {
+            if (i + 1 == argc) {
+                printf("invalid argument\n");
+                return -1;
+            } else {
+                config_path = argv[i + 1];
             }
             argv[i] = NULL;
             argv[i + 1] = NULL;
@@ -373,8 +957,42 @@ int main(int argc, char * argv[])
         }
     }
 
+    // the config files come first so -o options override them
+    ret = load_config(&mount_options);
+    if (ret != 0) {
+        return ret;
+    }
+    for (int i = 0; i < argc; i++) {
+        int first = i;
+        char * optstr;
+        if (argv[i] == NULL || strncmp(argv[i], "-o", 2) != 0) {
+            continue;
+        }
+        if (argv[i][2] != '\0') {
+            optstr = argv[i] + 2;
+        } else if (i + 1 < argc && argv[i + 1] != NULL) {
+            optstr = argv[++i];
+        } else {
+            continue;
+        }
+        ret = filter_mount_options(optstr);
+        if (ret != 0) {
+            return ret;
+        }
+        // nothing left for fuse, so drop the -o entirely
+        if (*optstr == '\0') {
+            for (int j = first; j <= i; j++) {
+                argv[j] = NULL;
+            }
+        }
+    }
+
+    if (cachesize > 0) {
+        mount_options.cachesize = cachesize;
+    }
+
     printf("Opening environment %s\n", env_path);
-    ret = toku_fs_mount(env_path);
+    ret = toku_fs_mount_with_options(env_path, &mount_options);
     if (ret != 0) {
         fprintf(stderr, "Failed to mount TokuFS, ret %d\n", ret);
         return ret;
@@ -15,9 +15,6 @@
 
 #include "cc.h"
 
-// globally defined in one place, typically tokufs.c
-extern int toku_debug;
-
 UNUSED
 static int toku_gettid(void)
 {
@@ -34,12 +31,4 @@ static long toku_current_time_usec(void)
     return t.tv_sec * 1000000L + t.tv_usec;
 }
 
-#define debug_echo(...)                                             \
-    do {                                                            \
-        if (toku_debug) {                                           \
-            printf("[%d] %s(): ", toku_gettid(), __FUNCTION__);     \
-            printf(__VA_ARGS__);                                    \
-        }                                                           \
-    } while (0)
-
 #endif /* TOKU_DEBUG_H */
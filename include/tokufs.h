@@ -10,6 +10,8 @@
 #include <utime.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
 /* TokuFS functions return 0 on success and -ERRNO on error. */
 #include <errno.h>
 
@@ -26,6 +28,140 @@ int toku_fs_mount(const char * path);
 
 int toku_fs_unmount(void);
 
+/**
+ * Compression methods the engine can use for a dictionary's nodes.
+ */
+enum toku_fs_compression_method
+{
+    TOKU_FS_COMPRESSION_DEFAULT = 0,
+    TOKU_FS_COMPRESSION_NONE,
+    TOKU_FS_COMPRESSION_QUICKLZ,
+    TOKU_FS_COMPRESSION_ZLIB,
+    TOKU_FS_COMPRESSION_LZMA,
+    TOKU_FS_COMPRESSION_FAST,
+    TOKU_FS_COMPRESSION_SMALL
+};
+
+/**
+ * Engine tuning knobs for one dictionary. A zero field means
+ * use the engine default for a new dictionary, and leave the
+ * stored value alone for an existing one.
+ */
+struct toku_fs_dict_options
+{
+    size_t nodesize;
+    size_t basementsize;
+    unsigned int fanout;
+    enum toku_fs_compression_method compression;
+};
+
+/**
+ * Access pattern advice, like posix_fadvise(2).
+ *
+ * NORMAL     - reads prefetch the blocks they cover.
+ * SEQUENTIAL - reads also prefetch well past their end.
+ * RANDOM     - reads prefetch nothing.
+ * WILLNEED   - warm the range into the cache in the background.
+ * DONTNEED   - stop warming the file and prefetch nothing, so
+ *              streaming data pulls as little as it can into
+ *              the cache. Blocks already cached stay there.
+ */
+enum toku_fs_advice
+{
+    TOKU_FS_ADVICE_NORMAL = 0,
+    TOKU_FS_ADVICE_SEQUENTIAL,
+    TOKU_FS_ADVICE_RANDOM,
+    TOKU_FS_ADVICE_WILLNEED,
+    TOKU_FS_ADVICE_DONTNEED
+};
+
+/**
+ * Everything that can be tuned at mount time. Data blocks and
+ * metadata live in separate dictionaries and are tuned separately.
+ * reclaim_rate caps how many bytes per second the background
+ * reclaim of removed files gives back. 0 means no cap. advice
+ * is the access pattern every file is opened with.
+ * meta_cachesize is the part of cachesize kept for metadata
+ * alone, so streaming data can't evict it. 0 means metadata
+ * shares the whole cache with data.
+ *
+ * A background thread flushes the messages buffered in the
+ * dictionaries once optimize_backlog of them were sent to one,
+ * or once nothing was sent for optimize_idle seconds, keeping
+ * disk io under optimize_rate bytes per second while it works.
+ * That counts what it reads and everything the engine flushes,
+ * the nodes it dirtied among them.
+ * It only runs if optimize_backlog or optimize_idle is set.
+ *
+ * workers is how many threads the library keeps for work it
+ * splits up. 0 means one per online cpu. Reads of at least
+ * parallel_read bytes are split into pieces that the workers
+ * read at once, each with its own cursor, and writes of at least
+ * parallel_write bytes into pieces whose blocks the workers put
+ * at once. 0 never splits them.
+ *
+ * Once a few files of a directory were opened in name order,
+ * the workers read the next dir_prefetch of them into the cache
+ * ahead of the opens. 0 turns that off, and so does an advice
+ * of random or dontneed.
+ */
+struct toku_fs_mount_options
+{
+    size_t cachesize;
+    size_t meta_cachesize;
+    size_t reclaim_rate;
+    size_t optimize_backlog;
+    size_t optimize_idle;
+    size_t optimize_rate;
+    size_t workers;
+    size_t parallel_read;
+    size_t parallel_write;
+    size_t dir_prefetch;
+    enum toku_fs_advice advice;
+    struct toku_fs_dict_options data;
+    struct toku_fs_dict_options meta;
+};
+
+/**
+ * Name of the config file toku_fs_mount() reads from the root of
+ * the mount path, if it exists. One key = value pair per line,
+ * using the same keys as toku_fs_mount_options_parse().
+ */
+#define TOKU_FS_CONFIG_FILE "tokufs.conf"
+
+/**
+ * Initialize mount options to the defaults.
+ */
+void toku_fs_mount_options_init(struct toku_fs_mount_options * opts);
+
+/**
+ * Parse a comma separated list of key=value pairs into opts.
+ * Sizes take an optional k, m or g suffix. Recognized keys are
+ * cachesize, meta_cachesize, reclaim_rate, fadvise, workers,
+ * parallel_{read,write}, dir_prefetch, optimize_{backlog,idle,rate}
+ * and {data,meta}_{nodesize,basementsize,fanout,compression}.
+ * Compression is one of none, quicklz, zlib, lzma, fast, small
+ * or default. fadvise is one of normal, sequential, random or
+ * dontneed. Returns -EINVAL on an unknown key or a bad value.
+ */
+int toku_fs_mount_options_parse(struct toku_fs_mount_options * opts,
+        const char * str);
+
+/**
+ * Read a config file of key = value lines into opts. Blank lines
+ * and lines starting with # are ignored. If a line has a bad
+ * option, -EINVAL is returned and, if bad_line isn't NULL, its
+ * line number is put there. It's set to 0 otherwise.
+ */
+int toku_fs_mount_options_load(struct toku_fs_mount_options * opts,
+        const char * filename, int * bad_line);
+
+/**
+ * Mount toku_fs at the given path using the given options.
+ */
+int toku_fs_mount_with_options(const char * path,
+        const struct toku_fs_mount_options * opts);
+
 //
 // File data operations
 //
@@ -40,20 +176,63 @@ ssize_t toku_fs_pread(int fd, void * buf,
 ssize_t toku_fs_pwrite(int fd, const void * buf,
         size_t count, off_t offset);
 
+/**
+ * Create a file, or replace an existing one's contents, with the
+ * count bytes in buf, without opening it. A new file gets mode.
+ * Cheaper than open, pwrite and close for small files.
+ */
+int toku_fs_put_file(const char * path, const void * buf,
+        size_t count, mode_t mode);
+
+/**
+ * Read up to count bytes from the front of a file into buf,
+ * without opening it. Returns the number of bytes read.
+ */
+ssize_t toku_fs_get_file(const char * path, void * buf, size_t count);
+
 //
 // Metadata operations
 //
 
 int toku_fs_stat(const char * path, struct stat * st);
 
+/**
+ * Batched versions of stat, open with O_CREAT and unlink, for
+ * many files at once, usually siblings. The paths are handled
+ * in key order with one pass over the metadata, and the result
+ * for paths[i] goes in rets[i]:
+ *
+ * stat_many   - 0 and the stat in sts[i], or -ENOENT.
+ * create_many - 0 if created, -EEXIST if it was already there.
+ * unlink_many - 0 if unlinked, -ENOENT, or -EISDIR.
+ */
+int toku_fs_stat_many(const char ** paths, int n,
+        struct stat * sts, int * rets);
+
+int toku_fs_create_many(const char ** paths, int n, mode_t mode, int * rets);
+
+int toku_fs_unlink_many(const char ** paths, int n, int * rets);
+
 int toku_fs_truncate(const char * path, off_t length);
 
 int toku_fs_symlink(const char * oldpath, const char * newpath);
 
+/**
+ * Unlink a file. Its metadata is gone when this returns, and
+ * its data blocks are queued to be given back in the background,
+ * so the cost doesn't depend on the size of the file. Returns
+ * -EISDIR for a directory, see rmdir and remove_tree.
+ */
 int toku_fs_unlink(const char * path);
 
 int toku_fs_readlink(const char * path, char * buf, size_t size);
 
+/**
+ * Rename oldpath to newpath, replacing whatever file is there.
+ * A directory only replaces an empty directory. Returns -EISDIR
+ * for a file onto a directory and -ENOTEMPTY for a directory
+ * onto one that isn't empty.
+ */
 int toku_fs_rename(const char * oldpath, const char * newpath);
 
 int toku_fs_utime(const char * path, const struct utimbuf * buf);
@@ -98,6 +277,18 @@ int toku_fs_mkdir(const char * path, mode_t mode);
 
 int toku_fs_rmdir(const char * path);
 
+/**
+ * Remove a directory and everything under it, like rm -rf.
+ * Everything is gone from the namespace when this returns,
+ * but the data blocks are given back in the background,
+ * the same way they are for toku_fs_unlink. If something
+ * is created in the directory while it's being removed,
+ * the directory is left with just that, and -ENOTEMPTY is
+ * returned. Something created further down, in a subdirectory
+ * already removed, or renamed in, is left without a parent.
+ */
+int toku_fs_remove_tree(const char * path);
+
 int toku_fs_opendir(const char * path, struct toku_dircursor * cursor);
 
 int toku_fs_closedir(struct toku_dircursor * cursor);
@@ -106,14 +297,485 @@ int toku_fs_readdir(struct toku_dircursor * cursor,
         struct toku_dirent * buf, int num_entries,
         int * entries_read);
 
+/**
+ * Recursive usage of a directory: the total size in bytes of
+ * everything under it, and how many entries (files, symlinks
+ * and directories) are under it, not counting itself.
+ */
+struct toku_fs_dir_usage
+{
+    uint64_t bytes;
+    uint64_t files;
+};
+
+int toku_fs_dir_usage(const char * path, struct toku_fs_dir_usage * usage);
+
+/**
+ * Filters applied while a walk scans, so entries that don't
+ * match are never handed back. Zeroed fields match everything.
+ *
+ * name                 - fnmatch(3) pattern for the last path component.
+ * type                 - S_IFREG, S_IFDIR, S_IFLNK, or 0 for any type.
+ * min_size, max_size   - inclusive size range. max_size 0 is unbounded.
+ * min_mtime, max_mtime - inclusive mtime range. max_mtime 0 is unbounded.
+ * min_depth, max_depth - levels below the root to report. The root is
+ *                        depth 0. max_depth 0 is unbounded.
+ */
+struct toku_fs_walk_filter
+{
+    const char * name;
+    mode_t type;
+    off_t min_size;
+    off_t max_size;
+    time_t min_mtime;
+    time_t max_mtime;
+    int min_depth;
+    int max_depth;
+};
+
+/**
+ * Called once for each matching entry. Return 0 to keep walking,
+ * anything else stops the walk and is returned by toku_fs_walk.
+ */
+typedef int (*toku_fs_walk_fn)(const char * path,
+        const struct stat * st, void * extra);
+
+int toku_fs_walk(const char * root, const struct toku_fs_walk_filter * filter,
+        toku_fs_walk_fn fn, void * extra);
+
 //
 // Hints and parameters
 //
 
 size_t toku_fs_get_blocksize(void);
 
+/**
+ * Advise tokufs how an open file is going to be read. NORMAL,
+ * SEQUENTIAL, RANDOM and DONTNEED apply to the whole file from
+ * then on. WILLNEED applies to len bytes at offset, or up to the
+ * end of the file if len is 0, and returns right away.
+ */
+int toku_fs_fadvise(int fd, off_t offset, off_t len,
+        enum toku_fs_advice advice);
+
+/**
+ * Get or set the cache size in bytes. Setting it while mounted
+ * waits for the operations in progress, writes back and drops
+ * everything cached, and starts over with a cache of the new
+ * size. Returns -EINVAL if it's 0, or if mounted and it isn't
+ * more than the meta_cachesize share.
+ */
 size_t toku_fs_get_cachesize(void);
 
 int toku_fs_set_cachesize(size_t cachesize);
 
+//
+// Statistics
+//
+
+/**
+ * Operations counted in toku_fs_stats. The first group are the
+ * file system calls, the rest are the calls they make into the
+ * block store, which map to one or more engine calls each.
+ */
+enum toku_fs_op {
+    TOKU_FS_OP_OPEN = 0,
+    TOKU_FS_OP_CLOSE,
+    TOKU_FS_OP_PREAD,
+    TOKU_FS_OP_PWRITE,
+    TOKU_FS_OP_PUT_FILE,
+    TOKU_FS_OP_GET_FILE,
+    TOKU_FS_OP_STAT,
+    TOKU_FS_OP_STAT_MANY,
+    TOKU_FS_OP_TRUNCATE,
+    TOKU_FS_OP_SYMLINK,
+    TOKU_FS_OP_UNLINK,
+    TOKU_FS_OP_CREATE_MANY,
+    TOKU_FS_OP_UNLINK_MANY,
+    TOKU_FS_OP_READLINK,
+    TOKU_FS_OP_RENAME,
+    TOKU_FS_OP_UTIME,
+    TOKU_FS_OP_CHMOD,
+    TOKU_FS_OP_CHOWN,
+    TOKU_FS_OP_MKDIR,
+    TOKU_FS_OP_RMDIR,
+    TOKU_FS_OP_OPENDIR,
+    TOKU_FS_OP_READDIR,
+    TOKU_FS_OP_DIR_USAGE,
+    TOKU_FS_OP_WALK,
+    TOKU_FS_OP_REMOVE_TREE,
+    TOKU_FS_OP_FADVISE,
+    TOKU_FS_OP_STATFS,
+    TOKU_FS_OP_BSTORE_GET,
+    TOKU_FS_OP_BSTORE_PUT,
+    TOKU_FS_OP_BSTORE_PUT_BLOCKS,
+    TOKU_FS_OP_BSTORE_DELETE,
+    TOKU_FS_OP_BSTORE_UPDATE,
+    TOKU_FS_OP_BSTORE_TRUNCATE,
+    TOKU_FS_OP_BSTORE_SCAN,
+    TOKU_FS_OP_BSTORE_SCAN_NAMES,
+    TOKU_FS_OP_BSTORE_RENAME_PREFIX,
+    TOKU_FS_OP_BSTORE_META_GET,
+    TOKU_FS_OP_BSTORE_META_GET_MANY,
+    TOKU_FS_OP_BSTORE_META_UPDATE,
+    TOKU_FS_OP_BSTORE_META_SCAN,
+    TOKU_FS_OP_BSTORE_RECLAIM_PUT,
+    TOKU_FS_OP_BSTORE_RECLAIM_DELETE,
+    TOKU_FS_OP_BSTORE_RECLAIM_SCAN,
+    TOKU_FS_OP_BSTORE_HOT_OPTIMIZE,
+    TOKU_FS_OPS
+};
+
+/**
+ * The name of an operation, like "pread" or "bstore_get".
+ */
+const char * toku_fs_op_name(enum toku_fs_op op);
+
+/**
+ * Latencies are counted in buckets by powers of two. Bucket i
+ * holds calls that took under 2^i nanoseconds and at least half
+ * that. The last bucket also holds everything slower.
+ */
+#define TOKU_FS_LATENCY_BUCKETS 32
+
+/**
+ * calls        - times the operation was called.
+ * errors       - calls that returned an error.
+ * bytes        - bytes read or written, for the calls that move data.
+ * blocks       - blocks read, written or deleted.
+ * upserts      - update messages sent to the engine, which change
+ *                a value without reading it first.
+ * cache_hits   - for bstore_meta_get, gets answered by the metadata
+ * cache_misses   cache or not. Zero for everything else.
+ * nsec         - time spent in all the calls.
+ * latency      - calls by how long they took, see above.
+ */
+struct toku_fs_op_stats
+{
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t bytes;
+    uint64_t blocks;
+    uint64_t upserts;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t nsec;
+    uint64_t latency[TOKU_FS_LATENCY_BUCKETS];
+};
+
+/**
+ * Counters kept since the process started, or since the last
+ * toku_fs_reset_stats().
+ *
+ * zero_blocks_elided - all zero blocks that were written as holes
+ *                      instead of being stored.
+ * zero_bytes_elided  - the zero bytes written to those blocks that
+ *                      weren't stored. Less than a block for each
+ *                      write that covered only part of one.
+ * heap_allocs        - heap allocations made on the write path.
+ *                      Stays flat once writing threads are warm.
+ * reclaims_pending   - unlinked files and removed trees whose data
+ *                      blocks are still being given back in the
+ *                      background. Survives a remount.
+ * cache_hits         - lookups found in the engine's cache. Data
+ * cache_misses         and metadata share it, less whatever the
+ *                      metadata cache answers.
+ * meta_cache_hits    - metadata gets answered by the reserved
+ * meta_cache_misses    metadata cache, or not. Zero unless it's
+ *                      on, see meta_cachesize.
+ * optimize_passes    - dictionaries the background optimizer got
+ *                      all the way through.
+ * optimize_ranges    - hot optimize calls it finished. The data
+ *                      dictionary is done in ranges of names.
+ * optimize_bytes     - disk io charged to the optimizer: what it
+ *                      read, and what the engine flushed while
+ *                      it ran.
+ * optimize_progress  - percent done of the range being optimized,
+ *                      0 if there isn't one.
+ * dir_prefetches     - sweeps of the siblings ahead of a directory
+ *                      being opened in name order, see dir_prefetch.
+ * dir_prefetches_dropped
+ *                    - sweeps not done because the workers were
+ *                      already busy with others.
+ * dir_prefetch_files - siblings the sweeps went over. Sweeps
+ *                      overlap, so a file can count twice.
+ * parallel_slices    - pieces big reads and writes were split
+ *                      into, see parallel_read.
+ * ops                - counters for each operation, see above.
+ */
+struct toku_fs_stats
+{
+    uint64_t zero_blocks_elided;
+    uint64_t zero_bytes_elided;
+    uint64_t heap_allocs;
+    uint64_t reclaims_pending;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t meta_cache_hits;
+    uint64_t meta_cache_misses;
+    uint64_t optimize_passes;
+    uint64_t optimize_ranges;
+    uint64_t optimize_bytes;
+    uint64_t optimize_progress;
+    uint64_t dir_prefetches;
+    uint64_t dir_prefetches_dropped;
+    uint64_t dir_prefetch_files;
+    uint64_t parallel_slices;
+    struct toku_fs_op_stats ops[TOKU_FS_OPS];
+};
+
+int toku_fs_get_stats(struct toku_fs_stats * stats);
+
+/**
+ * Start the counters over from zero. reclaims_pending and
+ * optimize_progress aren't counters, so they're left alone.
+ */
+int toku_fs_reset_stats(void);
+
+/**
+ * Write the operation counters to the given stream as text, one
+ * line per operation, for utils/tokufs-opstats to read. Returns
+ * -EIO if writing fails.
+ */
+int toku_fs_dump_stats(FILE * f);
+
+/**
+ * Phases inside the hot path the profiler times, when the library
+ * is built with PROFILE=1.
+ *
+ * keycmp          - the key comparator, called by the engine.
+ * env_update_cb   - applying an upsert to a value, data or metadata.
+ * block_update_cb - the part of that spent on data blocks.
+ * zero_fill       - zeroing the parts of a read buffer that fall
+ *                   in holes or past the end of the file.
+ */
+enum toku_fs_phase {
+    TOKU_FS_PHASE_KEYCMP = 0,
+    TOKU_FS_PHASE_ENV_UPDATE_CB,
+    TOKU_FS_PHASE_BLOCK_UPDATE_CB,
+    TOKU_FS_PHASE_ZERO_FILL,
+    TOKU_FS_PHASES
+};
+
+const char * toku_fs_phase_name(enum toku_fs_phase phase);
+
+/**
+ * calls   - times the phase ran.
+ * sampled - calls that were timed. Only one in sample_rate is.
+ * nsec    - time spent in the sampled calls. Scale by
+ *           calls / sampled to estimate the total.
+ */
+struct toku_fs_phase_stats
+{
+    uint64_t calls;
+    uint64_t sampled;
+    uint64_t nsec;
+};
+
+/**
+ * Phase counters by the operation the thread was in when the
+ * phase ran, the outermost one if operations nest. Engine threads
+ * applying messages or evicting nodes aren't in an operation, so
+ * they count under background.
+ */
+struct toku_fs_profile
+{
+    uint64_t sample_rate;
+    struct toku_fs_phase_stats ops[TOKU_FS_OPS][TOKU_FS_PHASES];
+    struct toku_fs_phase_stats background[TOKU_FS_PHASES];
+};
+
+/**
+ * Get the phase counters since the process started, or since the
+ * last toku_fs_reset_stats(). Returns -ENOSYS if the library was
+ * built without the profiler.
+ */
+int toku_fs_get_profile(struct toku_fs_profile * profile);
+
+/**
+ * Write the phase counters to the given stream as a table, with
+ * the estimated time of each phase and its share of the operation
+ * it ran under. Returns -ENOSYS if the library was built without
+ * the profiler, -EIO if writing fails.
+ */
+int toku_fs_print_profile(FILE * f);
+
+/**
+ * File system totals for statfs. They come from the root
+ * directory's usage counts and the engine's space estimates,
+ * so getting them never scans.
+ *
+ * files        - entries in the file system, including the root.
+ * bytes        - logical size of all files.
+ * stored_bytes - bytes held by the dictionaries, before compression.
+ * disk_bytes   - bytes the dictionaries take on disk, after compression.
+ * free_bytes   - bytes available on the file system under the mount.
+ * free_files   - inodes available on the file system under the mount.
+ */
+struct toku_fs_statfs
+{
+    uint64_t files;
+    uint64_t bytes;
+    uint64_t stored_bytes;
+    uint64_t disk_bytes;
+    uint64_t free_bytes;
+    uint64_t free_files;
+};
+
+int toku_fs_statfs(struct toku_fs_statfs * st);
+
+/**
+ * One dictionary's share of the engine status.
+ *
+ * logical_bytes - key and value bytes stored, before compression.
+ * disk_bytes    - size of its file, after compression.
+ * messages      - puts, deletes and updates sent to it.
+ * compression   - logical_bytes / disk_bytes, or 0 if it's empty.
+ */
+struct toku_fs_engine_dict
+{
+    uint64_t logical_bytes;
+    uint64_t disk_bytes;
+    uint64_t messages;
+    double compression;
+};
+
+/**
+ * What the storage engine did, from its status, next to what was
+ * asked of it. Counters are since the mount or the last
+ * toku_fs_reset_stats(). The rest are current values. An engine
+ * that doesn't keep a counter reports zero for it.
+ *
+ * bytes_written       - bytes written by pwrite and put_file.
+ * disk_bytes_written  - node bytes the engine wrote to its
+ *                       dictionaries, for checkpoints and
+ *                       evictions, plus its log bytes.
+ * cache_misses        - lookups the engine's cache missed.
+ * cache_evictions     - nodes evicted from the engine's cache.
+ * cache_bytes         - bytes in the engine's cache.
+ * cache_limit         - the most it may hold.
+ * checkpoints         - checkpoints taken.
+ * checkpoint_secs     - seconds spent in them.
+ * buffered_bytes      - message bytes buffered in the trees,
+ *                       not yet applied to leaves.
+ * file_bytes          - logical size of all files.
+ * write_amplification - disk_bytes_written / bytes_written.
+ * space_amplification - both dictionaries' disk bytes / file_bytes.
+ */
+struct toku_fs_engine_status
+{
+    uint64_t bytes_written;
+    uint64_t disk_bytes_written;
+    uint64_t cache_misses;
+    uint64_t cache_evictions;
+    uint64_t cache_bytes;
+    uint64_t cache_limit;
+    uint64_t checkpoints;
+    uint64_t checkpoint_secs;
+    uint64_t buffered_bytes;
+    uint64_t file_bytes;
+    struct toku_fs_engine_dict data;
+    struct toku_fs_engine_dict meta;
+    double write_amplification;
+    double space_amplification;
+};
+
+int toku_fs_engine_status(struct toku_fs_engine_status * status);
+
+/**
+ * Write the engine status as text for utils/tokufs-engstat: the
+ * fields above as "name value" lines, then every numeric row the
+ * engine keeps as "engine key value legend", raw. Returns -EIO if
+ * writing fails.
+ */
+int toku_fs_dump_engine_status(FILE * f);
+
+//
+// Tracing
+//
+
+/**
+ * Every thread keeps a ring of its most recent trace records,
+ * written without locks or system calls. What gets recorded is
+ * fixed when the library is built, with TRACE=<level>:
+ *
+ * 0 - nothing, the trace points compile away.
+ * 1 - the start and end of every file system call, with its
+ *     arguments. The default.
+ * 2 - the block store calls they make, too.
+ * 3 - every internal trace point. The default for DEBUG=1.
+ *
+ * A dump is binary: a toku_fs_trace_header, the names of its
+ * events, then for each thread a toku_fs_trace_thread and that
+ * many records, oldest first. utils/tokufs-trace decodes it.
+ */
+#define TOKU_FS_TRACE_MAGIC "TOKUTRC1"
+
+/**
+ * begin - an operation started. The event is the toku_fs_op.
+ * end   - it finished. a is 1 if it failed.
+ * args  - the arguments of the operation that just began.
+ * point - anything else.
+ */
+enum toku_fs_trace_kind {
+    TOKU_FS_TRACE_BEGIN = 0,
+    TOKU_FS_TRACE_END,
+    TOKU_FS_TRACE_ARGS,
+    TOKU_FS_TRACE_POINT
+};
+
+/**
+ * seq   - the record's position in its thread's ring, plus one.
+ * nsec  - when it happened, by CLOCK_MONOTONIC.
+ * path  - toku_fs_trace_path_hash() of the path involved, or 0.
+ * a, b  - offsets, sizes and such. Their names for each event
+ *         are in the dump.
+ */
+struct toku_fs_trace_record
+{
+    uint64_t seq;
+    uint64_t nsec;
+    uint64_t path;
+    uint64_t a;
+    uint64_t b;
+    uint16_t event;
+    uint8_t kind;
+    uint8_t level;
+    uint32_t unused;
+};
+
+struct toku_fs_trace_event
+{
+    char name[24];
+    char a[12];
+    char b[12];
+};
+
+struct toku_fs_trace_header
+{
+    char magic[8];
+    uint32_t level;
+    uint32_t record_size;
+    uint32_t events;
+    uint32_t threads;
+};
+
+struct toku_fs_trace_thread
+{
+    uint64_t tid;
+    uint64_t records;
+};
+
+/**
+ * Write what's in every thread's ring to the given stream,
+ * including threads that exited recently. Returns -EIO if
+ * writing fails.
+ */
+int toku_fs_trace_dump(FILE * f);
+
+/**
+ * The hash trace records use for a path.
+ */
+uint64_t toku_fs_trace_path_hash(const char * path);
+
 #endif /* TOKU_FS_H */
@@ -19,7 +19,7 @@ struct ADIOI_Fns_struct ADIO_TOKUFS_operations =
     ADIOI_GEN_WriteStridedColl,
     ADIOI_GEN_SeekIndividual,
     ADIOI_TOKUFS_Fcntl,             /* ad_tokufs_fcntl.c */
-    ADIOI_GEN_SetInfo,
+    ADIOI_TOKUFS_SetInfo,           /* ad_tokufs_hints.c */
     ADIOI_GEN_ReadStrided,
     ADIOI_GEN_WriteStrided,
     ADIOI_TOKUFS_Close,             /* ad_tokufs_close.c */
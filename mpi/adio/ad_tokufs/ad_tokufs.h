@@ -32,4 +32,8 @@ void ADIOI_TOKUFS_Delete(char * filename, int * err);
 
 void ADIOI_TOKUFS_Flush(ADIO_File fd, int * err);
 
+void ADIOI_TOKUFS_SetInfo(ADIO_File fd, MPI_Info users_info, int * err);
+
+void ADIOI_TOKUFS_Advise(ADIO_File fd);
+
 #endif /* AD_TOKUFS_H */
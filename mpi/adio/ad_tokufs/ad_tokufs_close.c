@@ -15,7 +15,7 @@ void ADIOI_TOKUFS_Close(ADIO_File fd, int * err)
             fd->filename, (unsigned) fd->fd_sys);
     
     /* Pass the tokufs file desc down to close() */
-    ret = tokufs_close(fd->fd_sys);
+    ret = toku_fs_close(fd->fd_sys);
     assert(ret == 0);
 
     /* And invalidate it, I guess. */
@@ -0,0 +1,75 @@
+/**
+ * TokuFS
+ */
+
+#include <string.h>
+
+#include "ad_tokufs.h"
+#include "adioi.h"
+
+/**
+ * Map the access_style hint onto tokufs advice. It's a comma
+ * separated list, so the first style we know wins.
+ */
+static enum toku_fs_advice access_style_advice(char * style)
+{
+    char * s, * saveptr;
+
+    for (s = strtok_r(style, ",", &saveptr); s != NULL;
+            s = strtok_r(NULL, ",", &saveptr)) {
+        if (strcmp(s, "sequential") == 0) {
+            return TOKU_FS_ADVICE_SEQUENTIAL;
+        } else if (strcmp(s, "random") == 0) {
+            return TOKU_FS_ADVICE_RANDOM;
+        } else if (strcmp(s, "read_once") == 0 ||
+                strcmp(s, "write_once") == 0) {
+            return TOKU_FS_ADVICE_DONTNEED;
+        }
+    }
+
+    return TOKU_FS_ADVICE_NORMAL;
+}
+
+void ADIOI_TOKUFS_Advise(ADIO_File fd)
+{
+    int flag, ret;
+    char * value;
+    enum toku_fs_advice advice;
+
+    if (fd->info == MPI_INFO_NULL) {
+        return;
+    }
+    value = ADIOI_Malloc(MPI_MAX_INFO_VAL + 1);
+    MPI_Info_get(fd->info, "access_style", MPI_MAX_INFO_VAL, value, &flag);
+    if (flag) {
+        advice = access_style_advice(value);
+        ret = toku_fs_fadvise(fd->fd_sys, 0, 0, advice);
+        assert(ret == 0);
+    }
+    ADIOI_Free(value);
+}
+
+void ADIOI_TOKUFS_SetInfo(ADIO_File fd, MPI_Info users_info, int * err)
+{
+    int flag;
+    char * value;
+
+    ADIOI_GEN_SetInfo(fd, users_info, err);
+    if (*err != MPI_SUCCESS || users_info == MPI_INFO_NULL) {
+        return;
+    }
+
+    // the generic code doesn't keep access_style, so we do
+    value = ADIOI_Malloc(MPI_MAX_INFO_VAL + 1);
+    MPI_Info_get(users_info, "access_style", MPI_MAX_INFO_VAL,
+            value, &flag);
+    if (flag) {
+        MPI_Info_set(fd->info, "access_style", value);
+    }
+    ADIOI_Free(value);
+
+    // hints given at open are applied by ADIOI_TOKUFS_Open
+    if (flag && fd->is_open) {
+        ADIOI_TOKUFS_Advise(fd);
+    }
+}
@@ -5,28 +5,42 @@
 #include "ad_tokufs.h"
 #include "adio-tokufs.h"
 
+#include <fcntl.h>
+
 static int tokufs_mounted;
 
 void ADIOI_TOKUFS_Open(ADIO_File fd, int * err)
 {
     int ret;
     int rank;
-    tokufs_fd tokufd;
+    int flags = 0;
+    mode_t mode = 0644;
 
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     ad_tokufs_debug(rank, "called with filename %s\n", fd->filename);
 
     if (!tokufs_mounted) {
-        tokufs_mount("adio.mount");
+        ret = toku_fs_mount("adio.mount");
+        assert(ret == 0);
         tokufs_mounted = 1;
     }
 
-    ret = tokufs_open(&tokufd, fd->filename, rank);
-    assert(ret == 0);
+    if (fd->access_mode & ADIO_CREATE) {
+        flags |= O_CREAT;
+    }
+    if (fd->access_mode & ADIO_EXCL) {
+        flags |= O_EXCL;
+    }
+    if (fd->perm != ADIO_PERM_NULL) {
+        mode = fd->perm;
+    }
+    ret = toku_fs_open(fd->filename, flags, mode);
+    assert(ret >= 0);
 
-    fd->fd_sys = tokufd;
+    fd->fd_sys = ret;
     fd->fp_ind = 0;
     fd->fp_sys_posn = -1;
+    ADIOI_TOKUFS_Advise(fd);
 
     *err = MPI_SUCCESS;
 }
@@ -8,7 +8,6 @@ void ADIOI_TOKUFS_ReadContig(ADIO_File fd, void *buf, int count,
     MPI_Datatype datatype, int filetype, ADIO_Offset offset, 
     ADIO_Status * status, int * err)
 {
-    int ret;
     int rank;
     int datatype_size, read_size;
     ssize_t bytes_read;
@@ -27,18 +26,16 @@ void ADIOI_TOKUFS_ReadContig(ADIO_File fd, void *buf, int count,
      * and take the offset as a parameter. Otherwise, use the ADIO
      * file position as the offset, and adjust it after reading. */
     if (filetype == ADIO_EXPLICIT_OFFSET) {
-        bytes_read = tokufs_read_at(fd->fd_sys, buf, read_size, offset);
+        bytes_read = toku_fs_pread(fd->fd_sys, buf, read_size, offset);
         assert(bytes_read == read_size);
     } else {
-        bytes_read = tokufs_read_at(fd->fd_sys, buf, read_size, fd->fp_ind);
+        bytes_read = toku_fs_pread(fd->fd_sys, buf, read_size, fd->fp_ind);
         assert(bytes_read == read_size);
         fd->fp_ind += bytes_read;
     }
     
 #ifdef HAVE_STATUS_SET_BYTES
-    if (ret != -1) {
-        MPIR_Status_set_bytes(status, datatype, ret);
-    }
+    MPIR_Status_set_bytes(status, datatype, bytes_read);
 #endif
 
     *err = MPI_SUCCESS;
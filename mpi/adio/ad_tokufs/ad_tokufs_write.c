@@ -9,7 +9,6 @@ void ADIOI_TOKUFS_WriteContig(ADIO_File fd, void *buf, int count,
     ADIO_Status * status, int * err)
 {
 
-    int ret;
     int rank;
     int datatype_size, write_size;
     ssize_t bytes_written;
@@ -29,18 +28,16 @@ void ADIOI_TOKUFS_WriteContig(ADIO_File fd, void *buf, int count,
      * otherwise us the ADIO file position, and update it after writing.
      */
     if (filetype == ADIO_EXPLICIT_OFFSET) {
-        bytes_written = tokufs_write_at(fd->fd_sys, buf, write_size, offset);
+        bytes_written = toku_fs_pwrite(fd->fd_sys, buf, write_size, offset);
         assert(bytes_written == write_size);
     } else {
-        bytes_written = tokufs_write_at(fd->fd_sys, buf, write_size, fd->fp_ind); 
+        bytes_written = toku_fs_pwrite(fd->fd_sys, buf, write_size, fd->fp_ind); 
         assert(bytes_written == write_size);
         fd->fp_ind += bytes_written;
     }
 
 #ifdef HAVE_STATUS_SET_BYTES
-    if (ret != -1) {
-        MPIR_Status_set_bytes(status, datatype, ret);
-    }
+    MPIR_Status_set_bytes(status, datatype, bytes_written);
 #endif
 
     *err = MPI_SUCCESS;
@@ -5,6 +5,8 @@
 #ifndef TOKU_BLOCK_H
 #define TOKU_BLOCK_H
 
+#include <string.h>
+
 #include "bstore.h"
 
 /**
@@ -31,4 +33,36 @@ static inline int block_get_count_by_size(size_t size)
     return blocks;
 }
 
+/**
+ * True if the first size bytes of buf are all zero.
+ *
+ * OR eight byte words together 64 bytes at a time and only branch
+ * once per 64 bytes, so the compiler can vectorize the inner loop.
+ * memcpy does the loads so buf doesn't have to be aligned.
+ */
+static inline int block_is_zero(const void * buf, size_t size)
+{
+    const unsigned char * p = buf;
+    uint64_t w[8], acc;
+    int i;
+
+    for (; size >= sizeof(w); p += sizeof(w), size -= sizeof(w)) {
+        memcpy(w, p, sizeof(w));
+        acc = 0;
+        for (i = 0; i < 8; i++) {
+            acc |= w[i];
+        }
+        if (acc != 0) {
+            return 0;
+        }
+    }
+    for (; size > 0; p++, size--) {
+        if (*p != 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
 #endif /* TOKU_BLOCK_H */
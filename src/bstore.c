@@ -2,25 +2,32 @@
  * TokuFS
  */
 
+#define _XOPEN_SOURCE 600
+
 #define TOKUDB_CURSOR_CONTINUE_NEW 0
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <sys/stat.h>
 
 #include <toku/str.h>
-#include <toku/debug.h>
 
 #include "bstore.h"
+#include "block.h"
 #include "byteorder.h"
+#include "metacache.h"
+#include "opstats.h"
+#include "trace.h"
 
 // each db will have its own identifier which we
 // can store in the app_private field.
 #define DATA_DB_NAME "data"
 #define META_DB_NAME "meta"
+#define RECLAIM_DB_NAME "reclaim"
 
 // There is exactly one db environment per process,
 // plus one data and one meta database. the environment
@@ -28,9 +35,143 @@
 static DB_ENV * db_env;
 static DB * data_db;
 static DB * meta_db;
+static DB * reclaim_db;
 static bstore_env_keycmp_fn env_keycmp;
 static bstore_update_callback_fn meta_update_cb;
 static size_t db_cachesize = 1L * 1024L * 1024 * 1024;
+static size_t meta_cachesize;
+static struct bstore_db_params data_db_params;
+static struct bstore_db_params meta_db_params;
+static struct bstore_stats bstore_stats;
+
+#define STATS_INC(field, n) __sync_fetch_and_add(&bstore_stats.field, (n))
+
+// Every operation holds the env lock for reading, so the env can
+// be closed and opened again under it for writing, which is the
+// only way to give the engine a new cache size. Scan callbacks may
+// call back in, so a thread only takes it on its way in the first
+// time. Once a resize is waiting, new operations wait behind it.
+static pthread_rwlock_t env_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t env_resize_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t env_resize_cond = PTHREAD_COND_INITIALIZER;
+static int env_resizing;
+static __thread int env_lock_depth;
+static char * env_path;
+
+static void env_enter(void)
+{
+    if (env_lock_depth++ > 0) {
+        return;
+    }
+    if (__sync_fetch_and_add(&env_resizing, 0)) {
+        pthread_mutex_lock(&env_resize_lock);
+        while (env_resizing) {
+            pthread_cond_wait(&env_resize_cond, &env_resize_lock);
+        }
+        pthread_mutex_unlock(&env_resize_lock);
+    }
+    pthread_rwlock_rdlock(&env_lock);
+}
+
+static void env_leave(void)
+{
+    assert(env_lock_depth > 0);
+    if (--env_lock_depth == 0) {
+        pthread_rwlock_unlock(&env_lock);
+    }
+}
+
+/**
+ * Info passed to the block update callback. It says that
+ * size bytes should be applied to the block, starting at
+ * offset, with the given buf. 
+ */
+struct block_update_cb_info
+{
+    size_t size;
+    uint64_t offset;
+    char buf[];
+};
+
+//
+// Block buffer pool
+//
+// Each thread keeps a few block sized buffers around for building
+// update messages and applying them, so the write path doesn't
+// touch the heap once a thread is warmed up. Buffers are big
+// enough for a block or an update message carrying a whole block.
+//
+
+#define BLOCK_POOL_SIZE 4
+#define BLOCK_POOL_BUFSIZE \
+    (sizeof(struct block_update_cb_info) + BSTORE_BLOCKSIZE)
+
+struct block_pool {
+    int count;
+    void * bufs[BLOCK_POOL_SIZE];
+};
+
+static pthread_key_t block_pool_key;
+static pthread_once_t block_pool_once = PTHREAD_ONCE_INIT;
+
+static void block_pool_destroy(void * arg)
+{
+    struct block_pool * pool = arg;
+
+    for (int i = 0; i < pool->count; i++) {
+        free(pool->bufs[i]);
+    }
+    free(pool);
+}
+
+static void block_pool_key_create(void)
+{
+    int ret = pthread_key_create(&block_pool_key, block_pool_destroy);
+    assert(ret == 0);
+}
+
+static struct block_pool * get_block_pool(void)
+{
+    struct block_pool * pool;
+
+    pthread_once(&block_pool_once, block_pool_key_create);
+    pool = pthread_getspecific(block_pool_key);
+    if (pool == NULL) {
+        pool = calloc(1, sizeof(struct block_pool));
+        pthread_setspecific(block_pool_key, pool);
+    }
+
+    return pool;
+}
+
+/**
+ * Get a buffer of BLOCK_POOL_BUFSIZE bytes from this
+ * thread's pool, allocating one only if the pool is empty.
+ */
+static void * block_pool_get(void)
+{
+    struct block_pool * pool = get_block_pool();
+
+    if (pool->count > 0) {
+        return pool->bufs[--pool->count];
+    }
+    STATS_INC(block_buffer_allocs, 1);
+    return malloc(BLOCK_POOL_BUFSIZE);
+}
+
+/**
+ * Give a buffer back to this thread's pool.
+ */
+static void block_pool_put(void * buf)
+{
+    struct block_pool * pool = get_block_pool();
+
+    if (pool->count < BLOCK_POOL_SIZE) {
+        pool->bufs[pool->count++] = buf;
+    } else {
+        free(buf);
+    }
+}
 
 /**
  * Initialize a DBT with the given data pointer and size.
@@ -104,16 +245,64 @@ static void generate_meta_key_dbt(DBT * key_dbt, const char * name)
 }
 
 /**
- * Info passed to the block update callback. It says that
- * size bytes should be applied to the block, starting at
- * offset, with the given buf. 
+ * Delete a key a cursor is sitting on. TokuDB cursors can't
+ * delete, so cursor loops delete by key and move on with
+ * getf_next, which picks up after the deleted key.
  */
-struct block_update_cb_info
+static int db_del_current(DB * db, DBT * key)
 {
-    size_t size;
-    uint64_t offset;
-    char buf[];
-};
+    int ret;
+
+#ifdef USE_BDB
+    ret = db->del(db, NULL, key, 0);
+#else
+    ret = db->del(db, NULL, key, DB_DELETE_ANY);
+#endif
+
+    return ret;
+}
+
+/**
+ * Apply size bytes from buf to a block at offset. newval always
+ * has room for a whole block, provided by the caller, so this
+ * never allocates. It may be the same buffer as oldval, in which
+ * case the update happens in place.
+ */
+static int block_update_apply(const DBT * oldval, DBT * newval,
+        const void * buf, size_t size, uint64_t offset)
+{
+    toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_BLOCK_UPDATE, NULL,
+            offset, size);
+
+    // a block that doesn't exist already reads as zeros, so
+    // writing zeros into it changes nothing.
+    int update_is_zero = block_is_zero(buf, size);
+    if (oldval == NULL && update_is_zero) {
+        STATS_INC(zero_blocks_elided, 1);
+        STATS_INC(zero_bytes_elided, size);
+        return BSTORE_UPDATE_IGNORE;
+    }
+
+    assert(newval->size == BSTORE_BLOCKSIZE);
+    if (oldval != NULL) {
+        if (newval->data != oldval->data) {
+            memcpy(newval->data, oldval->data, BSTORE_BLOCKSIZE);
+        }
+    } else {
+        memset(newval->data, 0, BSTORE_BLOCKSIZE);
+    }
+    memcpy(newval->data + offset, buf, size);
+
+    // if the update zeroed out the whole block, it becomes a hole.
+    // that can only happen if the update itself was zeros.
+    if (update_is_zero && block_is_zero(newval->data, BSTORE_BLOCKSIZE)) {
+        STATS_INC(zero_blocks_elided, 1);
+        STATS_INC(zero_bytes_elided, size);
+        return BSTORE_UPDATE_DELETE;
+    }
+
+    return 0;
+}
 
 /**
  * Update a block by copying bytes from the update op's buf 
@@ -125,27 +314,15 @@ static int block_update_cb(const DBT * oldval,
     assert(newval != NULL);
     assert(extra != NULL);
 
+    int ret;
     struct block_update_cb_info * info = extra;
-    debug_echo("called with info->offset %lu, info->size %lu\n",
-            info->offset, info->size);
 
-    // XXX if we do truncates via callbacks eventually, then
-    // it probably makes sense to pass info->size == 0
-    // and then return BSTORE_UPDATE_DELETE, before malloc.
-    
-    if (newval->size == 0) {
-        newval->data = malloc(BSTORE_BLOCKSIZE);
-        newval->size = BSTORE_BLOCKSIZE;
-    }
-    assert(newval->size == BSTORE_BLOCKSIZE);
-    if (oldval != NULL) {
-        memcpy(newval->data, oldval->data, BSTORE_BLOCKSIZE);
-    } else {
-        memset(newval->data, 0, BSTORE_BLOCKSIZE);
-    }
-    memcpy(newval->data + info->offset, info->buf, info->size);
+    PROFILE_START(BLOCK_UPDATE_CB);
+    ret = block_update_apply(oldval, newval,
+            info->buf, info->size, info->offset);
+    PROFILE_STOP(BLOCK_UPDATE_CB);
 
-    return 0;
+    return ret;
 }
 
 struct set_val_emulator_info {
@@ -198,6 +375,7 @@ static int env_update_cb(DB * db,
 
     int ret;
     DBT val, newval;
+    PROFILE_START(ENV_UPDATE_CB);
 
     // HACK bad hack to identify meta vs data db.
     // the idea is that metadata keys are null terminated
@@ -215,16 +393,20 @@ static int env_update_cb(DB * db,
     // more buffer space than we provide here, it will 
     // allocate the space and put a pointer to it
     // in newval.data and the size in newval.size. 
-    size_t newval_buf_size = old_val != NULL ? old_val->size : 0;
-    char newval_buf[newval_buf_size];
+    // blocks are always the same size, so the data db
+    // gets a whole block from the pool instead.
+    size_t newval_buf_size = old_val != NULL && is_meta_db ?
+        old_val->size : 0;
+    char newval_stack_buf[newval_buf_size];
+    char * newval_buf = is_data_db ? block_pool_get() : newval_stack_buf;
     newval.data = newval_buf;
-    newval.size = newval_buf_size;
+    newval.size = is_data_db ? BSTORE_BLOCKSIZE : newval_buf_size;
     ret = 0;
+    toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_UPDATE_CB, NULL,
+            is_data_db, old_val != NULL);
     if (is_data_db) {
-        debug_echo("called for data db\n");
         ret = block_update_cb(old_val, &newval, extra->data);
     } else if (is_meta_db) {
-        debug_echo("called for meta db\n");
         ret = meta_update_cb(old_val, &newval, extra->data);
     }
 
@@ -241,9 +423,14 @@ static int env_update_cb(DB * db,
             // we are responsible for freeing newval.data if
             // its not the same buffer we passed 
             if (newval.data != newval_buf) {
+                STATS_INC(update_callback_allocs, 1);
                 free(newval.data);
             }
     }
+    if (is_data_db) {
+        block_pool_put(newval_buf);
+    }
+    PROFILE_STOP(ENV_UPDATE_CB);
 
     return ret;
 }
@@ -265,8 +452,10 @@ static int env_open(const char * path)
     assert(db_env == NULL);   
     ret = db_env_create(&db_env, 0);
     assert(ret == 0);
-    gb = db_cachesize / (1L << 30);
-    bytes = db_cachesize % (1L << 30);
+    // the metadata cache's share comes out of the engine's
+    assert(meta_cachesize < db_cachesize);
+    gb = (db_cachesize - meta_cachesize) / (1L << 30);
+    bytes = (db_cachesize - meta_cachesize) % (1L << 30);
     assert(gb > 0 || bytes > 0);
     ret = db_env->set_cachesize(db_env, gb, bytes, 1);
     assert(ret == 0);
@@ -286,28 +475,96 @@ static int env_open(const char * path)
     return ret;
 }
 
-#undef SET_READ_PARAMS
+#ifndef USE_BDB
+/**
+ * Map a bstore compression constant to the engine's method.
+ */
+static enum toku_compression_method db_compression_method(int compression)
+{
+    switch (compression) {
+        case BSTORE_COMPRESSION_NONE:
+            return TOKU_NO_COMPRESSION;
+        case BSTORE_COMPRESSION_QUICKLZ:
+            return TOKU_QUICKLZ_METHOD;
+        case BSTORE_COMPRESSION_ZLIB:
+            return TOKU_ZLIB_METHOD;
+        case BSTORE_COMPRESSION_LZMA:
+            return TOKU_LZMA_METHOD;
+        case BSTORE_COMPRESSION_FAST:
+            return TOKU_FAST_COMPRESSION_METHOD;
+        case BSTORE_COMPRESSION_SMALL:
+            return TOKU_SMALL_COMPRESSION_METHOD;
+        default:
+            return TOKU_DEFAULT_COMPRESSION_METHOD;
+    }
+}
+#endif
 
-static void db_set_read_params(DB * db)
+/**
+ * Apply engine parameters to a db handle before it is opened.
+ * These only take effect if the open creates the dictionary.
+ */
+static void db_set_params(DB * db, const struct bstore_db_params * params)
 {
-#ifdef SET_READ_PARAMS
-    const long num_basement_nodes = 1;
-    const long basement_node_size = 4L * 1024*1024;
-    const long leaf_node_size = num_basement_nodes * basement_node_size;
+#ifndef USE_BDB
     int ret;
-    ret = db->set_readpagesize(db, basement_node_size);
-    assert(ret == 0);
-    ret = db->set_pagesize(db, leaf_node_size);
-    assert(ret == 0);
-    printf("set basement node size to %ld, leaf node size to %ld\n",
-            basement_node_size, leaf_node_size);
+    if (params->nodesize > 0) {
+        ret = db->set_pagesize(db, params->nodesize);
+        assert(ret == 0);
+    }
+    if (params->basementsize > 0) {
+        ret = db->set_readpagesize(db, params->basementsize);
+        assert(ret == 0);
+    }
+    if (params->fanout > 0) {
+        ret = db->set_fanout(db, params->fanout);
+        assert(ret == 0);
+    }
+    if (params->compression != BSTORE_COMPRESSION_DEFAULT) {
+        ret = db->set_compression_method(db,
+                db_compression_method(params->compression));
+        assert(ret == 0);
+    }
+#else
+    (void) db;
+    (void) params;
+#endif
+}
+
+/**
+ * Apply engine parameters to an open db handle, so an existing
+ * dictionary picks them up too. New nodes are written with the
+ * new parameters, old nodes are rewritten as they get dirtied.
+ */
+static void db_change_params(DB * db, const struct bstore_db_params * params)
+{
+#ifndef USE_BDB
+    int ret;
+    if (params->nodesize > 0) {
+        ret = db->change_pagesize(db, params->nodesize);
+        assert(ret == 0);
+    }
+    if (params->basementsize > 0) {
+        ret = db->change_readpagesize(db, params->basementsize);
+        assert(ret == 0);
+    }
+    if (params->fanout > 0) {
+        ret = db->change_fanout(db, params->fanout);
+        assert(ret == 0);
+    }
+    if (params->compression != BSTORE_COMPRESSION_DEFAULT) {
+        ret = db->change_compression_method(db,
+                db_compression_method(params->compression));
+        assert(ret == 0);
+    }
 #else
     (void) db;
+    (void) params;
 #endif
 }
 
 /**
- * Open the meta and data databases.
+ * Open the meta, data and reclaim databases.
  */
 static int env_open_databases(void)
 {
@@ -319,19 +576,30 @@ static int env_open_databases(void)
     assert(data_db == NULL);
     ret = db_create(&data_db, db_env, 0);
     assert(ret == 0);
-    db_set_read_params(data_db);
+    db_set_params(data_db, &data_db_params);
     ret = data_db->open(data_db, NULL, DATA_DB_NAME, NULL,
             DB_BTREE, flags, 0644);
     assert(ret == 0);
+    db_change_params(data_db, &data_db_params);
 
     // open the meta db
     assert(meta_db == NULL);
     ret = db_create(&meta_db, db_env, 0);
     assert(ret == 0);
-    db_set_read_params(meta_db);
+    db_set_params(meta_db, &meta_db_params);
     ret = meta_db->open(meta_db, NULL, META_DB_NAME, NULL,
             DB_BTREE, flags, 0644);
     assert(ret == 0);
+    db_change_params(meta_db, &meta_db_params);
+
+    // open the reclaim db. it only ever holds a few names,
+    // so the engine defaults are fine.
+    assert(reclaim_db == NULL);
+    ret = db_create(&reclaim_db, db_env, 0);
+    assert(ret == 0);
+    ret = reclaim_db->open(reclaim_db, NULL, RECLAIM_DB_NAME, NULL,
+            DB_BTREE, flags, 0644);
+    assert(ret == 0);
 
     return ret;
 }
@@ -373,19 +641,21 @@ int toku_bstore_env_open(const char * path, bstore_env_keycmp_fn keycmp,
 
     ret = os_maybe_mkdir(path);
     assert(ret == 0);
+    // a resize opens it again, see toku_bstore_env_set_cachesize
+    env_path = toku_strdup(path);
     ret = env_open(path);
     assert(ret == 0);
     ret = env_open_databases();
     assert(ret == 0);
+    toku_metacache_init(meta_cachesize);
 
     return ret;
 }
 
 /**
- * Close the bstore environment.
- * via bstore_env_open(). 
+ * Close the meta, data and reclaim databases.
  */
-int toku_bstore_env_close(void)
+static int env_close_databases(void)
 {
     int ret;
 
@@ -414,12 +684,46 @@ int toku_bstore_env_close(void)
     assert(ret == 0);
     meta_db = NULL;
 
-    // close the environment
+    // close the reclaim db
+    assert(reclaim_db != NULL);
+    ret = reclaim_db->close(reclaim_db, 0);
+    assert(ret == 0);
+    reclaim_db = NULL;
+
+    return ret;
+}
+
+/**
+ * Close the database environment.
+ */
+static int env_close(void)
+{
+    int ret;
+
     assert(db_env != NULL);
     ret = db_env->close(db_env, 0);
     assert(ret == 0);
     db_env = NULL;
 
+    return ret;
+}
+
+/**
+ * Close the bstore environment.
+ * via bstore_env_open(). 
+ */
+int toku_bstore_env_close(void)
+{
+    int ret;
+
+    ret = env_close_databases();
+    assert(ret == 0);
+    ret = env_close();
+    assert(ret == 0);
+    toku_metacache_destroy();
+    free(env_path);
+    env_path = NULL;
+
     // forget the key comparator and update functions
     env_keycmp = NULL;
     meta_update_cb = NULL;
@@ -504,9 +808,8 @@ static int rename_prefix_cb(DBT const * key,
                 info->u.check.should_rename = 1;
             }
         } 
-        debug_echo("rename_cb: key %s and oldprefix %s, should_rename? %s\n",
-                (char*)key->data, info->u.check.oldprefix, 
-                info->u.check.should_rename ? "yes" : "no");
+        toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_RENAME_CHECK,
+                key->data, info->u.check.should_rename, 0);
     }
     return 0;
 }
@@ -518,10 +821,6 @@ static int rename_cursor_current_prefix(DB * db, DBC * cursor,
     DBT key, value;
     DBT newkey;
 
-    debug_echo("rename current called on %s with old %s, new %s\n",
-            db == data_db ? "data db" : "meta db", 
-            oldprefix, newprefix);
-
     struct rename_prefix_cb_info info;
     info.u.get.key = &key;
     info.u.get.value = &value;
@@ -540,8 +839,6 @@ static int rename_cursor_current_prefix(DB * db, DBC * cursor,
     size_t oldprefix_len = strlen(oldprefix);
     size_t newprefix_len = strlen(newprefix);
     size_t newkey_size = info.u.get.key->size - oldprefix_len + newprefix_len;
-    debug_echo("old key size %u, oldprefix len %lu, newkey_size %lu\n",
-            info.u.get.key->size, oldprefix_len, newkey_size);
     char newkey_buf[newkey_size];
     // write the new prefix into the key
     memcpy(newkey_buf, newprefix, newprefix_len);
@@ -552,23 +849,9 @@ static int rename_cursor_current_prefix(DB * db, DBC * cursor,
     dbt_init(&newkey, newkey_buf, newkey_size);
 
     // get rid of the old pair, then put the new one
-    debug_echo("deleting cursor current, db is %s\n",
-            db == data_db ? "data" : "meta");
-    if (db == data_db) {
-        uint64_t k = get_data_key_block_num(&key);
-        (void)k;
-        uint64_t newk = get_data_key_block_num(&newkey);
-        (void)newk;
-        debug_echo("oldkey is %u bytes, %s[%lu]\n", key.size, 
-                (char*)key.data, k);
-        debug_echo("newkey is %u bytes, %s[%lu]\n", newkey.size, 
-                (char*)newkey.data, newk);
-    } else {
-        debug_echo("oldkey is %u bytes, %s\n", key.size, (char*)key.data);
-        debug_echo("newkey is %u bytes, %s\n", newkey.size, (char*)newkey.data);
-    }
-    ret = ENOSYS;
-    //ret = cursor->c_del(cursor, 0);
+    toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_RENAME_KEY, newkey_buf,
+            key.size, newkey.size);
+    ret = db_del_current(db, &key);
     assert(ret == 0);
     ret = db->put(db, NULL, &newkey, &value, 0);
     assert(ret == 0);
@@ -628,8 +911,6 @@ static int rename_prefix(DB * db, const char * oldprefix,
         }
         dbt_init(&key, prefix_buf, prefix_buf_len);
 
-        debug_echo("%s db : using key %s for rename...\n", 
-                db == data_db ? "data" : "meta", prefix_buf);
         struct rename_prefix_cb_info info;
         info.op = RENAME_PREFIX_CB_OP_CHECK;
         info.u.check.oldprefix = oldprefix;
@@ -642,8 +923,8 @@ static int rename_prefix(DB * db, const char * oldprefix,
         ret = ENOSYS;
 #endif
         assert(ret == 0 || ret == DB_NOTFOUND);
-        debug_echo("initial getf_set_range ret %s\n", 
-                ret == DB_NOTFOUND ? "DB_NOTFOUND" : "0");
+        toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_RENAME_START, prefix_buf,
+                db == data_db, info.u.check.should_rename);
         if (!info.u.check.should_rename) {
             // the callback looked at the first key and decided that
             // we should not rename it. there cannot exist any
@@ -687,8 +968,15 @@ static int rename_prefix(DB * db, const char * oldprefix,
  */
 int toku_bstore_rename_prefix(const char * oldprefix, const char * newprefix)
 {
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_RENAME_PREFIX);
+
+    env_enter();
     rename_prefix(data_db, oldprefix, newprefix);
     rename_prefix(meta_db, oldprefix, newprefix);
+    // renames are rare, so don't bother finding what moved
+    toku_metacache_invalidate_all();
+    env_leave();
+    toku_opstats_end(TOKU_FS_OP_BSTORE_RENAME_PREFIX, start, 0);
 
     return 0;
 }
@@ -704,18 +992,24 @@ int toku_bstore_get(struct bstore_s * bstore, uint64_t block_num, void * buf)
 {
     int ret;
     DBT key, value;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_GET);
 
-    debug_echo("called, block_num %lu\n", block_num);
+    toku_trace_args(TOKU_FS_OP_BSTORE_GET, bstore->name, block_num, 0);
     size_t key_buf_len = strlen(bstore->name) + sizeof(uint64_t) + 1;
     char key_buf[key_buf_len];
     generate_data_key_dbt(&key, key_buf, key_buf_len, 
             bstore->name, block_num);
     dbt_init(&value, buf, BSTORE_BLOCKSIZE);
+    env_enter();
     ret = data_db->get(data_db, NULL, &key, &value, 0);
+    env_leave();
     assert(ret == 0 || ret == DB_NOTFOUND);
     if (ret == DB_NOTFOUND) {
         ret = BSTORE_NOTFOUND;
+    } else {
+        toku_opstats_io(TOKU_FS_OP_BSTORE_GET, BSTORE_BLOCKSIZE, 1);
     }
+    toku_opstats_end(TOKU_FS_OP_BSTORE_GET, start, 0);
 
     return ret;
 }
@@ -729,62 +1023,171 @@ int toku_bstore_put(struct bstore_s * bstore,
 {
     int ret;
     DBT key, value;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_PUT);
+
+    toku_trace_args(TOKU_FS_OP_BSTORE_PUT, bstore->name, block_num, 0);
+    if (block_is_zero(buf, BSTORE_BLOCKSIZE)) {
+        STATS_INC(zero_blocks_elided, 1);
+        STATS_INC(zero_bytes_elided, BSTORE_BLOCKSIZE);
+        ret = toku_bstore_delete(bstore, block_num);
+    } else {
+        size_t key_buf_len = strlen(bstore->name) + sizeof(uint64_t) + 1;
+        char key_buf[key_buf_len];
+        generate_data_key_dbt(&key, key_buf, key_buf_len, 
+                bstore->name, block_num);
+        dbt_init(&value, buf, BSTORE_BLOCKSIZE);
+        env_enter();
+        ret = data_db->put(data_db, NULL, &key, &value, 0);
+        env_leave();
+        assert(ret == 0);
+        STATS_INC(data_messages, 1);
+        toku_opstats_io(TOKU_FS_OP_BSTORE_PUT, BSTORE_BLOCKSIZE, 1);
+    }
+    toku_opstats_end(TOKU_FS_OP_BSTORE_PUT, start, 0);
+
+    return ret;
+}
+
+/**
+ * Put size bytes from buf into consecutive blocks starting at
+ * block_num. The key is built once and only its block number
+ * changes from one block to the next.
+ */
+int toku_bstore_put_blocks(struct bstore_s * bstore, uint64_t block_num,
+        const void * buf, size_t size)
+{
+    int ret;
+    DBT key, value;
+    uint64_t k;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_PUT_BLOCKS);
+    char last[BSTORE_BLOCKSIZE];
 
-    debug_echo("called, block_num %lu\n", block_num);
+    toku_trace_args(TOKU_FS_OP_BSTORE_PUT_BLOCKS, bstore->name,
+            block_num, size);
     size_t key_buf_len = strlen(bstore->name) + sizeof(uint64_t) + 1;
     char key_buf[key_buf_len];
+    char * key_block_num = key_buf + key_buf_len - sizeof(uint64_t) - 1;
     generate_data_key_dbt(&key, key_buf, key_buf_len, 
             bstore->name, block_num);
-    dbt_init(&value, buf, BSTORE_BLOCKSIZE);
-    ret = data_db->put(data_db, NULL, &key, &value, 0);
+
+    toku_opstats_io(TOKU_FS_OP_BSTORE_PUT_BLOCKS, size,
+            (size + BSTORE_BLOCKSIZE - 1) / BSTORE_BLOCKSIZE);
+    ret = 0;
+    env_enter();
+    for (; size > 0; block_num++) {
+        const char * block = buf;
+        size_t n = size < BSTORE_BLOCKSIZE ? size : BSTORE_BLOCKSIZE;
+        if (n < BSTORE_BLOCKSIZE) {
+            memcpy(last, buf, n);
+            memset(last + n, 0, BSTORE_BLOCKSIZE - n);
+            block = last;
+        }
+        k = htonl64(block_num);
+        memcpy(key_block_num, &k, sizeof(uint64_t));
+        if (block_is_zero(block, BSTORE_BLOCKSIZE)) {
+            STATS_INC(zero_blocks_elided, 1);
+            STATS_INC(zero_bytes_elided, n);
+#ifdef USE_BDB
+            ret = data_db->del(data_db, NULL, &key, 0);
+            assert(ret == 0 || ret == DB_NOTFOUND);
+            ret = 0;
+#else
+            ret = data_db->del(data_db, NULL, &key, DB_DELETE_ANY);
+            assert(ret == 0);
+#endif
+        } else {
+            dbt_init(&value, block, BSTORE_BLOCKSIZE);
+            ret = data_db->put(data_db, NULL, &key, &value, 0);
+            assert(ret == 0);
+        }
+        STATS_INC(data_messages, 1);
+        buf += n;
+        size -= n;
+    }
+    env_leave();
+    toku_opstats_end(TOKU_FS_OP_BSTORE_PUT_BLOCKS, start, 0);
+
+    return ret;
+}
+
+/**
+ * Delete a block from the store, if it exists. TokuDB can do this
+ * blindly, without checking whether the key is there first.
+ */
+int toku_bstore_delete(struct bstore_s * bstore, uint64_t block_num)
+{
+    int ret;
+    DBT key;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_DELETE);
+
+    toku_trace_args(TOKU_FS_OP_BSTORE_DELETE, bstore->name, block_num, 0);
+    size_t key_buf_len = strlen(bstore->name) + sizeof(uint64_t) + 1;
+    char key_buf[key_buf_len];
+    generate_data_key_dbt(&key, key_buf, key_buf_len, 
+            bstore->name, block_num);
+    env_enter();
+#ifdef USE_BDB
+    ret = data_db->del(data_db, NULL, &key, 0);
+    assert(ret == 0 || ret == DB_NOTFOUND);
+    ret = 0;
+#else
+    ret = data_db->del(data_db, NULL, &key, DB_DELETE_ANY);
     assert(ret == 0);
+#endif
+    env_leave();
+    STATS_INC(data_messages, 1);
+    toku_opstats_io(TOKU_FS_OP_BSTORE_DELETE, 0, 1);
+    toku_opstats_end(TOKU_FS_OP_BSTORE_DELETE, start, 0);
 
     return ret;
 }
 
 /**
- * Update a block using read-modify-write (slow)
+ * Update a block using read-modify-write (slow). The update is
+ * applied right here, so it can use the caller's buf directly
+ * instead of copying it into a message.
  */
 static int bstore_update_rmw(struct bstore_s * bstore, uint64_t block_num,
         const void * buf, size_t size, size_t offset)
 {
     int ret;
-    DBT key, value;
+    DBT key, value, newval;
     DBT * oldval;
 
     // get the old block, if it exists.
-    char block[BSTORE_BLOCKSIZE];
+    char * block = block_pool_get();
     size_t key_buf_len = strlen(bstore->name) + sizeof(uint64_t) + 1;
     char key_buf[key_buf_len];
     generate_data_key_dbt(&key, key_buf, key_buf_len,
             bstore->name, block_num);
     dbt_init(&value, block, BSTORE_BLOCKSIZE);
+    env_enter();
     ret = data_db->get(data_db, NULL, &key, &value, 0);
     assert(ret == 0 || ret == DB_NOTFOUND);
     oldval = ret == 0 ? &value : NULL;
 
-    struct block_update_cb_info * info;
-    size_t info_size = sizeof(struct block_update_cb_info) + size;
-    char info_buf[info_size];
-    // create a block update cb info structure out of the 
-    // buf,size,offset triple and use it as the extra parameter
-    // to an update 
-    info = (struct block_update_cb_info *) info_buf;
-    info->offset = offset;
-    info->size = size;
-    memcpy(info->buf, buf, size);
-    // call the environment update callback immidiately. pass NULL
-    // for oldval if it did not exist. we'll use a custom setval
-    // function to emulate what tokudb does.
-    struct set_val_emulator_info set_val_info = {
-        .db = data_db,
-        .key = &key,
-    };
-    DBT extra_dbt;
-    dbt_init(&extra_dbt, info, info_size);
-    ret = env_update_cb(meta_db, &key, oldval, &extra_dbt, 
-            set_val_emulator, &set_val_info);
-    assert(ret == 0);
+    // the old block is updated in place, so the new one
+    // shares its buffer. block_update_apply skips copying
+    // the old bytes over themselves.
+    dbt_init(&newval, block, BSTORE_BLOCKSIZE);
+    ret = block_update_apply(oldval, &newval, buf, size, offset);
+    switch (ret) {
+        case BSTORE_UPDATE_DELETE:
+            ret = data_db->del(data_db, NULL, &key, 0);
+            assert(ret == 0);
+            break;
+        case BSTORE_UPDATE_IGNORE:
+            break;
+        case 0:
+            ret = data_db->put(data_db, NULL, &key, &newval, 0);
+            assert(ret == 0);
+            break;
+        default:
+            assert(0);
+    }
+    env_leave();
+    block_pool_put(block);
+
     return 0;
 }
 
@@ -796,21 +1199,23 @@ static int bstore_update_rmw(struct bstore_s * bstore, uint64_t block_num,
 int toku_bstore_update(struct bstore_s * bstore, uint64_t block_num,
         const void * buf, size_t size, size_t offset)
 {
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_UPDATE);
+    toku_trace_args(TOKU_FS_OP_BSTORE_UPDATE, bstore->name, block_num, size);
 #ifdef USE_BDB
-    return bstore_update_rmw(bstore, block_num, buf, size, offset);
+    int ret = bstore_update_rmw(bstore, block_num, buf, size, offset);
 #else
     int ret;
     DBT key, extra_dbt;
     struct block_update_cb_info * info;
     size_t info_size = sizeof(struct block_update_cb_info) + size;
-    char info_buf[info_size];
-
-    debug_echo("called, block_num %lu\n", block_num);
 
     // create a block update cb info structure out of the 
     // buf,size,offset triple and use it as the extra parameter
-    // to an update 
-    info = (struct block_update_cb_info *) info_buf;
+    // to an update. the engine keeps the message around after
+    // we return, so it has to carry a copy of the bytes. build
+    // it in a pooled buffer.
+    assert(size <= BSTORE_BLOCKSIZE);
+    info = block_pool_get();
     info->offset = offset;
     info->size = size;
     memcpy(info->buf, buf, size);
@@ -819,11 +1224,18 @@ int toku_bstore_update(struct bstore_s * bstore, uint64_t block_num,
     generate_data_key_dbt(&key, key_buf, key_buf_len, 
             bstore->name, block_num);
     dbt_init(&extra_dbt, info, info_size);
+    env_enter();
     ret = data_db->update(data_db, NULL, &key, &extra_dbt, 0);
+    env_leave();
     assert(ret == 0);
+    STATS_INC(data_messages, 1);
+    toku_opstats_upserts(TOKU_FS_OP_BSTORE_UPDATE, 1);
+    block_pool_put(info);
+#endif
+    toku_opstats_io(TOKU_FS_OP_BSTORE_UPDATE, size, 1);
+    toku_opstats_end(TOKU_FS_OP_BSTORE_UPDATE, start, 0);
 
     return ret;
-#endif
 }
 
 /**
@@ -839,6 +1251,7 @@ static int keys_share_name_prefix(DBT const * a, DBT const * b)
 
 struct truncate_cursor_cb_info {
     DBT * key;
+    DBT * current;
     uint64_t block_num;
     int should_delete;
 };
@@ -859,6 +1272,8 @@ static int truncate_cursor_cb(DBT const * key,
     if (keys_share_name_prefix(key, info->key)) {
         uint64_t block_num = get_data_key_block_num(key);
         if (block_num >= info->block_num) {
+            // same size as the search key, so it fits
+            memcpy(info->current->data, key->data, key->size);
             info->should_delete = 1;
         }
     }
@@ -868,25 +1283,31 @@ static int truncate_cursor_cb(DBT const * key,
 
 /**
  * Truncate a bstore, deleting any blocks greater than or 
- * equal to the given block number.
+ * equal to the given block number. Returns the number of
+ * blocks deleted.
  */
 int toku_bstore_truncate(struct bstore_s * bstore, uint64_t block_num)
 {
-    int ret;
-    DBT key;
+    int ret, deleted;
+    DBT key, current;
     DBC * cursor;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_TRUNCATE);
 
     size_t key_buf_len = strlen(bstore->name) + sizeof(uint64_t) + 1;
     char key_buf[key_buf_len];
     generate_data_key_dbt(&key, key_buf, key_buf_len, 
             bstore->name, block_num);
+    char current_buf[key_buf_len];
+    dbt_init(&current, current_buf, key_buf_len);
     struct truncate_cursor_cb_info info;
     info.key = &key;
+    info.current = &current;
     info.block_num = block_num;
     info.should_delete = 0;
 
     // put the cursor at the first key greater than
     // or equal to the first block number
+    env_enter();
     ret = data_db->cursor(data_db, NULL, &cursor, 0);
     assert(ret == 0);
 #ifndef USE_BDB
@@ -901,10 +1322,11 @@ int toku_bstore_truncate(struct bstore_s * bstore, uint64_t block_num)
     // the key it saw was within truncate range, so
     // we continue to getf_next and then delete while 
     // that is the case
+    deleted = 0;
     while (info.should_delete) {
-        ret = ENOSYS;
-        //ret = cursor->c_del(cursor, 0);
+        ret = db_del_current(data_db, &current);
         assert(ret == 0);
+        deleted++;
 #ifndef USE_BDB
         ret = cursor->c_getf_next(cursor, 0, truncate_cursor_cb, &info);
 #else
@@ -921,8 +1343,12 @@ int toku_bstore_truncate(struct bstore_s * bstore, uint64_t block_num)
 
     ret = cursor->c_close(cursor);
     assert(ret == 0);
+    env_leave();
+    STATS_INC(data_messages, deleted);
+    toku_opstats_io(TOKU_FS_OP_BSTORE_TRUNCATE, 0, deleted);
+    toku_opstats_end(TOKU_FS_OP_BSTORE_TRUNCATE, start, 0);
 
-    return ret;
+    return deleted;
 }
 
 /**
@@ -935,6 +1361,7 @@ struct block_scan_cb_info {
     DBT * start_key;
     void * extra;
     int do_continue;
+    uint64_t blocks;
 };
 
 /**
@@ -957,6 +1384,7 @@ static int block_scan_cb(DBT const * key, DBT const * val, void * extra)
     info->do_continue = 0;
     if (keys_share_name_prefix(info->start_key, key)) {
         uint64_t block_num = get_data_key_block_num(key);
+        info->blocks++;
         ret = info->cb(key->data, block_num, val->data, info->extra);
         if (ret == BSTORE_SCAN_CONTINUE) {
             info->do_continue = 1;
@@ -971,7 +1399,7 @@ static int block_scan_cb(DBT const * key, DBT const * val, void * extra)
  * Scan a bstore's blocks starting at first block greater than or
  * equal to block_num using the given callback and extra paramter.
  * The scan will attempt to prefetch blocks until the 
- * given prefetch block num 
+ * given prefetch block num, unless it's BSTORE_SCAN_NO_PREFETCH.
  */
 int toku_bstore_scan(struct bstore_s * bstore, 
         uint64_t block_num, uint64_t prefetch_block_num,
@@ -980,11 +1408,12 @@ int toku_bstore_scan(struct bstore_s * bstore,
     int r, ret;
     DBT key, prefetch_key;
     DBC * cursor;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_SCAN);
 
     // HACK aggresively fetch so much
     //block_num_end = UINT64_MAX;
 
-    debug_echo("called, start %lu, prefetch until %lu\n", 
+    toku_trace_args(TOKU_FS_OP_BSTORE_SCAN, bstore->name,
             block_num, prefetch_block_num);
     size_t key_buf_len = strlen(bstore->name) + sizeof(uint64_t) + 1;
     char key_buf[key_buf_len];
@@ -993,24 +1422,28 @@ int toku_bstore_scan(struct bstore_s * bstore,
             bstore->name, block_num);
     generate_data_key_dbt(&prefetch_key, prefetch_key_buf, key_buf_len, 
             bstore->name, prefetch_block_num);
+    env_enter();
     ret = data_db->cursor(data_db, NULL, &cursor, 0);
     assert(ret == 0);
 
     // acquire a range lock on the block range we want, so
     // that we maybe benefit from prefetching within the range
+    if (prefetch_block_num != BSTORE_SCAN_NO_PREFETCH) {
 #ifndef USE_BDB
-    ret = cursor->c_set_bounds(cursor, &key, &prefetch_key, true, 0);
+        ret = cursor->c_set_bounds(cursor, &key, &prefetch_key, true, 0);
 #else
-    (void) cursor;
-    ret = ENOSYS;
+        (void) cursor;
+        ret = ENOSYS;
 #endif
-    assert(ret == 0);
+        assert(ret == 0);
+    }
     
     struct block_scan_cb_info info = {
         .cb = cb,
         .start_key = &key,
         .extra = extra,
         .do_continue = 0,
+        .blocks = 0,
     };
     // set the cursor. if we succeed and the callback indicates
     // it wants more blocks, call it again with getf_next
@@ -1045,35 +1478,380 @@ int toku_bstore_scan(struct bstore_s * bstore,
 out:
     r = cursor->c_close(cursor);
     assert(r == 0);
+    env_leave();
     assert(ret == 0 || ret == BSTORE_NOTFOUND);
+    toku_opstats_io(TOKU_FS_OP_BSTORE_SCAN,
+            info.blocks * BSTORE_BLOCKSIZE, info.blocks);
+    toku_opstats_end(TOKU_FS_OP_BSTORE_SCAN, start, 0);
     return ret;
 }
 
+struct scan_names_cb_info {
+    const char * prefix;
+    size_t prefix_len;
+    const char * after;
+    char ** names;
+    int max;
+    int n;
+    int do_continue;
+};
+
+/**
+ * True if a data key belongs to the bstore with the given
+ * name. Data keys are the name without its null byte, then
+ * the block number and the magic byte.
+ */
+static int data_key_has_name(DBT const * key, const char * name, size_t len)
+{
+    return key->size == len + sizeof(uint64_t) + 1 &&
+        memcmp(key->data, name, len) == 0;
+}
+
+/**
+ * Collect each new name under the prefix, skipping the
+ * rest of the blocks of names already seen.
+ */
+static int scan_names_cb(DBT const * key, DBT const * val, void * extra)
+{
+    struct scan_names_cb_info * info = extra;
+    size_t len = key->size - sizeof(uint64_t) - 1;
+    (void) val;
+
+    info->do_continue = 0;
+    if (len < info->prefix_len ||
+            memcmp(key->data, info->prefix, info->prefix_len) != 0) {
+        return 0;
+    }
+    if (info->after != NULL &&
+            data_key_has_name(key, info->after, strlen(info->after))) {
+        info->do_continue = 1;
+        return 0;
+    }
+    if (info->n > 0 && data_key_has_name(key, info->names[info->n - 1],
+                strlen(info->names[info->n - 1]))) {
+        info->do_continue = 1;
+        return 0;
+    }
+    char * name = malloc(len + 1);
+    memcpy(name, key->data, len);
+    name[len] = '\0';
+    info->names[info->n++] = name;
+    info->do_continue = info->n < info->max;
+
+    return 0;
+}
+
+/**
+ * Find the names of up to max bstores that have blocks and
+ * whose names start with prefix. The scan starts at the first
+ * block of after, or at the start of the prefix if after is
+ * NULL, and skips after itself. Names are malloc'd into names.
+ *
+ * Returns the number of names found.
+ */
+int toku_bstore_scan_names(const char * prefix, const char * after,
+        char ** names, int max)
+{
+    int r, ret;
+    DBT key;
+    DBC * cursor;
+    const char * start = after != NULL ? after : prefix;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_BSTORE_SCAN_NAMES);
+
+    size_t key_buf_len = strlen(start) + sizeof(uint64_t) + 1;
+    char key_buf[key_buf_len];
+    generate_data_key_dbt(&key, key_buf, key_buf_len, start, 0);
+    env_enter();
+    ret = data_db->cursor(data_db, NULL, &cursor, 0);
+    assert(ret == 0);
+
+    struct scan_names_cb_info info = {
+        .prefix = prefix,
+        .prefix_len = strlen(prefix),
+        .after = after,
+        .names = names,
+        .max = max,
+        .n = 0,
+        .do_continue = 0,
+    };
+#ifndef USE_BDB
+    ret = cursor->c_getf_set_range(cursor, 0, &key, scan_names_cb, &info);
+#else
+    (void) scan_names_cb;
+    (void) cursor;
+    ret = ENOSYS;
+#endif
+    assert(ret == 0 || ret == DB_NOTFOUND);
+    while (ret == 0 && info.do_continue) {
+#ifndef USE_BDB
+        ret = cursor->c_getf_next(cursor, 0, scan_names_cb, &info);
+#else
+        (void) cursor;
+        ret = ENOSYS;
+#endif
+        assert(ret == 0 || ret == DB_NOTFOUND);
+    }
+
+    r = cursor->c_close(cursor);
+    assert(r == 0);
+    env_leave();
+    toku_opstats_end(TOKU_FS_OP_BSTORE_SCAN_NAMES, op_start, 0);
+    return info.n;
+}
+
 //
 // Metadata operations
 //
 
+#ifndef USE_BDB
+struct meta_get_cb_info {
+    DBT * buf;
+    const char * name;
+    uint64_t version;
+    size_t value_size;
+};
+
+/**
+ * Copy as much of a metadata value as fits into the
+ * buffer described by extra. Metadata values vary in
+ * size, so callers may only want the front of it. The
+ * whole value goes into the metadata cache.
+ */
+static int meta_get_cb(const DBT * key, const DBT * value, void * extra)
+{
+    struct meta_get_cb_info * info = extra;
+    DBT * buf = info->buf;
+    (void) key;
+
+    buf->size = buf->ulen < value->size ? buf->ulen : value->size;
+    memcpy(buf->data, value->data, buf->size);
+    info->value_size = value->size;
+    toku_metacache_put(info->name, value->data, value->size,
+            info->version);
+
+    return 0;
+}
+#endif
+
 /**
  * Get the metadata block for a given bstore by name. 
  * There is exactly one metadata block per bstore. 
- * The provided buffer should have at least size bytes.
+ * The provided buffer should have at least size bytes. Values
+ * bigger than size are truncated to it.
  */
-int toku_bstore_meta_get(const char * name, void * buf, size_t size)
+int toku_bstore_meta_get(const char * name, void * buf, size_t size,
+        size_t * value_size)
 {
     int ret;
+    uint64_t version;
     DBT key, value;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_META_GET);
 
+    if (toku_metacache_get(name, buf, size, value_size, &version)) {
+        toku_opstats_cache(TOKU_FS_OP_BSTORE_META_GET, 1);
+        ret = 0;
+        goto out;
+    }
+    if (meta_cachesize > 0) {
+        toku_opstats_cache(TOKU_FS_OP_BSTORE_META_GET, 0);
+    }
     generate_meta_key_dbt(&key, name);
     dbt_init(&value, buf, size);
+    env_enter();
+#ifdef USE_BDB
+    // a partial get can't fill the cache
+    (void) version;
+    value.flags |= DB_DBT_PARTIAL;
+    value.doff = 0;
+    value.dlen = size;
     ret = meta_db->get(meta_db, NULL, &key, &value, 0);
+    // a partial get only says how much it copied
+    *value_size = value.size;
+#else
+    struct meta_get_cb_info info = {
+        .buf = &value,
+        .name = name,
+        .version = version,
+    };
+    ret = meta_db->getf_set(meta_db, NULL, 0, &key, meta_get_cb, &info);
+    *value_size = info.value_size;
+#endif
+    env_leave();
     assert(ret == 0 || ret == DB_NOTFOUND);
     if (ret == DB_NOTFOUND) {
         ret = BSTORE_NOTFOUND;
     }
 
+out:
+    toku_opstats_end(TOKU_FS_OP_BSTORE_META_GET, start, 0);
     return ret;
 }
 
+/**
+ * Compare two meta keys the way the meta db does.
+ */
+static int meta_keycmp(DBT const * a, DBT const * b)
+{
+    size_t n;
+    int c;
+
+    if (env_keycmp != NULL) {
+        return env_keycmp(meta_db, a, b);
+    }
+    n = a->size < b->size ? a->size : b->size;
+    c = memcmp(a->data, b->data, n);
+    if (c == 0) {
+        c = a->size < b->size ? -1 : a->size > b->size;
+    }
+    return c;
+}
+
+struct meta_sort_entry {
+    DBT key;
+    int index;
+};
+
+static int meta_sort_cmp(const void * a, const void * b)
+{
+    const struct meta_sort_entry * ea = a;
+    const struct meta_sort_entry * eb = b;
+    int c = meta_keycmp(&ea->key, &eb->key);
+
+    return c != 0 ? c : ea->index - eb->index;
+}
+
+/**
+ * Sort the indexes of n names into meta db order.
+ */
+void toku_bstore_meta_sort(const char ** names, int n, int * order)
+{
+    int i;
+    struct meta_sort_entry * entries;
+
+    entries = malloc(n * sizeof(struct meta_sort_entry));
+    for (i = 0; i < n; i++) {
+        generate_meta_key_dbt(&entries[i].key, names[i]);
+        entries[i].index = i;
+    }
+    qsort(entries, n, sizeof(struct meta_sort_entry), meta_sort_cmp);
+    for (i = 0; i < n; i++) {
+        order[i] = entries[i].index;
+    }
+    free(entries);
+}
+
+// how far a batched get steps a cursor toward the next
+// name before it gives up and seeks to it instead
+#define META_MANY_MAX_STEPS 8
+
+/**
+ * The cursor of a batched get remembers the key it's on, so
+ * the next name can be compared to it without touching the db.
+ */
+struct meta_many_cb_info {
+    DBT * target;
+    int index;
+    DBT current;
+    size_t current_len;
+    int cmp;
+    bstore_meta_many_callback_fn cb;
+    void * extra;
+};
+
+#ifndef USE_BDB
+static int meta_many_cb(DBT const * key, DBT const * value, void * extra)
+{
+    struct meta_many_cb_info * info = extra;
+
+    if (key->size > info->current_len) {
+        info->current_len = key->size;
+        info->current.data = realloc(info->current.data, key->size);
+    }
+    memcpy(info->current.data, key->data, key->size);
+    info->current.size = key->size;
+    info->cmp = meta_keycmp(key, info->target);
+    if (info->cmp == 0) {
+        info->cb(info->index, value->data, value->size, info->extra);
+    }
+
+    return 0;
+}
+#endif
+
+/**
+ * Get the values of n names with one cursor. Names come in
+ * sorted order, so a name close after the last one is reached
+ * by stepping the cursor along the leaf it's already on. Only
+ * names further away need another descent of the tree.
+ */
+int toku_bstore_meta_get_many(const char ** names, const int * order,
+        int n, bstore_meta_many_callback_fn cb, void * extra)
+{
+    int r, ret, j, steps, positioned;
+    DBT target;
+    DBC * cursor;
+    struct meta_many_cb_info info;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_META_GET_MANY);
+
+    memset(&info, 0, sizeof(info));
+    info.target = &target;
+    info.cb = cb;
+    info.extra = extra;
+    env_enter();
+    ret = meta_db->cursor(meta_db, NULL, &cursor, 0);
+    assert(ret == 0);
+
+    positioned = 0;
+    for (j = 0; j < n; j++) {
+        generate_meta_key_dbt(&target, names[order[j]]);
+        info.index = order[j];
+        if (positioned) {
+            info.cmp = meta_keycmp(&info.current, &target);
+            if (info.cmp > 0) {
+                // the cursor is already past it, so it's not there
+                continue;
+            }
+            for (steps = 0; info.cmp < 0 &&
+                    steps < META_MANY_MAX_STEPS; steps++) {
+#ifndef USE_BDB
+                ret = cursor->c_getf_next(cursor, 0, meta_many_cb, &info);
+#else
+                ret = ENOSYS;
+#endif
+                assert(ret == 0 || ret == DB_NOTFOUND);
+                if (ret == DB_NOTFOUND) {
+                    // nothing left in the db, so no later name is there
+                    goto out;
+                }
+            }
+            // found, or stepped past it. a repeated name is
+            // found with no steps, and needs a seek for its value.
+            if (steps > 0 && info.cmp >= 0) {
+                continue;
+            }
+        }
+#ifndef USE_BDB
+        ret = cursor->c_getf_set_range(cursor, 0, &target,
+                meta_many_cb, &info);
+#else
+        ret = ENOSYS;
+#endif
+        assert(ret == 0 || ret == DB_NOTFOUND);
+        if (ret == DB_NOTFOUND) {
+            goto out;
+        }
+        positioned = 1;
+    }
+
+out:
+    free(info.current.data);
+    r = cursor->c_close(cursor);
+    assert(r == 0);
+    env_leave();
+    toku_opstats_end(TOKU_FS_OP_BSTORE_META_GET_MANY, start, 0);
+    return 0;
+}
+
 /**
  * Update the metadata using a read-modify-write (slow)
  */
@@ -1084,12 +1862,11 @@ static int bstore_meta_update_rmw(const char * name,
     DBT key, value;
     DBT * oldval;
 
-    // get the old metadata, if it exists.
-    // HACK HACK HACK we're not really supposed to know that
-    // struct metadata is == struct stat
-    char meta_buf[sizeof(struct stat)];
+    // get the old metadata, if it exists. metadata values
+    // vary in size, so let the db allocate the buffer.
     generate_meta_key_dbt(&key, name);
-    dbt_init(&value, &meta_buf, sizeof(meta_buf));
+    memset(&value, 0, sizeof(DBT));
+    value.flags = DB_DBT_MALLOC;
     ret = meta_db->get(meta_db, NULL, &key, &value, 0);
     assert(ret == 0 || ret == DB_NOTFOUND);
     oldval = ret == 0 ? &value : NULL;
@@ -1106,6 +1883,7 @@ static int bstore_meta_update_rmw(const char * name,
     ret = env_update_cb(meta_db, &key, oldval, &extra_dbt, 
             set_val_emulator, &set_val_info);
     assert(ret == 0);
+    free(value.data);
     return ret;
 }
 
@@ -1117,19 +1895,28 @@ static int bstore_meta_update_rmw(const char * name,
 int toku_bstore_meta_update(const char * name,
         const void * extra, size_t extra_size)
 {
+    int ret;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_META_UPDATE);
+
+    env_enter();
 #ifdef USE_BDB
-    return bstore_meta_update_rmw(name, extra, extra_size);
+    ret = bstore_meta_update_rmw(name, extra, extra_size);
 #else
-    int ret;
     DBT key, extra_dbt;
 
     generate_meta_key_dbt(&key, name);
     dbt_init(&extra_dbt, extra, extra_size);
     ret = meta_db->update(meta_db, NULL, &key, &extra_dbt, 0);
     assert(ret == 0);
+    toku_opstats_upserts(TOKU_FS_OP_BSTORE_META_UPDATE, 1);
+#endif
+    // only after the engine has it, see metacache.h
+    toku_metacache_invalidate(name);
+    env_leave();
+    STATS_INC(meta_messages, 1);
+    toku_opstats_end(TOKU_FS_OP_BSTORE_META_UPDATE, start, 0);
 
     return ret;
-#endif
 }
 
 struct meta_scan_cb_info {
@@ -1149,7 +1936,7 @@ static int meta_scan_cb(DBT const * key, DBT const * val, void * extra)
     struct meta_scan_cb_info * info = extra;
 
     info->do_continue = 0;
-    ret = info->cb(key->data, val->data, info->extra);
+    ret = info->cb(key->data, val->data, val->size, info->extra);
     if (ret == BSTORE_SCAN_CONTINUE) {
         ret = TOKUDB_CURSOR_CONTINUE_NEW;
         info->do_continue = 1;
@@ -1169,8 +1956,10 @@ int toku_bstore_meta_scan(const char * name,
     int r, ret;
     DBT key;
     DBC * cursor;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_META_SCAN);
 
     generate_meta_key_dbt(&key, name);
+    env_enter();
     ret = meta_db->cursor(meta_db, NULL, &cursor, 0);
     assert(ret == 0);
     
@@ -1210,6 +1999,8 @@ int toku_bstore_meta_scan(const char * name,
 out:
     r = cursor->c_close(cursor);
     assert(r == 0);
+    env_leave();
+    toku_opstats_end(TOKU_FS_OP_BSTORE_META_SCAN, start, 0);
     return ret;
 }
 
@@ -1229,6 +2020,7 @@ int toku_bstore_meta_dump(void)
     int ret;
     DBC * cursor;
 
+    env_enter();
     ret = meta_db->cursor(meta_db, NULL, &cursor, 0);
     assert(ret == 0);
 
@@ -1241,6 +2033,367 @@ int toku_bstore_meta_dump(void)
         ret = ENOSYS;
 #endif
     } while (ret == 0);
+    env_leave();
+
+    return 0;
+}
+
+//
+// Reclaim queue operations
+//
+
+/**
+ * Remember that name has blocks left to reclaim.
+ */
+int toku_bstore_reclaim_put(const char * name)
+{
+    int ret;
+    DBT key, value;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_RECLAIM_PUT);
+
+    generate_meta_key_dbt(&key, name);
+    dbt_init(&value, NULL, 0);
+    env_enter();
+    ret = reclaim_db->put(reclaim_db, NULL, &key, &value, 0);
+    env_leave();
+    assert(ret == 0);
+    toku_opstats_end(TOKU_FS_OP_BSTORE_RECLAIM_PUT, start, 0);
+
+    return ret;
+}
+
+/**
+ * Forget name once its blocks are reclaimed.
+ */
+int toku_bstore_reclaim_delete(const char * name)
+{
+    int ret;
+    DBT key;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_RECLAIM_DELETE);
+
+    generate_meta_key_dbt(&key, name);
+    env_enter();
+    ret = db_del_current(reclaim_db, &key);
+    env_leave();
+    assert(ret == 0 || ret == DB_NOTFOUND);
+    toku_opstats_end(TOKU_FS_OP_BSTORE_RECLAIM_DELETE, start, 0);
+
+    return 0;
+}
+
+struct reclaim_scan_cb_info {
+    bstore_reclaim_scan_callback_fn cb;
+    void * extra;
+};
+
+static int reclaim_scan_cb(DBT const * key, DBT const * value, void * extra)
+{
+    struct reclaim_scan_cb_info * info = extra;
+    (void) value;
+
+    info->cb(key->data, info->extra);
+
+    return 0;
+}
+
+/**
+ * Hand every name on the reclaim queue to the callback.
+ */
+int toku_bstore_reclaim_scan(bstore_reclaim_scan_callback_fn cb,
+        void * extra)
+{
+    int r, ret;
+    DBC * cursor;
+    struct reclaim_scan_cb_info info;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_RECLAIM_SCAN);
+
+    info.cb = cb;
+    info.extra = extra;
+    env_enter();
+    ret = reclaim_db->cursor(reclaim_db, NULL, &cursor, 0);
+    assert(ret == 0);
+
+    // getf_next on a fresh cursor starts at the first pair
+    do {
+#ifndef USE_BDB
+        ret = cursor->c_getf_next(cursor, 0, reclaim_scan_cb, &info);
+#else
+        (void) reclaim_scan_cb;
+        (void) cursor;
+        ret = DB_NOTFOUND;
+#endif
+        assert(ret == 0 || ret == DB_NOTFOUND);
+    } while (ret == 0);
+
+    r = cursor->c_close(cursor);
+    assert(r == 0);
+    env_leave();
+    toku_opstats_end(TOKU_FS_OP_BSTORE_RECLAIM_SCAN, start, 0);
+    return 0;
+}
+
+//
+// Maintenance operations
+//
+
+struct hot_optimize_cb_info {
+    bstore_progress_fn cb;
+    void * extra;
+};
+
+#ifndef USE_BDB
+static int hot_optimize_cb(void * extra, float progress)
+{
+    struct hot_optimize_cb_info * info = extra;
+
+    // give way to a resize, the caller can start over after
+    if (__sync_fetch_and_add(&env_resizing, 0)) {
+        return -EAGAIN;
+    }
+    return info->cb(progress, info->extra);
+}
+#endif
+
+/**
+ * Hot optimize *db, which is only looked at once the env lock
+ * is held, since a resize opens the dbs again.
+ */
+static int hot_optimize(DB ** db, DBT * left, DBT * right,
+        bstore_progress_fn cb, void * extra)
+{
+    int ret;
+    uint64_t start = toku_opstats_begin(TOKU_FS_OP_BSTORE_HOT_OPTIMIZE);
+    struct hot_optimize_cb_info info = {
+        .cb = cb,
+        .extra = extra,
+    };
+
+#ifndef USE_BDB
+    env_enter();
+    ret = (*db)->hot_optimize(*db, left, right, hot_optimize_cb, &info);
+    env_leave();
+#else
+    // bdb has nothing buffered to flush
+    (void) db; (void) left; (void) right; (void) info;
+    ret = 0;
+#endif
+    toku_opstats_end(TOKU_FS_OP_BSTORE_HOT_OPTIMIZE, start, 0);
+
+    return ret;
+}
+
+/**
+ * Optimize the blocks of every name from first to last, or the
+ * whole data db if they're NULL.
+ */
+int toku_bstore_hot_optimize_data(const char * first, const char * last,
+        bstore_progress_fn cb, void * extra)
+{
+    int ret;
+    DBT left, right;
+
+    if (first == NULL || last == NULL) {
+        return hot_optimize(&data_db, NULL, NULL, cb, extra);
+    }
+    toku_trace(TOKU_TRACE_IO, TOKU_TRACE_OPTIMIZE_RANGE, first,
+            toku_trace_path_hash(last), 0);
+    size_t left_buf_len = strlen(first) + sizeof(uint64_t) + 1;
+    size_t right_buf_len = strlen(last) + sizeof(uint64_t) + 1;
+    char left_buf[left_buf_len];
+    char right_buf[right_buf_len];
+    generate_data_key_dbt(&left, left_buf, left_buf_len, first, 0);
+    generate_data_key_dbt(&right, right_buf, right_buf_len,
+            last, UINT64_MAX);
+    ret = hot_optimize(&data_db, &left, &right, cb, extra);
+
+    return ret;
+}
+
+int toku_bstore_hot_optimize_meta(bstore_progress_fn cb, void * extra)
+{
+    return hot_optimize(&meta_db, NULL, NULL, cb, extra);
+}
+
+//
+// Statistics
+//
+
+/**
+ * The value of a numeric status row. Returns -1 for rows that
+ * aren't counters, like strings and dates.
+ */
+#ifndef USE_BDB
+static int status_row_value(const TOKU_ENGINE_STATUS_ROW_S * row,
+        uint64_t * value)
+{
+    switch (row->type) {
+        case UINT64:
+        case TOKUTIME:
+            *value = row->value.num;
+            return 0;
+        case PARCOUNT:
+            *value = read_partitioned_counter(row->value.parcount);
+            return 0;
+        case DOUBLE:
+            *value = row->value.dnum;
+            return 0;
+        default:
+            return -1;
+    }
+}
+#endif
+
+/**
+ * Call fn on every numeric row of the engine's status. The env
+ * must be open and entered. Engines without a status have no rows.
+ */
+static void env_status_rows(bstore_status_row_fn fn, void * extra)
+{
+#ifndef USE_BDB
+    int ret;
+    uint64_t i, max_rows, num_rows, panic, value;
+    fs_redzone_state redzone;
+    char panic_string[256];
+    TOKU_ENGINE_STATUS_ROW rows;
+
+    ret = db_env->get_engine_status_num_rows(db_env, &max_rows);
+    assert(ret == 0);
+    rows = malloc(max_rows * sizeof(TOKU_ENGINE_STATUS_ROW_S));
+    ret = db_env->get_engine_status(db_env, rows, max_rows, &num_rows,
+            &redzone, &panic, panic_string, sizeof(panic_string),
+            TOKU_ENGINE_STATUS);
+    assert(ret == 0);
+    for (i = 0; i < num_rows; i++) {
+        if (status_row_value(&rows[i], &value) == 0) {
+            fn(rows[i].keyname, rows[i].legend, value, extra);
+        }
+    }
+    free(rows);
+#else
+    (void) fn;
+    (void) extra;
+#endif
+}
+
+struct cache_status {
+    uint64_t * hits;
+    uint64_t * misses;
+};
+
+static void cache_status_row(const char * key, const char * legend,
+        uint64_t value, void * extra)
+{
+    struct cache_status * status = extra;
+    (void) legend;
+
+    if (strcmp(key, "CT_HIT") == 0) {
+        *status->hits = value;
+    } else if (strcmp(key, "CT_MISS") == 0) {
+        *status->misses = value;
+    }
+}
+
+/**
+ * Get the engine cache's hit and miss counts from its status.
+ * Engines that don't keep them report zero.
+ */
+static void env_get_cache_status(uint64_t * hits, uint64_t * misses)
+{
+    struct cache_status status = { hits, misses };
+
+    env_status_rows(cache_status_row, &status);
+}
+
+/**
+ * Get a snapshot of the bstore counters.
+ */
+void toku_bstore_get_stats(struct bstore_stats * stats)
+{
+    struct metacache_stats meta_stats;
+
+    toku_metacache_get_stats(&meta_stats);
+    stats->meta_cache_hits = meta_stats.hits;
+    stats->meta_cache_misses = meta_stats.misses;
+    stats->cache_hits = 0;
+    stats->cache_misses = 0;
+    env_enter();
+    if (db_env != NULL) {
+        env_get_cache_status(&stats->cache_hits, &stats->cache_misses);
+    }
+    env_leave();
+    stats->zero_blocks_elided =
+        __sync_fetch_and_add(&bstore_stats.zero_blocks_elided, 0);
+    stats->zero_bytes_elided =
+        __sync_fetch_and_add(&bstore_stats.zero_bytes_elided, 0);
+    stats->block_buffer_allocs =
+        __sync_fetch_and_add(&bstore_stats.block_buffer_allocs, 0);
+    stats->update_callback_allocs =
+        __sync_fetch_and_add(&bstore_stats.update_callback_allocs, 0);
+    stats->data_messages =
+        __sync_fetch_and_add(&bstore_stats.data_messages, 0);
+    stats->meta_messages =
+        __sync_fetch_and_add(&bstore_stats.meta_messages, 0);
+}
+
+void toku_bstore_get_messages(uint64_t * meta_messages,
+        uint64_t * data_messages)
+{
+    *meta_messages = __sync_fetch_and_add(&bstore_stats.meta_messages, 0);
+    *data_messages = __sync_fetch_and_add(&bstore_stats.data_messages, 0);
+}
+
+/**
+ * Get the space used by the dictionaries.
+ */
+int toku_bstore_env_get_space(struct bstore_space * space)
+{
+    struct bstore_space data, meta;
+
+    toku_bstore_env_get_dict_space(&data, &meta);
+    space->logical_bytes = data.logical_bytes + meta.logical_bytes;
+    space->disk_bytes = data.disk_bytes + meta.disk_bytes;
+
+    return 0;
+}
+
+/**
+ * Get the space used by each dictionary.
+ */
+int toku_bstore_env_get_dict_space(struct bstore_space * data,
+        struct bstore_space * meta)
+{
+    memset(data, 0, sizeof(struct bstore_space));
+    memset(meta, 0, sizeof(struct bstore_space));
+#ifndef USE_BDB
+    int ret;
+    DB_BTREE_STAT64 st;
+
+    env_enter();
+    DB * dbs[] = { data_db, meta_db };
+    struct bstore_space * spaces[] = { data, meta };
+    for (size_t i = 0; i < sizeof(dbs) / sizeof(DB *); i++) {
+        assert(dbs[i] != NULL);
+        ret = dbs[i]->stat64(dbs[i], NULL, &st);
+        assert(ret == 0);
+        spaces[i]->logical_bytes = st.bt_dsize;
+        spaces[i]->disk_bytes = st.bt_fsize;
+    }
+    env_leave();
+#endif
+
+    return 0;
+}
+
+/**
+ * Call fn on every numeric row of the engine's status.
+ */
+int toku_bstore_env_get_status(bstore_status_row_fn fn, void * extra)
+{
+    env_enter();
+    if (db_env != NULL) {
+        env_status_rows(fn, extra);
+    }
+    env_leave();
 
     return 0;
 }
@@ -1258,14 +2411,84 @@ size_t toku_bstore_env_get_cachesize(void)
 }
 
 /**
- * Set the cache size. Must be set before the env is open.
+ * Set the cache size. The engine only takes a cache size when its
+ * env is opened, so an open env is closed and opened again at the
+ * new size, with every operation held off until it's done. Closing
+ * writes back and drops everything the engine cached, which is how
+ * a smaller cache gives its memory back. The metadata cache keeps
+ * its share and its contents. Returns -EINVAL if an open env would
+ * be left nothing past the metadata's share.
  */
 int toku_bstore_env_set_cachesize(size_t size)
 {
-    assert(db_env == NULL);
+    int ret = 0;
 
+    if (db_env == NULL) {
+        db_cachesize = size;
+        goto out;
+    }
+    if (size <= meta_cachesize) {
+        ret = -EINVAL;
+        goto out;
+    }
+    // an operation resizing from the inside would wait on itself
+    assert(env_lock_depth == 0);
+
+    pthread_mutex_lock(&env_resize_lock);
+    env_resizing++;
+    pthread_mutex_unlock(&env_resize_lock);
+    pthread_rwlock_wrlock(&env_lock);
+    toku_trace(TOKU_TRACE_OPS, TOKU_TRACE_CACHE_RESIZE, NULL,
+            db_cachesize, size);
+    ret = env_close_databases();
+    assert(ret == 0);
+    ret = env_close();
+    assert(ret == 0);
     db_cachesize = size;
+    ret = env_open(env_path);
+    assert(ret == 0);
+    ret = env_open_databases();
+    assert(ret == 0);
+    pthread_rwlock_unlock(&env_lock);
+    pthread_mutex_lock(&env_resize_lock);
+    env_resizing--;
+    pthread_cond_broadcast(&env_resize_cond);
+    pthread_mutex_unlock(&env_resize_lock);
+
+out:
+    return ret;
+}
+
+/**
+ * Set how much of the cache is kept for metadata alone, see
+ * metacache.h. Must be set before the env is open, and be
+ * less than the whole cache.
+ */
+size_t toku_bstore_env_get_meta_cachesize(void)
+{
+    return meta_cachesize;
+}
+
+int toku_bstore_env_set_meta_cachesize(size_t size)
+{
+    assert(db_env == NULL);
+
+    meta_cachesize = size;
 
     return 0;
 }
 
+/**
+ * Set the data and meta db parameters. Must be set before
+ * the env is open.
+ */
+int toku_bstore_env_set_db_params(const struct bstore_db_params * data,
+        const struct bstore_db_params * meta)
+{
+    assert(db_env == NULL);
+
+    data_db_params = *data;
+    meta_db_params = *meta;
+
+    return 0;
+}
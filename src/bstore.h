@@ -32,6 +32,30 @@ struct bstore_s
     size_t name_len;
 };
 
+/**
+ * Compression methods a database can use. The bstore maps these
+ * to whatever the underlying engine calls them.
+ */
+#define BSTORE_COMPRESSION_DEFAULT 0
+#define BSTORE_COMPRESSION_NONE 1
+#define BSTORE_COMPRESSION_QUICKLZ 2
+#define BSTORE_COMPRESSION_ZLIB 3
+#define BSTORE_COMPRESSION_LZMA 4
+#define BSTORE_COMPRESSION_FAST 5
+#define BSTORE_COMPRESSION_SMALL 6
+
+/**
+ * Engine parameters for one of the data or meta databases.
+ * Zero means don't touch that parameter.
+ */
+struct bstore_db_params
+{
+    uint32_t nodesize;
+    uint32_t basementsize;
+    unsigned int fanout;
+    int compression;
+};
+
 /**
  * Comparison type for database keys. Both metadata and file block
  * keys are compared this way.
@@ -80,7 +104,7 @@ typedef int (*bstore_update_callback_fn)(const DBT * oldval,
 typedef int (*bstore_scan_callback_fn)(const char * name,
         uint64_t block_num, void * block, void * extra);
 typedef int (*bstore_meta_scan_callback_fn)(const char * name,
-        void * meta, void * extra);
+        void * meta, size_t meta_size, void * extra);
 
 #define BSTORE_SCAN_CONTINUE 1
 
@@ -132,22 +156,37 @@ int toku_bstore_get(struct bstore_s * bstore, uint64_t block_num, void * buf);
 
 /**
  * Put a block into the store, whose contents are the first
- * BSTORE_BLOCKSIZE bytes from buf. 
+ * BSTORE_BLOCKSIZE bytes from buf. A block of all zeros is
+ * deleted instead of stored, since missing blocks read as zeros.
  */
 int toku_bstore_put(struct bstore_s * bstore, 
         uint64_t block_num, const void * buf);
 
+/**
+ * Put size bytes from buf into consecutive blocks starting at
+ * block_num, as if by toku_bstore_put, zero padding the last.
+ */
+int toku_bstore_put_blocks(struct bstore_s * bstore, uint64_t block_num,
+        const void * buf, size_t size);
+
+/**
+ * Delete a block from the store, if it exists.
+ */
+int toku_bstore_delete(struct bstore_s * bstore, uint64_t block_num);
+
 /**
  * Update a block in the bstore. The update takes buf and copies size
  * bytes into the affected block, starting at the given offset. The
- * other bytes are unchanged.
+ * other bytes are unchanged. If the block ends up all zeros, it
+ * is deleted.
  */
 int toku_bstore_update(struct bstore_s * bstore, uint64_t block_num, 
         const void * buf, size_t size, size_t offset);
 
 /**
  * Truncate a bstore, deleting any blocks greater than 
- * or equal to the given block number
+ * or equal to the given block number. Returns the number
+ * of blocks deleted.
  */
 int toku_bstore_truncate(struct bstore_s * bstore, uint64_t block_num);
 
@@ -155,12 +194,26 @@ int toku_bstore_truncate(struct bstore_s * bstore, uint64_t block_num);
  * Scan a bstore's blocks starting at first block greater than or
  * equal to block_num using the given callback and extra paramter.
  * The scan will attempt to prefetch blocks until the 
- * given prefetch block num 
+ * given prefetch block num, or not at all if it's
+ * BSTORE_SCAN_NO_PREFETCH.
  */
+#define BSTORE_SCAN_NO_PREFETCH UINT64_MAX
+
 int toku_bstore_scan(struct bstore_s * bstore, 
         uint64_t block_num, uint64_t prefetch_block_num,
         bstore_scan_callback_fn cb, void * extra);
 
+/**
+ * Find the names of up to max bstores that have blocks and
+ * whose names start with prefix, in order. The scan starts
+ * just past the bstore named after, or at the beginning of
+ * the prefix if after is NULL. Names are malloc'd into names.
+ *
+ * Returns the number of names found.
+ */
+int toku_bstore_scan_names(const char * prefix, const char * after,
+        char ** names, int max);
+
 //
 // Metadata operations
 //
@@ -168,9 +221,31 @@ int toku_bstore_scan(struct bstore_s * bstore,
 /**
  * Get the metadata block for a given bstore by name. 
  * There is exactly one metadata block per bstore. 
- * The provided buffer should have at least size bytes.
+ * The provided buffer should have at least size bytes. Values
+ * bigger than that are cut short, but value_size is set to the
+ * size of the whole value either way.
+ */
+int toku_bstore_meta_get(const char * name, void * buf, size_t size,
+        size_t * value_size);
+
+/**
+ * Sort the indexes of n names into the order of the meta db,
+ * so batched operations walk it front to back. Equal names
+ * keep the order they were given in.
+ */
+void toku_bstore_meta_sort(const char ** names, int n, int * order);
+
+typedef void (*bstore_meta_many_callback_fn)(int index,
+        const void * value, size_t size, void * extra);
+
+/**
+ * Get the metadata of n names in one pass of a cursor. order
+ * comes from toku_bstore_meta_sort. The callback gets the index
+ * and value of each name that exists, in sorted order. Names
+ * that don't exist are skipped.
  */
-int toku_bstore_meta_get(const char * name, void * buf, size_t size);
+int toku_bstore_meta_get_many(const char ** names, const int * order,
+        int n, bstore_meta_many_callback_fn cb, void * extra);
 
 /**
  * Update the metadata for a given bstore by name. 
@@ -193,15 +268,160 @@ int toku_bstore_meta_scan(const char * name,
  */
 int toku_bstore_meta_dump(void);
 
+//
+// Reclaim queue operations
+//
+
+/**
+ * Names whose blocks still have to be reclaimed are kept in
+ * their own dictionary, so reclaiming carries on after a remount.
+ */
+typedef void (*bstore_reclaim_scan_callback_fn)(const char * name,
+        void * extra);
+
+int toku_bstore_reclaim_put(const char * name);
+
+int toku_bstore_reclaim_delete(const char * name);
+
+int toku_bstore_reclaim_scan(bstore_reclaim_scan_callback_fn cb,
+        void * extra);
+
+//
+// Maintenance operations
+//
+
+/**
+ * Hot optimize flushes the messages buffered in a dictionary
+ * down to its leaves, while everyone else keeps using it. The
+ * progress function is called every so often with the fraction
+ * done, and stops the optimize early by returning nonzero.
+ *
+ * Returns 0 once it's done, nonzero if it was stopped.
+ */
+typedef int (*bstore_progress_fn)(float progress, void * extra);
+
+/**
+ * Optimize the blocks of every name from first to last. Both
+ * NULL means the whole data db.
+ */
+int toku_bstore_hot_optimize_data(const char * first, const char * last,
+        bstore_progress_fn cb, void * extra);
+
+int toku_bstore_hot_optimize_meta(bstore_progress_fn cb, void * extra);
+
+//
+// Statistics
+//
+
+/**
+ * Counters kept by the bstore since the process started.
+ *
+ * zero_blocks_elided - all zero blocks that were deleted or never
+ *                      stored instead of being written out. Updates
+ *                      are counted when the engine applies them,
+ *                      which may be more than once per update.
+ * zero_bytes_elided  - the zeros written to those blocks, which is
+ *                      less than a block when a write only covered
+ *                      part of one.
+ * block_buffer_allocs - block buffers allocated for per-thread pools.
+ *                       Flat once every writing thread is warm.
+ * update_callback_allocs - values an update callback had to allocate
+ *                          because they outgrew the old value.
+ * data_messages, meta_messages - puts, deletes and updates sent
+ *                          to each db. Each one is a message the
+ *                          engine may buffer until it's flushed.
+ * cache_hits, cache_misses - lookups in the engine's cache, which
+ *                          data and metadata share.
+ * meta_cache_hits, meta_cache_misses - metadata gets answered by
+ *                          the metadata cache, or not. Zero when
+ *                          there is no metadata cache.
+ */
+struct bstore_stats
+{
+    uint64_t zero_blocks_elided;
+    uint64_t zero_bytes_elided;
+    uint64_t block_buffer_allocs;
+    uint64_t update_callback_allocs;
+    uint64_t data_messages;
+    uint64_t meta_messages;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t meta_cache_hits;
+    uint64_t meta_cache_misses;
+};
+
+void toku_bstore_get_stats(struct bstore_stats * stats);
+
+/**
+ * Just the message counts of toku_bstore_get_stats, which doesn't
+ * ask the engine for anything.
+ */
+void toku_bstore_get_messages(uint64_t * meta_messages,
+        uint64_t * data_messages);
+
+/**
+ * Space used by the data and meta dictionaries.
+ *
+ * logical_bytes - key and value bytes stored, before compression.
+ * disk_bytes    - size of the dictionary files, after compression.
+ */
+struct bstore_space
+{
+    uint64_t logical_bytes;
+    uint64_t disk_bytes;
+};
+
+/**
+ * Get the space used by the dictionaries. The engine keeps
+ * these estimates up to date in memory, so this never scans.
+ */
+int toku_bstore_env_get_space(struct bstore_space * space);
+
+/**
+ * The same, for the data and meta dictionaries on their own.
+ */
+int toku_bstore_env_get_dict_space(struct bstore_space * data,
+        struct bstore_space * meta);
+
+/**
+ * A row of the engine's status: its key, what it means and its
+ * value. Only rows with a numeric value are passed on.
+ */
+typedef void (*bstore_status_row_fn)(const char * key,
+        const char * legend, uint64_t value, void * extra);
+
+/**
+ * Call fn on every numeric row of the engine's status, in the
+ * engine's order. Counters start over when the env is opened.
+ */
+int toku_bstore_env_get_status(bstore_status_row_fn fn, void * extra);
+
 //
 // Hints and parameters.
 //
 
 /**
- * Get or set the cache size used by the bstore environment
+ * Get or set the cache size used by the bstore environment. It
+ * can be set while the env is open, which empties the cache and
+ * waits for operations in progress, see bstore.c.
  */
 size_t toku_bstore_env_get_cachesize(void);
 
 int toku_bstore_env_set_cachesize(size_t cachesize);
 
+/**
+ * Get or set how much of the cache is kept for metadata alone.
+ * 0, the default, means metadata shares the engine's cache.
+ */
+size_t toku_bstore_env_get_meta_cachesize(void);
+
+int toku_bstore_env_set_meta_cachesize(size_t cachesize);
+
+/**
+ * Set the engine parameters for the data and meta databases.
+ * Must be set before the env is open.
+ */
+int toku_bstore_env_set_db_params(const struct bstore_db_params * data,
+        const struct bstore_db_params * meta);
+
 #endif /* TOKU_BSTORE_H */
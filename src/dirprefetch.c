@@ -0,0 +1,235 @@
+/**
+ * TokuFS
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <toku/str.h>
+
+#include "bstore.h"
+#include "dirprefetch.h"
+#include "trace.h"
+
+// opens in name order before the siblings after them are swept
+#define DIRPREFETCH_STREAK 3
+
+// directories followed at once
+#define DIRPREFETCH_DIRS 16
+
+// sweeps running at once. more are dropped.
+#define DIRPREFETCH_SWEEPS 4
+
+/**
+ * The opens of one directory: the last child opened, and how
+ * many opens in a row went in name order.
+ */
+struct dir_stream {
+    char * dir;
+    char * last;
+    uint64_t streak;
+    uint64_t used;
+};
+
+struct sweep {
+    char * dir;
+    char * after;
+    size_t ahead;
+};
+
+static pthread_mutex_t dirprefetch_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct workpool * dirprefetch_pool;
+static struct workpool_batch dirprefetch_batch;
+static size_t dirprefetch_ahead;
+static struct dir_stream streams[DIRPREFETCH_DIRS];
+static uint64_t streams_clock;
+static int sweeps_running;
+static struct dirprefetch_stats dirprefetch_stats;
+
+struct meta_sweep_info {
+    const char * dir;
+    size_t dir_len;
+    const char * after;
+    size_t ahead;
+    size_t n;
+};
+
+/**
+ * Go over siblings until the keys leave the directory, either
+ * for another directory or for a level further down.
+ */
+static int meta_sweep_cb(const char * name, void * meta,
+        size_t meta_size, void * extra)
+{
+    struct meta_sweep_info * info = extra;
+    (void) meta; (void) meta_size;
+
+    if (strncmp(name, info->dir, info->dir_len) != 0 ||
+            strchr(name + info->dir_len, '/') != NULL) {
+        return 0;
+    }
+    if (strcmp(name, info->after) != 0) {
+        info->n++;
+    }
+    return info->n < info->ahead ? BSTORE_SCAN_CONTINUE : 0;
+}
+
+static void sweep_task(void * arg)
+{
+    int i, ret, n;
+    struct sweep * sweep = arg;
+    struct meta_sweep_info info;
+    char ** names;
+
+    info.dir = sweep->dir;
+    info.dir_len = strlen(sweep->dir);
+    info.after = sweep->after;
+    info.ahead = sweep->ahead;
+    info.n = 0;
+    ret = toku_bstore_meta_scan(sweep->after, meta_sweep_cb, &info);
+    assert(ret == 0 || ret == BSTORE_NOTFOUND);
+
+    // the names' blocks come in with them. one more name than
+    // ahead, since the scan stops at the first block of the last.
+    names = malloc((sweep->ahead + 1) * sizeof(char *));
+    n = toku_bstore_scan_names(sweep->dir, sweep->after, names,
+            sweep->ahead + 1);
+    for (i = 0; i < n; i++) {
+        free(names[i]);
+    }
+    free(names);
+    toku_trace(TOKU_TRACE_IO, TOKU_TRACE_DIR_PREFETCH, sweep->after,
+            info.n, n);
+
+    pthread_mutex_lock(&dirprefetch_lock);
+    sweeps_running--;
+    dirprefetch_stats.files += info.n;
+    pthread_mutex_unlock(&dirprefetch_lock);
+    free(sweep->dir);
+    free(sweep->after);
+    free(sweep);
+}
+
+/**
+ * Find the stream of the directory that's the first dir_len
+ * bytes of path, or take over the one used longest ago.
+ * Returns NULL if the directory is new.
+ */
+static struct dir_stream * get_stream(const char * path, size_t dir_len)
+{
+    int i;
+    struct dir_stream * s, * oldest = &streams[0];
+
+    for (i = 0; i < DIRPREFETCH_DIRS; i++) {
+        s = &streams[i];
+        if (s->dir != NULL && strlen(s->dir) == dir_len &&
+                strncmp(s->dir, path, dir_len) == 0) {
+            s->used = ++streams_clock;
+            return s;
+        }
+        if (s->used < oldest->used) {
+            oldest = s;
+        }
+    }
+    free(oldest->dir);
+    free(oldest->last);
+    oldest->dir = malloc(dir_len + 1);
+    memcpy(oldest->dir, path, dir_len);
+    oldest->dir[dir_len] = '\0';
+    oldest->last = toku_strdup(path);
+    oldest->streak = 1;
+    oldest->used = ++streams_clock;
+
+    return NULL;
+}
+
+void toku_dirprefetch_note_open(const char * path)
+{
+    int cmp;
+    size_t dir_len;
+    uint64_t every;
+    const char * slash = strrchr(path, '/');
+    struct dir_stream * s;
+    struct sweep * sweep;
+
+    if (slash == NULL) {
+        return;
+    }
+    dir_len = slash - path + 1;
+
+    pthread_mutex_lock(&dirprefetch_lock);
+    if (dirprefetch_ahead == 0) {
+        goto out;
+    }
+    every = dirprefetch_ahead / 2 > 0 ? dirprefetch_ahead / 2 : 1;
+    s = get_stream(path, dir_len);
+    if (s == NULL || (cmp = strcmp(path, s->last)) == 0) {
+        goto out;
+    }
+    s->streak = cmp > 0 ? s->streak + 1 : 1;
+    free(s->last);
+    s->last = toku_strdup(path);
+    if (s->streak < DIRPREFETCH_STREAK ||
+            (s->streak - DIRPREFETCH_STREAK) % every != 0) {
+        goto out;
+    }
+    if (sweeps_running == DIRPREFETCH_SWEEPS) {
+        dirprefetch_stats.dropped++;
+        goto out;
+    }
+    sweeps_running++;
+    dirprefetch_stats.sweeps++;
+    sweep = malloc(sizeof(struct sweep));
+    sweep->dir = toku_strdup(s->dir);
+    sweep->after = toku_strdup(path);
+    sweep->ahead = dirprefetch_ahead;
+    // still under the lock, so stop can't wait on the batch before
+    // the sweep is in it. only a worker runs it, never this thread.
+    toku_workpool_submit_worker(dirprefetch_pool, &dirprefetch_batch,
+            sweep_task, sweep);
+out:
+    pthread_mutex_unlock(&dirprefetch_lock);
+}
+
+void toku_dirprefetch_start(struct workpool * pool, size_t ahead)
+{
+    pthread_mutex_lock(&dirprefetch_lock);
+    dirprefetch_pool = pool;
+    dirprefetch_ahead = ahead;
+    toku_workpool_batch_init(&dirprefetch_batch);
+    pthread_mutex_unlock(&dirprefetch_lock);
+}
+
+void toku_dirprefetch_stop(void)
+{
+    int i;
+
+    // no sweep is submitted once ahead is 0, so none can be added
+    // to the batch while it's waited on
+    pthread_mutex_lock(&dirprefetch_lock);
+    dirprefetch_ahead = 0;
+    pthread_mutex_unlock(&dirprefetch_lock);
+    toku_workpool_wait(dirprefetch_pool, &dirprefetch_batch);
+    toku_workpool_batch_destroy(&dirprefetch_batch);
+
+    pthread_mutex_lock(&dirprefetch_lock);
+    dirprefetch_pool = NULL;
+    for (i = 0; i < DIRPREFETCH_DIRS; i++) {
+        free(streams[i].dir);
+        free(streams[i].last);
+        memset(&streams[i], 0, sizeof(struct dir_stream));
+    }
+    pthread_mutex_unlock(&dirprefetch_lock);
+}
+
+void toku_dirprefetch_get_stats(struct dirprefetch_stats * stats)
+{
+    pthread_mutex_lock(&dirprefetch_lock);
+    *stats = dirprefetch_stats;
+    pthread_mutex_unlock(&dirprefetch_lock);
+}
@@ -0,0 +1,53 @@
+/**
+ * TokuFS
+ */
+
+#ifndef TOKU_DIRPREFETCH_H
+#define TOKU_DIRPREFETCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "workpool.h"
+
+/**
+ * The files of a directory sit next to each other in both
+ * dictionaries. Metadata is in level order, so a directory's
+ * children are one run of keys, and data is in depth first order,
+ * so their blocks are one run too, along with whatever is under
+ * the subdirectories among them. Programs like tar, rsync and
+ * training data loaders open every file of a directory in order.
+ *
+ * Once a few opens in a directory went in name order, the next
+ * ahead siblings are swept into the cache with one cursor over
+ * each dictionary, as a task for the pool's workers, and again
+ * every ahead / 2 opens while the order holds. The thread that
+ * opened never runs a sweep itself. An ahead of 0 turns it off.
+ */
+void toku_dirprefetch_start(struct workpool * pool, size_t ahead);
+
+/**
+ * Stop following opens, once the sweeps already started are done.
+ */
+void toku_dirprefetch_stop(void);
+
+/**
+ * Note that path was opened.
+ */
+void toku_dirprefetch_note_open(const char * path);
+
+/**
+ * sweeps  - sweeps that ran ahead of a directory's opens.
+ * dropped - sweeps not started because too many were running.
+ * files   - siblings whose metadata the sweeps went over.
+ */
+struct dirprefetch_stats
+{
+    uint64_t sweeps;
+    uint64_t dropped;
+    uint64_t files;
+};
+
+void toku_dirprefetch_get_stats(struct dirprefetch_stats * stats);
+
+#endif /* TOKU_DIRPREFETCH_H */
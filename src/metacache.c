@@ -0,0 +1,361 @@
+/**
+ * TokuFS
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+
+#include "metacache.h"
+#include "trace.h"
+
+/**
+ * The cache is split into shards by the hash of the name, each
+ * with its own lock, table, LRU list and share of the budget,
+ * so concurrent stats of different names rarely contend.
+ */
+#define METACACHE_SHARDS 16
+#define METACACHE_MIN_BUCKETS 64
+
+struct metacache_entry {
+    char * name;
+    void * value;
+    size_t size;
+    uint64_t hash;
+    struct metacache_entry * hash_next;
+    struct metacache_entry * lru_prev;
+    struct metacache_entry * lru_next;
+};
+
+struct metacache_shard {
+    pthread_mutex_t lock;
+    struct metacache_entry ** buckets;
+    size_t num_buckets;
+    size_t num_entries;
+    // most recently used at the head
+    struct metacache_entry * lru_head;
+    struct metacache_entry * lru_tail;
+    size_t bytes;
+    size_t limit;
+    // bumped by every invalidate, see toku_metacache_put
+    uint64_t version;
+};
+
+static struct metacache_shard metacache_shards[METACACHE_SHARDS];
+static size_t metacache_size;
+static uint64_t metacache_hits;
+static uint64_t metacache_misses;
+
+static uint64_t name_hash(const char * name)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (; *name != '\0'; name++) {
+        hash ^= (unsigned char) *name;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static struct metacache_shard * get_shard(uint64_t hash)
+{
+    return &metacache_shards[hash % METACACHE_SHARDS];
+}
+
+/**
+ * What an entry costs against the budget.
+ */
+static size_t entry_charge(struct metacache_entry * entry)
+{
+    return sizeof(struct metacache_entry) + strlen(entry->name) + 1 +
+        entry->size;
+}
+
+static struct metacache_entry ** find_entry(struct metacache_shard * shard,
+        const char * name, uint64_t hash)
+{
+    struct metacache_entry ** p;
+
+    // shard by the low bits, bucket by the high ones
+    p = &shard->buckets[(hash >> 32) % shard->num_buckets];
+    for (; *p != NULL; p = &(*p)->hash_next) {
+        if ((*p)->hash == hash && strcmp((*p)->name, name) == 0) {
+            break;
+        }
+    }
+
+    return p;
+}
+
+static void lru_unlink(struct metacache_shard * shard,
+        struct metacache_entry * entry)
+{
+    if (entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        shard->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        shard->lru_tail = entry->lru_prev;
+    }
+}
+
+static void lru_push(struct metacache_shard * shard,
+        struct metacache_entry * entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = shard->lru_head;
+    if (shard->lru_head != NULL) {
+        shard->lru_head->lru_prev = entry;
+    } else {
+        shard->lru_tail = entry;
+    }
+    shard->lru_head = entry;
+}
+
+static void entry_free(struct metacache_entry * entry)
+{
+    free(entry->name);
+    free(entry->value);
+    free(entry);
+}
+
+/**
+ * Take the entry at p out of the shard and free it.
+ */
+static void remove_entry(struct metacache_shard * shard,
+        struct metacache_entry ** p)
+{
+    struct metacache_entry * entry = *p;
+
+    *p = entry->hash_next;
+    lru_unlink(shard, entry);
+    shard->bytes -= entry_charge(entry);
+    shard->num_entries--;
+    entry_free(entry);
+}
+
+/**
+ * Double the table once it has more entries than buckets.
+ */
+static void maybe_grow(struct metacache_shard * shard)
+{
+    size_t i, num_buckets;
+    struct metacache_entry ** buckets;
+    struct metacache_entry * entry, * next;
+
+    if (shard->num_entries <= shard->num_buckets) {
+        return;
+    }
+    num_buckets = shard->num_buckets * 2;
+    buckets = calloc(num_buckets, sizeof(struct metacache_entry *));
+    for (i = 0; i < shard->num_buckets; i++) {
+        for (entry = shard->buckets[i]; entry != NULL; entry = next) {
+            next = entry->hash_next;
+            entry->hash_next = buckets[(entry->hash >> 32) % num_buckets];
+            buckets[(entry->hash >> 32) % num_buckets] = entry;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->num_buckets = num_buckets;
+}
+
+static void evict_over_limit(struct metacache_shard * shard)
+{
+    struct metacache_entry * victim;
+
+    while (shard->bytes > shard->limit && shard->lru_tail != NULL) {
+        victim = shard->lru_tail;
+        remove_entry(shard, find_entry(shard, victim->name, victim->hash));
+    }
+}
+
+void toku_metacache_init(size_t size)
+{
+    int i, ret;
+    struct metacache_shard * shard;
+
+    metacache_size = size;
+    if (size == 0) {
+        return;
+    }
+    for (i = 0; i < METACACHE_SHARDS; i++) {
+        shard = &metacache_shards[i];
+        memset(shard, 0, sizeof(struct metacache_shard));
+        ret = pthread_mutex_init(&shard->lock, NULL);
+        assert(ret == 0);
+        shard->num_buckets = METACACHE_MIN_BUCKETS;
+        shard->buckets = calloc(shard->num_buckets,
+                sizeof(struct metacache_entry *));
+        shard->limit = size / METACACHE_SHARDS;
+    }
+}
+
+void toku_metacache_destroy(void)
+{
+    int i, ret;
+    struct metacache_shard * shard;
+    struct metacache_entry * entry, * next;
+
+    if (metacache_size == 0) {
+        return;
+    }
+    for (i = 0; i < METACACHE_SHARDS; i++) {
+        shard = &metacache_shards[i];
+        for (entry = shard->lru_head; entry != NULL; entry = next) {
+            next = entry->lru_next;
+            entry_free(entry);
+        }
+        free(shard->buckets);
+        ret = pthread_mutex_destroy(&shard->lock);
+        assert(ret == 0);
+        memset(shard, 0, sizeof(struct metacache_shard));
+    }
+    metacache_size = 0;
+}
+
+int toku_metacache_get(const char * name, void * buf, size_t size,
+        size_t * value_size,
+        uint64_t * version)
+{
+    int hit = 0;
+    uint64_t hash;
+    struct metacache_shard * shard;
+    struct metacache_entry * entry;
+
+    if (metacache_size == 0) {
+        return 0;
+    }
+    hash = name_hash(name);
+    shard = get_shard(hash);
+    pthread_mutex_lock(&shard->lock);
+    entry = *find_entry(shard, name, hash);
+    if (entry != NULL) {
+        memcpy(buf, entry->value, size < entry->size ? size : entry->size);
+        *value_size = entry->size;
+        lru_unlink(shard, entry);
+        lru_push(shard, entry);
+        hit = 1;
+    } else {
+        *version = shard->version;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    __sync_fetch_and_add(hit ? &metacache_hits : &metacache_misses, 1);
+
+    return hit;
+}
+
+void toku_metacache_put(const char * name, const void * value,
+        size_t size, uint64_t version)
+{
+    uint64_t hash;
+    struct metacache_shard * shard;
+    struct metacache_entry ** p;
+    struct metacache_entry * entry;
+
+    if (metacache_size == 0) {
+        return;
+    }
+    hash = name_hash(name);
+    shard = get_shard(hash);
+    pthread_mutex_lock(&shard->lock);
+    // something changed since the miss, so value may be stale
+    if (shard->version != version) {
+        goto out;
+    }
+    p = find_entry(shard, name, hash);
+    if (*p != NULL) {
+        remove_entry(shard, p);
+    }
+    entry = malloc(sizeof(struct metacache_entry));
+    entry->name = malloc(strlen(name) + 1);
+    strcpy(entry->name, name);
+    entry->value = malloc(size);
+    memcpy(entry->value, value, size);
+    entry->size = size;
+    entry->hash = hash;
+    if (entry_charge(entry) > shard->limit) {
+        entry_free(entry);
+        goto out;
+    }
+    p = &shard->buckets[(hash >> 32) % shard->num_buckets];
+    entry->hash_next = *p;
+    *p = entry;
+    lru_push(shard, entry);
+    shard->bytes += entry_charge(entry);
+    shard->num_entries++;
+    evict_over_limit(shard);
+    maybe_grow(shard);
+out:
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void toku_metacache_invalidate(const char * name)
+{
+    uint64_t hash;
+    struct metacache_shard * shard;
+    struct metacache_entry ** p;
+
+    if (metacache_size == 0) {
+        return;
+    }
+    hash = name_hash(name);
+    shard = get_shard(hash);
+    pthread_mutex_lock(&shard->lock);
+    p = find_entry(shard, name, hash);
+    if (*p != NULL) {
+        remove_entry(shard, p);
+    }
+    shard->version++;
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void toku_metacache_invalidate_all(void)
+{
+    int i;
+    struct metacache_shard * shard;
+
+    if (metacache_size == 0) {
+        return;
+    }
+    toku_trace(TOKU_TRACE_IO, TOKU_TRACE_METACACHE_INVALIDATE, NULL,
+            metacache_size, 0);
+    for (i = 0; i < METACACHE_SHARDS; i++) {
+        shard = &metacache_shards[i];
+        pthread_mutex_lock(&shard->lock);
+        while (shard->lru_head != NULL) {
+            remove_entry(shard, find_entry(shard, shard->lru_head->name,
+                        shard->lru_head->hash));
+        }
+        shard->version++;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+void toku_metacache_get_stats(struct metacache_stats * stats)
+{
+    int i;
+    struct metacache_shard * shard;
+
+    memset(stats, 0, sizeof(struct metacache_stats));
+    stats->hits = __sync_fetch_and_add(&metacache_hits, 0);
+    stats->misses = __sync_fetch_and_add(&metacache_misses, 0);
+    if (metacache_size == 0) {
+        return;
+    }
+    for (i = 0; i < METACACHE_SHARDS; i++) {
+        shard = &metacache_shards[i];
+        pthread_mutex_lock(&shard->lock);
+        stats->bytes += shard->bytes;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
@@ -0,0 +1,70 @@
+/**
+ * TokuFS
+ */
+
+#ifndef TOKU_METACACHE_H
+#define TOKU_METACACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * A cache of metadata values kept apart from the engine's cache,
+ * with a budget of its own. The engine cache is shared by data
+ * and metadata, so a big sequential read can push every metadata
+ * node out of it. Values in here are only ever evicted by other
+ * metadata, so stat stays fast while data streams through.
+ *
+ * Readers that miss get a version, and only put what they read
+ * back if nothing was invalidated since, so an update racing
+ * with a miss can't leave a stale value behind. Writers update
+ * the engine first and then invalidate.
+ */
+
+/**
+ * Set up a cache of at most size bytes. A size of 0 turns the
+ * cache off, and every get misses without being counted.
+ */
+void toku_metacache_init(size_t size);
+
+void toku_metacache_destroy(void);
+
+/**
+ * Copy up to size bytes of the cached value of name into buf,
+ * and set value_size to the size of the whole value. Returns
+ * nonzero on a hit. On a miss, version is set for a later
+ * toku_metacache_put.
+ */
+int toku_metacache_get(const char * name, void * buf, size_t size,
+        size_t * value_size,
+        uint64_t * version);
+
+/**
+ * Cache the value of name, read from the engine after a miss
+ * that returned version.
+ */
+void toku_metacache_put(const char * name, const void * value,
+        size_t size, uint64_t version);
+
+/**
+ * Forget the value of name, or of everything.
+ */
+void toku_metacache_invalidate(const char * name);
+
+void toku_metacache_invalidate_all(void);
+
+/**
+ * hits   - gets answered from the cache.
+ * misses - gets that went to the engine.
+ * bytes  - bytes the cache holds, out of its size.
+ */
+struct metacache_stats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t bytes;
+};
+
+void toku_metacache_get_stats(struct metacache_stats * stats);
+
+#endif /* TOKU_METACACHE_H */
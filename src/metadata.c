@@ -9,11 +9,12 @@
 #include <unistd.h>
 #include <assert.h>
 #include <time.h>
+#include <errno.h>
 
-#include <toku/debug.h>
 
 #include "metadata.h"
 #include "block.h"
+#include "trace.h"
 
 #define MIN(A, B)           ((A) < (B) ? (A) : (B))
 #define MAX(A, B)           ((A) > (B) ? (A) : (B))
@@ -34,6 +35,10 @@ enum meta_cb_info_type {
     UTIME,
     CHMOD,
     CHOWN,
+    PROMOTE,
+    DU,
+    PUT,
+    SET_USAGE,
 };
 
 /**
@@ -52,26 +57,376 @@ struct meta_cb_info_header {
 /**
  * Various metadata callbacks for each type.
  */
-static int create_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra);
-static int pread_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra);
-static int pwrite_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra);
-static int truncate_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra);
-static int symlink_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra);
-static int delete_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra);
-static int rename_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra);
-static int utime_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra);
-static int chmod_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra);
-static int chown_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra);
+static int create_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+static int pread_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+static int pwrite_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+static int truncate_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+static int symlink_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+static int delete_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+static int rename_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+static int utime_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+static int chmod_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+static int chown_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+static int promote_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+static int du_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+static int set_usage_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+static int put_meta_cb(struct metadata * meta,
+        int exists, void * extra);
+
+/**
+ * Real metadata callbacks get the old metadata decoded, followed
+ * by its inline data, and change it in place. exists is zero if
+ * there was no old metadata, in which case meta is all zeros.
+ * They return 0 if the metadata should be written back.
+ */
+typedef int (*meta_cb_fn)(struct metadata * meta, int exists, void * extra);
+
+//
+// On disk encoding
+//
+// Metadata is stored as a version byte, a varint mask of which
+// fields are present, a varint for each present field in order,
+// and then the inline data. Fields that are zero are left out.
+// Decoders skip fields they don't know about, so new fields
+// can be added to the end of the list without a new version.
+//
+
+enum metadata_field {
+    FIELD_MODE,
+    FIELD_NLINK,
+    FIELD_UID,
+    FIELD_GID,
+    FIELD_SIZE,
+    FIELD_ATIME,
+    FIELD_MTIME,
+    FIELD_CTIME,
+    FIELD_FLAGS,
+    FIELD_INLINE_SIZE,
+    FIELD_DU_BYTES,
+    FIELD_DU_FILES,
+    NUM_FIELDS
+};
+
+static size_t put_varint(unsigned char * p, uint64_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    p[n++] = v;
+
+    return n;
+}
+
+static int get_varint(const unsigned char ** p,
+        const unsigned char * end, uint64_t * v)
+{
+    uint64_t x = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*p == end) {
+            return -EINVAL;
+        }
+        unsigned char c = *(*p)++;
+        x |= (uint64_t) (c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *v = x;
+            return 0;
+        }
+    }
+
+    return -EINVAL;
+}
+
+/**
+ * Signed fields are zigzag encoded so small negative
+ * numbers stay small.
+ */
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+/**
+ * Get the field values of a metadata struct, in field order.
+ */
+static void metadata_to_fields(const struct metadata * meta,
+        uint64_t fields[NUM_FIELDS])
+{
+    fields[FIELD_MODE] = meta->st.st_mode;
+    fields[FIELD_NLINK] = meta->st.st_nlink;
+    fields[FIELD_UID] = meta->st.st_uid;
+    fields[FIELD_GID] = meta->st.st_gid;
+    fields[FIELD_SIZE] = zigzag(meta->st.st_size);
+    fields[FIELD_ATIME] = zigzag(meta->st.st_atime);
+    fields[FIELD_MTIME] = zigzag(meta->st.st_mtime);
+    fields[FIELD_CTIME] = zigzag(meta->st.st_ctime);
+    fields[FIELD_FLAGS] = meta->flags;
+    fields[FIELD_INLINE_SIZE] = meta->inline_size;
+    fields[FIELD_DU_BYTES] = meta->du_bytes;
+    fields[FIELD_DU_FILES] = meta->du_files;
+}
+
+/**
+ * Fill out a metadata struct from field values. The stat fields
+ * we don't store are derived or left zero.
+ */
+static void fields_to_metadata(const uint64_t fields[NUM_FIELDS],
+        struct metadata * meta)
+{
+    memset(meta, 0, METADATA_SIZE);
+    meta->st.st_mode = fields[FIELD_MODE];
+    meta->st.st_nlink = fields[FIELD_NLINK];
+    meta->st.st_uid = fields[FIELD_UID];
+    meta->st.st_gid = fields[FIELD_GID];
+    meta->st.st_size = unzigzag(fields[FIELD_SIZE]);
+    meta->st.st_atime = unzigzag(fields[FIELD_ATIME]);
+    meta->st.st_mtime = unzigzag(fields[FIELD_MTIME]);
+    meta->st.st_ctime = unzigzag(fields[FIELD_CTIME]);
+    meta->st.st_blksize = BSTORE_BLOCKSIZE;
+    //XXX this should really be the number of blocks allocated,
+    //not how many logical blocks fill the potentially sparse file
+    meta->st.st_blocks = block_get_count_by_size(meta->st.st_size);
+    meta->flags = fields[FIELD_FLAGS];
+    meta->inline_size = fields[FIELD_INLINE_SIZE];
+    meta->du_bytes = fields[FIELD_DU_BYTES];
+    meta->du_files = fields[FIELD_DU_FILES];
+}
+
+/**
+ * Encode metadata and its inline data into buf, which must
+ * have at least METADATA_ENCODED_MAX bytes.
+ * Returns the encoded size.
+ */
+size_t toku_metadata_encode(const struct metadata * meta, void * buf)
+{
+    uint64_t fields[NUM_FIELDS];
+    uint64_t mask;
+    unsigned char * p = buf;
+
+    metadata_to_fields(meta, fields);
+    mask = 0;
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        if (fields[i] != 0) {
+            mask |= 1ULL << i;
+        }
+    }
+
+    *p++ = METADATA_MAGIC;
+    *p++ = METADATA_VERSION;
+    p += put_varint(p, mask);
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        if (fields[i] != 0) {
+            p += put_varint(p, fields[i]);
+        }
+    }
+    assert((size_t) (p - (unsigned char *) buf) <= METADATA_ENCODED_HEADER_MAX);
+    memcpy(p, metadata_inline_data((struct metadata *) meta),
+            meta->inline_size);
+    p += meta->inline_size;
+
+    return p - (unsigned char *) buf;
+}
+
+/**
+ * Metadata written before flags, inline data and the usage
+ * counts existed is a bare struct stat. Take the stat and
+ * default the rest: no inline data, and no usage, which for
+ * a directory is flagged as not known yet.
+ */
+static int metadata_decode_legacy(const void * buf, size_t size,
+        struct metadata * meta)
+{
+    if (size != sizeof(struct stat)) {
+        return -EINVAL;
+    }
+    memset(meta, 0, METADATA_SIZE);
+    memcpy(&meta->st, buf, sizeof(struct stat));
+    if (S_ISDIR(meta->st.st_mode)) {
+        meta->flags = METADATA_FLAG_NO_USAGE;
+    }
+
+    return 0;
+}
+
+static int metadata_decode_fields(const void * buf, size_t size,
+        struct metadata * meta, int with_inline)
+{
+    int ret;
+    uint64_t mask, v;
+    uint64_t fields[NUM_FIELDS];
+    const unsigned char * p = buf;
+    const unsigned char * end = p + size;
+
+    if (size < 2 || p[0] != METADATA_MAGIC || p[1] != METADATA_VERSION) {
+        return -EINVAL;
+    }
+    p += 2;
+    ret = get_varint(&p, end, &mask);
+    if (ret != 0) {
+        return ret;
+    }
+    memset(fields, 0, sizeof(fields));
+    for (int i = 0; i < 64; i++) {
+        if (!(mask & (1ULL << i))) {
+            continue;
+        }
+        ret = get_varint(&p, end, &v);
+        if (ret != 0) {
+            return ret;
+        }
+        // fields from the future are skipped
+        if (i < NUM_FIELDS) {
+            fields[i] = v;
+        }
+    }
+    fields_to_metadata(fields, meta);
+
+    // the inline data is exactly what's left
+    if (meta->inline_size > METADATA_INLINE_SPACE ||
+            (size_t) (end - p) != meta->inline_size) {
+        return -EINVAL;
+    }
+    if (with_inline) {
+        memcpy(metadata_inline_data(meta), p, meta->inline_size);
+    }
+
+    return 0;
+}
+
+/**
+ * Decode a whole metadata value from buf. If with_inline is set,
+ * the inline data is copied after meta, which must have room for
+ * it (see union metadata_buf). An encoded value has to account
+ * for every byte, so a bare struct stat whose first bytes happen
+ * to look like the header still isn't taken for one.
+ * Returns 0 on success, -EINVAL if buf isn't valid metadata.
+ */
+int toku_metadata_decode(const void * buf, size_t size,
+        struct metadata * meta, int with_inline)
+{
+    int ret;
+
+    ret = metadata_decode_fields(buf, size, meta, with_inline);
+    if (ret != 0) {
+        ret = metadata_decode_legacy(buf, size, meta);
+    }
+
+    return ret;
+}
+
+/**
+ * Get the metadata for name, without any inline data.
+ */
+int toku_metadata_get(const char * name, struct metadata * meta)
+{
+    int ret;
+    size_t size;
+    char buf[METADATA_ENCODED_MAX];
+
+    // the whole value, since decoding checks its length
+    ret = toku_bstore_meta_get(name, buf, sizeof(buf), &size);
+    if (ret == 0) {
+        assert(size <= sizeof(buf));
+        ret = toku_metadata_decode(buf, size, meta, 0);
+        assert(ret == 0);
+    }
+
+    return ret;
+}
+
+struct get_many_info {
+    struct metadata * metas;
+    int * rets;
+};
+
+static void get_many_cb(int index, const void * value, size_t size,
+        void * extra)
+{
+    int ret;
+    struct get_many_info * info = extra;
+
+    ret = toku_metadata_decode(value, size, &info->metas[index], 0);
+    assert(ret == 0);
+    info->rets[index] = 0;
+}
+
+/**
+ * Get the metadata for n names in one pass over the meta db.
+ */
+int toku_metadata_get_many(const char ** names, const int * order,
+        int n, struct metadata * metas, int * rets)
+{
+    int i, ret;
+    struct get_many_info info;
+
+    for (i = 0; i < n; i++) {
+        rets[i] = BSTORE_NOTFOUND;
+    }
+    info.metas = metas;
+    info.rets = rets;
+    ret = toku_bstore_meta_get_many(names, order, n, get_many_cb, &info);
+    assert(ret == 0);
+
+    return ret;
+}
+
+/**
+ * Get the metadata for name, followed by its inline data.
+ */
+int toku_metadata_get_inline(const char * name, union metadata_buf * mbuf)
+{
+    int ret;
+    size_t size;
+    char buf[METADATA_ENCODED_MAX];
+
+    ret = toku_bstore_meta_get(name, buf, sizeof(buf), &size);
+    if (ret == 0) {
+        assert(size <= sizeof(buf));
+        ret = toku_metadata_decode(buf, size, &mbuf->meta, 1);
+        assert(ret == 0);
+    }
+
+    return ret;
+}
+
+/**
+ * Encode the given metadata into newval. The bstore gives newval
+ * a buffer the size of the old value, so we only need our own if
+ * the metadata grew.
+ */
+static void encode_newval(const struct metadata * meta, DBT * newval)
+{
+    char buf[METADATA_ENCODED_MAX];
+    size_t size;
+
+    size = toku_metadata_encode(meta, buf);
+    if (size > newval->size) {
+        newval->data = malloc(size);
+    }
+    newval->size = size;
+    memcpy(newval->data, buf, size);
+}
 
 /**
  * All metadata updates will go through this callback
@@ -80,7 +435,9 @@ static int chown_meta_cb(const DBT * oldval,
 int toku_metadata_update_callback(const DBT * oldval,
         DBT * newval, void * extra)
 {
-    bstore_update_callback_fn cb;
+    int ret;
+    meta_cb_fn cb;
+    union metadata_buf mbuf;
     struct meta_cb_info_header * h = extra;
     assert(h != NULL);
 
@@ -116,11 +473,38 @@ int toku_metadata_update_callback(const DBT * oldval,
         case CHOWN:
             cb = chown_meta_cb;
             break;
+        case PROMOTE:
+            cb = promote_meta_cb;
+            break;
+        case DU:
+            cb = du_meta_cb;
+            break;
+        case PUT:
+            cb = put_meta_cb;
+            break;
+        case SET_USAGE:
+            cb = set_usage_meta_cb;
+            break;
         default:
             assert(0);
     }
 
-    int ret = cb(oldval, newval, extra);
+    memset(&mbuf.meta, 0, METADATA_SIZE);
+    if (oldval != NULL) {
+        // old layouts are converted as they're rewritten. something
+        // that isn't metadata at all is left alone rather than
+        // lost, since there's no one to give an error to here.
+        ret = toku_metadata_decode(oldval->data, oldval->size,
+                &mbuf.meta, 1);
+        if (ret != 0) {
+            return BSTORE_UPDATE_IGNORE;
+        }
+    }
+    ret = cb(&mbuf.meta, oldval != NULL, extra);
+    if (ret == 0) {
+        encode_newval(&mbuf.meta, newval);
+    }
+
     return ret;
 }
 
@@ -138,32 +522,30 @@ struct create_meta_cb_info {
  * a meta_get due to mode bit checks, because then this should
  * only happen if the metadata doesn't already exist.
  */
-static int create_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra)
+static int create_meta_cb(struct metadata * meta,
+        int exists, void * extra)
 {
     int ret;
     struct create_meta_cb_info * info = extra;
     assert(info->h.type == CREATE);
 
-    if (oldval != NULL) {
+    if (exists) {
         ret = BSTORE_UPDATE_IGNORE;
         goto out;
     }
 
     // no meta data existed. create it.
-    // we have to provide our own buffer space
-    newval->data = malloc(METADATA_SIZE);
-    newval->size = METADATA_SIZE;
-    struct metadata * meta = newval->data;
-    memset(meta, 0, METADATA_SIZE);
     meta->st.st_mode = info->mode;
     meta->st.st_nlink = 1;
     meta->st.st_uid = getuid();
     meta->st.st_gid = getgid();
-    meta->st.st_blksize = BSTORE_BLOCKSIZE;
     meta->st.st_atime = info->ctime;
     meta->st.st_mtime = info->ctime;
     meta->st.st_ctime = info->ctime;
+    // new files start out with their data inline
+    if (!S_ISDIR(info->mode)) {
+        meta->flags = METADATA_FLAG_INLINE;
+    }
     ret = 0;
 
 out:
@@ -198,22 +580,18 @@ struct pread_meta_cb_info {
 /**
  * Update the access time due to a pread
  */
-static int pread_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra)
+static int pread_meta_cb(struct metadata * meta,
+        int exists, void * extra)
 {
     int ret;
     struct pread_meta_cb_info * info = extra;
     assert(info->h.type == PREAD);
-    assert(oldval != NULL);
+    assert(exists);
 
     // if the new time is the same, do nothing
-    struct metadata * meta = oldval->data;
     if (meta->st.st_atime == info->atime) {
         ret = BSTORE_UPDATE_IGNORE;
     } else {
-        assert(newval->size == METADATA_SIZE);
-        memcpy(newval->data, oldval->data, METADATA_SIZE);
-        meta = newval->data;
         meta->st.st_atime = info->atime;
         ret = 0;
     }
@@ -239,35 +617,57 @@ int toku_metadata_update_for_pread(const char * name, time_t atime)
 
 /**
  * meta callbacks for pwrite set the modified time and possibly
- * set the file size if the last_offset is bigger than the existing
+ * set the file size if the last_offset is bigger than the existing.
+ * inline pwrites also carry the bytes written.
  */
 struct pwrite_meta_cb_info {
     struct meta_cb_info_header h;
     time_t mtime;
     off_t last_offset;
+    off_t inline_offset;
+    size_t inline_size;
+    char inline_buf[];
 };
 
+/**
+ * Write an inline pwrite's bytes into the inline data, growing
+ * it if the write goes past the current end.
+ */
+static void inline_pwrite(struct metadata * meta,
+        struct pwrite_meta_cb_info * info)
+{
+    assert(meta->flags & METADATA_FLAG_INLINE);
+
+    size_t end = info->inline_offset + info->inline_size;
+    size_t new_inline_size = MAX(meta->inline_size, end);
+    assert(new_inline_size <= METADATA_INLINE_MAX);
+
+    // zero the gap between the old end and the write, if any
+    char * data = metadata_inline_data(meta);
+    if ((size_t) info->inline_offset > meta->inline_size) {
+        memset(data + meta->inline_size, 0,
+                info->inline_offset - meta->inline_size);
+    }
+    memcpy(data + info->inline_offset, info->inline_buf, info->inline_size);
+    meta->inline_size = new_inline_size;
+}
+
 /**
  * callback to update the metadata after a pwrite
  */
-static int pwrite_meta_cb(const DBT * oldval, 
-        DBT * newval, void * extra)
+static int pwrite_meta_cb(struct metadata * meta, 
+        int exists, void * extra)
 {
-    assert(oldval != NULL);
+    assert(exists);
 
     struct pwrite_meta_cb_info * info = extra;
     assert(info->h.type == PWRITE);
-    assert(newval->size == METADATA_SIZE);
-    memcpy(newval->data, oldval->data, METADATA_SIZE);
+    if (info->inline_size > 0) {
+        inline_pwrite(meta, info);
+    }
 
-    struct metadata * meta = newval->data;
     meta->st.st_mtime = info->mtime;
     meta->st.st_size = MAX(meta->st.st_size, info->last_offset);
-    //XXX this should really be the number of blocks allocated,
-    //not how many logical blocks fill the potentially sparse file
-    //possible solution: have tokufs_write count the number of
-    //bstore puts it does and pass that with the cb info
-    meta->st.st_blocks = block_get_count_by_size(meta->st.st_size);
     return 0;
 }
 
@@ -284,6 +684,139 @@ int toku_metadata_update_for_pwrite(const char * name,
     info.h.type = PWRITE;
     info.mtime = mtime;
     info.last_offset = last_offset;
+    info.inline_offset = 0;
+    info.inline_size = 0;
+    ret = toku_bstore_meta_update(name, &info, sizeof(info));
+    assert(ret == 0);
+
+    return ret;
+}
+
+/**
+ * Write count bytes at offset into an inline file's metadata.
+ */
+int toku_metadata_update_for_inline_pwrite(const char * name,
+        time_t mtime, const void * buf, size_t count, off_t offset)
+{
+    int ret;
+
+    assert(offset + count <= METADATA_INLINE_MAX);
+    size_t info_size = sizeof(struct pwrite_meta_cb_info) + count;
+    char info_buf[info_size];
+    struct pwrite_meta_cb_info * info = (void *) info_buf;
+    info->h.type = PWRITE;
+    info->mtime = mtime;
+    info->last_offset = offset + count;
+    info->inline_offset = offset;
+    info->inline_size = count;
+    memcpy(info->inline_buf, buf, count);
+    ret = toku_bstore_meta_update(name, info, info_size);
+    assert(ret == 0);
+
+    return ret;
+}
+
+/**
+ * A put replaces a file's contents all at once. Contents
+ * that are inline come along in the message.
+ */
+struct put_meta_cb_info {
+    struct meta_cb_info_header h;
+    time_t mtime;
+    mode_t mode;
+    off_t size;
+    int is_inline;
+    char inline_buf[];
+};
+
+/**
+ * callback to create or replace a file after a put. a new
+ * file gets the same defaults as a create, an existing one
+ * keeps its mode, owner and ctime.
+ */
+static int put_meta_cb(struct metadata * meta,
+        int exists, void * extra)
+{
+    struct put_meta_cb_info * info = extra;
+    assert(info->h.type == PUT);
+
+    if (!exists) {
+        meta->st.st_mode = info->mode;
+        meta->st.st_nlink = 1;
+        meta->st.st_uid = getuid();
+        meta->st.st_gid = getgid();
+        meta->st.st_atime = info->mtime;
+        meta->st.st_ctime = info->mtime;
+    }
+    meta->st.st_mtime = info->mtime;
+    meta->st.st_size = info->size;
+    if (info->is_inline) {
+        assert(info->size <= METADATA_INLINE_MAX);
+        meta->flags |= METADATA_FLAG_INLINE;
+        meta->inline_size = info->size;
+        memcpy(metadata_inline_data(meta), info->inline_buf, info->size);
+    } else {
+        meta->flags &= ~METADATA_FLAG_INLINE;
+        meta->inline_size = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * Create or replace a file whose contents are size bytes.
+ */
+int toku_metadata_update_for_put(const char * name, time_t mtime,
+        mode_t mode, const void * buf, size_t size, int is_inline)
+{
+    int ret;
+
+    size_t inline_size = is_inline ? size : 0;
+    assert(inline_size <= METADATA_INLINE_MAX);
+    size_t info_size = sizeof(struct put_meta_cb_info) + inline_size;
+    char info_buf[info_size];
+    struct put_meta_cb_info * info = (void *) info_buf;
+    info->h.type = PUT;
+    info->mtime = mtime;
+    info->mode = mode;
+    info->size = size;
+    info->is_inline = is_inline;
+    memcpy(info->inline_buf, buf, inline_size);
+    ret = toku_bstore_meta_update(name, info, info_size);
+    assert(ret == 0);
+
+    return ret;
+}
+
+struct promote_meta_cb_info {
+    struct meta_cb_info_header h;
+};
+
+/**
+ * callback to drop the inline data once it lives in blocks
+ */
+static int promote_meta_cb(struct metadata * meta,
+        int exists, void * extra)
+{
+    struct promote_meta_cb_info * info = extra;
+    assert(info->h.type == PROMOTE);
+    assert(exists);
+
+    meta->flags &= ~METADATA_FLAG_INLINE;
+    meta->inline_size = 0;
+
+    return 0;
+}
+
+/**
+ * Mark an inline file as stored in blocks.
+ */
+int toku_metadata_update_for_promote(const char * name)
+{
+    int ret;
+
+    struct promote_meta_cb_info info;
+    info.h.type = PROMOTE;
     ret = toku_bstore_meta_update(name, &info, sizeof(info));
     assert(ret == 0);
 
@@ -301,22 +834,21 @@ struct truncate_meta_cb_info {
  * to set the file to exactly the new size
  * even if it's bigger than the old. Blame POSIX.
  */
-static int truncate_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra)
+static int truncate_meta_cb(struct metadata * meta,
+        int exists, void * extra)
 {
-    assert(oldval != NULL);
+    assert(exists);
     struct truncate_meta_cb_info * info = extra;
     assert(info->h.type == TRUNCATE);
 
-    debug_echo("called with size %ld\n", info->size);
+    toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_META_TRUNCATE, NULL,
+            info->size, meta->st.st_size);
 
-    assert(newval->size == METADATA_SIZE);
-    memcpy(newval->data, oldval->data, METADATA_SIZE);
-    struct metadata * meta = newval->data;
     meta->st.st_size = info->size;
-    meta->st.st_blocks = block_get_count_by_size(meta->st.st_size);
-
-    debug_echo("finished. st.st_size %ld\n", meta->st.st_size);
+    // inline data past the new size goes away
+    if ((off_t) meta->inline_size > info->size) {
+        meta->inline_size = info->size;
+    }
 
     return 0;
 }
@@ -341,32 +873,31 @@ struct symlink_meta_cb_info {
     struct meta_cb_info_header h;
     time_t ctime;
     size_t link_size;
+    char target[];
 };
 
 /**
  * callback to create the metadata for a symlink
  */
-static int symlink_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra)
+static int symlink_meta_cb(struct metadata * meta,
+        int exists, void * extra)
 {
-    assert(oldval == NULL);
     struct symlink_meta_cb_info * info = extra;
     assert(info->h.type == SYMLINK);
 
     // it is an error for symlink if newpath already exists.
     // this condition should have been checked by the caller.
-    assert(newval->size == 0);
-    newval->data = malloc(METADATA_SIZE);
-    newval->size = METADATA_SIZE;
-    struct metadata * meta = newval->data;
-    memset(meta, 0, METADATA_SIZE);
+    assert(!exists);
     // mark it as a symbolic link
     meta->st.st_mode = S_IFLNK;
     meta->st.st_atime = info->ctime;
     meta->st.st_mtime = info->ctime;
     meta->st.st_ctime = info->ctime;
     meta->st.st_size = info->link_size;
-    meta->st.st_blocks = 1;
+    // the target lives inline, without a null byte
+    meta->flags = METADATA_FLAG_INLINE;
+    meta->inline_size = info->link_size;
+    memcpy(metadata_inline_data(meta), info->target, info->link_size);
 
     return 0;
 }
@@ -376,14 +907,107 @@ static int symlink_meta_cb(const DBT * oldval,
  * does not already exist.
  */
 int toku_metadata_update_for_symlink(const char * name,
-        time_t create_time, size_t link_size)
+        time_t create_time, const char * target)
 {
     int ret;
 
-    struct symlink_meta_cb_info info;
-    info.h.type = SYMLINK;
-    info.ctime = create_time;
-    info.link_size = link_size;
+    size_t link_size = strlen(target);
+    assert(link_size < METADATA_SYMLINK_MAX);
+    size_t info_size = sizeof(struct symlink_meta_cb_info) + link_size;
+    char info_buf[info_size];
+    struct symlink_meta_cb_info * info = (void *) info_buf;
+    info->h.type = SYMLINK;
+    info->ctime = create_time;
+    info->link_size = link_size;
+    memcpy(info->target, target, link_size);
+    ret = toku_bstore_meta_update(name, info, info_size);
+    assert(ret == 0);
+
+    return ret;
+}
+
+struct du_meta_cb_info {
+    struct meta_cb_info_header h;
+    int64_t bytes;
+    int64_t files;
+};
+
+/**
+ * callback to apply usage deltas to a directory. the directory
+ * may have been removed since the caller looked, so a missing
+ * one is ignored, and so is one whose counts aren't known yet,
+ * since a delta would only wrap them.
+ */
+static int du_meta_cb(struct metadata * meta,
+        int exists, void * extra)
+{
+    struct du_meta_cb_info * info = extra;
+    assert(info->h.type == DU);
+
+    if (!exists || (meta->flags & METADATA_FLAG_NO_USAGE)) {
+        return BSTORE_UPDATE_IGNORE;
+    }
+    meta->du_bytes += info->bytes;
+    meta->du_files += info->files;
+
+    return 0;
+}
+
+/**
+ * Add deltas to a directory's recursive byte and file counts.
+ */
+int toku_metadata_update_for_du(const char * name,
+        int64_t bytes, int64_t files)
+{
+    int ret;
+
+    struct du_meta_cb_info info;
+    info.h.type = DU;
+    info.bytes = bytes;
+    info.files = files;
+    ret = toku_bstore_meta_update(name, &info, sizeof(info));
+    assert(ret == 0);
+
+    return ret;
+}
+
+struct set_usage_meta_cb_info {
+    struct meta_cb_info_header h;
+    uint64_t bytes;
+    uint64_t files;
+};
+
+/**
+ * callback to set a directory's usage counts outright.
+ */
+static int set_usage_meta_cb(struct metadata * meta,
+        int exists, void * extra)
+{
+    struct set_usage_meta_cb_info * info = extra;
+    assert(info->h.type == SET_USAGE);
+
+    if (!exists) {
+        return BSTORE_UPDATE_IGNORE;
+    }
+    meta->du_bytes = info->bytes;
+    meta->du_files = info->files;
+    meta->flags &= ~METADATA_FLAG_NO_USAGE;
+
+    return 0;
+}
+
+/**
+ * Set a directory's recursive byte and file counts.
+ */
+int toku_metadata_set_usage(const char * name,
+        uint64_t bytes, uint64_t files)
+{
+    int ret;
+
+    struct set_usage_meta_cb_info info;
+    info.h.type = SET_USAGE;
+    info.bytes = bytes;
+    info.files = files;
     ret = toku_bstore_meta_update(name, &info, sizeof(info));
     assert(ret == 0);
 
@@ -398,15 +1022,15 @@ struct delete_meta_cb_info {
  * No hard links supported, so nlinks is always one,
  * and the meta callback always just does a delete.
  */
-static int delete_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra)
+static int delete_meta_cb(struct metadata * meta,
+        int exists, void * extra)
 {
     struct delete_meta_cb_info * info = extra;
     assert(info->h.type == DELETE);
 
-    (void) oldval;
-    (void) newval;
-    debug_echo("deleting metadata\n");
+    (void) meta;
+    (void) exists;
+    toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_META_DELETE, NULL, 0, 0);
     return BSTORE_UPDATE_DELETE; 
 }
 
@@ -428,27 +1052,21 @@ int toku_metadata_delete(const char * name)
 struct rename_meta_cb_info {
     struct meta_cb_info_header h;
     struct metadata meta;
+    char inline_buf[];
 };
 
 /**
  * callback that copies old metadata to a new name
  */
-static int rename_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra)
+static int rename_meta_cb(struct metadata * meta,
+        int exists, void * extra)
 {
     // there shouldn't have been something here beforehand
-    assert(oldval == NULL);
-    // copy over the metadata from info into newval
+    assert(!exists);
+    // copy over the metadata and inline data from info
     struct rename_meta_cb_info * info = extra;
     assert(info->h.type == RENAME);
-    if (newval->size == 0) {
-        // there was no metadata with this name previously.
-        // so we need to give space.
-        newval->data = malloc(METADATA_SIZE);
-        newval->size = METADATA_SIZE;
-    }
-    assert(newval->size == METADATA_SIZE);
-    memcpy(newval->data, &info->meta, METADATA_SIZE);
+    memcpy(meta, &info->meta, METADATA_SIZE + info->meta.inline_size);
 
     return 0;
 }
@@ -462,10 +1080,13 @@ int toku_metadata_update_for_rename(const char * name,
 {
     int ret;
 
-    struct rename_meta_cb_info info;
-    info.h.type = RENAME;
-    memcpy(&info.meta, meta, METADATA_SIZE);
-    ret = toku_bstore_meta_update(name, &info, sizeof(info));
+    size_t info_size = sizeof(struct rename_meta_cb_info) +
+        meta->inline_size;
+    char info_buf[info_size];
+    struct rename_meta_cb_info * info = (void *) info_buf;
+    info->h.type = RENAME;
+    memcpy(&info->meta, meta, METADATA_SIZE + meta->inline_size);
+    ret = toku_bstore_meta_update(name, info, info_size);
 
     return ret;
 }
@@ -480,15 +1101,13 @@ struct utime_meta_cb_info {
  * the utimebuf should not be NULL, that case should
  * be handled by the initial call, not this callback.
  */
-static int utime_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra)
+static int utime_meta_cb(struct metadata * meta,
+        int exists, void * extra)
 {
     struct utime_meta_cb_info * info = extra;
     assert(info->h.type == UTIME);
 
-    assert(newval->size == METADATA_SIZE);
-    memcpy(newval->data, oldval->data, METADATA_SIZE);
-    struct metadata * meta = newval->data;
+    assert(exists);
     meta->st.st_mtime = info->buf.modtime;
     meta->st.st_atime = info->buf.actime;
 
@@ -523,15 +1142,13 @@ struct chmod_meta_cb_info {
  * update callback for a chmod operation.
  * overwrites the old mode with the new one.
  */
-static int chmod_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra)
+static int chmod_meta_cb(struct metadata * meta,
+        int exists, void * extra)
 {
     struct chmod_meta_cb_info * info = extra;
     assert(info->h.type == CHMOD);
     
-    assert(newval->size == METADATA_SIZE);
-    memcpy(newval->data, oldval->data, METADATA_SIZE);
-    struct metadata * meta = newval->data;
+    assert(exists);
     meta->st.st_mode = info->mode;
 
     return 0;
@@ -563,15 +1180,13 @@ struct chown_meta_cb_info {
  * update callback for chown that sets new
  * group or owner
  */
-static int chown_meta_cb(const DBT * oldval,
-        DBT * newval, void * extra)
+static int chown_meta_cb(struct metadata * meta,
+        int exists, void * extra)
 {
     struct chown_meta_cb_info * info = extra;
     assert(info->h.type == CHOWN);
 
-    assert(newval->size == METADATA_SIZE);
-    memcpy(newval->data, oldval->data, METADATA_SIZE);
-    struct metadata * meta = newval->data;
+    assert(exists);
     // the api is stupid and says to ignore if these
     // _unsigned_ values (uid_t, gid_t) are -1
     if (info->owner != (uid_t) -1) {
@@ -8,6 +8,8 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <utime.h>
+#include <limits.h>
+#include <stdint.h>
 
 #ifdef USE_BDB
 #include <db.h>
@@ -16,14 +18,127 @@
 #endif
 
 /**
- * TokuFS file metadata is represented by a stat struct, and
- * perhaps more in the future.
+ * TokuFS file metadata is represented by a stat struct, some flags,
+ * and the size of any inline data. Small files and symlinks keep
+ * their contents right after the metadata in the same value, so
+ * reading them never touches the data db.
+ *
+ * Directories also keep the total size and number of everything
+ * under them, recursively, so du doesn't have to walk the tree.
+ *
+ * This is the decoded form. On disk, only the fields we maintain
+ * are stored, varint encoded. See toku_metadata_encode().
  */
 struct metadata {
     struct stat st;
+    uint32_t flags;
+    uint32_t inline_size;
+    uint64_t du_bytes;
+    uint64_t du_files;
 };
 #define METADATA_SIZE (sizeof(struct metadata))
 
+/**
+ * The file's contents are the inline bytes after the metadata,
+ * not blocks in the data db. Files start out inline and are
+ * promoted to blocks once a write goes past METADATA_INLINE_MAX.
+ * They never go back.
+ */
+#define METADATA_FLAG_INLINE 0x1
+
+/**
+ * A directory from before usage counts were kept. Its counts
+ * mean nothing and deltas aren't applied to it until they're
+ * set with toku_metadata_set_usage(), which mount does.
+ */
+#define METADATA_FLAG_NO_USAGE 0x2
+
+#ifndef METADATA_INLINE_MAX
+#define METADATA_INLINE_MAX 2048
+#endif
+
+/**
+ * Symlink targets are always inline, up to PATH_MAX bytes.
+ */
+#define METADATA_SYMLINK_MAX PATH_MAX
+
+#define METADATA_INLINE_SPACE \
+    (METADATA_INLINE_MAX > METADATA_SYMLINK_MAX ? \
+     METADATA_INLINE_MAX : METADATA_SYMLINK_MAX)
+
+#define METADATA_MAX_SIZE (METADATA_SIZE + METADATA_INLINE_SPACE)
+
+/**
+ * Every encoded metadata value starts with the magic byte, then
+ * the version. Metadata written before the encoding is a bare
+ * struct stat, which toku_metadata_decode() tells apart by size
+ * and converts.
+ */
+#define METADATA_MAGIC 0xd7
+#define METADATA_VERSION 1
+
+/**
+ * Encoded metadata is at most this big without inline data: the
+ * magic, the version, the field mask and a 10 byte varint per field.
+ */
+#define METADATA_ENCODED_HEADER_MAX 128
+#define METADATA_ENCODED_MAX \
+    (METADATA_ENCODED_HEADER_MAX + METADATA_INLINE_SPACE)
+
+/**
+ * Big enough to get any metadata value, including inline data.
+ */
+union metadata_buf {
+    struct metadata meta;
+    char buf[METADATA_MAX_SIZE];
+};
+
+/**
+ * Get a pointer to the inline data following the metadata
+ */
+static inline char * metadata_inline_data(struct metadata * meta)
+{
+    return (char *) (meta + 1);
+}
+
+/**
+ * Encode metadata, followed by its inline data, into buf, which
+ * must have at least METADATA_ENCODED_MAX bytes.
+ * Returns the encoded size.
+ */
+size_t toku_metadata_encode(const struct metadata * meta, void * buf);
+
+/**
+ * Decode a whole metadata value of size bytes from buf. If
+ * with_inline is set, the inline data is copied after meta, which
+ * must have room for it. A bare struct stat from before the
+ * encoding decodes with no inline data or usage counts, and a
+ * directory's with METADATA_FLAG_NO_USAGE.
+ * Returns 0 on success, -EINVAL if buf isn't valid metadata.
+ */
+int toku_metadata_decode(const void * buf, size_t size,
+        struct metadata * meta, int with_inline);
+
+/**
+ * Get the metadata for name, without its inline data.
+ * Returns 0 on success, BSTORE_NOTFOUND if it doesn't exist.
+ */
+int toku_metadata_get(const char * name, struct metadata * meta);
+
+/**
+ * Get the metadata for n names, without inline data, in one
+ * pass over the meta db. order is from toku_bstore_meta_sort.
+ * rets[i] is 0 if names[i] exists, BSTORE_NOTFOUND if not.
+ */
+int toku_metadata_get_many(const char ** names, const int * order,
+        int n, struct metadata * metas, int * rets);
+
+/**
+ * Get the metadata for name, followed by its inline data.
+ * Returns 0 on success, BSTORE_NOTFOUND if it doesn't exist.
+ */
+int toku_metadata_get_inline(const char * name, union metadata_buf * mbuf);
+
 /**
  * All metadata updates will go through this callback
  * via the bstore.
@@ -51,17 +166,55 @@ int toku_metadata_update_for_pread(const char * name, time_t atime);
 int toku_metadata_update_for_pwrite(const char * name, 
         time_t mtime, off_t last_offset);
 
+/**
+ * Write count bytes at offset into an inline file's metadata,
+ * updating the modification time and size like a pwrite.
+ * The file must be inline, and offset + count must be no
+ * more than METADATA_INLINE_MAX.
+ */
+int toku_metadata_update_for_inline_pwrite(const char * name,
+        time_t mtime, const void * buf, size_t count, off_t offset);
+
+/**
+ * Create a file, or replace an existing file's contents, with
+ * size bytes. If is_inline, buf is stored inline and size must
+ * be no more than METADATA_INLINE_MAX. Otherwise the caller must
+ * have written the data to blocks first. A new file gets mode.
+ */
+int toku_metadata_update_for_put(const char * name, time_t mtime,
+        mode_t mode, const void * buf, size_t size, int is_inline);
+
+/**
+ * Mark an inline file as stored in blocks and drop its inline
+ * data. The caller must have written the data to blocks first.
+ */
+int toku_metadata_update_for_promote(const char * name);
+
 /**
  * Update the size and block count of a file after truncate
  */
 int toku_metadata_update_for_truncate(const char * name, off_t size);
 
 /**
- * Update metadata after a symlink. Requires that the metadata
- * does not already exist.
+ * Update metadata after a symlink, storing the target inline.
+ * Requires that the metadata does not already exist.
  */
 int toku_metadata_update_for_symlink(const char * name,
-        time_t ctime, size_t link_size);
+        time_t ctime, const char * target);
+
+/**
+ * Add deltas to a directory's recursive byte and file counts.
+ * Does nothing if the directory doesn't exist.
+ */
+int toku_metadata_update_for_du(const char * name,
+        int64_t bytes, int64_t files);
+
+/**
+ * Set a directory's recursive byte and file counts, and clear
+ * METADATA_FLAG_NO_USAGE. Does nothing if it doesn't exist.
+ */
+int toku_metadata_set_usage(const char * name,
+        uint64_t bytes, uint64_t files);
 
 /**
  * Delete metadata for the given bstore name
@@ -69,8 +222,8 @@ int toku_metadata_update_for_symlink(const char * name,
 int toku_metadata_delete(const char * name);
 
 /**
- * Update metadata after a rename by copying existing metadata
- * into new metadata with the new name.
+ * Update metadata after a rename by copying existing metadata,
+ * followed by its inline data, into new metadata with the new name.
  */
 int toku_metadata_update_for_rename(const char * name, 
         struct metadata * meta);
@@ -0,0 +1,431 @@
+/**
+ * TokuFS
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "opstats.h"
+#include "trace.h"
+
+static const char * opstats_names[TOKU_FS_OPS] = {
+    [TOKU_FS_OP_OPEN] = "open",
+    [TOKU_FS_OP_CLOSE] = "close",
+    [TOKU_FS_OP_PREAD] = "pread",
+    [TOKU_FS_OP_PWRITE] = "pwrite",
+    [TOKU_FS_OP_PUT_FILE] = "put_file",
+    [TOKU_FS_OP_GET_FILE] = "get_file",
+    [TOKU_FS_OP_STAT] = "stat",
+    [TOKU_FS_OP_STAT_MANY] = "stat_many",
+    [TOKU_FS_OP_TRUNCATE] = "truncate",
+    [TOKU_FS_OP_SYMLINK] = "symlink",
+    [TOKU_FS_OP_UNLINK] = "unlink",
+    [TOKU_FS_OP_CREATE_MANY] = "create_many",
+    [TOKU_FS_OP_UNLINK_MANY] = "unlink_many",
+    [TOKU_FS_OP_READLINK] = "readlink",
+    [TOKU_FS_OP_RENAME] = "rename",
+    [TOKU_FS_OP_UTIME] = "utime",
+    [TOKU_FS_OP_CHMOD] = "chmod",
+    [TOKU_FS_OP_CHOWN] = "chown",
+    [TOKU_FS_OP_MKDIR] = "mkdir",
+    [TOKU_FS_OP_RMDIR] = "rmdir",
+    [TOKU_FS_OP_OPENDIR] = "opendir",
+    [TOKU_FS_OP_READDIR] = "readdir",
+    [TOKU_FS_OP_DIR_USAGE] = "dir_usage",
+    [TOKU_FS_OP_WALK] = "walk",
+    [TOKU_FS_OP_REMOVE_TREE] = "remove_tree",
+    [TOKU_FS_OP_FADVISE] = "fadvise",
+    [TOKU_FS_OP_STATFS] = "statfs",
+    [TOKU_FS_OP_BSTORE_GET] = "bstore_get",
+    [TOKU_FS_OP_BSTORE_PUT] = "bstore_put",
+    [TOKU_FS_OP_BSTORE_PUT_BLOCKS] = "bstore_put_blocks",
+    [TOKU_FS_OP_BSTORE_DELETE] = "bstore_delete",
+    [TOKU_FS_OP_BSTORE_UPDATE] = "bstore_update",
+    [TOKU_FS_OP_BSTORE_TRUNCATE] = "bstore_truncate",
+    [TOKU_FS_OP_BSTORE_SCAN] = "bstore_scan",
+    [TOKU_FS_OP_BSTORE_SCAN_NAMES] = "bstore_scan_names",
+    [TOKU_FS_OP_BSTORE_RENAME_PREFIX] = "bstore_rename_prefix",
+    [TOKU_FS_OP_BSTORE_META_GET] = "bstore_meta_get",
+    [TOKU_FS_OP_BSTORE_META_GET_MANY] = "bstore_meta_get_many",
+    [TOKU_FS_OP_BSTORE_META_UPDATE] = "bstore_meta_update",
+    [TOKU_FS_OP_BSTORE_META_SCAN] = "bstore_meta_scan",
+    [TOKU_FS_OP_BSTORE_RECLAIM_PUT] = "bstore_reclaim_put",
+    [TOKU_FS_OP_BSTORE_RECLAIM_DELETE] = "bstore_reclaim_delete",
+    [TOKU_FS_OP_BSTORE_RECLAIM_SCAN] = "bstore_reclaim_scan",
+    [TOKU_FS_OP_BSTORE_HOT_OPTIMIZE] = "bstore_hot_optimize",
+};
+
+static const char * opstats_phase_names[TOKU_FS_PHASES] = {
+    [TOKU_FS_PHASE_KEYCMP] = "keycmp",
+    [TOKU_FS_PHASE_ENV_UPDATE_CB] = "env_update_cb",
+    [TOKU_FS_PHASE_BLOCK_UPDATE_CB] = "block_update_cb",
+    [TOKU_FS_PHASE_ZERO_FILL] = "zero_fill",
+};
+
+/**
+ * A thread's counters. Only the owner writes them. Readers see
+ * each counter either before or after an increment, which is all
+ * they need.
+ */
+struct opstats_thread {
+    struct toku_fs_op_stats ops[TOKU_FS_OPS];
+#ifdef TOKUFS_PROFILE
+    struct toku_fs_profile profile;
+    // calls of each phase until the next timed one, by operation
+    // and then background, as of sampling epoch sample_epoch
+    uint32_t sample_countdown[TOKU_FS_OPS + 1][TOKU_FS_PHASES];
+    uint64_t sample_epoch;
+#endif
+    struct opstats_thread * prev;
+    struct opstats_thread * next;
+};
+
+// the lock covers the list and the retired counters, and is only
+// taken by a thread's first operation, its exit and readers
+static pthread_mutex_t opstats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct opstats_thread * opstats_threads;
+static struct toku_fs_op_stats opstats_retired[TOKU_FS_OPS];
+#ifdef TOKUFS_PROFILE
+static struct toku_fs_profile opstats_retired_profile;
+// bumped to start every thread's sampling over
+static uint64_t opstats_sample_epoch;
+#endif
+static pthread_key_t opstats_key;
+static pthread_once_t opstats_once = PTHREAD_ONCE_INIT;
+static __thread struct opstats_thread * opstats_self;
+// the outermost operation the thread is in, TOKU_FS_OPS if none,
+// and how many operations deep it is
+static __thread enum toku_fs_op opstats_current = TOKU_FS_OPS;
+static __thread unsigned opstats_depth;
+
+static void opstats_add(struct toku_fs_op_stats * a,
+        const struct toku_fs_op_stats * b)
+{
+    int i, j;
+
+    for (i = 0; i < TOKU_FS_OPS; i++) {
+        a[i].calls += b[i].calls;
+        a[i].errors += b[i].errors;
+        a[i].bytes += b[i].bytes;
+        a[i].blocks += b[i].blocks;
+        a[i].upserts += b[i].upserts;
+        a[i].cache_hits += b[i].cache_hits;
+        a[i].cache_misses += b[i].cache_misses;
+        a[i].nsec += b[i].nsec;
+        for (j = 0; j < TOKU_FS_LATENCY_BUCKETS; j++) {
+            a[i].latency[j] += b[i].latency[j];
+        }
+    }
+}
+
+#ifdef TOKUFS_PROFILE
+static void phases_add(struct toku_fs_phase_stats * a,
+        const struct toku_fs_phase_stats * b)
+{
+    for (int i = 0; i < TOKU_FS_PHASES; i++) {
+        a[i].calls += b[i].calls;
+        a[i].sampled += b[i].sampled;
+        a[i].nsec += b[i].nsec;
+    }
+}
+
+static void profile_add(struct toku_fs_profile * a,
+        const struct toku_fs_profile * b)
+{
+    for (int i = 0; i < TOKU_FS_OPS; i++) {
+        phases_add(a->ops[i], b->ops[i]);
+    }
+    phases_add(a->background, b->background);
+}
+#endif
+
+/**
+ * Fold an exiting thread's counters into the retired ones.
+ */
+static void opstats_thread_exit(void * arg)
+{
+    struct opstats_thread * self = arg;
+
+    pthread_mutex_lock(&opstats_lock);
+    opstats_add(opstats_retired, self->ops);
+#ifdef TOKUFS_PROFILE
+    profile_add(&opstats_retired_profile, &self->profile);
+#endif
+    if (self->prev != NULL) {
+        self->prev->next = self->next;
+    } else {
+        opstats_threads = self->next;
+    }
+    if (self->next != NULL) {
+        self->next->prev = self->prev;
+    }
+    pthread_mutex_unlock(&opstats_lock);
+    free(self);
+    opstats_self = NULL;
+}
+
+static void opstats_key_create(void)
+{
+    int ret;
+
+    ret = pthread_key_create(&opstats_key, opstats_thread_exit);
+    assert(ret == 0);
+}
+
+static struct opstats_thread * get_self(void)
+{
+    int ret;
+    struct opstats_thread * self = opstats_self;
+
+    if (self == NULL) {
+        pthread_once(&opstats_once, opstats_key_create);
+        self = calloc(1, sizeof(struct opstats_thread));
+        assert(self != NULL);
+        ret = pthread_setspecific(opstats_key, self);
+        assert(ret == 0);
+        pthread_mutex_lock(&opstats_lock);
+        self->next = opstats_threads;
+        if (opstats_threads != NULL) {
+            opstats_threads->prev = self;
+        }
+        opstats_threads = self;
+        pthread_mutex_unlock(&opstats_lock);
+        opstats_self = self;
+    }
+
+    return self;
+}
+
+static struct toku_fs_op_stats * get_op_stats(enum toku_fs_op op)
+{
+    assert(op < TOKU_FS_OPS);
+    return &get_self()->ops[op];
+}
+
+uint64_t toku_opstats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t toku_opstats_begin(enum toku_fs_op op)
+{
+    uint64_t now = toku_opstats_now();
+
+    if (opstats_depth++ == 0) {
+        opstats_current = op;
+    }
+    toku_trace_op(now, op, TOKU_FS_TRACE_BEGIN, 0);
+
+    return now;
+}
+
+/**
+ * Bucket i holds latencies of i significant bits.
+ */
+static int latency_bucket(uint64_t nsec)
+{
+    int bucket = nsec == 0 ? 0 : 64 - __builtin_clzll(nsec);
+
+    return bucket < TOKU_FS_LATENCY_BUCKETS ? bucket :
+        TOKU_FS_LATENCY_BUCKETS - 1;
+}
+
+void toku_opstats_end(enum toku_fs_op op, uint64_t start, int error)
+{
+    uint64_t now = toku_opstats_now();
+    uint64_t nsec = now - start;
+    struct toku_fs_op_stats * stats = get_op_stats(op);
+
+    stats->calls++;
+    stats->errors += error ? 1 : 0;
+    stats->nsec += nsec;
+    stats->latency[latency_bucket(nsec)]++;
+    // only the outermost end leaves the operation, even if an
+    // operation of the same kind was nested in it
+    if (opstats_depth > 0 && --opstats_depth == 0) {
+        opstats_current = TOKU_FS_OPS;
+    }
+    toku_trace_op(now, op, TOKU_FS_TRACE_END, error ? 1 : 0);
+}
+
+void toku_opstats_io(enum toku_fs_op op, uint64_t bytes, uint64_t blocks)
+{
+    struct toku_fs_op_stats * stats = get_op_stats(op);
+
+    stats->bytes += bytes;
+    stats->blocks += blocks;
+}
+
+void toku_opstats_upserts(enum toku_fs_op op, uint64_t n)
+{
+    get_op_stats(op)->upserts += n;
+}
+
+void toku_opstats_cache(enum toku_fs_op op, int hit)
+{
+    struct toku_fs_op_stats * stats = get_op_stats(op);
+
+    if (hit) {
+        stats->cache_hits++;
+    } else {
+        stats->cache_misses++;
+    }
+}
+
+#ifdef TOKUFS_PROFILE
+static struct toku_fs_phase_stats * get_phase_stats(enum toku_fs_phase phase)
+{
+    struct toku_fs_profile * profile = &get_self()->profile;
+
+    return opstats_current < TOKU_FS_OPS ?
+        &profile->ops[opstats_current][phase] :
+        &profile->background[phase];
+}
+
+/**
+ * Every phase call is counted, but only the first of every
+ * TOKUFS_PROFILE_SAMPLE gets a timestamp, counting from the last
+ * toku_opstats_restart_sampling(). A start of 0 tells the stop
+ * not to bother.
+ */
+uint64_t toku_opstats_phase_start(enum toku_fs_phase phase)
+{
+    struct opstats_thread * self = get_self();
+    struct toku_fs_phase_stats * stats = get_phase_stats(phase);
+    uint64_t epoch = __atomic_load_n(&opstats_sample_epoch, __ATOMIC_RELAXED);
+    uint32_t * countdown;
+
+    if (self->sample_epoch != epoch) {
+        memset(self->sample_countdown, 0, sizeof(self->sample_countdown));
+        self->sample_epoch = epoch;
+    }
+    stats->calls++;
+    countdown = &self->sample_countdown[opstats_current][phase];
+    if (*countdown > 0) {
+        (*countdown)--;
+        return 0;
+    }
+    *countdown = TOKUFS_PROFILE_SAMPLE - 1;
+    return toku_opstats_now();
+}
+
+void toku_opstats_restart_sampling(void)
+{
+    __sync_fetch_and_add(&opstats_sample_epoch, 1);
+}
+
+void toku_opstats_phase_stop(enum toku_fs_phase phase, uint64_t start)
+{
+    struct toku_fs_phase_stats * stats;
+
+    if (start != 0) {
+        stats = get_phase_stats(phase);
+        stats->sampled++;
+        stats->nsec += toku_opstats_now() - start;
+    }
+}
+
+void toku_opstats_get_profile(struct toku_fs_profile * profile)
+{
+    struct opstats_thread * t;
+
+    pthread_mutex_lock(&opstats_lock);
+    memcpy(profile, &opstats_retired_profile, sizeof(*profile));
+    for (t = opstats_threads; t != NULL; t = t->next) {
+        profile_add(profile, &t->profile);
+    }
+    pthread_mutex_unlock(&opstats_lock);
+    profile->sample_rate = TOKUFS_PROFILE_SAMPLE;
+}
+
+static void phases_sub(struct toku_fs_phase_stats * a,
+        const struct toku_fs_phase_stats * b)
+{
+    for (int i = 0; i < TOKU_FS_PHASES; i++) {
+        a[i].calls -= b[i].calls;
+        a[i].sampled -= b[i].sampled;
+        a[i].nsec -= b[i].nsec;
+    }
+}
+
+void toku_opstats_sub_profile(struct toku_fs_profile * a,
+        const struct toku_fs_profile * b)
+{
+    for (int i = 0; i < TOKU_FS_OPS; i++) {
+        phases_sub(a->ops[i], b->ops[i]);
+    }
+    phases_sub(a->background, b->background);
+}
+#endif
+
+void toku_opstats_get(struct toku_fs_op_stats * ops)
+{
+    struct opstats_thread * t;
+
+    pthread_mutex_lock(&opstats_lock);
+    memcpy(ops, opstats_retired, sizeof(opstats_retired));
+    for (t = opstats_threads; t != NULL; t = t->next) {
+        opstats_add(ops, t->ops);
+    }
+    pthread_mutex_unlock(&opstats_lock);
+}
+
+void toku_opstats_sub(struct toku_fs_op_stats * a,
+        const struct toku_fs_op_stats * b)
+{
+    int i, j;
+
+    for (i = 0; i < TOKU_FS_OPS; i++) {
+        a[i].calls -= b[i].calls;
+        a[i].errors -= b[i].errors;
+        a[i].bytes -= b[i].bytes;
+        a[i].blocks -= b[i].blocks;
+        a[i].upserts -= b[i].upserts;
+        a[i].cache_hits -= b[i].cache_hits;
+        a[i].cache_misses -= b[i].cache_misses;
+        a[i].nsec -= b[i].nsec;
+        for (j = 0; j < TOKU_FS_LATENCY_BUCKETS; j++) {
+            a[i].latency[j] -= b[i].latency[j];
+        }
+    }
+}
+
+const char * toku_opstats_name(enum toku_fs_op op)
+{
+    return op < TOKU_FS_OPS ? opstats_names[op] : NULL;
+}
+
+const char * toku_opstats_phase_name(enum toku_fs_phase phase)
+{
+    return phase < TOKU_FS_PHASES ? opstats_phase_names[phase] : NULL;
+}
+
+int toku_opstats_dump(FILE * f, const struct toku_fs_op_stats * ops)
+{
+    int i, j;
+
+    fprintf(f, "# op calls errors bytes blocks upserts cache_hits "
+            "cache_misses nsec latency[%d]\n", TOKU_FS_LATENCY_BUCKETS);
+    for (i = 0; i < TOKU_FS_OPS; i++) {
+        fprintf(f, "%s %lu %lu %lu %lu %lu %lu %lu %lu", opstats_names[i],
+                ops[i].calls, ops[i].errors, ops[i].bytes, ops[i].blocks,
+                ops[i].upserts, ops[i].cache_hits, ops[i].cache_misses,
+                ops[i].nsec);
+        for (j = 0; j < TOKU_FS_LATENCY_BUCKETS; j++) {
+            fprintf(f, " %lu", ops[i].latency[j]);
+        }
+        fprintf(f, "\n");
+    }
+
+    return ferror(f) ? -EIO : 0;
+}
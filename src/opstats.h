@@ -0,0 +1,97 @@
+/**
+ * TokuFS
+ */
+
+#ifndef TOKU_OPSTATS_H
+#define TOKU_OPSTATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <tokufs.h>
+
+/**
+ * Counters and latency histograms for each operation. Every
+ * thread counts into its own set, so nothing on the way through
+ * an operation takes a lock or shares a cache line. Readers add
+ * the sets up, along with what's left of threads that exited.
+ *
+ * An operation takes toku_opstats_begin() on the way in and calls
+ * toku_opstats_end() on the way out. The others add to the
+ * thread's counters for an operation in between.
+ */
+uint64_t toku_opstats_now(void);
+
+uint64_t toku_opstats_begin(enum toku_fs_op op);
+
+void toku_opstats_end(enum toku_fs_op op, uint64_t start, int error);
+
+void toku_opstats_io(enum toku_fs_op op, uint64_t bytes, uint64_t blocks);
+
+void toku_opstats_upserts(enum toku_fs_op op, uint64_t n);
+
+void toku_opstats_cache(enum toku_fs_op op, int hit);
+
+/**
+ * Add up every thread's counters into ops, which has room for
+ * TOKU_FS_OPS of them.
+ */
+void toku_opstats_get(struct toku_fs_op_stats * ops);
+
+/**
+ * Subtract the counters in b from a.
+ */
+void toku_opstats_sub(struct toku_fs_op_stats * a,
+        const struct toku_fs_op_stats * b);
+
+const char * toku_opstats_name(enum toku_fs_op op);
+
+/**
+ * Write ops as text, one line per operation. Returns 0, or
+ * -EIO if the stream fails.
+ */
+int toku_opstats_dump(FILE * f, const struct toku_fs_op_stats * ops);
+
+const char * toku_opstats_phase_name(enum toku_fs_phase phase);
+
+/**
+ * With -DTOKUFS_PROFILE, PROFILE_START(phase) and PROFILE_STOP(phase)
+ * around a phase in the same block count it against the operation
+ * the thread is in, timing one call in TOKUFS_PROFILE_SAMPLE.
+ * Otherwise they compile to nothing.
+ */
+#ifdef TOKUFS_PROFILE
+
+#ifndef TOKUFS_PROFILE_SAMPLE
+#define TOKUFS_PROFILE_SAMPLE 64
+#endif
+
+uint64_t toku_opstats_phase_start(enum toku_fs_phase phase);
+
+void toku_opstats_phase_stop(enum toku_fs_phase phase, uint64_t start);
+
+void toku_opstats_get_profile(struct toku_fs_profile * profile);
+
+/**
+ * Have every thread time the next call of each phase, and every
+ * TOKUFS_PROFILE_SAMPLE after it, as if it had just started.
+ */
+void toku_opstats_restart_sampling(void);
+
+void toku_opstats_sub_profile(struct toku_fs_profile * a,
+        const struct toku_fs_profile * b);
+
+#define PROFILE_START(phase)                                        \
+    uint64_t profile_start_##phase =                                \
+        toku_opstats_phase_start(TOKU_FS_PHASE_##phase)
+#define PROFILE_STOP(phase)                                         \
+    toku_opstats_phase_stop(TOKU_FS_PHASE_##phase, profile_start_##phase)
+
+#else
+
+#define PROFILE_START(phase) do { } while (0)
+#define PROFILE_STOP(phase) do { } while (0)
+
+#endif /* TOKUFS_PROFILE */
+
+#endif /* TOKU_OPSTATS_H */
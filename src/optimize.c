@@ -0,0 +1,355 @@
+/**
+ * TokuFS
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+
+#include "bstore.h"
+#include "optimize.h"
+#include "trace.h"
+
+// how often the thread looks at the message counts, in seconds,
+// unless the idle time is shorter
+#define OPTIMIZE_POLL 5
+
+// names of the data db optimized per hot optimize call
+#define OPTIMIZE_RANGE_NAMES 256
+
+enum optimize_dict {
+    OPTIMIZE_META = 0,
+    OPTIMIZE_DATA,
+    OPTIMIZE_DICTS
+};
+
+static pthread_mutex_t optimize_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t optimize_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t optimize_thread;
+static int optimize_started;
+static int optimize_stopping;
+static uint64_t optimize_backlog;
+static size_t optimize_idle;
+static size_t optimize_rate;
+static struct optimize_stats optimize_stats;
+// message counts of each dictionary as of its last optimize
+static uint64_t optimize_done[OPTIMIZE_DICTS];
+
+/**
+ * Where the current hot optimize call started, so the progress
+ * callback knows how far ahead of the rate it is.
+ */
+struct optimize_call {
+    uint64_t start_io;
+    struct timeval start;
+};
+
+static uint64_t elapsed_usec(struct timeval * since)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - since->tv_sec) * 1000000 +
+        now.tv_usec - since->tv_usec;
+}
+
+/**
+ * Bytes the calling thread has read from disk so far, or 0 if
+ * the kernel doesn't say. Hot optimize does its reads on the
+ * thread that calls it.
+ */
+static uint64_t thread_read_bytes(void)
+{
+    FILE * f;
+    char line[128];
+    unsigned long long n;
+    uint64_t bytes = 0;
+
+    f = fopen("/proc/thread-self/io", "r");
+    if (f == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "read_bytes: %llu", &n) == 1) {
+            bytes += n;
+        }
+    }
+    fclose(f);
+
+    return bytes;
+}
+
+// the engine status rows counting bytes of nodes written to disk
+static const char * const flush_rows[] = {
+    "FT_DISK_FLUSH_LEAF_BYTES",
+    "FT_DISK_FLUSH_NONLEAF_BYTES",
+    "FT_DISK_FLUSH_LEAF_BYTES_FOR_CHECKPOINT",
+    "FT_DISK_FLUSH_NONLEAF_BYTES_FOR_CHECKPOINT",
+};
+
+static void flush_bytes_row(const char * key, const char * legend,
+        uint64_t value, void * extra)
+{
+    uint64_t * bytes = extra;
+    (void) legend;
+
+    for (size_t i = 0; i < sizeof(flush_rows) / sizeof(flush_rows[0]); i++) {
+        if (strcmp(key, flush_rows[i]) == 0) {
+            *bytes += value;
+        }
+    }
+}
+
+/**
+ * Bytes of nodes the engine has written to disk since its env
+ * was opened. The nodes a hot optimize dirties are written by the
+ * engine's checkpoint and eviction threads, not the one that
+ * called it, so they're only seen here.
+ */
+static uint64_t engine_flush_bytes(void)
+{
+    int ret;
+    uint64_t bytes = 0;
+
+    ret = toku_bstore_env_get_status(flush_bytes_row, &bytes);
+    assert(ret == 0);
+
+    return bytes;
+}
+
+/**
+ * Disk io to charge an optimize with: what it read, and what
+ * the engine flushed. The flushes of nodes other work dirtied
+ * are charged too, so the optimizer backs off when the rest of
+ * the process is writing.
+ */
+static uint64_t optimize_io_bytes(void)
+{
+    return thread_read_bytes() + engine_flush_bytes();
+}
+
+/**
+ * Io since the call started. The engine's counters start over
+ * if its env is opened again by a cache resize.
+ */
+static uint64_t optimize_call_io(struct optimize_call * call)
+{
+    uint64_t io = optimize_io_bytes();
+
+    return io > call->start_io ? io - call->start_io : 0;
+}
+
+/**
+ * Wait up to usec, or until the thread is told to stop.
+ * Returns nonzero if it should stop. Called with the lock held.
+ */
+static int optimize_wait(uint64_t usec)
+{
+    struct timeval now;
+    struct timespec until;
+
+    gettimeofday(&now, NULL);
+    usec += now.tv_usec;
+    until.tv_sec = now.tv_sec + usec / 1000000;
+    until.tv_nsec = (usec % 1000000) * 1000;
+    while (!optimize_stopping && pthread_cond_timedwait(&optimize_cond,
+                &optimize_lock, &until) != ETIMEDOUT);
+
+    return optimize_stopping;
+}
+
+/**
+ * Called by the engine as a hot optimize goes. Sleeps long
+ * enough to bring the io done so far under the rate, and stops
+ * the optimize if we're stopping.
+ */
+static int optimize_progress_cb(float progress, void * extra)
+{
+    int stopping;
+    uint64_t io, usec, target;
+    struct optimize_call * call = extra;
+
+    pthread_mutex_lock(&optimize_lock);
+    optimize_stats.progress = progress * 100;
+    if (optimize_rate > 0) {
+        io = optimize_call_io(call);
+        target = io * 1000000 / optimize_rate;
+        usec = elapsed_usec(&call->start);
+        if (usec < target) {
+            optimize_wait(target - usec);
+        }
+    }
+    stopping = optimize_stopping;
+    pthread_mutex_unlock(&optimize_lock);
+
+    return stopping;
+}
+
+static void optimize_call_begin(struct optimize_call * call)
+{
+    call->start_io = optimize_io_bytes();
+    gettimeofday(&call->start, NULL);
+}
+
+static void optimize_call_end(struct optimize_call * call)
+{
+    pthread_mutex_lock(&optimize_lock);
+    optimize_stats.ranges++;
+    optimize_stats.bytes += optimize_call_io(call);
+    optimize_stats.progress = 0;
+    pthread_mutex_unlock(&optimize_lock);
+}
+
+/**
+ * Each returns 0 once the whole dictionary is optimized, or
+ * nonzero if it was cut short, by a stop or a cache resize.
+ */
+static int optimize_meta(void)
+{
+    int ret;
+    struct optimize_call call;
+
+    optimize_call_begin(&call);
+    ret = toku_bstore_hot_optimize_meta(optimize_progress_cb, &call);
+    optimize_call_end(&call);
+
+    return ret;
+}
+
+/**
+ * Optimize the data db a range of names at a time, so the
+ * work comes in pieces.
+ */
+static int optimize_data(void)
+{
+    int i, n, ret = 0;
+    char * names[OPTIMIZE_RANGE_NAMES];
+    char * after = NULL;
+    struct optimize_call call;
+
+    while (ret == 0 && (n = toku_bstore_scan_names("/", after,
+                    names, OPTIMIZE_RANGE_NAMES)) > 0) {
+        optimize_call_begin(&call);
+        ret = toku_bstore_hot_optimize_data(names[0], names[n - 1],
+                optimize_progress_cb, &call);
+        optimize_call_end(&call);
+        free(after);
+        after = names[n - 1];
+        for (i = 0; i < n - 1; i++) {
+            free(names[i]);
+        }
+    }
+    free(after);
+
+    return ret;
+}
+
+static void * optimize_thread_fn(void * arg)
+{
+    int d, ret;
+    uint64_t pending, total, last_total;
+    uint64_t messages[OPTIMIZE_DICTS];
+    struct timeval last_activity;
+    size_t poll = optimize_idle > 0 && optimize_idle < OPTIMIZE_POLL ?
+        optimize_idle : OPTIMIZE_POLL;
+    (void) arg;
+
+    last_total = optimize_done[OPTIMIZE_META] + optimize_done[OPTIMIZE_DATA];
+    gettimeofday(&last_activity, NULL);
+
+    pthread_mutex_lock(&optimize_lock);
+    while (!optimize_wait(poll * 1000000)) {
+        pthread_mutex_unlock(&optimize_lock);
+        toku_bstore_get_messages(&messages[OPTIMIZE_META],
+                &messages[OPTIMIZE_DATA]);
+        total = messages[OPTIMIZE_META] + messages[OPTIMIZE_DATA];
+        if (total != last_total) {
+            last_total = total;
+            gettimeofday(&last_activity, NULL);
+        }
+        for (d = 0; d < OPTIMIZE_DICTS; d++) {
+            total = messages[d];
+            pending = total - optimize_done[d];
+            if (pending == 0) {
+                continue;
+            }
+            if ((optimize_backlog > 0 && pending >= optimize_backlog) ||
+                    (optimize_idle > 0 && elapsed_usec(&last_activity) >=
+                     optimize_idle * 1000000ULL)) {
+                toku_trace(TOKU_TRACE_OPS, TOKU_TRACE_OPTIMIZE_DICT, NULL,
+                        d == OPTIMIZE_META, pending);
+                ret = d == OPTIMIZE_META ? optimize_meta() :
+                    optimize_data();
+                // one cut short is tried again next time around
+                if (ret != 0) {
+                    break;
+                }
+                optimize_done[d] = total;
+                pthread_mutex_lock(&optimize_lock);
+                optimize_stats.passes++;
+                pthread_mutex_unlock(&optimize_lock);
+            }
+        }
+        pthread_mutex_lock(&optimize_lock);
+    }
+    pthread_mutex_unlock(&optimize_lock);
+
+    return NULL;
+}
+
+int toku_optimize_start(uint64_t backlog, size_t idle, size_t rate)
+{
+    int ret = 0;
+
+    // only what's sent from here on counts
+    toku_bstore_get_messages(&optimize_done[OPTIMIZE_META],
+            &optimize_done[OPTIMIZE_DATA]);
+    optimize_backlog = backlog;
+    optimize_idle = idle;
+    optimize_rate = rate;
+    optimize_stopping = 0;
+    // nothing would ever set it off
+    if (backlog == 0 && idle == 0) {
+        goto out;
+    }
+    ret = pthread_create(&optimize_thread, NULL, optimize_thread_fn, NULL);
+    assert(ret == 0);
+    optimize_started = 1;
+
+out:
+    return ret;
+}
+
+int toku_optimize_stop(void)
+{
+    int ret = 0;
+
+    if (!optimize_started) {
+        goto out;
+    }
+    pthread_mutex_lock(&optimize_lock);
+    optimize_stopping = 1;
+    pthread_cond_broadcast(&optimize_cond);
+    pthread_mutex_unlock(&optimize_lock);
+    ret = pthread_join(optimize_thread, NULL);
+    assert(ret == 0);
+    optimize_started = 0;
+    optimize_stats.progress = 0;
+
+out:
+    return ret;
+}
+
+void toku_optimize_get_stats(struct optimize_stats * stats)
+{
+    pthread_mutex_lock(&optimize_lock);
+    *stats = optimize_stats;
+    pthread_mutex_unlock(&optimize_lock);
+}
@@ -0,0 +1,53 @@
+/**
+ * Tokufs
+ */
+
+#ifndef TOKU_OPTIMIZE_H
+#define TOKU_OPTIMIZE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * The engine buffers puts, deletes and updates as messages high
+ * in the tree, and a read that finds a backlog of them applies
+ * them on the way down. An optimize thread flushes them ahead of
+ * time with hot optimize, the meta and data dictionaries each on
+ * their own. The data dictionary is done a range of names at a
+ * time.
+ *
+ * A dictionary gets optimized once backlog messages were sent
+ * to it since its last optimize, or once it has any at all and
+ * nothing was sent to either dictionary for idle seconds. While
+ * it works, the thread keeps the disk io under rate bytes per
+ * second, and doesn't wait at all if rate is 0. That io is what
+ * it reads plus everything the engine flushes, which includes the
+ * nodes it dirties, written back by the engine's own threads.
+ */
+int toku_optimize_start(uint64_t backlog, size_t idle, size_t rate);
+
+/**
+ * Stop the optimize thread, stopping any optimize in the middle.
+ */
+int toku_optimize_stop(void);
+
+/**
+ * passes   - dictionaries optimized all the way through.
+ * ranges   - hot optimize calls finished, one per range of the
+ *            data dictionary and one per meta optimize.
+ * bytes    - disk io charged to optimizes: what they read, and
+ *            what the engine flushed while they ran.
+ * progress - percent done of the hot optimize going on now,
+ *            or 0 if there isn't one.
+ */
+struct optimize_stats
+{
+    uint64_t passes;
+    uint64_t ranges;
+    uint64_t bytes;
+    unsigned progress;
+};
+
+void toku_optimize_get_stats(struct optimize_stats * stats);
+
+#endif /* TOKU_OPTIMIZE_H */
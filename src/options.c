@@ -0,0 +1,333 @@
+/**
+ * TokuFS
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include <tokufs.h>
+#include <toku/str.h>
+
+#include "bstore.h"
+#include "trace.h"
+
+#define OPTIONS_MAX_LINE 1024
+
+// reads and writes this big are worth the hand off to other threads
+#define PARALLEL_READ_DEFAULT (1 << 20)
+#define PARALLEL_WRITE_DEFAULT (1 << 20)
+
+// siblings swept ahead of a directory read in name order
+#define DIR_PREFETCH_DEFAULT 64
+
+/**
+ * Parse a size with an optional k, m or g suffix. Sizes too big
+ * for a size_t are invalid rather than wrapped.
+ */
+static int parse_size(const char * str, size_t * size)
+{
+    char * end;
+    int shift;
+    unsigned long long n;
+
+    if (!isdigit((unsigned char) *str)) {
+        return -EINVAL;
+    }
+    errno = 0;
+    n = strtoull(str, &end, 10);
+    if (errno == ERANGE || n > SIZE_MAX) {
+        return -EINVAL;
+    }
+    switch (tolower((unsigned char) *end)) {
+        case 'g':
+            shift = 30;
+            end++;
+            break;
+        case 'm':
+            shift = 20;
+            end++;
+            break;
+        case 'k':
+            shift = 10;
+            end++;
+            break;
+        case '\0':
+            shift = 0;
+            break;
+        default:
+            return -EINVAL;
+    }
+    if (*end != '\0' || n == 0 || n > (SIZE_MAX >> shift)) {
+        return -EINVAL;
+    }
+    n <<= shift;
+    *size = n;
+
+    return 0;
+}
+
+/**
+ * Parse a size for an option where 0 means off or automatic.
+ */
+static int parse_size_or_zero(const char * str, size_t * size)
+{
+    if (strcmp(str, "0") == 0) {
+        *size = 0;
+        return 0;
+    }
+
+    return parse_size(str, size);
+}
+
+/**
+ * Compression method names, indexed by method.
+ */
+static const char * compression_names[] = {
+    [TOKU_FS_COMPRESSION_DEFAULT] = "default",
+    [TOKU_FS_COMPRESSION_NONE] = "none",
+    [TOKU_FS_COMPRESSION_QUICKLZ] = "quicklz",
+    [TOKU_FS_COMPRESSION_ZLIB] = "zlib",
+    [TOKU_FS_COMPRESSION_LZMA] = "lzma",
+    [TOKU_FS_COMPRESSION_FAST] = "fast",
+    [TOKU_FS_COMPRESSION_SMALL] = "small",
+};
+
+/**
+ * Parse a compression method by name.
+ */
+static int parse_compression(const char * str,
+        enum toku_fs_compression_method * method)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(compression_names) / sizeof(char *); i++) {
+        if (strcmp(str, compression_names[i]) == 0) {
+            *method = i;
+            return 0;
+        }
+    }
+
+    return -EINVAL;
+}
+
+/**
+ * Advice names, indexed by advice. WILLNEED is for a range,
+ * so it can't be a default for every file.
+ */
+static const char * advice_names[] = {
+    [TOKU_FS_ADVICE_NORMAL] = "normal",
+    [TOKU_FS_ADVICE_SEQUENTIAL] = "sequential",
+    [TOKU_FS_ADVICE_RANDOM] = "random",
+    [TOKU_FS_ADVICE_WILLNEED] = NULL,
+    [TOKU_FS_ADVICE_DONTNEED] = "dontneed",
+};
+
+/**
+ * Parse access pattern advice by name.
+ */
+static int parse_advice(const char * str, enum toku_fs_advice * advice)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(advice_names) / sizeof(char *); i++) {
+        if (advice_names[i] != NULL && strcmp(str, advice_names[i]) == 0) {
+            *advice = i;
+            return 0;
+        }
+    }
+
+    return -EINVAL;
+}
+
+/**
+ * Set one dictionary option, given the key without
+ * the data_ or meta_ prefix.
+ */
+static int set_dict_option(struct toku_fs_dict_options * dict,
+        const char * key, const char * value)
+{
+    int ret;
+    size_t n;
+
+    if (strcmp(key, "compression") == 0) {
+        ret = parse_compression(value, &dict->compression);
+        goto out;
+    }
+
+    ret = parse_size(value, &n);
+    if (ret != 0) {
+        goto out;
+    }
+    if (strcmp(key, "nodesize") == 0 && n <= UINT32_MAX) {
+        dict->nodesize = n;
+    } else if (strcmp(key, "basementsize") == 0 && n <= UINT32_MAX) {
+        dict->basementsize = n;
+    } else if (strcmp(key, "fanout") == 0 && n <= UINT32_MAX) {
+        dict->fanout = n;
+    } else {
+        ret = -EINVAL;
+    }
+
+out:
+    return ret;
+}
+
+/**
+ * Set a single key to a value.
+ */
+static int set_option(struct toku_fs_mount_options * opts,
+        const char * key, const char * value)
+{
+    int ret;
+
+    toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_MOUNT_OPTION, key, 0, 0);
+    if (strcmp(key, "cachesize") == 0) {
+        ret = parse_size(value, &opts->cachesize);
+    } else if (strcmp(key, "meta_cachesize") == 0) {
+        ret = parse_size(value, &opts->meta_cachesize);
+    } else if (strcmp(key, "reclaim_rate") == 0) {
+        ret = parse_size(value, &opts->reclaim_rate);
+    } else if (strcmp(key, "optimize_backlog") == 0) {
+        ret = parse_size(value, &opts->optimize_backlog);
+    } else if (strcmp(key, "optimize_idle") == 0) {
+        ret = parse_size(value, &opts->optimize_idle);
+    } else if (strcmp(key, "optimize_rate") == 0) {
+        ret = parse_size(value, &opts->optimize_rate);
+    } else if (strcmp(key, "workers") == 0) {
+        ret = parse_size_or_zero(value, &opts->workers);
+    } else if (strcmp(key, "parallel_read") == 0) {
+        ret = parse_size_or_zero(value, &opts->parallel_read);
+    } else if (strcmp(key, "parallel_write") == 0) {
+        ret = parse_size_or_zero(value, &opts->parallel_write);
+    } else if (strcmp(key, "dir_prefetch") == 0) {
+        ret = parse_size_or_zero(value, &opts->dir_prefetch);
+    } else if (strcmp(key, "fadvise") == 0) {
+        ret = parse_advice(value, &opts->advice);
+    } else if (toku_strprefix(key, "data_")) {
+        ret = set_dict_option(&opts->data, key + strlen("data_"), value);
+    } else if (toku_strprefix(key, "meta_")) {
+        ret = set_dict_option(&opts->meta, key + strlen("meta_"), value);
+    } else {
+        ret = -EINVAL;
+    }
+
+    return ret;
+}
+
+/**
+ * Trim leading and trailing whitespace in place.
+ */
+static char * strtrim(char * str)
+{
+    char * end;
+
+    while (isspace((unsigned char) *str)) {
+        str++;
+    }
+    end = str + strlen(str);
+    while (end > str && isspace((unsigned char) end[-1])) {
+        end--;
+    }
+    *end = '\0';
+
+    return str;
+}
+
+/**
+ * Split a key=value pair and set it.
+ */
+static int set_option_pair(struct toku_fs_mount_options * opts, char * pair)
+{
+    char * value;
+
+    value = strchr(pair, '=');
+    if (value == NULL) {
+        return -EINVAL;
+    }
+    *value++ = '\0';
+
+    return set_option(opts, strtrim(pair), strtrim(value));
+}
+
+/**
+ * Initialize mount options to the defaults.
+ */
+void toku_fs_mount_options_init(struct toku_fs_mount_options * opts)
+{
+    memset(opts, 0, sizeof(struct toku_fs_mount_options));
+    opts->cachesize = toku_bstore_env_get_cachesize();
+    opts->parallel_read = PARALLEL_READ_DEFAULT;
+    opts->parallel_write = PARALLEL_WRITE_DEFAULT;
+    opts->dir_prefetch = DIR_PREFETCH_DEFAULT;
+}
+
+/**
+ * Parse a comma separated list of key=value pairs into opts.
+ */
+int toku_fs_mount_options_parse(struct toku_fs_mount_options * opts,
+        const char * str)
+{
+    int ret;
+    char * buf, * pair, * saveptr;
+
+    ret = 0;
+    buf = toku_strdup(str);
+    for (pair = strtok_r(buf, ",", &saveptr); pair != NULL;
+            pair = strtok_r(NULL, ",", &saveptr)) {
+        ret = set_option_pair(opts, pair);
+        if (ret != 0) {
+            break;
+        }
+    }
+    free(buf);
+
+    return ret;
+}
+
+/**
+ * Read a config file of key = value lines into opts.
+ */
+int toku_fs_mount_options_load(struct toku_fs_mount_options * opts,
+        const char * filename, int * bad_line)
+{
+    int ret, lineno;
+    FILE * fp;
+    char line[OPTIONS_MAX_LINE], * p;
+
+    if (bad_line != NULL) {
+        *bad_line = 0;
+    }
+    fp = fopen(filename, "r");
+    if (fp == NULL) {
+        ret = -errno;
+        goto out;
+    }
+
+    ret = 0;
+    lineno = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        p = strtrim(line);
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+        ret = set_option_pair(opts, p);
+        if (ret != 0) {
+            if (bad_line != NULL) {
+                *bad_line = lineno;
+            }
+            break;
+        }
+    }
+    fclose(fp);
+
+out:
+    return ret;
+}
@@ -0,0 +1,499 @@
+/**
+ * TokuFS
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <toku/str.h>
+
+#include "bstore.h"
+#include "reclaim.h"
+#include "trace.h"
+
+// names handed to the reclaim function per scan
+#define RECLAIM_BATCH 64
+
+// buckets the table of queued names starts with
+#define RECLAIM_MIN_BUCKETS 64
+
+/**
+ * Names are reclaimed in the order they were released. A job
+ * stays on the queue until it's done, so toku_reclaim_covers
+ * keeps seeing it while it runs. Every job is also in the
+ * bstore's reclaim queue, until it's done.
+ *
+ * A mass unlink queues millions of single names, and every
+ * create checks whether its path is queued, so single names
+ * are also counted in a hash table, by how many jobs have them.
+ * Prefixes of removed trees are few, and are kept on a list of
+ * their own that covers walks.
+ */
+struct reclaim_job {
+    char * prefix;
+    int held;
+    struct reclaim_job * prev;
+    struct reclaim_job * next;
+    // prefix jobs only
+    struct reclaim_job * prefix_prev;
+    struct reclaim_job * prefix_next;
+};
+
+struct queued_name {
+    char * name;
+    uint64_t hash;
+    uint64_t jobs;
+    struct queued_name * hash_next;
+};
+
+static pthread_mutex_t reclaim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reclaim_cond = PTHREAD_COND_INITIALIZER;
+static struct reclaim_job * reclaim_head;
+static struct reclaim_job * reclaim_tail;
+static struct reclaim_job * reclaim_prefixes;
+static struct queued_name ** reclaim_buckets;
+static size_t reclaim_num_buckets;
+static size_t reclaim_num_names;
+static uint64_t reclaim_jobs;
+static int reclaim_stopping;
+static pthread_t reclaim_thread;
+static reclaim_fn reclaim_name;
+static size_t reclaim_rate;
+
+static int job_is_prefix(struct reclaim_job * job)
+{
+    size_t len = strlen(job->prefix);
+    return len > 0 && job->prefix[len - 1] == '/';
+}
+
+static uint64_t name_hash(const char * name)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (; *name != '\0'; name++) {
+        hash ^= (unsigned char) *name;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static struct queued_name ** find_name(const char * name, uint64_t hash)
+{
+    struct queued_name ** p;
+
+    p = &reclaim_buckets[hash % reclaim_num_buckets];
+    for (; *p != NULL; p = &(*p)->hash_next) {
+        if ((*p)->hash == hash && strcmp((*p)->name, name) == 0) {
+            break;
+        }
+    }
+
+    return p;
+}
+
+/**
+ * Double the table once it has more names than buckets.
+ */
+static void maybe_grow(void)
+{
+    size_t i, num_buckets;
+    struct queued_name ** buckets;
+    struct queued_name * n, * next;
+
+    if (reclaim_num_names <= reclaim_num_buckets) {
+        return;
+    }
+    num_buckets = reclaim_num_buckets * 2;
+    buckets = calloc(num_buckets, sizeof(struct queued_name *));
+    assert(buckets != NULL);
+    for (i = 0; i < reclaim_num_buckets; i++) {
+        for (n = reclaim_buckets[i]; n != NULL; n = next) {
+            next = n->hash_next;
+            n->hash_next = buckets[n->hash % num_buckets];
+            buckets[n->hash % num_buckets] = n;
+        }
+    }
+    free(reclaim_buckets);
+    reclaim_buckets = buckets;
+    reclaim_num_buckets = num_buckets;
+}
+
+/**
+ * Count another job for a single name.
+ */
+static void name_add(const char * name)
+{
+    uint64_t hash = name_hash(name);
+    struct queued_name ** p = find_name(name, hash);
+    struct queued_name * n = *p;
+
+    if (n == NULL) {
+        n = malloc(sizeof(struct queued_name));
+        n->name = toku_strdup(name);
+        n->hash = hash;
+        n->jobs = 0;
+        n->hash_next = NULL;
+        *p = n;
+        reclaim_num_names++;
+        maybe_grow();
+    }
+    n->jobs++;
+}
+
+/**
+ * Count a single name's job done. Returns nonzero if it was
+ * the last one for the name.
+ */
+static int name_remove(const char * name)
+{
+    struct queued_name ** p = find_name(name, name_hash(name));
+    struct queued_name * n = *p;
+
+    assert(n != NULL && n->jobs > 0);
+    if (--n->jobs > 0) {
+        return 0;
+    }
+    *p = n->hash_next;
+    reclaim_num_names--;
+    free(n->name);
+    free(n);
+
+    return 1;
+}
+
+static void reclaim_names_init(void)
+{
+    reclaim_num_buckets = RECLAIM_MIN_BUCKETS;
+    reclaim_buckets = calloc(reclaim_num_buckets,
+            sizeof(struct queued_name *));
+    assert(reclaim_buckets != NULL);
+    reclaim_num_names = 0;
+}
+
+static void reclaim_names_destroy(void)
+{
+    size_t i;
+    struct queued_name * n, * next;
+
+    for (i = 0; i < reclaim_num_buckets; i++) {
+        for (n = reclaim_buckets[i]; n != NULL; n = next) {
+            next = n->hash_next;
+            free(n->name);
+            free(n);
+        }
+    }
+    free(reclaim_buckets);
+    reclaim_buckets = NULL;
+    reclaim_num_buckets = 0;
+    reclaim_num_names = 0;
+}
+
+/**
+ * Keep reclaiming under the rate by waiting as long as it
+ * takes to give back that many blocks at the rate. Returns
+ * nonzero if the reclaim thread should stop.
+ */
+static int reclaim_throttle(int blocks)
+{
+    int stopping;
+    uint64_t usec;
+    struct timeval now;
+    struct timespec until;
+
+    pthread_mutex_lock(&reclaim_lock);
+    if (reclaim_rate > 0 && blocks > 0) {
+        usec = (uint64_t) blocks * BSTORE_BLOCKSIZE * 1000000 / reclaim_rate;
+        gettimeofday(&now, NULL);
+        usec += now.tv_usec;
+        until.tv_sec = now.tv_sec + usec / 1000000;
+        until.tv_nsec = (usec % 1000000) * 1000;
+        // stopping wakes us up early
+        while (!reclaim_stopping && pthread_cond_timedwait(&reclaim_cond,
+                    &reclaim_lock, &until) != ETIMEDOUT);
+    }
+    stopping = reclaim_stopping;
+    pthread_mutex_unlock(&reclaim_lock);
+
+    return stopping;
+}
+
+/**
+ * Hand every name under prefix with blocks to the reclaim
+ * function, a batch at a time. Names the function leaves
+ * alone are skipped by starting the next batch after them.
+ * Returns nonzero if it stopped before getting through them.
+ */
+static int reclaim_prefix(const char * prefix)
+{
+    int i, n, stopped = 0;
+    char * names[RECLAIM_BATCH];
+    char * after = NULL;
+
+    toku_trace(TOKU_TRACE_OPS, TOKU_TRACE_RECLAIM, prefix, 1, 0);
+    while (!stopped && (n = toku_bstore_scan_names(prefix, after,
+                    names, RECLAIM_BATCH)) > 0) {
+        for (i = 0; i < n && !stopped; i++) {
+            stopped = reclaim_throttle(reclaim_name(names[i]));
+        }
+        free(after);
+        after = names[n - 1];
+        for (i = 0; i < n - 1; i++) {
+            free(names[i]);
+        }
+    }
+    free(after);
+
+    return stopped;
+}
+
+/**
+ * Reclaim a job's name or everything under its prefix.
+ * Returns nonzero if it stopped before finishing.
+ */
+static int reclaim_job_run(struct reclaim_job * job)
+{
+    if (job_is_prefix(job)) {
+        return reclaim_prefix(job->prefix);
+    }
+    toku_trace(TOKU_TRACE_OPS, TOKU_TRACE_RECLAIM, job->prefix, 0, 0);
+    reclaim_throttle(reclaim_name(job->prefix));
+    return 0;
+}
+
+/**
+ * The first job that isn't held, or NULL. Only removed trees
+ * are held for long, so few are skipped.
+ */
+static struct reclaim_job * reclaim_next_job(void)
+{
+    struct reclaim_job * job;
+
+    for (job = reclaim_head; job != NULL && job->held; job = job->next);
+    return job;
+}
+
+static struct reclaim_job * reclaim_new_job(const char * name, int held)
+{
+    struct reclaim_job * job = malloc(sizeof(struct reclaim_job));
+
+    job->prefix = toku_strdup(name);
+    job->held = held;
+    job->prev = NULL;
+    job->next = NULL;
+    job->prefix_prev = NULL;
+    job->prefix_next = NULL;
+
+    return job;
+}
+
+static void reclaim_append_job(struct reclaim_job * job)
+{
+    job->prev = reclaim_tail;
+    if (reclaim_tail != NULL) {
+        reclaim_tail->next = job;
+    } else {
+        reclaim_head = job;
+    }
+    reclaim_tail = job;
+    if (job_is_prefix(job)) {
+        job->prefix_next = reclaim_prefixes;
+        if (reclaim_prefixes != NULL) {
+            reclaim_prefixes->prefix_prev = job;
+        }
+        reclaim_prefixes = job;
+    } else {
+        name_add(job->prefix);
+    }
+    __sync_fetch_and_add(&reclaim_jobs, 1);
+}
+
+/**
+ * Take a finished job off the queue. The same name can be
+ * queued twice, say a file unlinked again before its first
+ * reclaim ran, so it stays in the bstore until the last one.
+ */
+static void reclaim_remove_job(struct reclaim_job * job)
+{
+    int last = 1;
+    struct reclaim_job * other;
+
+    if (job->prev != NULL) {
+        job->prev->next = job->next;
+    } else {
+        reclaim_head = job->next;
+    }
+    if (job->next != NULL) {
+        job->next->prev = job->prev;
+    } else {
+        reclaim_tail = job->prev;
+    }
+    if (job_is_prefix(job)) {
+        if (job->prefix_prev != NULL) {
+            job->prefix_prev->prefix_next = job->prefix_next;
+        } else {
+            reclaim_prefixes = job->prefix_next;
+        }
+        if (job->prefix_next != NULL) {
+            job->prefix_next->prefix_prev = job->prefix_prev;
+        }
+        for (other = reclaim_prefixes; other != NULL && last;
+                other = other->prefix_next) {
+            last = strcmp(other->prefix, job->prefix) != 0;
+        }
+    } else {
+        last = name_remove(job->prefix);
+    }
+    if (last) {
+        toku_bstore_reclaim_delete(job->prefix);
+    }
+    __sync_fetch_and_sub(&reclaim_jobs, 1);
+    free(job->prefix);
+    free(job);
+}
+
+static void * reclaim_thread_fn(void * arg)
+{
+    int stopped;
+    struct reclaim_job * job;
+    (void) arg;
+
+    pthread_mutex_lock(&reclaim_lock);
+    for (;;) {
+        while (!reclaim_stopping && (job = reclaim_next_job()) == NULL) {
+            pthread_cond_wait(&reclaim_cond, &reclaim_lock);
+        }
+        if (reclaim_stopping) {
+            break;
+        }
+        pthread_mutex_unlock(&reclaim_lock);
+        stopped = reclaim_job_run(job);
+        pthread_mutex_lock(&reclaim_lock);
+        if (stopped) {
+            break;
+        }
+        reclaim_remove_job(job);
+    }
+    pthread_mutex_unlock(&reclaim_lock);
+
+    return NULL;
+}
+
+/**
+ * Queue a name the last mount didn't get to. It's already
+ * in the bstore.
+ */
+static void reclaim_load_cb(const char * name, void * extra)
+{
+    (void) extra;
+
+    toku_trace(TOKU_TRACE_OPS, TOKU_TRACE_RECLAIM_RESUME, name, 0, 0);
+    reclaim_append_job(reclaim_new_job(name, 0));
+}
+
+int toku_reclaim_start(reclaim_fn fn, size_t rate)
+{
+    int ret;
+
+    reclaim_name = fn;
+    reclaim_rate = rate;
+    reclaim_stopping = 0;
+    pthread_mutex_lock(&reclaim_lock);
+    reclaim_names_init();
+    ret = toku_bstore_reclaim_scan(reclaim_load_cb, NULL);
+    assert(ret == 0);
+    pthread_mutex_unlock(&reclaim_lock);
+    ret = pthread_create(&reclaim_thread, NULL, reclaim_thread_fn, NULL);
+    assert(ret == 0);
+
+    return ret;
+}
+
+int toku_reclaim_stop(void)
+{
+    int ret;
+    struct reclaim_job * job;
+
+    pthread_mutex_lock(&reclaim_lock);
+    reclaim_stopping = 1;
+    pthread_cond_broadcast(&reclaim_cond);
+    pthread_mutex_unlock(&reclaim_lock);
+    ret = pthread_join(reclaim_thread, NULL);
+    assert(ret == 0);
+
+    // whatever is left stays in the bstore for the next mount
+    while ((job = reclaim_head) != NULL) {
+        reclaim_head = job->next;
+        free(job->prefix);
+        free(job);
+    }
+    reclaim_tail = NULL;
+    reclaim_prefixes = NULL;
+    reclaim_names_destroy();
+    reclaim_jobs = 0;
+
+    return ret;
+}
+
+struct reclaim_job * toku_reclaim_hold(const char * name)
+{
+    struct reclaim_job * job = reclaim_new_job(name, 1);
+
+    pthread_mutex_lock(&reclaim_lock);
+    toku_bstore_reclaim_put(name);
+    reclaim_append_job(job);
+    pthread_mutex_unlock(&reclaim_lock);
+
+    return job;
+}
+
+void toku_reclaim_release(struct reclaim_job * job)
+{
+    pthread_mutex_lock(&reclaim_lock);
+    job->held = 0;
+    pthread_cond_broadcast(&reclaim_cond);
+    pthread_mutex_unlock(&reclaim_lock);
+}
+
+void toku_reclaim_add(const char * name)
+{
+    struct reclaim_job * job = reclaim_new_job(name, 0);
+
+    pthread_mutex_lock(&reclaim_lock);
+    toku_bstore_reclaim_put(name);
+    reclaim_append_job(job);
+    pthread_cond_broadcast(&reclaim_cond);
+    pthread_mutex_unlock(&reclaim_lock);
+}
+
+int toku_reclaim_covers(const char * path)
+{
+    int covered = 0;
+    struct reclaim_job * job;
+
+    // nearly always nothing is queued, so don't take the lock
+    if (toku_reclaim_pending() == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&reclaim_lock);
+    covered = *find_name(path, name_hash(path)) != NULL;
+    for (job = reclaim_prefixes; job != NULL && !covered;
+            job = job->prefix_next) {
+        covered = toku_strprefix(path, job->prefix);
+    }
+    pthread_mutex_unlock(&reclaim_lock);
+
+    return covered;
+}
+
+uint64_t toku_reclaim_pending(void)
+{
+    return __sync_fetch_and_add(&reclaim_jobs, 0);
+}
@@ -0,0 +1,71 @@
+/**
+ * Tokufs
+ */
+
+#ifndef TOKU_RECLAIM_H
+#define TOKU_RECLAIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Removed files give their data blocks back in the background.
+ * The metadata goes right away, and the name of whatever was
+ * removed is queued here for a reclaim thread. A name ending in
+ * a slash is the prefix of a removed tree, and the thread finds
+ * every name under it that still has blocks. Any other name is
+ * a single unlinked file. Each one is handed to the reclaim
+ * function, which returns how many blocks it gave back.
+ *
+ * The reclaim function decides whether the blocks are really
+ * garbage, since a path can be created again before its old
+ * blocks are gone.
+ *
+ * The queue is kept in the bstore, so whatever wasn't reclaimed
+ * before an unmount is picked up again at the next mount.
+ */
+typedef int (*reclaim_fn)(const char * name);
+
+/**
+ * Start the reclaim thread, giving back at most rate bytes per
+ * second, or as fast as it can if rate is 0. Anything left on
+ * the queue by the last mount is reclaimed first.
+ */
+int toku_reclaim_start(reclaim_fn fn, size_t rate);
+
+/**
+ * Stop the reclaim thread. Whatever isn't done yet stays queued
+ * in the bstore for the next mount.
+ */
+int toku_reclaim_stop(void);
+
+/**
+ * Queue the blocks of name, or of every name starting with
+ * it if it ends in a slash.
+ */
+void toku_reclaim_add(const char * name);
+
+/**
+ * Queue a name, but don't reclaim it until it's released.
+ * toku_reclaim_covers sees it right away, so paths created
+ * under it meanwhile drop their stale blocks, while the reclaim
+ * thread waits until every name under it is really gone.
+ */
+struct reclaim_job;
+
+struct reclaim_job * toku_reclaim_hold(const char * name);
+
+void toku_reclaim_release(struct reclaim_job * job);
+
+/**
+ * True if path is queued, or falls under a prefix that is,
+ * in which case it may have stale blocks.
+ */
+int toku_reclaim_covers(const char * path);
+
+/**
+ * Number of names queued or being reclaimed.
+ */
+uint64_t toku_reclaim_pending(void);
+
+#endif /* TOKU_RECLAIM_H */
@@ -0,0 +1,126 @@
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "../workpool.h"
+
+#define WORKERS 4
+#define TASKS 100000
+#define FANOUT 16
+#define SUBMITTERS 8
+#define ROUNDS 10
+
+static struct workpool * pool;
+static uint64_t ran;
+
+static void count_task(void * arg)
+{
+    (void) arg;
+    __atomic_add_fetch(&ran, 1, __ATOMIC_RELAXED);
+}
+
+/* More tasks than a deque holds, so some run inline. */
+static void test_many(void)
+{
+    struct workpool_batch batch;
+
+    ran = 0;
+    toku_workpool_batch_init(&batch);
+    for (int i = 0; i < TASKS; i++) {
+        toku_workpool_submit(pool, &batch, count_task, NULL);
+    }
+    toku_workpool_wait(pool, &batch);
+    assert(ran == TASKS);
+
+    // waited on batches can be used again, and an empty one is done
+    for (int r = 0; r < ROUNDS; r++) {
+        toku_workpool_submit(pool, &batch, count_task, NULL);
+        toku_workpool_wait(pool, &batch);
+        assert(ran == (uint64_t) TASKS + r + 1);
+    }
+    toku_workpool_wait(pool, &batch);
+    toku_workpool_batch_destroy(&batch);
+}
+
+/* Tasks that submit and wait on their own batches. */
+static void nested_task(void * arg)
+{
+    int depth = (int) (intptr_t) arg;
+    struct workpool_batch batch;
+
+    if (depth == 0) {
+        count_task(NULL);
+        return;
+    }
+    toku_workpool_batch_init(&batch);
+    for (int i = 0; i < FANOUT; i++) {
+        toku_workpool_submit(pool, &batch, nested_task,
+                (void *) (intptr_t) (depth - 1));
+    }
+    toku_workpool_wait(pool, &batch);
+    toku_workpool_batch_destroy(&batch);
+}
+
+static void test_nested(void)
+{
+    ran = 0;
+    nested_task((void *) (intptr_t) 3);
+    assert(ran == FANOUT * FANOUT * FANOUT);
+}
+
+/* Threads outside the pool submitting at once, each to its own batch. */
+static void * submitter(void * arg)
+{
+    struct workpool_batch batch;
+    (void) arg;
+
+    toku_workpool_batch_init(&batch);
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < TASKS / SUBMITTERS / ROUNDS; i++) {
+            toku_workpool_submit(pool, &batch, count_task, NULL);
+        }
+        toku_workpool_wait(pool, &batch);
+    }
+    toku_workpool_batch_destroy(&batch);
+    return NULL;
+}
+
+static void test_submitters(void)
+{
+    int ret;
+    pthread_t threads[SUBMITTERS];
+
+    // twice, so the second set adopts the deques the first left
+    for (int r = 0; r < 2; r++) {
+        ran = 0;
+        for (int i = 0; i < SUBMITTERS; i++) {
+            ret = pthread_create(&threads[i], NULL, submitter, NULL);
+            assert(ret == 0);
+        }
+        for (int i = 0; i < SUBMITTERS; i++) {
+            ret = pthread_join(threads[i], NULL);
+            assert(ret == 0);
+        }
+        assert(ran == TASKS / SUBMITTERS / ROUNDS * SUBMITTERS * ROUNDS);
+    }
+}
+
+int main(void)
+{
+    pool = toku_workpool_create(WORKERS);
+    assert(toku_workpool_workers(pool) == WORKERS);
+    test_many();
+    test_nested();
+    test_submitters();
+    toku_workpool_destroy(pool);
+
+    pool = toku_workpool_create(0);
+    assert(toku_workpool_workers(pool) > 0);
+    test_nested();
+    toku_workpool_destroy(pool);
+
+    return 0;
+}
@@ -7,30 +7,32 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <assert.h>
 #include <pthread.h>
+#include <limits.h>
+#include <fnmatch.h>
+#include <sys/statvfs.h>
 
 #include <tokufs.h>
 #include <toku/str.h>
-#include <toku/debug.h>
-
-// this will the one and only place the global
-// symbol toku_debug will be defined, as prototyped
-// in the toku/debug.h header
-#ifdef DEBUG
-UNUSED
-int toku_debug = 1;
-#else
-UNUSED
-int toku_debug = 0;
-#endif
 
 #include "metadata.h"
 #include "block.h"
 #include "bstore.h"
+#include "reclaim.h"
+#include "optimize.h"
+#include "opstats.h"
+#include "trace.h"
+#include "workpool.h"
+#include "dirprefetch.h"
 
 #define MAX_OPEN_FILES      1024
+#define PATH_LOCKS        64
+// a multiple of PATH_LOCKS, so a path's lock covers its slot
+#define KNOWN_SIZES       1024
+#define ARRAY_SIZE(a)       (sizeof(a) / sizeof((a)[0]))
 #define MIN(A, B)           ((A) < (B) ? (A) : (B))
 #define MAX(A, B)           ((A) > (B) ? (A) : (B))
 
@@ -47,6 +49,11 @@ struct open_file
 {
     int last_pread_offset;
     int last_pread_size;
+    // the file may still have its data inline. cleared the first
+    // time we see it isn't, since files never go back to inline.
+    int maybe_inline;
+    // how reads prefetch, see toku_fs_fadvise
+    enum toku_fs_advice advice;
     enum open_file_status status;
     struct bstore_s bstore;
 };
@@ -56,6 +63,20 @@ struct open_file
  */
 static char * mount_path;
 
+/**
+ * Advice every file is opened with, from the mount options.
+ */
+static enum toku_fs_advice default_advice;
+
+/**
+ * Threads for work that's split up, and how big a read or a
+ * write has to be before it is, from the mount options.
+ */
+static struct workpool * workpool;
+static size_t parallel_read;
+static size_t parallel_write;
+static uint64_t parallel_slices;
+
 /**
  * Table of open files and a lock to protect it.
  */
@@ -67,24 +88,285 @@ static pthread_rwlock_t fd_table_lock = PTHREAD_RWLOCK_INITIALIZER;
  */
 static void fd_table_read_lock(void)
 {
-    debug_echo("called\n");
+    toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_FD_TABLE_LOCK, NULL, 0, 0);
     pthread_rwlock_rdlock(&fd_table_lock);
 }
 static void fd_table_write_lock(void)
 {
-    debug_echo("called\n");
+    toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_FD_TABLE_LOCK, NULL, 1, 0);
     pthread_rwlock_wrlock(&fd_table_lock);
 }
 static void fd_table_unlock(void)
 {
-    debug_echo("called\n");
+    toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_FD_TABLE_UNLOCK, NULL, 0, 0);
     pthread_rwlock_unlock(&fd_table_lock);
 }
 
+/**
+ * Operations that read the metadata and then update it based on
+ * what they saw, like inline writes, promotions, truncates and
+ * anything that changes directory usage, are serialized per path.
+ * Paths hash onto a fixed set of locks.
+ */
+static pthread_mutex_t path_locks[PATH_LOCKS];
+
+static uint32_t path_hash(const char * path)
+{
+    uint32_t hash = 2166136261U;
+
+    for (const char * c = path; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char) *c) * 16777619U;
+    }
+
+    return hash;
+}
+
+static pthread_mutex_t * get_path_lock(const char * path)
+{
+    return &path_locks[path_hash(path) % PATH_LOCKS];
+}
+
+/**
+ * Take the locks for a batch of paths, each lock once and in
+ * lock order, so batches can't deadlock with each other.
+ * Anything that holds more than one path lock takes them here.
+ */
+static void lock_paths(const char ** paths, int n, char * held)
+{
+    int i;
+
+    memset(held, 0, PATH_LOCKS);
+    for (i = 0; i < n; i++) {
+        held[get_path_lock(paths[i]) - path_locks] = 1;
+    }
+    for (i = 0; i < PATH_LOCKS; i++) {
+        if (held[i]) {
+            pthread_mutex_lock(&path_locks[i]);
+        }
+    }
+}
+
+static void unlock_paths(const char * held)
+{
+    int i;
+
+    for (i = PATH_LOCKS - 1; i >= 0; i--) {
+        if (held[i]) {
+            pthread_mutex_unlock(&path_locks[i]);
+        }
+    }
+}
+
+/**
+ * Copy the directory path is in to parent, which must be at
+ * least as big as path. The root is its own parent.
+ */
+static void get_parent(const char * path, char * parent)
+{
+    char * slash;
+
+    strcpy(parent, path);
+    slash = strrchr(parent, '/');
+    assert(slash != NULL);
+    if (slash == parent) {
+        slash[1] = '\0';
+    } else {
+        slash[0] = '\0';
+    }
+}
+
+/**
+ * Lock paths to create them, along with the directories they go
+ * in, so an rmdir or remove_tree holding a directory's lock can't
+ * find it empty and delete it while an entry is created in it.
+ */
+static void lock_paths_for_create(const char ** paths, int n, char * held)
+{
+    int i;
+    size_t size = 0;
+    char * parents, * parent;
+    const char ** all = malloc(2 * n * sizeof(char *));
+
+    for (i = 0; i < n; i++) {
+        size += strlen(paths[i]) + 1;
+    }
+    parents = malloc(size);
+    parent = parents;
+    for (i = 0; i < n; i++) {
+        get_parent(paths[i], parent);
+        all[2 * i] = paths[i];
+        all[2 * i + 1] = parent;
+        parent += strlen(paths[i]) + 1;
+    }
+    lock_paths(all, 2 * n, held);
+    free(parents);
+    free(all);
+}
+
+static void lock_path_for_create(const char * path, char * held)
+{
+    char parent[strlen(path) + 1];
+    const char * both[2] = { path, parent };
+
+    get_parent(path, parent);
+    lock_paths(both, 2, held);
+}
+
+/**
+ * Bumped whenever a file shrinks or goes away, which
+ * invalidates every known size below.
+ */
+static uint64_t shrink_gen;
+
+static void bump_shrink_gen(void)
+{
+    __sync_fetch_and_add(&shrink_gen, 1);
+}
+
+/**
+ * The sizes of recently written files, as of a shrink generation,
+ * so a write that grows a file can work out by how much without
+ * reading its metadata. A path's slot is only touched under its
+ * path lock. Paths that share a slot take turns in it.
+ */
+struct known_size {
+    char * path;
+    off_t size;
+    uint64_t gen;
+};
+
+static struct known_size known_sizes[KNOWN_SIZES];
+
+static struct known_size * get_known_size(const char * path)
+{
+    return &known_sizes[path_hash(path) % KNOWN_SIZES];
+}
+
+/**
+ * Get the size path is known to have. Returns 0 if it isn't known.
+ */
+static int known_size_get(const char * path, uint64_t gen, off_t * size)
+{
+    struct known_size * k = get_known_size(path);
+
+    if (k->path == NULL || k->gen != gen || strcmp(k->path, path) != 0) {
+        return 0;
+    }
+    *size = k->size;
+
+    return 1;
+}
+
+static void known_size_set(const char * path, uint64_t gen, off_t size)
+{
+    struct known_size * k = get_known_size(path);
+
+    if (k->path == NULL || strcmp(k->path, path) != 0) {
+        free(k->path);
+        k->path = toku_strdup(path);
+    }
+    k->size = size;
+    k->gen = gen;
+}
+
+/**
+ * Forget path's size, once it grew some other way than a block
+ * write. Shrinking doesn't need this, since it bumps the shrink
+ * generation, which every known size is checked against.
+ */
+static void known_size_forget(const char * path)
+{
+    struct known_size * k = get_known_size(path);
+
+    if (k->path != NULL && strcmp(k->path, path) == 0) {
+        free(k->path);
+        k->path = NULL;
+    }
+}
+
+static void known_sizes_clear(void)
+{
+    for (int i = 0; i < KNOWN_SIZES; i++) {
+        free(known_sizes[i].path);
+        known_sizes[i].path = NULL;
+    }
+}
+
+/**
+ * Add usage deltas to every directory above path.
+ */
+static void update_ancestor_usage(const char * path,
+        int64_t bytes, int64_t files)
+{
+    int ret;
+    char * slash;
+    char parent[strlen(path) + 1];
+
+    if (bytes == 0 && files == 0) {
+        return;
+    }
+    strcpy(parent, path);
+    while (strcmp(parent, "/") != 0) {
+        slash = strrchr(parent, '/');
+        assert(slash != NULL);
+        if (slash == parent) {
+            slash[1] = '\0';
+        } else {
+            slash[0] = '\0';
+        }
+        ret = toku_metadata_update_for_du(parent, bytes, files);
+        assert(ret == 0);
+    }
+}
+
+/**
+ * True if two paths are in the same directory.
+ */
+static int same_parent(const char * a, const char * b)
+{
+    size_t len = strrchr(a, '/') - a;
+
+    return len == (size_t) (strrchr(b, '/') - b) &&
+        memcmp(a, b, len) == 0;
+}
+
+/**
+ * Usage deltas for a run of siblings in a batch. Siblings are
+ * next to each other in key order, so a batch updates the
+ * directories above them once per run instead of once per path.
+ */
+struct sibling_usage {
+    const char * path;
+    int64_t bytes;
+    int64_t files;
+};
+
+static void sibling_usage_add(struct sibling_usage * usage,
+        const char * path, int64_t bytes, int64_t files)
+{
+    if (usage->path != NULL && !same_parent(usage->path, path)) {
+        update_ancestor_usage(usage->path, usage->bytes, usage->files);
+        usage->bytes = 0;
+        usage->files = 0;
+    }
+    usage->path = path;
+    usage->bytes += bytes;
+    usage->files += files;
+}
+
+static void sibling_usage_flush(struct sibling_usage * usage)
+{
+    if (usage->path != NULL) {
+        update_ancestor_usage(usage->path, usage->bytes, usage->files);
+    }
+}
+
 static void invalidate_open_file(struct open_file * file)
 {
     file->last_pread_offset = -1;
     file->last_pread_size = -1;
+    file->maybe_inline = 0;
+    file->advice = TOKU_FS_ADVICE_NORMAL;
     file->status = FREE;
     memset(&file->bstore, 0, sizeof(struct bstore_s));
 }
@@ -157,9 +439,8 @@ static struct open_file * locked_get_open_file(int fd)
  *
  * Data blocks depth first order is accomplished with just a memcmp
  */
-static int keycmp(DB * db, DBT const * a, DBT const * b)
+static int compare_keys(DBT const * a, DBT const * b)
 {
-    (void) db;
     unsigned char *k1 = a->data;
     unsigned char *k2 = b->data;
     int v1, v2, comparelen;
@@ -219,24 +500,306 @@ just_memcmp:
     }
 }
 
+static int keycmp(DB * db, DBT const * a, DBT const * b)
+{
+    int c;
+    (void) db;
+
+    PROFILE_START(KEYCMP);
+    c = compare_keys(a, b);
+    PROFILE_STOP(KEYCMP);
+
+    return c;
+}
+
+/**
+ * Convert the public dictionary options to bstore db params.
+ */
+static int dict_options_to_params(const struct toku_fs_dict_options * dict,
+        struct bstore_db_params * params)
+{
+    if (dict->basementsize > 0 && dict->nodesize > 0 &&
+            dict->basementsize > dict->nodesize) {
+        return -EINVAL;
+    }
+    params->nodesize = dict->nodesize;
+    params->basementsize = dict->basementsize;
+    params->fanout = dict->fanout;
+    switch (dict->compression) {
+        case TOKU_FS_COMPRESSION_NONE:
+            params->compression = BSTORE_COMPRESSION_NONE;
+            break;
+        case TOKU_FS_COMPRESSION_QUICKLZ:
+            params->compression = BSTORE_COMPRESSION_QUICKLZ;
+            break;
+        case TOKU_FS_COMPRESSION_ZLIB:
+            params->compression = BSTORE_COMPRESSION_ZLIB;
+            break;
+        case TOKU_FS_COMPRESSION_LZMA:
+            params->compression = BSTORE_COMPRESSION_LZMA;
+            break;
+        case TOKU_FS_COMPRESSION_FAST:
+            params->compression = BSTORE_COMPRESSION_FAST;
+            break;
+        case TOKU_FS_COMPRESSION_SMALL:
+            params->compression = BSTORE_COMPRESSION_SMALL;
+            break;
+        default:
+            params->compression = BSTORE_COMPRESSION_DEFAULT;
+    }
+    return 0;
+}
+
+/**
+ * Do a full bstore truncate on the bstore for the given
+ * name. Returns the number of blocks deleted.
+ */
+static int do_bstore_truncate(const char * path)
+{
+    int ret, deleted;
+    struct bstore_s bstore;
+
+    ret = toku_bstore_open(&bstore, path);
+    assert(ret == 0);
+    deleted = toku_bstore_truncate(&bstore, 0);
+    assert(deleted >= 0);
+    ret = toku_bstore_close(&bstore);
+    assert(ret == 0);
+    return deleted;
+}
+
+/**
+ * Called by the reclaim thread for each unlinked file and each
+ * name with blocks under a removed prefix. The path may exist,
+ * either because it was created again since, in which case its
+ * old blocks were already dropped by create_if_new and the ones
+ * left are the new file's, or because the last checkpoint before
+ * a crash came between queueing it and deleting its metadata.
+ * Either way the blocks are kept.
+ * Returns the number of blocks given back.
+ */
+static int reclaim_file(const char * name)
+{
+    int deleted = 0;
+    struct metadata meta;
+    pthread_mutex_t * lock = get_path_lock(name);
+
+    pthread_mutex_lock(lock);
+    if (toku_metadata_get(name, &meta) != 0) {
+        deleted = do_bstore_truncate(name);
+    }
+    pthread_mutex_unlock(lock);
+
+    return deleted;
+}
+
+/**
+ * WILLNEED advice warms a range of blocks into the cache by
+ * scanning it on a thread of its own, so the caller doesn't
+ * wait. Only a few run at once, and advice past that is
+ * dropped. DONTNEED and unmount stop them early.
+ */
+#define WILLNEED_MAX 4
+
+struct willneed_job {
+    struct bstore_s bstore;
+    uint64_t first_block_num;
+    uint64_t last_block_num;
+    int cancelled;
+};
+
+static pthread_mutex_t willneed_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t willneed_cond = PTHREAD_COND_INITIALIZER;
+static struct willneed_job * willneed_jobs[WILLNEED_MAX];
+
+static int willneed_scan_cb(const char * name, uint64_t block_num,
+        void * block_buf, void * extra)
+{
+    struct willneed_job * job = extra;
+    (void) name; (void) block_buf;
+
+    if (__sync_fetch_and_add(&job->cancelled, 0) ||
+            block_num >= job->last_block_num) {
+        return 0;
+    }
+    return BSTORE_SCAN_CONTINUE;
+}
+
+static void * willneed_thread(void * arg)
+{
+    int i, ret;
+    struct willneed_job * job = arg;
+
+    ret = toku_bstore_scan(&job->bstore, job->first_block_num,
+            job->last_block_num, willneed_scan_cb, job);
+    assert(ret == 0 || ret == BSTORE_NOTFOUND);
+    ret = toku_bstore_close(&job->bstore);
+    assert(ret == 0);
+
+    pthread_mutex_lock(&willneed_lock);
+    for (i = 0; willneed_jobs[i] != job; i++);
+    willneed_jobs[i] = NULL;
+    pthread_cond_broadcast(&willneed_cond);
+    pthread_mutex_unlock(&willneed_lock);
+    free(job);
+
+    return NULL;
+}
+
+/**
+ * Warm blocks first through last of the named file, if
+ * there's a free slot for it.
+ */
+static void willneed_start(const char * name, uint64_t first,
+        uint64_t last)
+{
+    int i, ret;
+    pthread_t thread;
+    struct willneed_job * job;
+
+    pthread_mutex_lock(&willneed_lock);
+    for (i = 0; i < WILLNEED_MAX && willneed_jobs[i] != NULL; i++);
+    if (i == WILLNEED_MAX) {
+        toku_trace(TOKU_TRACE_IO, TOKU_TRACE_WILLNEED_DROP, name,
+                first, last);
+        goto out;
+    }
+    job = malloc(sizeof(struct willneed_job));
+    ret = toku_bstore_open(&job->bstore, name);
+    assert(ret == 0);
+    job->first_block_num = first;
+    job->last_block_num = last;
+    job->cancelled = 0;
+    willneed_jobs[i] = job;
+    ret = pthread_create(&thread, NULL, willneed_thread, job);
+    assert(ret == 0);
+    ret = pthread_detach(thread);
+    assert(ret == 0);
+out:
+    pthread_mutex_unlock(&willneed_lock);
+}
+
+/**
+ * Stop warming the named file, or everything if name is NULL.
+ * With wait set, returns once the stopped scans are done.
+ */
+static void willneed_cancel(const char * name, int wait)
+{
+    int i, busy;
+
+    pthread_mutex_lock(&willneed_lock);
+    do {
+        busy = 0;
+        for (i = 0; i < WILLNEED_MAX; i++) {
+            struct willneed_job * job = willneed_jobs[i];
+            if (job != NULL && (name == NULL ||
+                        strcmp(job->bstore.name, name) == 0)) {
+                __sync_fetch_and_or(&job->cancelled, 1);
+                busy = 1;
+            }
+        }
+        if (busy && wait) {
+            pthread_cond_wait(&willneed_cond, &willneed_lock);
+        }
+    } while (busy && wait);
+    pthread_mutex_unlock(&willneed_lock);
+}
+
 /**
  * Mount tokufs at the given path. If a tokufs mount point does not
- * exist at that path, one will be created.
+ * exist at that path, one will be created. Options are read from
+ * the config file at the root of the path, if there is one.
  */
 int toku_fs_mount(const char * path)
 {
     int ret;
+    char * config;
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    config = malloc(strlen(path) + strlen(TOKU_FS_CONFIG_FILE) + 2);
+    sprintf(config, "%s/%s", path, TOKU_FS_CONFIG_FILE);
+    ret = toku_fs_mount_options_load(&opts, config, NULL);
+    free(config);
+    if (ret != 0 && ret != -ENOENT) {
+        goto out;
+    }
+
+    ret = toku_fs_mount_with_options(path, &opts);
+
+out:
+    return ret;
+}
+
+static void backfill_usage_if_legacy(void);
+
+/**
+ * Mount tokufs at the given path using the given options.
+ */
+int toku_fs_mount_with_options(const char * path,
+        const struct toku_fs_mount_options * opts)
+{
+    int ret;
+    size_t cachesize;
+    struct bstore_db_params data_params, meta_params;
 
-    debug_echo("mounting %s\n", path);
+    toku_trace(TOKU_TRACE_OPS, TOKU_TRACE_MOUNT, path, 0, 0);
     assert(mount_path == NULL);
+
+    // every option is checked before any of them is applied, so a
+    // mount that fails leaves things as they were
+    ret = dict_options_to_params(&opts->data, &data_params);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = dict_options_to_params(&opts->meta, &meta_params);
+    if (ret != 0) {
+        goto out;
+    }
+    cachesize = opts->cachesize > 0 ?
+        opts->cachesize : toku_bstore_env_get_cachesize();
+    // the metadata cache is carved out of the whole cache
+    if (opts->meta_cachesize >= cachesize) {
+        ret = -EINVAL;
+        goto out;
+    }
+    ret = toku_bstore_env_set_cachesize(cachesize);
+    assert(ret == 0);
+    ret = toku_bstore_env_set_meta_cachesize(opts->meta_cachesize);
+    assert(ret == 0);
+    ret = toku_bstore_env_set_db_params(&data_params, &meta_params);
+    assert(ret == 0);
+
+    for (int i = 0; i < PATH_LOCKS; i++) {
+        ret = pthread_mutex_init(&path_locks[i], NULL);
+        assert(ret == 0);
+    }
+
     mount_path = toku_strdup(path);
     ret = toku_bstore_env_open(mount_path, keycmp, 
             toku_metadata_update_callback);
     assert(ret == 0);
+    ret = toku_reclaim_start(reclaim_file, opts->reclaim_rate);
+    assert(ret == 0);
+    ret = toku_optimize_start(opts->optimize_backlog, opts->optimize_idle,
+            opts->optimize_rate);
+    assert(ret == 0);
+    default_advice = opts->advice;
+    workpool = toku_workpool_create(opts->workers);
+    parallel_read = opts->parallel_read;
+    parallel_write = opts->parallel_write;
+    // random advice means there's no order worth reading ahead of,
+    // and dontneed that nothing read should be kept around
+    toku_dirprefetch_start(workpool,
+            default_advice == TOKU_FS_ADVICE_RANDOM ||
+            default_advice == TOKU_FS_ADVICE_DONTNEED ?
+            0 : opts->dir_prefetch);
     // make sure the root directory exists
     ret = toku_fs_mkdir("/", 0755);
     assert(ret == 0);
+    backfill_usage_if_legacy();
 
+out:
     return ret;
 }
 
@@ -248,15 +811,26 @@ int toku_fs_unmount(void)
 {
     int ret;
 
-    debug_echo("unmounting %s\n", mount_path);
+    toku_trace(TOKU_TRACE_OPS, TOKU_TRACE_UNMOUNT, mount_path, 0, 0);
     assert(mount_path != NULL);
 
+    willneed_cancel(NULL, 1);
+    toku_dirprefetch_stop();
+    toku_workpool_destroy(workpool);
+    workpool = NULL;
+    ret = toku_optimize_stop();
+    assert(ret == 0);
+    ret = toku_reclaim_stop();
+    assert(ret == 0);
     ret = toku_bstore_env_close();
     assert(ret == 0);
     free(mount_path);
     mount_path = NULL;
-
-    debug_echo("successfully unmounted\n");
+    known_sizes_clear();
+    for (int i = 0; i < PATH_LOCKS; i++) {
+        ret = pthread_mutex_destroy(&path_locks[i]);
+        assert(ret == 0);
+    }
 
     return 0;
 }
@@ -272,21 +846,61 @@ int toku_fs_unmount(void)
  */
 static int file_exists(const char * path)
 {
-    char buf[METADATA_SIZE];
-    return toku_bstore_meta_get(path, buf, METADATA_SIZE) == 0;
+    struct metadata meta;
+    return toku_metadata_get(path, &meta) == 0;
 }
 
 /**
- * Open a tokufs file, returning a file descriptor on success.
+ * Get how much an entry counts toward the usage of the
+ * directories above it: a directory counts as itself plus
+ * everything under it.
  */
-int toku_fs_open(const char * path, int flags, mode_t mode)
+static void get_entry_usage(const struct metadata * meta,
+        int64_t * bytes, int64_t * files)
 {
-    int i;
-    int ret;
-    struct open_file * file;
+    if (S_ISDIR(meta->st.st_mode)) {
+        *bytes = meta->du_bytes;
+        *files = meta->du_files + 1;
+    } else {
+        *bytes = meta->st.st_size;
+        *files = 1;
+    }
+}
+
+/**
+ * Create metadata for path if it doesn't already exist,
+ * counting it in the usage of every directory above it.
+ */
+static void create_if_new(const char * path, mode_t mode)
+{
+    int ret;
+    char held[PATH_LOCKS];
+
+    lock_path_for_create(path, held);
+    if (!file_exists(path)) {
+        time_t now = time(NULL);
+        // a removed file here may not have been reclaimed yet
+        if (toku_reclaim_covers(path)) {
+            do_bstore_truncate(path);
+        }
+        ret = toku_metadata_update_for_create(path, now, mode);
+        assert(ret == 0);
+        update_ancestor_usage(path, 0, 1);
+    }
+    unlock_paths(held);
+}
+
+/**
+ * Open a tokufs file, returning a file descriptor on success.
+ */
+int toku_fs_open(const char * path, int flags, mode_t mode)
+{
+    int i;
+    int ret;
+    struct open_file * file;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_OPEN);
 
-    debug_echo("called path = %s, flags %d, mode %x (O_CREAT ? %d)\n", 
-            path, flags, mode, flags & O_CREAT);
+    toku_trace_args(TOKU_FS_OP_OPEN, path, flags, mode);
 
     assert(mount_path != NULL);
 
@@ -308,9 +922,7 @@ int toku_fs_open(const char * path, int flags, mode_t mode)
     // file already exists.
     ret = 0;
     if (flags & O_CREAT) {
-        time_t now = time(NULL);
-        ret = toku_metadata_update_for_create(path, now, mode);
-        assert(ret == 0);
+        create_if_new(path, mode);
     } else if (!file_exists(path)) {
         ret = -ENOENT;
     }
@@ -321,6 +933,8 @@ int toku_fs_open(const char * path, int flags, mode_t mode)
         ret = toku_bstore_open(&file->bstore, path);
         assert(ret == 0);
         ret = i;
+        file->maybe_inline = 1;
+        file->advice = default_advice;
         file->status = VALID;
     } else {
         invalidate_open_file(file);
@@ -328,7 +942,10 @@ int toku_fs_open(const char * path, int flags, mode_t mode)
 
 out:
     fd_table_unlock();
-    debug_echo("done, fd = %d\n", i);
+    if (ret >= 0 && !(flags & O_CREAT)) {
+        toku_dirprefetch_note_open(path);
+    }
+    toku_opstats_end(TOKU_FS_OP_OPEN, op_start, ret < 0);
     return ret;
 }
 
@@ -339,8 +956,9 @@ int toku_fs_close(int fd)
 {
     int ret;
     struct open_file * file;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_CLOSE);
 
-    debug_echo("called, fd = %d\n", fd);
+    toku_trace_args(TOKU_FS_OP_CLOSE, NULL, fd, 0);
 
     assert(mount_path != NULL);
     if (fd < 0 || fd > MAX_OPEN_FILES) { 
@@ -360,6 +978,7 @@ int toku_fs_close(int fd)
 
 out:
     fd_table_unlock();
+    toku_opstats_end(TOKU_FS_OP_CLOSE, op_start, ret < 0);
     return ret;
 }
 
@@ -367,7 +986,6 @@ struct pread_scan_cb_info {
     void * buf;
     off_t offset;
     size_t count;
-    size_t bytes_read;
 };
 
 /**
@@ -380,7 +998,6 @@ static void update_pread_scan_cb_info(
     info->buf += read_size; 
     info->offset += read_size;
     info->count -= read_size;
-    info->bytes_read += read_size;
 }
 
 static int pread_scan_cb(const char * name, 
@@ -401,24 +1018,24 @@ static int pread_scan_cb(const char * name,
     // or we are out of bytes to write (count == 0)
     block_num = block_get_num_by_position(info->offset);
     block_offset = block_get_offset_by_position(info->offset);
-    debug_echo("scan starting at current_block_num %lu, need block %lu "
-            "at offset %ld\n", current_block_num, block_num,
-            block_offset);
+    toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_PREAD_SCAN, NULL,
+            current_block_num, block_num);
+    PROFILE_START(ZERO_FILL);
     while (info->count > 0 && block_num < current_block_num) {
         // The read size can be no more than the bytes count,
         // nor the bytes left in the block based on offset.
         read_size = MIN(info->count, BSTORE_BLOCKSIZE - block_offset);
         assert(read_size > 0);
         memset(info->buf, 0, read_size);
-        debug_echo("block %lu missing, with %lu bytes to go, "
-                "padding %lu zeros to buffer at %p\n",
-                block_num, info->count, read_size, info->buf);
+        toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_PREAD_HOLE, NULL,
+                block_num, read_size);
         // update the info struct, then calc the 
         // next block num and offset
         update_pread_scan_cb_info(info, read_size);
         block_num = block_get_num_by_position(info->offset);
         block_offset = block_get_offset_by_position(info->offset);
     }
+    PROFILE_STOP(ZERO_FILL);
     // we've padded up to the current block with zeroes,
     // and we still need more bytes, so we should need
     // the current block.
@@ -438,88 +1055,327 @@ static int pread_scan_cb(const char * name,
 }
 
 /**
- * Read count bytes from the file starting at offset into buf.
+ * Read count bytes from an inline file into buf, zero filling
+ * past the inline data. Returns 1 if the file was inline and
+ * the read was done, 0 if the caller should read blocks.
  */
-ssize_t toku_fs_pread(int fd, void * buf,
+static int pread_inline(struct open_file * file, void * buf,
         size_t count, off_t offset)
 {
     int ret;
-    ssize_t bytes_read;
-    struct open_file * file;
-
-    debug_echo("called with fd = %d, buf = %p, count = %lu, "
-            "offset = %lu\n", fd, buf, count, offset);
+    size_t read_size;
+    union metadata_buf mbuf;
 
-    if (offset < 0) {
-        bytes_read = -EINVAL;
-        goto out;
+    ret = toku_metadata_get_inline(file->bstore.name, &mbuf);
+    assert(ret == 0);
+    // promotion writes the blocks before clearing the flag,
+    // so either way we see all of the data.
+    if (!(mbuf.meta.flags & METADATA_FLAG_INLINE)) {
+        file->maybe_inline = 0;
+        return 0;
     }
-    file = locked_get_open_file(fd);
-    if (file == NULL) {
-        bytes_read = -EBADF;
-        goto out;
+
+    read_size = 0;
+    if (offset < (off_t) mbuf.meta.inline_size) {
+        read_size = MIN(count, (size_t) (mbuf.meta.inline_size - offset));
+        memcpy(buf, metadata_inline_data(&mbuf.meta) + offset, read_size);
     }
+    PROFILE_START(ZERO_FILL);
+    memset(buf + read_size, 0, count - read_size);
+    PROFILE_STOP(ZERO_FILL);
 
-    struct metadata meta;
-    ret = toku_bstore_meta_get(file->bstore.name, &meta, METADATA_SIZE);
-    assert(ret == 0);
+    return 1;
+}
+
+/**
+ * Sequential readers get a megabyte of prefetch past what
+ * they asked for.
+ */
+#define SEQUENTIAL_PREFETCH_BLOCKS ((1 << 20) / BSTORE_BLOCKSIZE)
+
+/**
+ * How far a read ending at end_block_num should prefetch,
+ * given the file's advice.
+ */
+static uint64_t pread_prefetch_block_num(struct open_file * file,
+        uint64_t end_block_num)
+{
+    switch (file->advice) {
+    case TOKU_FS_ADVICE_SEQUENTIAL:
+        return end_block_num + SEQUENTIAL_PREFETCH_BLOCKS;
+    case TOKU_FS_ADVICE_RANDOM:
+    case TOKU_FS_ADVICE_DONTNEED:
+        return BSTORE_SCAN_NO_PREFETCH;
+    default:
+        return end_block_num;
+    }
+}
 
+/**
+ * Read count bytes of blocks starting at offset into buf, with
+ * holes and whatever is past the end of the file read as zeros.
+ */
+static void pread_blocks(struct bstore_s * bstore, void * buf,
+        size_t count, off_t offset, uint64_t prefetch_block_num)
+{
+    int ret;
     struct pread_scan_cb_info info;
+
     info.buf = buf;
     info.offset = offset;
     info.count = count;
-    info.bytes_read = 0;
-
-    uint64_t block_num = block_get_num_by_position(offset);
-    uint64_t end_block_num = block_get_num_by_position(offset + count);
-    ret = toku_bstore_scan(&file->bstore, block_num, 
-            end_block_num, pread_scan_cb, &info);
+    ret = toku_bstore_scan(bstore, block_get_num_by_position(offset),
+            prefetch_block_num, pread_scan_cb, &info);
     assert(ret == 0 || ret == BSTORE_NOTFOUND);
 
     // this will fill out any extra bytes after the end
-    // of the file as zeros.
+    // of the scan as zeros.
     if (info.count > 0) {
+        PROFILE_START(ZERO_FILL);
         memset(info.buf, 0, info.count);
-        info.bytes_read += info.count;
+        PROFILE_STOP(ZERO_FILL);
     }
+}
 
-    time_t now = time(NULL);
-    ret = toku_metadata_update_for_pread(file->bstore.name, now);
-    assert(ret == 0);
+/**
+ * A piece of a big read or write, which a worker does with its
+ * own cursor or inserts, straight from or into its part of the
+ * caller's buffer.
+ */
+struct io_slice {
+    struct open_file * file;
+    void * buf;
+    size_t count;
+    off_t offset;
+    int last;
+};
 
-    debug_echo("done. offset = %lu, count = %lu, bytes_read = %ld\n", 
-            info.offset, info.count, info.bytes_read);
-    bytes_read = info.bytes_read;
+/**
+ * Run fn on block aligned slices of a big read or write, about
+ * two for each thread that can work on them so a slow one doesn't
+ * hold up the rest, but none smaller than half of min_size.
+ * Returns once every slice is done.
+ */
+static void io_parallel(struct open_file * file, void * buf,
+        size_t count, off_t offset, size_t min_size, workpool_fn fn)
+{
+    int i, n;
+    size_t slice_size, size;
+    off_t end = offset + count;
+    struct io_slice * slices;
+    struct workpool_batch batch;
+
+    slice_size = count / (2 * (toku_workpool_workers(workpool) + 1));
+    slice_size = MAX(slice_size, min_size / 2);
+    slice_size = (slice_size + BSTORE_BLOCKSIZE - 1) /
+        BSTORE_BLOCKSIZE * BSTORE_BLOCKSIZE;
+    n = (count + BSTORE_BLOCKSIZE + slice_size - 1) / slice_size;
+    slices = malloc(n * sizeof(struct io_slice));
+    assert(slices != NULL);
+
+    toku_workpool_batch_init(&batch);
+    for (i = 0; i < n && offset < end; i++) {
+        // the first slice ends on a block boundary
+        size = slice_size - block_get_offset_by_position(offset);
+        size = MIN(size, (size_t) (end - offset));
+        slices[i].file = file;
+        slices[i].buf = buf;
+        slices[i].count = size;
+        slices[i].offset = offset;
+        slices[i].last = offset + (off_t) size == end;
+        toku_workpool_submit(workpool, &batch, fn, &slices[i]);
+        buf += size;
+        offset += size;
+    }
+    assert(offset == end);
+    __sync_fetch_and_add(&parallel_slices, i);
+    toku_workpool_wait(workpool, &batch);
+    toku_workpool_batch_destroy(&batch);
+    free(slices);
+}
 
-out:
-    return bytes_read;
+/**
+ * Read a slice. Only the last one prefetches past the end of
+ * the read.
+ */
+static void pread_slice_task(void * arg)
+{
+    struct io_slice * slice = arg;
+    struct open_file * file = slice->file;
+    uint64_t end_block_num =
+        block_get_num_by_position(slice->offset + slice->count);
+    uint64_t prefetch_block_num;
+
+    toku_trace(TOKU_TRACE_IO, TOKU_TRACE_PREAD_SLICE, file->bstore.name,
+            slice->offset, slice->count);
+    if (slice->last) {
+        prefetch_block_num = pread_prefetch_block_num(file, end_block_num);
+    } else if (file->advice == TOKU_FS_ADVICE_RANDOM ||
+            file->advice == TOKU_FS_ADVICE_DONTNEED) {
+        prefetch_block_num = BSTORE_SCAN_NO_PREFETCH;
+    } else {
+        prefetch_block_num = end_block_num;
+    }
+    pread_blocks(&file->bstore, slice->buf, slice->count, slice->offset,
+            prefetch_block_num);
 }
 
 /**
- * Write count bytes into the file starting at offset from buf.
+ * Read count bytes from the file starting at offset into buf.
  */
-ssize_t toku_fs_pwrite(int fd, const void * buf,
+ssize_t toku_fs_pread(int fd, void * buf,
         size_t count, off_t offset)
 {
     int ret;
-    ssize_t bytes_written;
-    size_t write_size;
+    ssize_t bytes_read;
     struct open_file * file;
-    
-    debug_echo("called with fd = %d, buf = %p, count = %lu,"
-            " offset = %lu\n", fd, buf, count, offset);
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_PREAD);
 
     if (offset < 0) {
-        bytes_written = -EINVAL;
+        bytes_read = -EINVAL;
         goto out;
     }
     file = locked_get_open_file(fd);
     if (file == NULL) {
-        bytes_written = -EBADF;
+        bytes_read = -EBADF;
         goto out;
     }
-    
-    bytes_written = 0;
+    toku_trace_args(TOKU_FS_OP_PREAD, file->bstore.name, offset, count);
+
+    if (file->maybe_inline && pread_inline(file, buf, count, offset)) {
+        bytes_read = count;
+        goto update_atime;
+    }
+
+    if (parallel_read > 0 && count >= parallel_read) {
+        io_parallel(file, buf, count, offset, parallel_read,
+                pread_slice_task);
+    } else {
+        pread_blocks(&file->bstore, buf, count, offset,
+                pread_prefetch_block_num(file,
+                    block_get_num_by_position(offset + count)));
+    }
+    bytes_read = count;
+
+update_atime:;
+    time_t now = time(NULL);
+    ret = toku_metadata_update_for_pread(file->bstore.name, now);
+    assert(ret == 0);
+
+out:
+    toku_opstats_io(TOKU_FS_OP_PREAD, bytes_read > 0 ? bytes_read : 0, 0);
+    toku_opstats_end(TOKU_FS_OP_PREAD, op_start, bytes_read < 0);
+    return bytes_read;
+}
+
+/**
+ * Move an inline file's data into blocks. The caller
+ * holds the inline lock.
+ */
+static void promote_inline(struct open_file * file, struct metadata * meta)
+{
+    int ret;
+    char block[BSTORE_BLOCKSIZE];
+    char * data = metadata_inline_data(meta);
+
+    for (size_t off = 0; off < meta->inline_size; off += BSTORE_BLOCKSIZE) {
+        size_t size = MIN(BSTORE_BLOCKSIZE, meta->inline_size - off);
+        memset(block, 0, BSTORE_BLOCKSIZE);
+        memcpy(block, data + off, size);
+        ret = toku_bstore_put(&file->bstore,
+                block_get_num_by_position(off), block);
+        assert(ret == 0);
+    }
+    ret = toku_metadata_update_for_promote(file->bstore.name);
+    assert(ret == 0);
+}
+
+/**
+ * Write count bytes into an inline file, promoting it to blocks
+ * if the write doesn't fit. Returns 1 if the write was done
+ * inline, 0 if the caller should write blocks.
+ */
+static int pwrite_inline(struct open_file * file, const void * buf,
+        size_t count, off_t offset)
+{
+    int ret, done;
+    union metadata_buf mbuf;
+    pthread_mutex_t * lock = get_path_lock(file->bstore.name);
+
+    done = 0;
+    pthread_mutex_lock(lock);
+    ret = toku_metadata_get_inline(file->bstore.name, &mbuf);
+    assert(ret == 0);
+    if (!(mbuf.meta.flags & METADATA_FLAG_INLINE)) {
+        file->maybe_inline = 0;
+    } else if (offset + count <= METADATA_INLINE_MAX) {
+        time_t now = time(NULL);
+        off_t end = offset + count;
+        ret = toku_metadata_update_for_inline_pwrite(file->bstore.name,
+                now, buf, count, offset);
+        assert(ret == 0);
+        if (end > mbuf.meta.st.st_size) {
+            update_ancestor_usage(file->bstore.name,
+                    end - mbuf.meta.st.st_size, 0);
+            known_size_forget(file->bstore.name);
+        }
+        done = 1;
+    } else {
+        toku_trace(TOKU_TRACE_IO, TOKU_TRACE_PROMOTE_INLINE,
+                file->bstore.name, offset, count);
+        promote_inline(file, &mbuf.meta);
+        file->maybe_inline = 0;
+    }
+    pthread_mutex_unlock(lock);
+
+    return done;
+}
+
+/**
+ * Update the metadata after a block write that ended at end,
+ * and if it grew the file, the usage of the directories above.
+ * The metadata update is a blind upsert. Only the first write
+ * to grow a file since it was last shrunk, or since its known
+ * size was pushed out by another path's, reads the real size.
+ * Files only change size under their path lock, so the known
+ * size is checked and the upsert sent under it too, or a
+ * truncate or unlink could slip in between and the upsert would
+ * grow the file back without its usage being counted.
+ */
+static void pwrite_update_metadata(struct open_file * file, off_t end)
+{
+    int ret;
+    off_t size;
+    struct metadata meta;
+    time_t now = time(NULL);
+    const char * path = file->bstore.name;
+    pthread_mutex_t * lock = get_path_lock(path);
+
+    pthread_mutex_lock(lock);
+    uint64_t gen = __sync_fetch_and_add(&shrink_gen, 0);
+    if (!known_size_get(path, gen, &size)) {
+        ret = toku_metadata_get(path, &meta);
+        assert(ret == 0);
+        size = meta.st.st_size;
+    }
+    ret = toku_metadata_update_for_pwrite(path, now, end);
+    assert(ret == 0);
+    if (end > size) {
+        update_ancestor_usage(path, end - size, 0);
+    }
+    known_size_set(path, gen, MAX(end, size));
+    pthread_mutex_unlock(lock);
+}
+
+/**
+ * Write count bytes of blocks starting at offset from buf.
+ */
+static void pwrite_blocks(struct bstore_s * bstore, const void * buf,
+        size_t count, off_t offset)
+{
+    int ret;
+    size_t write_size;
+
     while (count > 0) {
         uint64_t block_num = block_get_num_by_position(offset);
         size_t block_offset = block_get_offset_by_position(offset);
@@ -529,285 +1385,664 @@ ssize_t toku_fs_pwrite(int fd, const void * buf,
         assert(write_size > 0);
         // If the write size is a full block, overwrite any old block
         // with the new block. Otherwise, update a subset of bytes 
+        // All zero blocks are never stored, see toku_bstore_put().
         if (write_size == BSTORE_BLOCKSIZE) {
-            ret = toku_bstore_put(&file->bstore, block_num, buf);
+            ret = toku_bstore_put(bstore, block_num, buf);
+            assert(ret == 0);
         } else {
-            ret = toku_bstore_update(&file->bstore, block_num, 
+            ret = toku_bstore_update(bstore, block_num, 
                     buf, write_size, block_offset);
             assert(ret == 0);
         }
 
         buf += write_size;
-        bytes_written += write_size;
         offset += write_size;
         count -= write_size;
     }
+}
 
-    time_t now = time(NULL);
-    ret = toku_metadata_update_for_pwrite(file->bstore.name, now, offset);
-    assert(ret == 0);
+/**
+ * Write a slice. Slices cover different blocks, so their
+ * puts can go into the tree at the same time.
+ */
+static void pwrite_slice_task(void * arg)
+{
+    struct io_slice * slice = arg;
 
-    debug_echo("done. offset = %lu, count = %lu,"
-            " bytes_written = %lu\n", offset, count, bytes_written);
-out:
-    return bytes_written;
+    toku_trace(TOKU_TRACE_IO, TOKU_TRACE_PWRITE_SLICE,
+            slice->file->bstore.name, slice->offset, slice->count);
+    pwrite_blocks(&slice->file->bstore, slice->buf, slice->count,
+            slice->offset);
 }
 
-//
-// Metadata operations
-//
-
 /**
- * Get metadata for a particular file. This
- * currently involves just getting the metadata
- * for its associated bstore and copying it over.
+ * Write count bytes into the file starting at offset from buf.
  */
-int toku_fs_stat(const char * path, struct stat * st)
+ssize_t toku_fs_pwrite(int fd, const void * buf,
+        size_t count, off_t offset)
 {
-    int ret;
-    struct metadata meta;
+    ssize_t bytes_written;
+    struct open_file * file;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_PWRITE);
 
-    ret = toku_bstore_meta_get(path, &meta, METADATA_SIZE);
-    if (ret == 0) {
-        memcpy(st, &meta.st, sizeof(struct stat));
+    if (offset < 0) {
+        bytes_written = -EINVAL;
+        goto out;
+    }
+    file = locked_get_open_file(fd);
+    if (file == NULL) {
+        bytes_written = -EBADF;
+        goto out;
+    }
+    toku_trace_args(TOKU_FS_OP_PWRITE, file->bstore.name, offset, count);
+
+    if (file->maybe_inline && pwrite_inline(file, buf, count, offset)) {
+        bytes_written = count;
+        goto out;
+    }
+
+    // the slices only read from buf
+    if (parallel_write > 0 && count >= parallel_write) {
+        io_parallel(file, (void *) buf, count, offset, parallel_write,
+                pwrite_slice_task);
     } else {
-        ret = -ENOENT;
+        pwrite_blocks(&file->bstore, buf, count, offset);
     }
+    bytes_written = count;
 
-    return ret;
+    pwrite_update_metadata(file, offset + count);
+out:
+    toku_opstats_io(TOKU_FS_OP_PWRITE, bytes_written > 0 ? bytes_written : 0, 0);
+    toku_opstats_end(TOKU_FS_OP_PWRITE, op_start, bytes_written < 0);
+    return bytes_written;
 }
 
 /**
- * Truncate a block in a bstore to the given offset.
+ * Create a file, or replace an existing one, whose contents are
+ * the count bytes in buf. Small files go inline in the one
+ * metadata message. Bigger ones put their blocks first, so the
+ * new contents show up all at once with the metadata.
  */
-static int truncate_block(struct bstore_s * bstore, 
-        uint64_t block_num, off_t block_offset)
+int toku_fs_put_file(const char * path, const void * buf,
+        size_t count, mode_t mode)
 {
-    int ret;
-    char buf[BSTORE_BLOCKSIZE];
+    int ret, exists, is_inline;
+    struct metadata meta;
+    struct bstore_s bstore;
+    char held[PATH_LOCKS];
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_PUT_FILE);
 
-    assert(block_offset < BSTORE_BLOCKSIZE);
-    memset(buf, 0, BSTORE_BLOCKSIZE);
-    ret = toku_bstore_update(bstore, block_num, buf,
-            BSTORE_BLOCKSIZE - block_offset, block_offset);
+    toku_trace_args(TOKU_FS_OP_PUT_FILE, path, count, 0);
+    assert(mount_path != NULL);
+
+    lock_path_for_create(path, held);
+    ret = toku_metadata_get(path, &meta);
+    exists = ret == 0;
+    if (exists && S_ISDIR(meta.st.st_mode)) {
+        ret = -EISDIR;
+        goto out;
+    } else if (exists && S_ISLNK(meta.st.st_mode)) {
+        ret = -EEXIST;
+        goto out;
+    }
+
+    // files that are already in blocks never go back inline
+    is_inline = count <= METADATA_INLINE_MAX &&
+        (!exists || (meta.flags & METADATA_FLAG_INLINE));
+    // a removed file here may not have been reclaimed yet
+    if (!exists && toku_reclaim_covers(path)) {
+        do_bstore_truncate(path);
+    }
+    if (!is_inline) {
+        ret = toku_bstore_open(&bstore, path);
+        assert(ret == 0);
+        ret = toku_bstore_put_blocks(&bstore, 0, buf, count);
+        assert(ret == 0);
+        // drop whatever the old contents had past the new end
+        if (exists && !(meta.flags & METADATA_FLAG_INLINE)) {
+            ret = toku_bstore_truncate(&bstore,
+                    block_get_count_by_size(count));
+            assert(ret >= 0);
+        }
+        ret = toku_bstore_close(&bstore);
+        assert(ret == 0);
+    }
+    ret = toku_metadata_update_for_put(path, time(NULL), mode,
+            buf, count, is_inline);
     assert(ret == 0);
 
-    return 0;
+    if (!exists) {
+        update_ancestor_usage(path, count, 1);
+    } else {
+        if ((off_t) count < meta.st.st_size) {
+            bump_shrink_gen();
+        }
+        update_ancestor_usage(path, count - meta.st.st_size, 0);
+        known_size_forget(path);
+    }
+    toku_opstats_io(TOKU_FS_OP_PUT_FILE, count, 0);
+
+out:
+    unlock_paths(held);
+    toku_opstats_end(TOKU_FS_OP_PUT_FILE, op_start, ret < 0);
+    return ret;
 }
 
 /**
- * Truncate a file so that it is no more than length bytes.
+ * Read up to count bytes from the front of a file into buf,
+ * without opening it. Returns the number of bytes read, which
+ * is less than count if the file is smaller.
  */
-int toku_fs_truncate(const char * path, off_t length)
+ssize_t toku_fs_get_file(const char * path, void * buf, size_t count)
 {
     int ret;
-    struct metadata meta;
-
-    debug_echo("called with path %s, length %ld\n", path, length);
+    ssize_t bytes_read;
+    union metadata_buf mbuf;
+    struct bstore_s bstore;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_GET_FILE);
 
-    // Probably can't truncate below 0 bytes.
-    if (length < 0) {
-        ret = -EINVAL;
-        goto out;
-    }
+    toku_trace_args(TOKU_FS_OP_GET_FILE, path, count, 0);
+    assert(mount_path != NULL);
 
-    ret = toku_bstore_meta_get(path, &meta, METADATA_SIZE);
+    ret = toku_metadata_get_inline(path, &mbuf);
     if (ret == BSTORE_NOTFOUND) {
-        ret = -ENOENT;
+        bytes_read = -ENOENT;
         goto out;
     }
     assert(ret == 0);
-    if (meta.st.st_size < length) {
-        // we're truncating up, or truncating to the
-        // same size. either way, no blocks are 
-        // going to get deleted, but the meta data
-        // will be updated.
-        goto not_deleting_blocks;
-    } else if (meta.st.st_size == length) {
-        // we don't need to do anything if the size
-        // is not changing.
+    if (S_ISDIR(mbuf.meta.st.st_mode)) {
+        bytes_read = -EISDIR;
         goto out;
     }
 
-    // if a file is length bytes, then its last byte resides
-    // on block len / BLOCKSIZE, so we should remove every block
-    // greater than that. 
-    uint64_t new_max_block_num = block_get_num_by_position(length);
-    uint64_t first_block_to_go = new_max_block_num + 1;
-    debug_echo("max_block_num %lu, first to go %lu\n", 
-            new_max_block_num, first_block_to_go);
+    count = MIN(count, (size_t) mbuf.meta.st.st_size);
+    if (mbuf.meta.flags & METADATA_FLAG_INLINE) {
+        size_t read_size = MIN(count, mbuf.meta.inline_size);
+        memcpy(buf, metadata_inline_data(&mbuf.meta), read_size);
+        PROFILE_START(ZERO_FILL);
+        memset(buf + read_size, 0, count - read_size);
+        PROFILE_STOP(ZERO_FILL);
+        bytes_read = count;
+        goto update_atime;
+    }
 
-    struct bstore_s bstore;
     ret = toku_bstore_open(&bstore, path);
     assert(ret == 0);
-
-    ret = toku_bstore_truncate(&bstore, first_block_to_go);
+    pread_blocks(&bstore, buf, count, 0, block_get_num_by_position(count));
+    ret = toku_bstore_close(&bstore);
     assert(ret == 0);
+    bytes_read = count;
 
-    size_t block_offset = block_get_offset_by_position(length); 
-    ret = truncate_block(&bstore, new_max_block_num, block_offset); 
+update_atime:
+    ret = toku_metadata_update_for_pread(path, time(NULL));
     assert(ret == 0);
+    toku_dirprefetch_note_open(path);
 
-    ret = toku_bstore_close(&bstore);
+out:
+    toku_opstats_io(TOKU_FS_OP_GET_FILE, bytes_read > 0 ? bytes_read : 0, 0);
+    toku_opstats_end(TOKU_FS_OP_GET_FILE, op_start, bytes_read < 0);
+    return bytes_read;
+}
+
+//
+// Metadata operations
+//
+
+/**
+ * Get metadata for a particular file. This
+ * currently involves just getting the metadata
+ * for its associated bstore and copying it over.
+ */
+int toku_fs_stat(const char * path, struct stat * st)
+{
+    int ret;
+    struct metadata meta;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_STAT);
+
+    toku_trace_args(TOKU_FS_OP_STAT, path, 0, 0);
+
+    ret = toku_metadata_get(path, &meta);
+    if (ret == 0) {
+        memcpy(st, &meta.st, sizeof(struct stat));
+    } else {
+        ret = -ENOENT;
+    }
+
+    toku_opstats_end(TOKU_FS_OP_STAT, op_start, ret < 0);
+    return ret;
+}
+
+/**
+ * Stat n paths at once. The lookups are sorted into key order
+ * and served by one cursor, so siblings share the leaves they
+ * live on. rets[i] is 0 or -ENOENT for paths[i].
+ */
+int toku_fs_stat_many(const char ** paths, int n,
+        struct stat * sts, int * rets)
+{
+    int i, ret;
+    int * order;
+    struct metadata * metas;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_STAT_MANY);
+
+    toku_trace_args(TOKU_FS_OP_STAT_MANY, NULL, n, 0);
+
+    if (n < 0) {
+        toku_opstats_end(TOKU_FS_OP_STAT_MANY, op_start, 1);
+        return -EINVAL;
+    }
+    order = malloc(n * sizeof(int));
+    metas = malloc(n * sizeof(struct metadata));
+    toku_bstore_meta_sort(paths, n, order);
+    ret = toku_metadata_get_many(paths, order, n, metas, rets);
     assert(ret == 0);
+    for (i = 0; i < n; i++) {
+        if (rets[i] == 0) {
+            memcpy(&sts[i], &metas[i].st, sizeof(struct stat));
+        } else {
+            rets[i] = -ENOENT;
+        }
+    }
+    free(metas);
+    free(order);
 
-not_deleting_blocks:
-    // update the metadata to have the new file size.
-    ret = toku_metadata_update_for_truncate(path, length);
+    toku_opstats_end(TOKU_FS_OP_STAT_MANY, op_start, 0);
+    return 0;
+}
+
+/**
+ * Truncate a block in a bstore to the given offset.
+ */
+static int truncate_block(struct bstore_s * bstore, 
+        uint64_t block_num, off_t block_offset)
+{
+    int ret;
+    char buf[BSTORE_BLOCKSIZE];
+
+    assert(block_offset < BSTORE_BLOCKSIZE);
+    memset(buf, 0, BSTORE_BLOCKSIZE);
+    // zeroing a whole block is just a put of zeros, which the
+    // bstore turns into a delete.
+    if (block_offset == 0) {
+        ret = toku_bstore_put(bstore, block_num, buf);
+    } else {
+        ret = toku_bstore_update(bstore, block_num, buf,
+                BSTORE_BLOCKSIZE - block_offset, block_offset);
+    }
     assert(ret == 0);
-out:
-    return ret;
+
+    return 0;
 }
 
 /**
- * Symbolicly link old path to new path. This can be accomplished
- * by having newpath be a file whose contents are oldpath and
- * whose metadata indicates that it's a symlink.
+ * Truncate a file so that it is no more than length bytes.
  */
-int toku_fs_symlink(const char * oldpath, const char * newpath)
+int toku_fs_truncate(const char * path, off_t length)
 {
     int ret;
     struct metadata meta;
-    char buf[BSTORE_BLOCKSIZE];
+    pthread_mutex_t * lock;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_TRUNCATE);
 
-    debug_echo("called with oldpath %s, newpath %s\n",
-            oldpath, newpath);
+    toku_trace_args(TOKU_FS_OP_TRUNCATE, path, length, 0);
 
-    ret = toku_bstore_meta_get(newpath, &meta, METADATA_SIZE);
-    if (ret == 0) {
-        ret = -EEXIST;
+    // Probably can't truncate below 0 bytes.
+    if (length < 0) {
+        toku_opstats_end(TOKU_FS_OP_TRUNCATE, op_start, 1);
+        return -EINVAL;
+    }
+
+    // don't let the file get promoted out from under us
+    lock = get_path_lock(path);
+    pthread_mutex_lock(lock);
+    ret = toku_metadata_get(path, &meta);
+    if (ret == BSTORE_NOTFOUND) {
+        ret = -ENOENT;
         goto out;
     }
-    // XXX here, being lazy, we restrict symlinks 
-    // to only paths that fit into a block. 
-    // should be good enough for a while.
-    size_t oldpath_size = strlen(oldpath) + 1;
-    if (oldpath_size > BSTORE_BLOCKSIZE) {
-        ret = -ENAMETOOLONG;
+    assert(ret == 0);
+    if (meta.flags & METADATA_FLAG_INLINE) {
+        // inline data is trimmed by the metadata update
+        goto not_deleting_blocks;
+    } else if (meta.st.st_size < length) {
+        // we're truncating up, or truncating to the
+        // same size. either way, no blocks are 
+        // going to get deleted, but the meta data
+        // will be updated.
+        goto not_deleting_blocks;
+    } else if (meta.st.st_size == length) {
+        // we don't need to do anything if the size
+        // is not changing.
         goto out;
     }
 
+    // if a file is length bytes, then its last byte resides
+    // on block len / BLOCKSIZE, so we should remove every block
+    // greater than that. 
+    uint64_t new_max_block_num = block_get_num_by_position(length);
+    uint64_t first_block_to_go = new_max_block_num + 1;
+    toku_trace(TOKU_TRACE_IO, TOKU_TRACE_TRUNCATE_BLOCKS, path,
+            new_max_block_num, first_block_to_go);
+
     struct bstore_s bstore;
-    ret = toku_bstore_open(&bstore, newpath);
+    ret = toku_bstore_open(&bstore, path);
     assert(ret == 0);
-    memset(buf, 0, BSTORE_BLOCKSIZE);
-    memcpy(buf, oldpath, oldpath_size);
-    ret = toku_bstore_put(&bstore, 0, buf);
+
+    ret = toku_bstore_truncate(&bstore, first_block_to_go);
+    assert(ret >= 0);
+
+    size_t block_offset = block_get_offset_by_position(length); 
+    ret = truncate_block(&bstore, new_max_block_num, block_offset); 
     assert(ret == 0);
+
     ret = toku_bstore_close(&bstore);
     assert(ret == 0);
 
-    time_t now = time(NULL);
-    ret = toku_metadata_update_for_symlink(newpath, now, oldpath_size);
+not_deleting_blocks:
+    // update the metadata to have the new file size.
+    ret = toku_metadata_update_for_truncate(path, length);
     assert(ret == 0);
-
+    if (length < meta.st.st_size) {
+        bump_shrink_gen();
+    }
+    update_ancestor_usage(path, length - meta.st.st_size, 0);
+    known_size_forget(path);
 out:
+    pthread_mutex_unlock(lock);
+    toku_opstats_end(TOKU_FS_OP_TRUNCATE, op_start, ret < 0);
     return ret;
 }
 
 /**
- * Background task that does a full bstore truncate
- * on the bstore for the given name passed as arg
+ * Symbolicly link old path to new path. This can be accomplished
+ * by having newpath be a file whose inline contents are oldpath
+ * and whose metadata indicates that it's a symlink.
  */
-static int do_bstore_truncate(const char * path)
+int toku_fs_symlink(const char * oldpath, const char * newpath)
 {
     int ret;
-    struct bstore_s bstore;
+    struct metadata meta;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_SYMLINK);
 
-    ret = toku_bstore_open(&bstore, path);
-    assert(ret == 0);
-    ret = toku_bstore_truncate(&bstore, 0);
-    assert(ret == 0);
-    ret = toku_bstore_close(&bstore);
+    toku_trace_args(TOKU_FS_OP_SYMLINK, newpath, 0, 0);
+
+    if (strlen(oldpath) >= METADATA_SYMLINK_MAX) {
+        toku_opstats_end(TOKU_FS_OP_SYMLINK, op_start, 1);
+        return -ENAMETOOLONG;
+    }
+
+    char held[PATH_LOCKS];
+    lock_path_for_create(newpath, held);
+    ret = toku_metadata_get(newpath, &meta);
+    if (ret == 0) {
+        ret = -EEXIST;
+        goto out;
+    }
+
+    time_t now = time(NULL);
+    ret = toku_metadata_update_for_symlink(newpath, now, oldpath);
     assert(ret == 0);
+    update_ancestor_usage(newpath, strlen(oldpath), 1);
+
+out:
+    unlock_paths(held);
+    toku_opstats_end(TOKU_FS_OP_SYMLINK, op_start, ret < 0);
     return ret;
 }
 
 /**
  * Unlink a file, decrementing its reference count. If the count
- * goes to zero, the files contents and metadata are removed.
+ * goes to zero, the file's metadata is removed and its contents
+ * are queued for the reclaim thread.
  * XXX ref count is always 1, so decrementing is always 0
  */
 int toku_fs_unlink(const char * path)
 {
     int ret;
+    int64_t bytes, files;
     struct metadata meta;
+    pthread_mutex_t * lock = get_path_lock(path);
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_UNLINK);
 
-    debug_echo("called with path %s\n", path);
+    toku_trace_args(TOKU_FS_OP_UNLINK, path, 0, 0);
 
-    ret = toku_bstore_meta_get(path, &meta, METADATA_SIZE);
+    pthread_mutex_lock(lock);
+    ret = toku_metadata_get(path, &meta);
     if (ret == BSTORE_NOTFOUND) {
         ret = -ENOENT;
         goto out;
     }
     assert(ret == 0);
+    // taking a directory's usage off its ancestors would leave
+    // what's under it counted nowhere
+    if (S_ISDIR(meta.st.st_mode)) {
+        ret = -EISDIR;
+        goto out;
+    }
 
-    // delete the metadata
+    // queue the blocks to be given back later, if the data wasn't
+    // inline, before the metadata goes. the env keeps no log, so a
+    // crash comes back to the last checkpoint, which has every
+    // write made before it. one taken after the delete has the name
+    // queued. one taken between the two has the name queued with
+    // the file still there, which the reclaim skips. anything after
+    // the last checkpoint is lost, so the unlink may be undone, but
+    // never with the blocks gone and the file still there.
+    if (meta.st.st_blocks > 0 && !(meta.flags & METADATA_FLAG_INLINE)) {
+        toku_reclaim_add(path);
+    }
     ret = toku_metadata_delete(path);
     assert(ret == 0);
-    // truncate away the blocks
-    if (meta.st.st_blocks > 0) {
-        ret = do_bstore_truncate(path);
+    bump_shrink_gen();
+    get_entry_usage(&meta, &bytes, &files);
+    update_ancestor_usage(path, -bytes, -files);
+
+out:
+    pthread_mutex_unlock(lock);
+    toku_opstats_end(TOKU_FS_OP_UNLINK, op_start, ret < 0);
+    return ret;
+}
+
+/**
+ * Create n files with the given mode, like an open with O_CREAT
+ * for each. Existence is checked for all of them in one cursor
+ * pass, the creates go out in key order, and the directories
+ * above them are updated once per run of siblings. rets[i] is
+ * 0 if paths[i] was created, -EEXIST if it was already there.
+ */
+int toku_fs_create_many(const char ** paths, int n, mode_t mode, int * rets)
+{
+    int i, j, ret;
+    int * order;
+    struct metadata * metas;
+    struct sibling_usage usage;
+    char held[PATH_LOCKS];
+    time_t now = time(NULL);
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_CREATE_MANY);
+
+    toku_trace_args(TOKU_FS_OP_CREATE_MANY, NULL, n, 0);
+
+    if (n < 0) {
+        toku_opstats_end(TOKU_FS_OP_CREATE_MANY, op_start, 1);
+        return -EINVAL;
+    }
+    order = malloc(n * sizeof(int));
+    metas = malloc(n * sizeof(struct metadata));
+    memset(&usage, 0, sizeof(usage));
+    toku_bstore_meta_sort(paths, n, order);
+
+    lock_paths_for_create(paths, n, held);
+    ret = toku_metadata_get_many(paths, order, n, metas, rets);
+    assert(ret == 0);
+    for (j = 0; j < n; j++) {
+        i = order[j];
+        // a path given twice is next to itself in key order
+        if (rets[i] == 0 || (j > 0 && strcmp(paths[order[j - 1]],
+                        paths[i]) == 0)) {
+            rets[i] = -EEXIST;
+            continue;
+        }
+        // a removed file here may not have been reclaimed yet
+        if (toku_reclaim_covers(paths[i])) {
+            do_bstore_truncate(paths[i]);
+        }
+        ret = toku_metadata_update_for_create(paths[i], now, mode);
         assert(ret == 0);
+        sibling_usage_add(&usage, paths[i], 0, 1);
+        rets[i] = 0;
     }
+    sibling_usage_flush(&usage);
+    unlock_paths(held);
 
+    free(metas);
+    free(order);
+    toku_opstats_end(TOKU_FS_OP_CREATE_MANY, op_start, 0);
+    return 0;
+}
 
-out:
-    return ret;
+/**
+ * Unlink n files, like toku_fs_unlink for each, but looking them
+ * all up in one cursor pass and updating the directories above
+ * them once per run of siblings. rets[i] is 0 if paths[i] was
+ * unlinked, -ENOENT if it didn't exist, -EISDIR for a directory.
+ */
+int toku_fs_unlink_many(const char ** paths, int n, int * rets)
+{
+    int i, j, ret, removed;
+    int64_t bytes, files;
+    int * order;
+    struct metadata * metas;
+    struct sibling_usage usage;
+    char held[PATH_LOCKS];
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_UNLINK_MANY);
+
+    toku_trace_args(TOKU_FS_OP_UNLINK_MANY, NULL, n, 0);
+
+    if (n < 0) {
+        toku_opstats_end(TOKU_FS_OP_UNLINK_MANY, op_start, 1);
+        return -EINVAL;
+    }
+    order = malloc(n * sizeof(int));
+    metas = malloc(n * sizeof(struct metadata));
+    memset(&usage, 0, sizeof(usage));
+    toku_bstore_meta_sort(paths, n, order);
+
+    removed = 0;
+    lock_paths_for_create(paths, n, held);
+    ret = toku_metadata_get_many(paths, order, n, metas, rets);
+    assert(ret == 0);
+    for (j = 0; j < n; j++) {
+        i = order[j];
+        // a path given twice is next to itself in key order
+        if (rets[i] != 0 || (j > 0 && strcmp(paths[order[j - 1]],
+                        paths[i]) == 0)) {
+            rets[i] = -ENOENT;
+            continue;
+        }
+        if (S_ISDIR(metas[i].st.st_mode)) {
+            rets[i] = -EISDIR;
+            continue;
+        }
+        // queued first, as in toku_fs_unlink
+        if (metas[i].st.st_blocks > 0 &&
+                !(metas[i].flags & METADATA_FLAG_INLINE)) {
+            toku_reclaim_add(paths[i]);
+        }
+        ret = toku_metadata_delete(paths[i]);
+        assert(ret == 0);
+        get_entry_usage(&metas[i], &bytes, &files);
+        sibling_usage_add(&usage, paths[i], -bytes, -files);
+        rets[i] = 0;
+        removed++;
+    }
+    if (removed > 0) {
+        bump_shrink_gen();
+    }
+    sibling_usage_flush(&usage);
+    unlock_paths(held);
+
+    free(metas);
+    free(order);
+    toku_opstats_end(TOKU_FS_OP_UNLINK_MANY, op_start, 0);
+    return 0;
+}
+
+/**
+ * Symlinks made before targets were kept inline have theirs,
+ * null terminated, in the first data block.
+ */
+static int readlink_block(const char * path, char * buf, size_t size)
+{
+    int ret;
+    char block[BSTORE_BLOCKSIZE];
+    struct bstore_s bstore;
+
+    memset(block, 0, BSTORE_BLOCKSIZE);
+    ret = toku_bstore_open(&bstore, path);
+    assert(ret == 0);
+    // a missing block leaves the target empty
+    toku_bstore_get(&bstore, 0, block);
+    ret = toku_bstore_close(&bstore);
+    assert(ret == 0);
+
+    char * end = memchr(block, '\0', BSTORE_BLOCKSIZE);
+    size_t link_size = end != NULL ? (size_t) (end - block) :
+        BSTORE_BLOCKSIZE;
+    size_t read_size = MIN(link_size, size - 1);
+    memcpy(buf, block, read_size);
+    buf[read_size] = '\0';
+
+    return 0;
 }
 
+/**
+ * Read the target of a symlink into buf, truncating it to
+ * size - 1 bytes so the null byte always fits.
+ */
 int toku_fs_readlink(const char * path, char * buf, size_t size)
 {
     int ret;
-    struct metadata meta;
-    char linkbuf[BSTORE_BLOCKSIZE];
+    union metadata_buf mbuf;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_READLINK);
 
-    ret = toku_bstore_meta_get(path, &meta, METADATA_SIZE);
+    toku_trace_args(TOKU_FS_OP_READLINK, path, size, 0);
+
+    ret = toku_metadata_get_inline(path, &mbuf);
     if (ret != 0) {
         ret = -ENOENT;
         goto out;
     }
-    if (!S_ISLNK(meta.st.st_mode)) {
+    if (!S_ISLNK(mbuf.meta.st.st_mode) || size == 0) {
         ret = -EINVAL;
         goto out;
     }
+    if (!(mbuf.meta.flags & METADATA_FLAG_INLINE)) {
+        ret = readlink_block(path, buf, size);
+        goto out;
+    }
 
-    debug_echo("called with path %s, size %lu\n",
-            path, size);
-
-    struct bstore_s bstore;
-    ret = toku_bstore_open(&bstore, path);
-    assert(ret == 0);
-
-    // get the first block and read its contents
-    // as the path for the symlink. we should
-    // read at most 'size' bytes into buf, minus one
-    // so the null byte always fits
-    size_t link_size = meta.st.st_size;
-    size_t read_size = MIN(link_size, size);
-    ret = toku_bstore_get(&bstore, 0, buf);
-    assert(ret == 0);
-    strncpy(linkbuf, buf, read_size);
-
-    ret = toku_bstore_close(&bstore);
-    assert(ret == 0);
+    size_t read_size = MIN(mbuf.meta.inline_size, size - 1);
+    memcpy(buf, metadata_inline_data(&mbuf.meta), read_size);
+    buf[read_size] = '\0';
 
 out:
+    toku_opstats_end(TOKU_FS_OP_READLINK, op_start, ret < 0);
     return ret;
 }
 
-
 int toku_fs_rename(const char * oldpath, const char * newpath)
 {
     int ret;
     struct metadata meta;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_RENAME);
+
+    toku_trace_args(TOKU_FS_OP_RENAME, oldpath,
+            toku_trace_path_hash(newpath), 0);
 
     // get the oldpath metadata and make sure 
     // the newpath does not exist
-    ret = toku_bstore_meta_get(oldpath, &meta, METADATA_SIZE);
+    ret = toku_metadata_get(oldpath, &meta);
     if (ret == BSTORE_NOTFOUND) {
-        debug_echo("cant rename %s to %s, source not found!\n", 
-                oldpath, newpath);
         ret = -ENOENT;
     } else {
         if (file_exists(newpath)) {
@@ -815,13 +2050,36 @@ int toku_fs_rename(const char * oldpath, const char * newpath)
             // nlinks > 1, and make an unlink not guaruntee 
             // to actually remove the file. 
             ret = toku_fs_unlink(newpath);
-            assert(ret == 0);
+            // a directory can only replace an empty one
+            if (ret == -EISDIR && S_ISDIR(meta.st.st_mode)) {
+                ret = toku_fs_rmdir(newpath);
+            }
+            if (ret != 0) {
+                goto out;
+            }
+        }
+        if (toku_reclaim_covers(newpath)) {
+            pthread_mutex_t * lock = get_path_lock(newpath);
+            pthread_mutex_lock(lock);
+            do_bstore_truncate(newpath);
+            pthread_mutex_unlock(lock);
         }
 
         ret = toku_bstore_rename_prefix(oldpath, newpath);
         assert(ret == 0);
+        // the old paths are gone, which is a shrink as far as
+        // their known sizes go
+        bump_shrink_gen();
+
+        // move the usage from the old parents to the new ones
+        int64_t bytes, files;
+        get_entry_usage(&meta, &bytes, &files);
+        update_ancestor_usage(oldpath, -bytes, -files);
+        update_ancestor_usage(newpath, bytes, files);
     }
 
+out:
+    toku_opstats_end(TOKU_FS_OP_RENAME, op_start, ret < 0);
     return ret;
 }
 
@@ -832,6 +2090,9 @@ int toku_fs_rename(const char * oldpath, const char * newpath)
 int toku_fs_utime(const char * path, const struct utimbuf * buf)
 {
     int ret;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_UTIME);
+
+    toku_trace_args(TOKU_FS_OP_UTIME, path, 0, 0);
     
     struct utimbuf tbuf;
     time_t now = time(NULL);
@@ -840,6 +2101,7 @@ int toku_fs_utime(const char * path, const struct utimbuf * buf)
     ret = toku_metadata_update_for_utime(path, &tbuf);
     assert(ret == 0);
 
+    toku_opstats_end(TOKU_FS_OP_UTIME, op_start, ret < 0);
     return ret;
 }
 
@@ -855,20 +2117,28 @@ int toku_fs_access(const char * path, int amode)
 int toku_fs_chmod(const char * path, mode_t mode)
 {
     int ret;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_CHMOD);
+
+    toku_trace_args(TOKU_FS_OP_CHMOD, path, mode, 0);
 
     ret = toku_metadata_update_for_chmod(path, mode);
     assert(ret == 0);
 
+    toku_opstats_end(TOKU_FS_OP_CHMOD, op_start, ret < 0);
     return ret;
 }
 
 int toku_fs_chown(const char * path, uid_t owner, gid_t group)
 {
     int ret;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_CHOWN);
+
+    toku_trace_args(TOKU_FS_OP_CHOWN, path, owner, group);
     
     ret = toku_metadata_update_for_chown(path, owner, group);
     assert(ret == 0);
 
+    toku_opstats_end(TOKU_FS_OP_CHOWN, op_start, ret < 0);
     return ret;
 }
 
@@ -892,15 +2162,18 @@ static int is_directly_under_dir(const char * filename,
 int toku_fs_mkdir(const char * path, mode_t mode)
 {
     int ret;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_MKDIR);
+
+    toku_trace_args(TOKU_FS_OP_MKDIR, path, mode, 0);
 
     //TODO check that it makes sense to mkdir at the
     //given path. major error checking needed.
     //XXX this check is not needed for fuse
 
-    time_t now = time(NULL);
-    ret = toku_metadata_update_for_create(path, now, mode | S_IFDIR);
-    assert(ret == 0);
+    create_if_new(path, mode | S_IFDIR);
+    ret = 0;
 
+    toku_opstats_end(TOKU_FS_OP_MKDIR, op_start, ret < 0);
     return ret;
 }
 
@@ -910,12 +2183,12 @@ struct directory_is_empty_info {
 };
 
 static int directory_is_empty_meta_scan(const char * name,
-        void * meta, void * extra)
+        void * meta, size_t meta_size, void * extra)
 {
     struct directory_is_empty_info * info = extra;
     (void) meta;
+    (void) meta_size;
 
-    debug_echo("scanning to check for a child of %s\n", info->dirname);
     // we're supposed to scan with a starting key 
     // that has a slash after a real directory name,
     // which shouldn't directly exist, but rather
@@ -926,12 +2199,12 @@ static int directory_is_empty_meta_scan(const char * name,
         assert(strcmp(name, info->dirname) != 0);
     }
     if (is_directly_under_dir(name, info->dirname)) {
-        debug_echo("saw child %s\n", name);
         info->saw_child = 1;
     } else {
-        debug_echo("did not see child, stopping at %s\n", name);
         info->saw_child = 0;
     }
+    toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_RMDIR_CHILD, name,
+            info->saw_child, 0);
     return 0;
 }
 
@@ -977,29 +2250,34 @@ int toku_fs_rmdir(const char * path)
 {
     int ret;
     struct metadata meta;
+    pthread_mutex_t * lock;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_RMDIR);
 
-    debug_echo("called with path %s\n", path);
+    toku_trace_args(TOKU_FS_OP_RMDIR, path, 0, 0);
 
     // can't remove the root directory
     if (strcmp(path, "/") == 0) {
-        ret = -EINVAL;
-        goto out;
+        toku_opstats_end(TOKU_FS_OP_RMDIR, op_start, 1);
+        return -EINVAL;
     }
 
-    ret = toku_bstore_meta_get(path, &meta, METADATA_SIZE);
+    lock = get_path_lock(path);
+    pthread_mutex_lock(lock);
+    ret = toku_metadata_get(path, &meta);
     if (ret != 0) {
         ret = -ENOENT;
     } else if (!S_ISDIR(meta.st.st_mode)) {
         ret = -ENOTDIR;
     } else if (!directory_is_empty(path)) {
-        debug_echo("couldnt rmdir, wasn't empty!\n");
         ret = -ENOTEMPTY;
     } else {
         ret = toku_metadata_delete(path);
         assert(ret == 0);
+        update_ancestor_usage(path, 0, -1);
     }
 
-out:
+    pthread_mutex_unlock(lock);
+    toku_opstats_end(TOKU_FS_OP_RMDIR, op_start, ret < 0);
     return ret;
 }
 
@@ -1011,9 +2289,12 @@ int toku_fs_opendir(const char * path, struct toku_dircursor * cursor)
 {
     int ret;
     struct metadata meta;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_OPENDIR);
+
+    toku_trace_args(TOKU_FS_OP_OPENDIR, path, 0, 0);
 
     // make sure a directory exists at path
-    ret = toku_bstore_meta_get(path, &meta, METADATA_SIZE);
+    ret = toku_metadata_get(path, &meta);
     if (ret == BSTORE_NOTFOUND) {
         ret = -ENOENT;
         goto out;
@@ -1039,6 +2320,7 @@ int toku_fs_opendir(const char * path, struct toku_dircursor * cursor)
     cursor->status = TOKU_DIRCURSOR_STATUS_FIRST;
 
 out:
+    toku_opstats_end(TOKU_FS_OP_OPENDIR, op_start, ret < 0);
     return ret;
 }
 
@@ -1088,18 +2370,18 @@ struct readdir_scan_cb_info {
  * as extra
  */
 static int readdir_scan_cb(const char * name,
-        void * meta, void * extra)
+        void * meta, size_t meta_size, void * extra)
 {
     int ret;
     struct readdir_scan_cb_info * info = extra;
 
-    debug_echo("got key %s\n", name);
+    toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_READDIR_KEY, name,
+            info->status == READDIR_SCAN_CB_STATUS_SKIP_FIRST, 0);
 
     // skip the first entry if requested
     if (info->status == READDIR_SCAN_CB_STATUS_SKIP_FIRST) {
         info->status = READDIR_SCAN_CB_STATUS_READING;
         ret = BSTORE_SCAN_CONTINUE;
-        debug_echo("skipping first iteration by request\n");
         goto out;
     }
     // if we're not on the first iteration, the current
@@ -1116,9 +2398,12 @@ static int readdir_scan_cb(const char * name,
     if (info->entries_read < info->num_entries_to_read) {
         if (is_directly_under_dir(name, info->dirname)) {
             // copy over key/val to info->buf
+            struct metadata m;
             struct toku_dirent * dirent = &info->buf[info->entries_read];
+            ret = toku_metadata_decode(meta, meta_size, &m, 0);
+            assert(ret == 0);
             dirent->filename = toku_strdup(name);
-            memcpy(&dirent->st, meta, sizeof(struct stat));
+            memcpy(&dirent->st, &m.st, sizeof(struct stat));
             info->entries_read++;
             info->status = READDIR_SCAN_CB_STATUS_READING;
             ret = BSTORE_SCAN_CONTINUE;
@@ -1129,9 +2414,8 @@ static int readdir_scan_cb(const char * name,
             // are adjacent, so if we scan starting at some directory
             // then subsequent files are in that directory iff they
             // are directly under it
-            debug_echo("end of the directory stream, "
-                    " since %s is not directly under %s\n",
-                    name, info->dirname);
+            toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_READDIR_END, name,
+                    info->entries_read, 0);
             info->status = READDIR_SCAN_CB_STATUS_DONE;
         }
     } else {
@@ -1158,9 +2442,9 @@ int toku_fs_readdir(struct toku_dircursor * cursor,
         int * entries_read)
 {
     int ret;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_READDIR);
 
-    debug_echo("called with dir %s, current %s\n",
-            cursor->dirname, cursor->current);
+    toku_trace_args(TOKU_FS_OP_READDIR, cursor->dirname, num_entries, 0);
 
     struct readdir_scan_cb_info info;
     info.dirname = cursor->dirname;
@@ -1190,15 +2474,13 @@ int toku_fs_readdir(struct toku_dircursor * cursor,
             break;
         case TOKU_DIRCURSOR_STATUS_DONE:
             // this cursor is exhausted
-            debug_echo("tried to readdir on an exhausted cursor!\n");
             ret = 0;
             goto out;
     }
 
     ret = toku_bstore_meta_scan(cursor->current, readdir_scan_cb, &info);
-    debug_echo("meta scan ret %d, info.status %d, "
-            "info.entries_read %d\n", ret, 
-            info.status, info.entries_read);
+    toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_READDIR_SCAN, NULL,
+            info.entries_read, info.status == READDIR_SCAN_CB_STATUS_MORE);
     if (ret == BSTORE_NOTFOUND) {
         // if we couldn't start the scan and this is the first
         // for this cursor, then the directory is simply empty.
@@ -1210,7 +2492,6 @@ int toku_fs_readdir(struct toku_dircursor * cursor,
     }
     assert(ret == 0);
     if (info.status == READDIR_SCAN_CB_STATUS_MORE) {
-        debug_echo("readdir says more\n");
         cursor->status = TOKU_DIRCURSOR_STATUS_READING;
         ret = 1;
     } else {
@@ -1218,7 +2499,6 @@ int toku_fs_readdir(struct toku_dircursor * cursor,
         // wanted to finish, or was in the middle of reading and ran
         // to the end of the directory stream. either way, the
         // cursor is done.
-        debug_echo("readdir is done\n");
         cursor->status = TOKU_DIRCURSOR_STATUS_DONE;
         ret = 0;
     }
@@ -1230,34 +2510,998 @@ int toku_fs_readdir(struct toku_dircursor * cursor,
         // info.entries read is the first free index, minus one is the
         // last one we wrote to.
         int i = info.entries_read - 1;
-        debug_echo("changing cursor from %s to %s\n", 
-                cursor->current, info.buf[i].filename);
+        toku_trace(TOKU_TRACE_DEBUG, TOKU_TRACE_READDIR_CURSOR,
+                info.buf[i].filename, 0, 0);
         free(cursor->current);
         cursor->current = toku_strdup(info.buf[i].filename);
     }
 
 out:
     *entries_read = info.entries_read;
+    toku_opstats_end(TOKU_FS_OP_READDIR, op_start, ret < 0);
     return ret;
 }
 
-//
-// Hints and parameters
-//
-
-size_t toku_fs_get_blocksize(void)
+/**
+ * Get the total size and number of files under a directory,
+ * recursively. These are kept up to date as files change, so
+ * this is a single metadata read.
+ */
+int toku_fs_dir_usage(const char * path, struct toku_fs_dir_usage * usage)
 {
-    size_t blocksize = BSTORE_BLOCKSIZE;
+    int ret;
+    struct metadata meta;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_DIR_USAGE);
 
-    return blocksize;
-}
+    toku_trace_args(TOKU_FS_OP_DIR_USAGE, path, 0, 0);
 
-size_t toku_fs_get_cachesize(void)
-{
-    return toku_bstore_env_get_cachesize();
+    ret = toku_metadata_get(path, &meta);
+    if (ret != 0) {
+        ret = -ENOENT;
+    } else if (!S_ISDIR(meta.st.st_mode)) {
+        ret = -ENOTDIR;
+    } else {
+        usage->bytes = meta.du_bytes;
+        usage->files = meta.du_files;
+    }
+
+    toku_opstats_end(TOKU_FS_OP_DIR_USAGE, op_start, ret < 0);
+    return ret;
 }
 
-int toku_fs_set_cachesize(size_t cachesize)
+/**
+ * Walks hand entries back in batches, so the callback never
+ * runs with a cursor open and is free to call back into tokufs.
+ */
+#define WALK_BATCH 64
+
+struct walk_entry {
+    char * path;
+    struct stat st;
+};
+
+/**
+ * prefix is the root with a trailing slash and depth is the
+ * slash count of the level being scanned. resume is the key the
+ * last batch stopped on, which the next batch skips.
+ */
+struct walk_scan_cb_info {
+    const char * prefix;
+    size_t prefix_len;
+    int depth;
+    int report;
+    const char * resume;
+    const struct toku_fs_walk_filter * filter;
+    struct walk_entry batch[WALK_BATCH];
+    int entries;
+    int saw_dir;
+    int more;
+};
+
+/**
+ * True if the entry passes every filter besides depth.
+ */
+static int walk_filter_match(const struct toku_fs_walk_filter * filter,
+        const char * path, const struct stat * st)
 {
-    return toku_bstore_env_set_cachesize(cachesize);
+    mode_t type;
+    const char * base;
+
+    if (filter->name != NULL) {
+        base = strrchr(path, '/');
+        base = base != NULL ? base + 1 : path;
+        if (fnmatch(filter->name, base, 0) != 0) {
+            return 0;
+        }
+    }
+    // files created through the library api keep the mode they
+    // were given, which usually has no type bits.
+    type = st->st_mode & S_IFMT;
+    if (type == 0) {
+        type = S_IFREG;
+    }
+    if (filter->type != 0 && type != filter->type) {
+        return 0;
+    }
+    if (st->st_size < filter->min_size ||
+            (filter->max_size != 0 && st->st_size > filter->max_size)) {
+        return 0;
+    }
+    if (st->st_mtime < filter->min_mtime ||
+            (filter->max_mtime != 0 && st->st_mtime > filter->max_mtime)) {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Everything on one level under the root is adjacent in the
+ * metadata, so the scan runs until a key leaves the root or
+ * the level, or the batch fills up.
+ */
+static int walk_scan_cb(const char * name,
+        void * meta, size_t meta_size, void * extra)
+{
+    int ret;
+    struct metadata m;
+    struct walk_scan_cb_info * info = extra;
+
+    if (info->resume != NULL) {
+        const char * resume = info->resume;
+        info->resume = NULL;
+        if (strcmp(name, resume) == 0) {
+            return BSTORE_SCAN_CONTINUE;
+        }
+    }
+    if (strncmp(name, info->prefix, info->prefix_len) != 0 ||
+            toku_strcount(name, '/') != info->depth) {
+        return 0;
+    }
+    // the root directory "/" is its own prefix
+    if (name[info->prefix_len] == '\0') {
+        return BSTORE_SCAN_CONTINUE;
+    }
+
+    ret = toku_metadata_decode(meta, meta_size, &m, 0);
+    assert(ret == 0);
+    if (S_ISDIR(m.st.st_mode)) {
+        info->saw_dir = 1;
+    }
+    if (info->report && walk_filter_match(info->filter, name, &m.st)) {
+        struct walk_entry * entry = &info->batch[info->entries++];
+        entry->path = toku_strdup(name);
+        memcpy(&entry->st, &m.st, sizeof(struct stat));
+        if (info->entries == WALK_BATCH) {
+            info->more = 1;
+            return 0;
+        }
+    }
+
+    return BSTORE_SCAN_CONTINUE;
+}
+
+/**
+ * The smallest key with depth slashes under prefix. Path
+ * components are at most NAME_MAX bytes, none of them 0, so
+ * a run of NAME_MAX + 1 0x01 bytes sorts below the first
+ * component of any real key. The slashes after it only
+ * make the slash count right.
+ */
+static char * walk_level_start(const char * prefix, int slashes)
+{
+    size_t len = strlen(prefix);
+    char * start;
+
+    if (slashes == 0) {
+        return toku_strdup(prefix);
+    }
+    start = malloc(len + NAME_MAX + 1 + slashes + 1);
+    memcpy(start, prefix, len);
+    memset(start + len, 1, NAME_MAX + 1);
+    memset(start + len + NAME_MAX + 1, '/', slashes);
+    start[len + NAME_MAX + 1 + slashes] = '\0';
+
+    return start;
+}
+
+/**
+ * Hand a batch to the callback and free it. Returns what
+ * the callback returned, or 0 if every call did.
+ */
+static int walk_report_batch(struct walk_scan_cb_info * info,
+        toku_fs_walk_fn fn, void * extra)
+{
+    int i, ret = 0;
+
+    for (i = 0; i < info->entries; i++) {
+        if (ret == 0) {
+            ret = fn(info->batch[i].path, &info->batch[i].st, extra);
+        }
+        free(info->batch[i].path);
+    }
+    info->entries = 0;
+
+    return ret;
+}
+
+/**
+ * Walk everything under root, breadth first. Because the
+ * metadata is sorted by depth before name, each level under
+ * the root is one range scan, rather than one scan per directory.
+ * The filter is checked during the scan and matches are passed
+ * to fn as they are found, a batch at a time.
+ */
+static int walk(const char * root, const struct toku_fs_walk_filter * filter,
+        toku_fs_walk_fn fn, void * extra)
+{
+    int ret, level, base;
+    size_t len;
+    char * prefix, * start, * resume;
+    struct metadata meta;
+    struct toku_fs_walk_filter none;
+    struct walk_scan_cb_info * info;
+
+    if (filter == NULL) {
+        memset(&none, 0, sizeof(none));
+        filter = &none;
+    }
+    ret = toku_metadata_get(root, &meta);
+    if (ret != 0) {
+        return -ENOENT;
+    }
+    if (filter->min_depth == 0 && walk_filter_match(filter, root, &meta.st)) {
+        ret = fn(root, &meta.st, extra);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    if (!S_ISDIR(meta.st.st_mode)) {
+        return 0;
+    }
+
+    len = strlen(root);
+    prefix = malloc(len + 2);
+    strcpy(prefix, root);
+    if (len == 0 || root[len - 1] != '/') {
+        strcat(prefix, "/");
+    }
+    base = toku_strcount(prefix, '/');
+
+    info = malloc(sizeof(struct walk_scan_cb_info));
+    info->prefix = prefix;
+    info->prefix_len = strlen(prefix);
+    info->filter = filter;
+    info->entries = 0;
+    for (level = 1; filter->max_depth == 0 || level <= filter->max_depth;
+            level++) {
+        info->depth = base + level - 1;
+        info->report = level >= filter->min_depth;
+        info->saw_dir = 0;
+        start = walk_level_start(prefix, level - 1);
+        resume = NULL;
+        do {
+            info->resume = resume;
+            info->more = 0;
+            ret = toku_bstore_meta_scan(resume != NULL ? resume : start,
+                    walk_scan_cb, info);
+            assert(ret == 0 || ret == BSTORE_NOTFOUND);
+            free(resume);
+            resume = NULL;
+            if (info->more) {
+                resume = toku_strdup(info->batch[info->entries - 1].path);
+            }
+            ret = walk_report_batch(info, fn, extra);
+        } while (ret == 0 && resume != NULL);
+        free(resume);
+        free(start);
+        // nothing deeper can exist without a directory at this level
+        if (ret != 0 || !info->saw_dir) {
+            break;
+        }
+    }
+    free(info);
+    free(prefix);
+
+    return ret;
+}
+
+int toku_fs_walk(const char * root, const struct toku_fs_walk_filter * filter,
+        toku_fs_walk_fn fn, void * extra)
+{
+    int ret;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_WALK);
+
+    toku_trace_args(TOKU_FS_OP_WALK, root, 0, 0);
+
+    ret = walk(root, filter, fn, extra);
+    toku_opstats_end(TOKU_FS_OP_WALK, op_start, ret < 0);
+    return ret;
+}
+
+struct backfill_info {
+    uint64_t bytes;
+    uint64_t files;
+    char ** dirs;
+    int num_dirs;
+};
+
+static int backfill_cb(const char * path,
+        const struct stat * st, void * extra)
+{
+    struct backfill_info * info = extra;
+
+    info->files++;
+    if (S_ISDIR(st->st_mode)) {
+        info->dirs = realloc(info->dirs,
+                (info->num_dirs + 1) * sizeof(char *));
+        info->dirs[info->num_dirs++] = toku_strdup(path);
+    } else {
+        info->bytes += st->st_size;
+    }
+
+    return 0;
+}
+
+/**
+ * Count up the usage of a directory from before usage was kept,
+ * one level at a time, and set it. Subdirectories whose counts
+ * are already known are taken as they are, so a backfill cut
+ * short by a crash picks up where it left off, and a directory
+ * is only set once everything under it is.
+ */
+static void backfill_usage(const char * path,
+        uint64_t * bytes, uint64_t * files)
+{
+    int i, ret;
+    uint64_t b, f;
+    struct metadata meta;
+    struct toku_fs_walk_filter filter;
+    struct backfill_info info;
+
+    memset(&filter, 0, sizeof(filter));
+    filter.min_depth = 1;
+    filter.max_depth = 1;
+    memset(&info, 0, sizeof(info));
+    ret = walk(path, &filter, backfill_cb, &info);
+    assert(ret == 0);
+    for (i = 0; i < info.num_dirs; i++) {
+        ret = toku_metadata_get(info.dirs[i], &meta);
+        assert(ret == 0);
+        if (meta.flags & METADATA_FLAG_NO_USAGE) {
+            backfill_usage(info.dirs[i], &b, &f);
+        } else {
+            b = meta.du_bytes;
+            f = meta.du_files;
+        }
+        info.bytes += b;
+        info.files += f;
+        free(info.dirs[i]);
+    }
+    free(info.dirs);
+    ret = toku_metadata_set_usage(path, info.bytes, info.files);
+    assert(ret == 0);
+    *bytes = info.bytes;
+    *files = info.files;
+}
+
+/**
+ * An env from before usage was kept has none on its directories.
+ * Fill it in at mount, before anything can change it, so deltas
+ * don't wrap the counts and du and statfs are right.
+ */
+static void backfill_usage_if_legacy(void)
+{
+    int ret;
+    uint64_t bytes, files;
+    struct metadata meta;
+
+    ret = toku_metadata_get("/", &meta);
+    assert(ret == 0);
+    if (meta.flags & METADATA_FLAG_NO_USAGE) {
+        backfill_usage("/", &bytes, &files);
+    }
+}
+
+struct remove_tree_info {
+    int64_t bytes;
+    int64_t files;
+};
+
+/**
+ * Delete an entry under the tree, adding up what it used on its
+ * own. A directory's usage covers entries the walk also visits.
+ */
+static int remove_tree_cb(const char * path,
+        const struct stat * st, void * extra)
+{
+    int ret;
+    struct remove_tree_info * info = extra;
+    pthread_mutex_t * lock = get_path_lock(path);
+
+    pthread_mutex_lock(lock);
+    ret = toku_metadata_delete(path);
+    assert(ret == 0);
+    pthread_mutex_unlock(lock);
+    if (!S_ISDIR(st->st_mode)) {
+        info->bytes += st->st_size;
+    }
+    info->files++;
+
+    return 0;
+}
+
+/**
+ * Remove a directory and everything under it. The metadata
+ * is deleted right away, one level at a time, while the data
+ * blocks are queued for the reclaim thread, so the cost is
+ * one metadata delete per entry no matter how big the files are.
+ *
+ * Entries under the directory don't update the usage of their
+ * parents as they go, since those are going too. The directory's
+ * own usage covers all of them when it is taken off its ancestors.
+ *
+ * Nothing stops an entry from being created under the directory
+ * during the walk. If one is there once the walk is done, the
+ * directory stays, with what was removed taken off its usage, and
+ * the call fails with -ENOTEMPTY, the same as rmdir would. Creates
+ * hold the lock of the directory they create in, so one can't
+ * land between that check and the delete.
+ *
+ * What's still possible: creates don't check that their directory
+ * exists, so one deeper down, in a subdirectory the walk already
+ * deleted, is left with no parent. So is an entry renamed into
+ * the tree, since renames don't take path locks.
+ */
+static int remove_tree(const char * path)
+{
+    int ret;
+    size_t len;
+    char * prefix;
+    int64_t bytes, files;
+    struct metadata meta;
+    struct toku_fs_walk_filter filter;
+    struct remove_tree_info info;
+    struct reclaim_job * job;
+    pthread_mutex_t * lock;
+
+    if (strcmp(path, "/") == 0) {
+        return -EINVAL;
+    }
+    ret = toku_metadata_get(path, &meta);
+    if (ret != 0) {
+        return -ENOENT;
+    }
+    if (!S_ISDIR(meta.st.st_mode)) {
+        return toku_fs_unlink(path);
+    }
+
+    // hold the blocks for reclaim before the metadata goes, so
+    // anything created under the prefix knows to drop stale
+    // blocks, but don't reclaim them until the names are gone.
+    len = strlen(path);
+    prefix = malloc(len + 2);
+    sprintf(prefix, "%s/", path);
+    job = toku_reclaim_hold(prefix);
+    free(prefix);
+
+    memset(&filter, 0, sizeof(filter));
+    filter.min_depth = 1;
+    memset(&info, 0, sizeof(info));
+    ret = walk(path, &filter, remove_tree_cb, &info);
+    assert(ret == 0);
+
+    lock = get_path_lock(path);
+    pthread_mutex_lock(lock);
+    if (!directory_is_empty(path)) {
+        ret = toku_metadata_update_for_du(path, -info.bytes, -info.files);
+        assert(ret == 0);
+        update_ancestor_usage(path, -info.bytes, -info.files);
+        bump_shrink_gen();
+        ret = -ENOTEMPTY;
+        goto out;
+    }
+    ret = toku_metadata_get(path, &meta);
+    assert(ret == 0);
+    ret = toku_metadata_delete(path);
+    assert(ret == 0);
+    bump_shrink_gen();
+    get_entry_usage(&meta, &bytes, &files);
+    update_ancestor_usage(path, -bytes, -files);
+out:
+    pthread_mutex_unlock(lock);
+    toku_reclaim_release(job);
+
+    return ret;
+}
+
+int toku_fs_remove_tree(const char * path)
+{
+    int ret;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_REMOVE_TREE);
+
+    toku_trace_args(TOKU_FS_OP_REMOVE_TREE, path, 0, 0);
+
+    ret = remove_tree(path);
+    toku_opstats_end(TOKU_FS_OP_REMOVE_TREE, op_start, ret < 0);
+    return ret;
+}
+
+//
+// Hints and parameters
+//
+
+size_t toku_fs_get_blocksize(void)
+{
+    size_t blocksize = BSTORE_BLOCKSIZE;
+
+    return blocksize;
+}
+
+int toku_fs_fadvise(int fd, off_t offset, off_t len,
+        enum toku_fs_advice advice)
+{
+    int ret;
+    struct metadata meta;
+    struct open_file * file;
+    uint64_t last_block_num;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_FADVISE);
+
+    if (offset < 0 || len < 0 || advice < TOKU_FS_ADVICE_NORMAL ||
+            advice > TOKU_FS_ADVICE_DONTNEED) {
+        ret = -EINVAL;
+        goto out;
+    }
+    file = locked_get_open_file(fd);
+    if (file == NULL) {
+        ret = -EBADF;
+        goto out;
+    }
+    toku_trace_args(TOKU_FS_OP_FADVISE, file->bstore.name, offset, len);
+
+    ret = 0;
+    switch (advice) {
+    case TOKU_FS_ADVICE_WILLNEED:
+        // there's nothing to warm in an inline file
+        if (toku_metadata_get(file->bstore.name, &meta) != 0 ||
+                (meta.flags & METADATA_FLAG_INLINE) ||
+                offset >= meta.st.st_size) {
+            break;
+        }
+        if (len == 0 || offset + len > meta.st.st_size) {
+            len = meta.st.st_size - offset;
+        }
+        last_block_num = block_get_num_by_position(offset + len - 1);
+        willneed_start(file->bstore.name,
+                block_get_num_by_position(offset), last_block_num);
+        break;
+    case TOKU_FS_ADVICE_DONTNEED:
+        // the engine has no way to drop blocks from its cache, so
+        // stop warming them and read only what's asked for, which
+        // keeps the blocks this file pulls in to a minimum
+        willneed_cancel(file->bstore.name, 0);
+        file->advice = advice;
+        break;
+    default:
+        file->advice = advice;
+        break;
+    }
+
+out:
+    toku_opstats_end(TOKU_FS_OP_FADVISE, op_start, ret < 0);
+    return ret;
+}
+
+size_t toku_fs_get_cachesize(void)
+{
+    return toku_bstore_env_get_cachesize();
+}
+
+int toku_fs_set_cachesize(size_t cachesize)
+{
+    if (cachesize == 0) {
+        return -EINVAL;
+    }
+    toku_trace(TOKU_TRACE_OPS, TOKU_TRACE_SET_CACHESIZE, NULL,
+            cachesize, 0);
+    return toku_bstore_env_set_cachesize(cachesize);
+}
+
+//
+// Statistics
+//
+
+// what the counters were at the last reset
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct toku_fs_stats stats_baseline;
+#ifdef TOKUFS_PROFILE
+static struct toku_fs_profile profile_baseline;
+#endif
+static struct toku_fs_engine_status engine_baseline;
+
+const char * toku_fs_op_name(enum toku_fs_op op)
+{
+    return toku_opstats_name(op);
+}
+
+const char * toku_fs_phase_name(enum toku_fs_phase phase)
+{
+    return toku_opstats_phase_name(phase);
+}
+
+int toku_fs_trace_dump(FILE * f)
+{
+    return toku_trace_dump(f);
+}
+
+uint64_t toku_fs_trace_path_hash(const char * path)
+{
+    return toku_trace_path_hash(path);
+}
+
+/**
+ * A counter's count since then. The engine's start over when
+ * the env is opened again, by a resize or a remount.
+ */
+static uint64_t counter_since(uint64_t now, uint64_t then)
+{
+    return now >= then ? now - then : now;
+}
+
+static void get_stats_since_start(struct toku_fs_stats * stats)
+{
+    struct bstore_stats bstats;
+    struct optimize_stats ostats;
+    struct dirprefetch_stats dstats;
+
+    memset(stats, 0, sizeof(struct toku_fs_stats));
+    toku_bstore_get_stats(&bstats);
+    stats->zero_blocks_elided = bstats.zero_blocks_elided;
+    stats->zero_bytes_elided = bstats.zero_bytes_elided;
+    stats->heap_allocs = bstats.block_buffer_allocs +
+        bstats.update_callback_allocs;
+    stats->reclaims_pending = toku_reclaim_pending();
+    stats->cache_hits = bstats.cache_hits;
+    stats->cache_misses = bstats.cache_misses;
+    stats->meta_cache_hits = bstats.meta_cache_hits;
+    stats->meta_cache_misses = bstats.meta_cache_misses;
+    toku_optimize_get_stats(&ostats);
+    stats->optimize_passes = ostats.passes;
+    stats->optimize_ranges = ostats.ranges;
+    stats->optimize_bytes = ostats.bytes;
+    stats->optimize_progress = ostats.progress;
+    toku_dirprefetch_get_stats(&dstats);
+    stats->dir_prefetches = dstats.sweeps;
+    stats->dir_prefetches_dropped = dstats.dropped;
+    stats->dir_prefetch_files = dstats.files;
+    stats->parallel_slices = __sync_fetch_and_add(&parallel_slices, 0);
+    toku_opstats_get(stats->ops);
+}
+
+#define ENGINE_FIELD(field) offsetof(struct toku_fs_engine_status, field)
+
+/**
+ * The engine status rows that feed each counter. A counter fed
+ * by more than one row gets their sum.
+ */
+static const struct {
+    const char * key;
+    size_t offset;
+} engine_rows[] = {
+    { "FT_DISK_FLUSH_LEAF_BYTES", ENGINE_FIELD(disk_bytes_written) },
+    { "FT_DISK_FLUSH_NONLEAF_BYTES", ENGINE_FIELD(disk_bytes_written) },
+    { "FT_DISK_FLUSH_LEAF_BYTES_FOR_CHECKPOINT",
+        ENGINE_FIELD(disk_bytes_written) },
+    { "FT_DISK_FLUSH_NONLEAF_BYTES_FOR_CHECKPOINT",
+        ENGINE_FIELD(disk_bytes_written) },
+    { "LOGGER_BYTES_WRITTEN", ENGINE_FIELD(disk_bytes_written) },
+    { "CT_MISS", ENGINE_FIELD(cache_misses) },
+    { "CT_EVICTIONS", ENGINE_FIELD(cache_evictions) },
+    { "CT_SIZE_CURRENT", ENGINE_FIELD(cache_bytes) },
+    { "CT_SIZE_LIMIT", ENGINE_FIELD(cache_limit) },
+    { "CP_CHECKPOINT_COUNT", ENGINE_FIELD(checkpoints) },
+    { "CP_TIME_CHECKPOINT_DURATION", ENGINE_FIELD(checkpoint_secs) },
+    { "FT_MSG_BYTES_CURR", ENGINE_FIELD(buffered_bytes) },
+};
+
+/**
+ * The fields of an engine status that count up, as opposed to
+ * showing how things are now.
+ */
+static const size_t engine_counters[] = {
+    ENGINE_FIELD(bytes_written),
+    ENGINE_FIELD(disk_bytes_written),
+    ENGINE_FIELD(cache_misses),
+    ENGINE_FIELD(cache_evictions),
+    ENGINE_FIELD(checkpoints),
+    ENGINE_FIELD(checkpoint_secs),
+    ENGINE_FIELD(data.messages),
+    ENGINE_FIELD(meta.messages),
+};
+
+static uint64_t * engine_field(struct toku_fs_engine_status * status,
+        size_t offset)
+{
+    return (uint64_t *) ((char *) status + offset);
+}
+
+static void engine_status_row(const char * key, const char * legend,
+        uint64_t value, void * extra)
+{
+    struct toku_fs_engine_status * status = extra;
+    (void) legend;
+
+    for (size_t i = 0; i < ARRAY_SIZE(engine_rows); i++) {
+        if (strcmp(key, engine_rows[i].key) == 0) {
+            *engine_field(status, engine_rows[i].offset) += value;
+        }
+    }
+}
+
+static void get_engine_status_since_start(
+        struct toku_fs_engine_status * status)
+{
+    int ret;
+    struct metadata root;
+    struct bstore_stats bstats;
+    struct bstore_space data, meta;
+    struct toku_fs_op_stats * ops =
+        malloc(TOKU_FS_OPS * sizeof(struct toku_fs_op_stats));
+
+    memset(status, 0, sizeof(struct toku_fs_engine_status));
+    ret = toku_bstore_env_get_status(engine_status_row, status);
+    assert(ret == 0);
+    toku_opstats_get(ops);
+    status->bytes_written = ops[TOKU_FS_OP_PWRITE].bytes +
+        ops[TOKU_FS_OP_PUT_FILE].bytes;
+    free(ops);
+    toku_bstore_get_stats(&bstats);
+    status->data.messages = bstats.data_messages;
+    status->meta.messages = bstats.meta_messages;
+    ret = toku_bstore_env_get_dict_space(&data, &meta);
+    assert(ret == 0);
+    status->data.logical_bytes = data.logical_bytes;
+    status->data.disk_bytes = data.disk_bytes;
+    status->meta.logical_bytes = meta.logical_bytes;
+    status->meta.disk_bytes = meta.disk_bytes;
+    ret = toku_metadata_get("/", &root);
+    assert(ret == 0);
+    status->file_bytes = root.du_bytes;
+}
+
+static double ratio(uint64_t a, uint64_t b)
+{
+    return b > 0 ? (double) a / b : 0;
+}
+
+int toku_fs_engine_status(struct toku_fs_engine_status * status)
+{
+    size_t i;
+    uint64_t * field;
+
+    assert(mount_path != NULL);
+    get_engine_status_since_start(status);
+    pthread_mutex_lock(&stats_lock);
+    for (i = 0; i < ARRAY_SIZE(engine_counters); i++) {
+        field = engine_field(status, engine_counters[i]);
+        *field = counter_since(*field,
+                *engine_field(&engine_baseline, engine_counters[i]));
+    }
+    pthread_mutex_unlock(&stats_lock);
+
+    status->data.compression = ratio(status->data.logical_bytes,
+            status->data.disk_bytes);
+    status->meta.compression = ratio(status->meta.logical_bytes,
+            status->meta.disk_bytes);
+    status->write_amplification = ratio(status->disk_bytes_written,
+            status->bytes_written);
+    status->space_amplification = ratio(status->data.disk_bytes +
+            status->meta.disk_bytes, status->file_bytes);
+
+    return 0;
+}
+
+/**
+ * The engine status fields, by the names in a dump.
+ */
+static const struct {
+    const char * name;
+    size_t offset;
+} engine_dump_fields[] = {
+    { "bytes_written", ENGINE_FIELD(bytes_written) },
+    { "disk_bytes_written", ENGINE_FIELD(disk_bytes_written) },
+    { "cache_misses", ENGINE_FIELD(cache_misses) },
+    { "cache_evictions", ENGINE_FIELD(cache_evictions) },
+    { "cache_bytes", ENGINE_FIELD(cache_bytes) },
+    { "cache_limit", ENGINE_FIELD(cache_limit) },
+    { "checkpoints", ENGINE_FIELD(checkpoints) },
+    { "checkpoint_secs", ENGINE_FIELD(checkpoint_secs) },
+    { "buffered_bytes", ENGINE_FIELD(buffered_bytes) },
+    { "file_bytes", ENGINE_FIELD(file_bytes) },
+    { "data_logical_bytes", ENGINE_FIELD(data.logical_bytes) },
+    { "data_disk_bytes", ENGINE_FIELD(data.disk_bytes) },
+    { "data_messages", ENGINE_FIELD(data.messages) },
+    { "meta_logical_bytes", ENGINE_FIELD(meta.logical_bytes) },
+    { "meta_disk_bytes", ENGINE_FIELD(meta.disk_bytes) },
+    { "meta_messages", ENGINE_FIELD(meta.messages) },
+};
+
+static void dump_engine_row(const char * key, const char * legend,
+        uint64_t value, void * extra)
+{
+    fprintf(extra, "engine %s %lu %s\n", key, value, legend);
+}
+
+int toku_fs_dump_engine_status(FILE * f)
+{
+    int ret;
+    struct toku_fs_engine_status status;
+
+    ret = toku_fs_engine_status(&status);
+    assert(ret == 0);
+    fprintf(f, "# tokufs engine status\n");
+    for (size_t i = 0; i < ARRAY_SIZE(engine_dump_fields); i++) {
+        fprintf(f, "%s %lu\n", engine_dump_fields[i].name,
+                *engine_field(&status, engine_dump_fields[i].offset));
+    }
+    fprintf(f, "# engine rows, counting since the env was opened\n");
+    ret = toku_bstore_env_get_status(dump_engine_row, f);
+    assert(ret == 0);
+
+    return ferror(f) ? -EIO : 0;
+}
+
+int toku_fs_get_stats(struct toku_fs_stats * stats)
+{
+    struct toku_fs_stats * then = &stats_baseline;
+
+    get_stats_since_start(stats);
+    pthread_mutex_lock(&stats_lock);
+    stats->zero_blocks_elided = counter_since(stats->zero_blocks_elided,
+            then->zero_blocks_elided);
+    stats->zero_bytes_elided = counter_since(stats->zero_bytes_elided,
+            then->zero_bytes_elided);
+    stats->heap_allocs = counter_since(stats->heap_allocs,
+            then->heap_allocs);
+    stats->cache_hits = counter_since(stats->cache_hits, then->cache_hits);
+    stats->cache_misses = counter_since(stats->cache_misses,
+            then->cache_misses);
+    stats->meta_cache_hits = counter_since(stats->meta_cache_hits,
+            then->meta_cache_hits);
+    stats->meta_cache_misses = counter_since(stats->meta_cache_misses,
+            then->meta_cache_misses);
+    stats->optimize_passes = counter_since(stats->optimize_passes,
+            then->optimize_passes);
+    stats->optimize_ranges = counter_since(stats->optimize_ranges,
+            then->optimize_ranges);
+    stats->optimize_bytes = counter_since(stats->optimize_bytes,
+            then->optimize_bytes);
+    stats->dir_prefetches = counter_since(stats->dir_prefetches,
+            then->dir_prefetches);
+    stats->dir_prefetches_dropped = counter_since(
+            stats->dir_prefetches_dropped, then->dir_prefetches_dropped);
+    stats->dir_prefetch_files = counter_since(stats->dir_prefetch_files,
+            then->dir_prefetch_files);
+    stats->parallel_slices = counter_since(stats->parallel_slices,
+            then->parallel_slices);
+    toku_opstats_sub(stats->ops, then->ops);
+    pthread_mutex_unlock(&stats_lock);
+
+    return 0;
+}
+
+int toku_fs_reset_stats(void)
+{
+    struct toku_fs_stats * now = malloc(sizeof(struct toku_fs_stats));
+    struct toku_fs_engine_status engine;
+
+    get_stats_since_start(now);
+    memset(&engine, 0, sizeof(engine));
+    if (mount_path != NULL) {
+        get_engine_status_since_start(&engine);
+    }
+    pthread_mutex_lock(&stats_lock);
+    stats_baseline = *now;
+    engine_baseline = engine;
+#ifdef TOKUFS_PROFILE
+    // the first call of each phase from here on is timed
+    toku_opstats_restart_sampling();
+    toku_opstats_get_profile(&profile_baseline);
+#endif
+    pthread_mutex_unlock(&stats_lock);
+    free(now);
+
+    return 0;
+}
+
+int toku_fs_dump_stats(FILE * f)
+{
+    int ret;
+    struct toku_fs_stats * stats = malloc(sizeof(struct toku_fs_stats));
+
+    ret = toku_fs_get_stats(stats);
+    assert(ret == 0);
+    ret = toku_opstats_dump(f, stats->ops);
+    free(stats);
+
+    return ret;
+}
+
+int toku_fs_get_profile(struct toku_fs_profile * profile)
+{
+#ifdef TOKUFS_PROFILE
+    toku_opstats_get_profile(profile);
+    pthread_mutex_lock(&stats_lock);
+    toku_opstats_sub_profile(profile, &profile_baseline);
+    pthread_mutex_unlock(&stats_lock);
+
+    return 0;
+#else
+    (void) profile;
+    return -ENOSYS;
+#endif
+}
+
+int toku_fs_print_profile(FILE * f)
+{
+    int ret, op, phase;
+    double ns_per_call, total_ns;
+    char share[16];
+    struct toku_fs_stats * stats = malloc(sizeof(struct toku_fs_stats));
+    struct toku_fs_profile * profile = malloc(sizeof(struct toku_fs_profile));
+    const struct toku_fs_phase_stats * p;
+
+    ret = toku_fs_get_profile(profile);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = toku_fs_get_stats(stats);
+    assert(ret == 0);
+    fprintf(f, "Phase profile (1 in %lu calls timed):\n", profile->sample_rate);
+    fprintf(f, " %-22s %-16s %12s %10s %12s %8s\n",
+            "op", "phase", "calls", "ns/call", "total ms", "of op");
+    // the row after the last op is the background threads
+    for (op = 0; op <= TOKU_FS_OPS; op++) {
+        for (phase = 0; phase < TOKU_FS_PHASES; phase++) {
+            p = op < TOKU_FS_OPS ? &profile->ops[op][phase] :
+                &profile->background[phase];
+            if (p->sampled == 0) {
+                continue;
+            }
+            ns_per_call = p->nsec / (p->sampled * 1.0);
+            total_ns = ns_per_call * p->calls;
+            if (op < TOKU_FS_OPS && stats->ops[op].nsec > 0) {
+                snprintf(share, sizeof(share), "%.1lf%%",
+                        100.0 * total_ns / stats->ops[op].nsec);
+            } else {
+                snprintf(share, sizeof(share), "-");
+            }
+            fprintf(f, " %-22s %-16s %12lu %10.0lf %12.3lf %8s\n",
+                    op < TOKU_FS_OPS ? toku_fs_op_name(op) : "background",
+                    toku_fs_phase_name(phase), p->calls, ns_per_call,
+                    total_ns / 1000000, share);
+        }
+    }
+    ret = ferror(f) ? -EIO : 0;
+
+out:
+    free(profile);
+    free(stats);
+    return ret;
+}
+
+/**
+ * Get file system totals without scanning anything.
+ */
+int toku_fs_statfs(struct toku_fs_statfs * st)
+{
+    int ret;
+    struct metadata root;
+    struct bstore_space space;
+    struct statvfs vfs;
+    uint64_t op_start = toku_opstats_begin(TOKU_FS_OP_STATFS);
+
+    assert(mount_path != NULL);
+    memset(st, 0, sizeof(struct toku_fs_statfs));
+
+    ret = toku_metadata_get("/", &root);
+    assert(ret == 0);
+    st->files = root.du_files + 1;
+    st->bytes = root.du_bytes;
+
+    ret = toku_bstore_env_get_space(&space);
+    assert(ret == 0);
+    st->stored_bytes = space.logical_bytes;
+    st->disk_bytes = space.disk_bytes;
+
+    ret = statvfs(mount_path, &vfs);
+    if (ret != 0) {
+        ret = -errno;
+        goto out;
+    }
+    st->free_bytes = (uint64_t) vfs.f_bavail * vfs.f_frsize;
+    st->free_files = vfs.f_favail;
+
+out:
+    toku_opstats_end(TOKU_FS_OP_STATFS, op_start, ret < 0);
+    return ret;
 }
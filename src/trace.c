@@ -0,0 +1,300 @@
+/**
+ * TokuFS
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <toku/debug.h>
+
+#include "trace.h"
+#include "opstats.h"
+
+// records in each thread's ring, a power of two
+#ifndef TOKU_TRACE_RING
+#define TOKU_TRACE_RING 4096
+#endif
+
+// rings of threads that exited are kept for dumps, up to this many
+#define TRACE_RETIRED_MAX 32
+
+/**
+ * What a and b mean for each event. For operations they name
+ * the arguments in the args record, and the name comes from
+ * the op stats.
+ */
+static const struct toku_fs_trace_event trace_events[TOKU_TRACE_EVENTS] = {
+    [TOKU_FS_OP_OPEN] = { "", "flags", "mode" },
+    [TOKU_FS_OP_CLOSE] = { "", "fd", "" },
+    [TOKU_FS_OP_PREAD] = { "", "offset", "size" },
+    [TOKU_FS_OP_PWRITE] = { "", "offset", "size" },
+    [TOKU_FS_OP_PUT_FILE] = { "", "size", "" },
+    [TOKU_FS_OP_GET_FILE] = { "", "size", "" },
+    [TOKU_FS_OP_STAT_MANY] = { "", "count", "" },
+    [TOKU_FS_OP_TRUNCATE] = { "", "length", "" },
+    [TOKU_FS_OP_CREATE_MANY] = { "", "count", "" },
+    [TOKU_FS_OP_UNLINK_MANY] = { "", "count", "" },
+    [TOKU_FS_OP_READLINK] = { "", "size", "" },
+    [TOKU_FS_OP_RENAME] = { "", "to", "" },
+    [TOKU_FS_OP_CHMOD] = { "", "mode", "" },
+    [TOKU_FS_OP_CHOWN] = { "", "uid", "gid" },
+    [TOKU_FS_OP_MKDIR] = { "", "mode", "" },
+    [TOKU_FS_OP_READDIR] = { "", "entries", "" },
+    [TOKU_FS_OP_FADVISE] = { "", "offset", "length" },
+    [TOKU_FS_OP_BSTORE_GET] = { "", "block", "" },
+    [TOKU_FS_OP_BSTORE_PUT] = { "", "block", "" },
+    [TOKU_FS_OP_BSTORE_PUT_BLOCKS] = { "", "block", "size" },
+    [TOKU_FS_OP_BSTORE_DELETE] = { "", "block", "" },
+    [TOKU_FS_OP_BSTORE_UPDATE] = { "", "block", "size" },
+    [TOKU_FS_OP_BSTORE_TRUNCATE] = { "", "block", "" },
+    [TOKU_FS_OP_BSTORE_SCAN] = { "", "block", "prefetch" },
+    [TOKU_FS_OP_BSTORE_RENAME_PREFIX] = { "", "to", "" },
+    [TOKU_FS_OP_BSTORE_META_GET_MANY] = { "", "count", "" },
+    [TOKU_TRACE_MOUNT] = { "mount", "", "" },
+    [TOKU_TRACE_UNMOUNT] = { "unmount", "", "" },
+    [TOKU_TRACE_MOUNT_OPTION] = { "mount_option", "", "" },
+    [TOKU_TRACE_SET_CACHESIZE] = { "set_cachesize", "bytes", "" },
+    [TOKU_TRACE_CACHE_RESIZE] = { "cache_resize", "from", "to" },
+    [TOKU_TRACE_FD_TABLE_LOCK] = { "fd_table_lock", "write", "" },
+    [TOKU_TRACE_FD_TABLE_UNLOCK] = { "fd_table_unlock", "", "" },
+    [TOKU_TRACE_WILLNEED_DROP] = { "willneed_drop", "first", "last" },
+    [TOKU_TRACE_PREAD_SCAN] = { "pread_scan", "block", "want" },
+    [TOKU_TRACE_PREAD_HOLE] = { "pread_hole", "block", "bytes" },
+    [TOKU_TRACE_PREAD_SLICE] = { "pread_slice", "offset", "size" },
+    [TOKU_TRACE_PWRITE_SLICE] = { "pwrite_slice", "offset", "size" },
+    [TOKU_TRACE_DIR_PREFETCH] = { "dir_prefetch", "files", "names" },
+    [TOKU_TRACE_PROMOTE_INLINE] = { "promote_inline", "offset", "size" },
+    [TOKU_TRACE_TRUNCATE_BLOCKS] = { "truncate_blocks", "last", "first" },
+    [TOKU_TRACE_RMDIR_CHILD] = { "rmdir_child", "found", "" },
+    [TOKU_TRACE_READDIR_KEY] = { "readdir_key", "skip", "" },
+    [TOKU_TRACE_READDIR_END] = { "readdir_end", "entries", "" },
+    [TOKU_TRACE_READDIR_SCAN] = { "readdir_scan", "entries", "more" },
+    [TOKU_TRACE_READDIR_CURSOR] = { "readdir_cursor", "", "" },
+    [TOKU_TRACE_UPDATE_CB] = { "update_cb", "data", "exists" },
+    [TOKU_TRACE_BLOCK_UPDATE] = { "block_update", "offset", "size" },
+    [TOKU_TRACE_RENAME_START] = { "rename_start", "data", "rename" },
+    [TOKU_TRACE_RENAME_CHECK] = { "rename_check", "rename", "" },
+    [TOKU_TRACE_RENAME_KEY] = { "rename_key", "old size", "new size" },
+    [TOKU_TRACE_META_TRUNCATE] = { "meta_truncate", "size", "old size" },
+    [TOKU_TRACE_META_DELETE] = { "meta_delete", "", "" },
+    [TOKU_TRACE_METACACHE_INVALIDATE] = { "metacache_invalidate", "size", "" },
+    [TOKU_TRACE_OPTIMIZE_DICT] = { "optimize_dict", "meta", "messages" },
+    [TOKU_TRACE_OPTIMIZE_RANGE] = { "optimize_range", "to", "" },
+    [TOKU_TRACE_RECLAIM] = { "reclaim", "prefix", "" },
+    [TOKU_TRACE_RECLAIM_RESUME] = { "reclaim_resume", "", "" },
+};
+
+/**
+ * A thread's ring. Only the owner writes it. A record's seq is
+ * zero while it's being written, so readers copying it at the
+ * same time can tell and drop it.
+ */
+struct trace_ring {
+    uint64_t head;
+    uint64_t tid;
+    int exited;
+    struct trace_ring * prev;
+    struct trace_ring * next;
+    struct toku_fs_trace_record records[TOKU_TRACE_RING];
+};
+
+// the lock covers the list, newest ring first, and is only taken
+// by a thread's first trace point, its exit and dumps
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring * trace_rings;
+static int trace_rings_exited;
+static pthread_key_t trace_key;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static __thread struct trace_ring * trace_self;
+
+static void ring_unlink(struct trace_ring * ring)
+{
+    if (ring->prev != NULL) {
+        ring->prev->next = ring->next;
+    } else {
+        trace_rings = ring->next;
+    }
+    if (ring->next != NULL) {
+        ring->next->prev = ring->prev;
+    }
+}
+
+/**
+ * Keep an exiting thread's ring for the next dump, and let go
+ * of the oldest one kept if there are too many.
+ */
+static void trace_thread_exit(void * arg)
+{
+    struct trace_ring * ring = arg, * oldest = NULL;
+
+    pthread_mutex_lock(&trace_lock);
+    ring->exited = 1;
+    if (++trace_rings_exited > TRACE_RETIRED_MAX) {
+        for (struct trace_ring * r = trace_rings; r != NULL; r = r->next) {
+            if (r->exited) {
+                oldest = r;
+            }
+        }
+        ring_unlink(oldest);
+        trace_rings_exited--;
+    }
+    pthread_mutex_unlock(&trace_lock);
+    free(oldest);
+    trace_self = NULL;
+}
+
+static void trace_key_create(void)
+{
+    int ret;
+
+    ret = pthread_key_create(&trace_key, trace_thread_exit);
+    assert(ret == 0);
+}
+
+static struct trace_ring * get_ring(void)
+{
+    int ret;
+    struct trace_ring * ring = trace_self;
+
+    if (ring == NULL) {
+        pthread_once(&trace_once, trace_key_create);
+        ring = calloc(1, sizeof(struct trace_ring));
+        assert(ring != NULL);
+        ring->tid = toku_gettid();
+        ret = pthread_setspecific(trace_key, ring);
+        assert(ret == 0);
+        pthread_mutex_lock(&trace_lock);
+        ring->next = trace_rings;
+        if (trace_rings != NULL) {
+            trace_rings->prev = ring;
+        }
+        trace_rings = ring;
+        pthread_mutex_unlock(&trace_lock);
+        trace_self = ring;
+    }
+
+    return ring;
+}
+
+uint64_t toku_trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * FNV-1a, which is quick and spreads short paths well enough.
+ */
+uint64_t toku_trace_path_hash(const char * path)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    if (path == NULL) {
+        return 0;
+    }
+    for (const unsigned char * c = (const unsigned char *) path;
+            *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void toku_trace_write(uint64_t nsec, int level, int event, int kind,
+        const char * path, uint64_t a, uint64_t b)
+{
+    struct trace_ring * ring = get_ring();
+    uint64_t n = ring->head;
+    struct toku_fs_trace_record * r = &ring->records[n % TOKU_TRACE_RING];
+
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->nsec = nsec;
+    r->path = toku_trace_path_hash(path);
+    r->a = a;
+    r->b = b;
+    r->event = event;
+    r->kind = kind;
+    r->level = level;
+    __atomic_store_n(&r->seq, n + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, n + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Copy a ring's records into out, oldest first, leaving out
+ * any its owner was in the middle of writing. Returns how
+ * many were copied.
+ */
+static uint64_t ring_copy(struct trace_ring * ring,
+        struct toku_fs_trace_record * out)
+{
+    uint64_t i, seq, n = 0;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > TOKU_TRACE_RING ? head - TOKU_TRACE_RING : 0;
+    struct toku_fs_trace_record * r;
+
+    for (i = first; i < head; i++) {
+        r = &ring->records[i % TOKU_TRACE_RING];
+        seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+        out[n] = *r;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (seq == i + 1 &&
+                __atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq) {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+int toku_trace_dump(FILE * f)
+{
+    int i;
+    struct trace_ring * ring;
+    struct toku_fs_trace_header header;
+    struct toku_fs_trace_event event;
+    struct toku_fs_trace_thread thread;
+    struct toku_fs_trace_record * records;
+
+    records = malloc(TOKU_TRACE_RING * sizeof(struct toku_fs_trace_record));
+    assert(records != NULL);
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TOKU_FS_TRACE_MAGIC, sizeof(header.magic));
+    header.level = TOKU_TRACE_LEVEL;
+    header.record_size = sizeof(struct toku_fs_trace_record);
+    header.events = TOKU_TRACE_EVENTS;
+
+    pthread_mutex_lock(&trace_lock);
+    for (ring = trace_rings; ring != NULL; ring = ring->next) {
+        header.threads++;
+    }
+    fwrite(&header, sizeof(header), 1, f);
+    for (i = 0; i < TOKU_TRACE_EVENTS; i++) {
+        event = trace_events[i];
+        if (i < TOKU_FS_OPS) {
+            snprintf(event.name, sizeof(event.name), "%s",
+                    toku_opstats_name(i));
+        }
+        fwrite(&event, sizeof(event), 1, f);
+    }
+    for (ring = trace_rings; ring != NULL; ring = ring->next) {
+        thread.tid = ring->tid;
+        thread.records = ring_copy(ring, records);
+        fwrite(&thread, sizeof(thread), 1, f);
+        fwrite(records, sizeof(struct toku_fs_trace_record),
+                thread.records, f);
+    }
+    pthread_mutex_unlock(&trace_lock);
+    free(records);
+
+    return ferror(f) ? -EIO : 0;
+}
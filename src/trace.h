@@ -0,0 +1,122 @@
+/**
+ * TokuFS
+ */
+
+#ifndef TOKU_TRACE_H
+#define TOKU_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <tokufs.h>
+
+/**
+ * Trace levels, see tokufs.h. A trace point above the level the
+ * library was built with is dead code the compiler throws out,
+ * arguments and all.
+ */
+#define TOKU_TRACE_NONE 0
+#define TOKU_TRACE_OPS 1
+#define TOKU_TRACE_IO 2
+#define TOKU_TRACE_DEBUG 3
+
+#ifndef TOKU_TRACE_LEVEL
+#ifdef DEBUG
+#define TOKU_TRACE_LEVEL TOKU_TRACE_DEBUG
+#else
+#define TOKU_TRACE_LEVEL TOKU_TRACE_OPS
+#endif
+#endif
+
+/**
+ * Trace events. The operations come first, so an operation's
+ * begin, args and end records use its toku_fs_op.
+ */
+enum toku_trace_event {
+    TOKU_TRACE_MOUNT = TOKU_FS_OPS,
+    TOKU_TRACE_UNMOUNT,
+    TOKU_TRACE_MOUNT_OPTION,
+    TOKU_TRACE_SET_CACHESIZE,
+    TOKU_TRACE_CACHE_RESIZE,
+    TOKU_TRACE_FD_TABLE_LOCK,
+    TOKU_TRACE_FD_TABLE_UNLOCK,
+    TOKU_TRACE_WILLNEED_DROP,
+    TOKU_TRACE_PREAD_SCAN,
+    TOKU_TRACE_PREAD_HOLE,
+    TOKU_TRACE_PREAD_SLICE,
+    TOKU_TRACE_PWRITE_SLICE,
+    TOKU_TRACE_DIR_PREFETCH,
+    TOKU_TRACE_PROMOTE_INLINE,
+    TOKU_TRACE_TRUNCATE_BLOCKS,
+    TOKU_TRACE_RMDIR_CHILD,
+    TOKU_TRACE_READDIR_KEY,
+    TOKU_TRACE_READDIR_END,
+    TOKU_TRACE_READDIR_SCAN,
+    TOKU_TRACE_READDIR_CURSOR,
+    TOKU_TRACE_UPDATE_CB,
+    TOKU_TRACE_BLOCK_UPDATE,
+    TOKU_TRACE_RENAME_START,
+    TOKU_TRACE_RENAME_CHECK,
+    TOKU_TRACE_RENAME_KEY,
+    TOKU_TRACE_META_TRUNCATE,
+    TOKU_TRACE_META_DELETE,
+    TOKU_TRACE_METACACHE_INVALIDATE,
+    TOKU_TRACE_OPTIMIZE_DICT,
+    TOKU_TRACE_OPTIMIZE_RANGE,
+    TOKU_TRACE_RECLAIM,
+    TOKU_TRACE_RECLAIM_RESUME,
+    TOKU_TRACE_EVENTS
+};
+
+uint64_t toku_trace_now(void);
+
+/**
+ * Append a record to the calling thread's ring. Use the macros
+ * below, which compile to nothing above TOKU_TRACE_LEVEL.
+ */
+void toku_trace_write(uint64_t nsec, int level, int event, int kind,
+        const char * path, uint64_t a, uint64_t b);
+
+/**
+ * Write every thread's ring to f, as described in tokufs.h.
+ */
+int toku_trace_dump(FILE * f);
+
+uint64_t toku_trace_path_hash(const char * path);
+
+/**
+ * Operations are traced at the ops level, the block store's
+ * at the io level.
+ */
+#define toku_trace_op_level(op)                                     \
+    ((op) < TOKU_FS_OP_BSTORE_GET ? TOKU_TRACE_OPS : TOKU_TRACE_IO)
+
+#define toku_trace_op(nsec, op, kind, error)                        \
+    do {                                                            \
+        if (toku_trace_op_level(op) <= TOKU_TRACE_LEVEL) {          \
+            toku_trace_write(nsec, toku_trace_op_level(op), op,     \
+                    kind, NULL, error, 0);                          \
+        }                                                           \
+    } while (0)
+
+/**
+ * The arguments of the operation the thread just began.
+ */
+#define toku_trace_args(op, path, a, b)                             \
+    do {                                                            \
+        if (toku_trace_op_level(op) <= TOKU_TRACE_LEVEL) {          \
+            toku_trace_write(toku_trace_now(),                      \
+                    toku_trace_op_level(op), op,                    \
+                    TOKU_FS_TRACE_ARGS, path, a, b);                \
+        }                                                           \
+    } while (0)
+
+#define toku_trace(level, event, path, a, b)                        \
+    do {                                                            \
+        if ((level) <= TOKU_TRACE_LEVEL) {                          \
+            toku_trace_write(toku_trace_now(), level, event,        \
+                    TOKU_FS_TRACE_POINT, path, a, b);               \
+        }                                                           \
+    } while (0)
+
+#endif /* TOKU_TRACE_H */
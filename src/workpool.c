@@ -0,0 +1,526 @@
+/**
+ * TokuFS
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "workpool.h"
+
+// tasks each deque holds, a power of two
+#define DEQUE_SIZE 1024
+#define DEQUE_MASK (DEQUE_SIZE - 1)
+
+// deques in a pool, for its workers and the threads submitting
+#define POOL_DEQUES 256
+
+// times an idle worker looks around for work before it parks
+#define IDLE_SPINS 64
+
+struct task {
+    workpool_fn fn;
+    void * arg;
+    struct workpool_batch * batch;
+};
+
+struct worker_task {
+    struct task task;
+    struct worker_task * next;
+};
+
+/**
+ * A Chase-Lev deque with a fixed number of slots. The owner pushes
+ * and takes at the bottom, thieves take from the top, and only a
+ * take racing a steal for the last task needs a compare and swap.
+ * A thief may read a slot while the owner refills it, but then it
+ * loses the race for top and drops what it read, so slots are only
+ * ever read and written with relaxed atomics.
+ */
+struct deque {
+    int64_t top;
+    char top_pad[64 - sizeof(int64_t)];
+    int64_t bottom;
+    char bottom_pad[64 - sizeof(int64_t)];
+    // set when the owner exits, until another thread adopts it
+    int orphaned;
+    struct task tasks[DEQUE_SIZE];
+};
+
+struct workpool {
+    int workers;
+    int stopping;
+    pthread_t * threads;
+    // each thread's deque
+    pthread_key_t key;
+    struct deque * deques[POOL_DEQUES];
+    int num_deques;
+    pthread_mutex_t deques_lock;
+    // tasks for the workers alone, oldest first
+    struct worker_task * worker_head;
+    struct worker_task * worker_tail;
+    int64_t worker_tasks;
+    pthread_mutex_t worker_lock;
+    // idle workers park until the epoch moves
+    int sleepers;
+    uint64_t epoch;
+    pthread_mutex_t park_lock;
+    pthread_cond_t park;
+};
+
+static void slot_write(struct task * slot, const struct task * task)
+{
+    __atomic_store_n(&slot->fn, task->fn, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->arg, task->arg, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->batch, task->batch, __ATOMIC_RELAXED);
+}
+
+static void slot_read(struct task * slot, struct task * task)
+{
+    task->fn = __atomic_load_n(&slot->fn, __ATOMIC_RELAXED);
+    task->arg = __atomic_load_n(&slot->arg, __ATOMIC_RELAXED);
+    task->batch = __atomic_load_n(&slot->batch, __ATOMIC_RELAXED);
+}
+
+/**
+ * Push a task as the owner. Returns -1 if the deque is full.
+ */
+static int deque_push(struct deque * d, const struct task * task)
+{
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+
+    if (b - t >= DEQUE_SIZE) {
+        return -1;
+    }
+    slot_write(&d->tasks[b & DEQUE_MASK], task);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+/**
+ * Take the newest task as the owner. Returns -1 if there's none.
+ */
+static int deque_take(struct deque * d, struct task * task)
+{
+    int ret = 0;
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    int64_t t;
+
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t > b) {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    slot_read(&d->tasks[b & DEQUE_MASK], task);
+    if (t == b) {
+        // the last one, which a thief may be taking too
+        if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            ret = -1;
+        }
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+
+    return ret;
+}
+
+/**
+ * Take the oldest task as a thief. Returns -1 if there's none or
+ * another thread got it first.
+ */
+static int deque_steal(struct deque * d, struct task * task)
+{
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    int64_t b;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) {
+        return -1;
+    }
+    slot_read(&d->tasks[t & DEQUE_MASK], task);
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int64_t deque_size(struct deque * d)
+{
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+
+    return b > t ? b - t : 0;
+}
+
+static void deque_orphan(void * arg)
+{
+    struct deque * d = arg;
+
+    __atomic_store_n(&d->orphaned, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Get the calling thread's deque, giving it one the first time.
+ * A thread that exited leaves its deque to the next thread that
+ * needs one. Returns NULL if every deque is taken.
+ */
+static struct deque * get_deque(struct workpool * pool)
+{
+    int i;
+    struct deque * d = pthread_getspecific(pool->key);
+
+    if (d != NULL) {
+        return d;
+    }
+    pthread_mutex_lock(&pool->deques_lock);
+    for (i = 0; i < pool->num_deques; i++) {
+        if (__atomic_load_n(&pool->deques[i]->orphaned, __ATOMIC_ACQUIRE)) {
+            d = pool->deques[i];
+            d->orphaned = 0;
+            break;
+        }
+    }
+    if (d == NULL && pool->num_deques < POOL_DEQUES) {
+        d = calloc(1, sizeof(struct deque));
+        assert(d != NULL);
+        pool->deques[pool->num_deques] = d;
+        __atomic_store_n(&pool->num_deques, pool->num_deques + 1,
+                __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&pool->deques_lock);
+    if (d != NULL) {
+        pthread_setspecific(pool->key, d);
+    }
+
+    return d;
+}
+
+/**
+ * Wake a parked worker, if there is one. The fence pairs with the
+ * one a worker makes between counting itself as a sleeper and
+ * looking for work one last time, so either the worker sees the
+ * task just pushed, or this sees the worker.
+ */
+static void wake_worker(struct workpool * pool, int all)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+    pthread_mutex_lock(&pool->park_lock);
+    __atomic_add_fetch(&pool->epoch, 1, __ATOMIC_RELEASE);
+    if (all) {
+        pthread_cond_broadcast(&pool->park);
+    } else {
+        pthread_cond_signal(&pool->park);
+    }
+    pthread_mutex_unlock(&pool->park_lock);
+}
+
+static void batch_finish_one(struct workpool_batch * batch)
+{
+    if (__atomic_sub_fetch(&batch->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&batch->lock);
+        __atomic_store_n(&batch->finished, 1, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&batch->done);
+        pthread_mutex_unlock(&batch->lock);
+    }
+}
+
+static void run_task(const struct task * task)
+{
+    task->fn(task->arg);
+    batch_finish_one(task->batch);
+}
+
+/**
+ * Steal a task to run from some other deque, starting at a random
+ * one. Up to half of what else the victim had comes along into
+ * self, so a worker that ran dry gets a share of the work in one
+ * visit rather than coming back for each task. Returns -1 if no
+ * task could be had.
+ */
+static int steal_half(struct workpool * pool, struct deque * self,
+        struct task * task, unsigned int * seed)
+{
+    int i, n, start;
+    int64_t k, size;
+    struct deque * victim;
+    struct task extra;
+
+    n = __atomic_load_n(&pool->num_deques, __ATOMIC_ACQUIRE);
+    start = n > 0 ? rand_r(seed) % n : 0;
+    for (i = 0; i < n; i++) {
+        victim = pool->deques[(start + i) % n];
+        if (victim == self || (size = deque_size(victim)) == 0) {
+            continue;
+        }
+        if (deque_steal(victim, task) != 0) {
+            continue;
+        }
+        if (self != NULL) {
+            for (k = 1; k < size / 2; k++) {
+                if (deque_steal(victim, &extra) != 0) {
+                    break;
+                }
+                if (deque_push(self, &extra) != 0) {
+                    run_task(&extra);
+                }
+            }
+            if (k > 1) {
+                wake_worker(pool, 0);
+            }
+        }
+        return 0;
+    }
+
+    return -1;
+}
+
+/**
+ * Take the oldest task queued for the workers alone. Returns -1
+ * if there's none.
+ */
+static int take_worker_task(struct workpool * pool, struct task * task)
+{
+    struct worker_task * w = NULL;
+
+    if (__atomic_load_n(&pool->worker_tasks, __ATOMIC_ACQUIRE) == 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&pool->worker_lock);
+    if (pool->worker_head != NULL) {
+        w = pool->worker_head;
+        pool->worker_head = w->next;
+        if (pool->worker_head == NULL) {
+            pool->worker_tail = NULL;
+        }
+        __atomic_sub_fetch(&pool->worker_tasks, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&pool->worker_lock);
+    if (w == NULL) {
+        return -1;
+    }
+    *task = w->task;
+    free(w);
+
+    return 0;
+}
+
+static int pool_has_work(struct workpool * pool)
+{
+    int i, n = __atomic_load_n(&pool->num_deques, __ATOMIC_ACQUIRE);
+
+    if (__atomic_load_n(&pool->worker_tasks, __ATOMIC_ACQUIRE) > 0) {
+        return 1;
+    }
+    for (i = 0; i < n; i++) {
+        if (deque_size(pool->deques[i]) > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Sleep until something is submitted or the pool stops.
+ */
+static void park_worker(struct workpool * pool)
+{
+    uint64_t epoch = __atomic_load_n(&pool->epoch, __ATOMIC_ACQUIRE);
+
+    __atomic_add_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!pool_has_work(pool)) {
+        pthread_mutex_lock(&pool->park_lock);
+        while (pool->epoch == epoch && !pool->stopping) {
+            pthread_cond_wait(&pool->park, &pool->park_lock);
+        }
+        pthread_mutex_unlock(&pool->park_lock);
+    }
+    __atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+}
+
+static void * worker_main(void * arg)
+{
+    int idle = 0;
+    struct workpool * pool = arg;
+    struct deque * self = get_deque(pool);
+    unsigned int seed = (unsigned int) (uintptr_t) self;
+    struct task task;
+
+    assert(self != NULL);
+    while (1) {
+        if (deque_take(self, &task) == 0 ||
+                take_worker_task(pool, &task) == 0 ||
+                steal_half(pool, self, &task, &seed) == 0) {
+            run_task(&task);
+            idle = 0;
+        } else if (__atomic_load_n(&pool->stopping, __ATOMIC_ACQUIRE)) {
+            break;
+        } else if (++idle < IDLE_SPINS) {
+            sched_yield();
+        } else {
+            park_worker(pool);
+            idle = 0;
+        }
+    }
+
+    return NULL;
+}
+
+void toku_workpool_batch_init(struct workpool_batch * batch)
+{
+    // the submitter holds one until it waits, so the batch can't
+    // finish while tasks are still being added
+    batch->pending = 1;
+    batch->finished = 0;
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->done, NULL);
+}
+
+void toku_workpool_batch_destroy(struct workpool_batch * batch)
+{
+    pthread_mutex_destroy(&batch->lock);
+    pthread_cond_destroy(&batch->done);
+}
+
+struct workpool * toku_workpool_create(int workers)
+{
+    int i, ret;
+    struct workpool * pool = calloc(1, sizeof(struct workpool));
+
+    assert(pool != NULL);
+    if (workers <= 0) {
+        workers = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    // leave room for the threads that submit
+    if (workers > POOL_DEQUES / 2) {
+        workers = POOL_DEQUES / 2;
+    }
+    pool->workers = workers;
+    ret = pthread_key_create(&pool->key, deque_orphan);
+    assert(ret == 0);
+    pthread_mutex_init(&pool->deques_lock, NULL);
+    pthread_mutex_init(&pool->worker_lock, NULL);
+    pthread_mutex_init(&pool->park_lock, NULL);
+    pthread_cond_init(&pool->park, NULL);
+    pool->threads = malloc(workers * sizeof(pthread_t));
+    for (i = 0; i < workers; i++) {
+        ret = pthread_create(&pool->threads[i], NULL, worker_main, pool);
+        assert(ret == 0);
+    }
+
+    return pool;
+}
+
+void toku_workpool_destroy(struct workpool * pool)
+{
+    int i;
+
+    __atomic_store_n(&pool->stopping, 1, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&pool->park_lock);
+    pool->epoch++;
+    pthread_cond_broadcast(&pool->park);
+    pthread_mutex_unlock(&pool->park_lock);
+    for (i = 0; i < pool->workers; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    // a thread still holding a deque finds out it's gone this way
+    pthread_key_delete(pool->key);
+    assert(pool->worker_head == NULL);
+    for (i = 0; i < pool->num_deques; i++) {
+        assert(deque_size(pool->deques[i]) == 0);
+        free(pool->deques[i]);
+    }
+    pthread_mutex_destroy(&pool->deques_lock);
+    pthread_mutex_destroy(&pool->worker_lock);
+    pthread_mutex_destroy(&pool->park_lock);
+    pthread_cond_destroy(&pool->park);
+    free(pool->threads);
+    free(pool);
+}
+
+int toku_workpool_workers(struct workpool * pool)
+{
+    return pool->workers;
+}
+
+void toku_workpool_submit(struct workpool * pool,
+        struct workpool_batch * batch, workpool_fn fn, void * arg)
+{
+    struct task task = { fn, arg, batch };
+    struct deque * self = get_deque(pool);
+
+    __atomic_add_fetch(&batch->pending, 1, __ATOMIC_RELAXED);
+    if (self == NULL || deque_push(self, &task) != 0) {
+        run_task(&task);
+        return;
+    }
+    wake_worker(pool, 0);
+}
+
+void toku_workpool_submit_worker(struct workpool * pool,
+        struct workpool_batch * batch, workpool_fn fn, void * arg)
+{
+    struct worker_task * w = malloc(sizeof(struct worker_task));
+
+    assert(w != NULL);
+    w->task.fn = fn;
+    w->task.arg = arg;
+    w->task.batch = batch;
+    w->next = NULL;
+    __atomic_add_fetch(&batch->pending, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&pool->worker_lock);
+    if (pool->worker_tail != NULL) {
+        pool->worker_tail->next = w;
+    } else {
+        pool->worker_head = w;
+    }
+    pool->worker_tail = w;
+    __atomic_add_fetch(&pool->worker_tasks, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&pool->worker_lock);
+    wake_worker(pool, 0);
+}
+
+void toku_workpool_wait(struct workpool * pool,
+        struct workpool_batch * batch)
+{
+    struct deque * self = get_deque(pool);
+    unsigned int seed = (unsigned int) (uintptr_t) batch;
+    struct task task;
+
+    // let go of the submitter's hold
+    batch_finish_one(batch);
+    while (!__atomic_load_n(&batch->finished, __ATOMIC_ACQUIRE)) {
+        if ((self != NULL && deque_take(self, &task) == 0) ||
+                steal_half(pool, self, &task, &seed) == 0) {
+            run_task(&task);
+            continue;
+        }
+        // what's left is running on other threads
+        pthread_mutex_lock(&batch->lock);
+        while (!batch->finished) {
+            pthread_cond_wait(&batch->done, &batch->lock);
+        }
+        pthread_mutex_unlock(&batch->lock);
+    }
+    // the thread that finished it may still be signaling
+    pthread_mutex_lock(&batch->lock);
+    pthread_mutex_unlock(&batch->lock);
+    batch->pending = 1;
+    batch->finished = 0;
+}
@@ -0,0 +1,81 @@
+/**
+ * TokuFS
+ */
+
+#ifndef TOKU_WORKPOOL_H
+#define TOKU_WORKPOOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * A fixed set of worker threads for work the library splits up,
+ * like the sub-ranges of a big read. Every worker, and every other
+ * thread that submits, has its own deque of tasks. Its owner pushes
+ * and pops at one end without locks, while workers with nothing to
+ * do steal half of someone else's from the other end. Workers that
+ * find nothing anywhere park until something is submitted.
+ *
+ * Tasks are submitted as part of a batch, which the submitter waits
+ * on. A waiting thread runs tasks itself rather than sleep, so a
+ * task can submit and wait on a batch of its own. Tasks only a
+ * worker may run go on a shared queue of their own instead.
+ */
+struct workpool;
+
+typedef void (*workpool_fn)(void * arg);
+
+/**
+ * Tasks submitted together, to be waited on together. Initialize
+ * one before submitting to it. It may be reused once waited on.
+ */
+struct workpool_batch {
+    uint64_t pending;
+    int finished;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+};
+
+void toku_workpool_batch_init(struct workpool_batch * batch);
+
+void toku_workpool_batch_destroy(struct workpool_batch * batch);
+
+/**
+ * Start a pool with the given number of workers, or one per
+ * online cpu if it's 0.
+ */
+struct workpool * toku_workpool_create(int workers);
+
+/**
+ * Stop the workers. Every batch must have been waited on first.
+ */
+void toku_workpool_destroy(struct workpool * pool);
+
+int toku_workpool_workers(struct workpool * pool);
+
+/**
+ * Queue fn(arg) in the batch. When the calling thread's deque is
+ * full, or no more threads can have one, the task runs right here
+ * instead, which also keeps a fast submitter from getting too far
+ * ahead of the workers.
+ */
+void toku_workpool_submit(struct workpool * pool,
+        struct workpool_batch * batch, workpool_fn fn, void * arg);
+
+/**
+ * Queue fn(arg) in the batch for a worker to run, never the calling
+ * thread, nor one waiting on some other batch. For work in the
+ * background of an operation, which the operation shouldn't end
+ * up doing itself the next time it waits.
+ */
+void toku_workpool_submit_worker(struct workpool * pool,
+        struct workpool_batch * batch, workpool_fn fn, void * arg);
+
+/**
+ * Wait for every task in the batch to finish, running queued tasks
+ * in the meantime.
+ */
+void toku_workpool_wait(struct workpool * pool,
+        struct workpool_batch * batch);
+
+#endif /* TOKU_WORKPOOL_H */
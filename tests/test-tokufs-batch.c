@@ -0,0 +1,159 @@
+#include "tokufs-test.h"
+
+#define NUM_DIRS 3
+#define NUM_PER_DIR 100
+#define NUM_PATHS (NUM_DIRS * NUM_PER_DIR)
+
+static char * paths[NUM_PATHS];
+
+/* Every other file in each directory, in an order that isn't
+ * key order, so lookups both step and seek. */
+static void make_paths(void)
+{
+    int i, d, f;
+    char path[64];
+
+    for (i = 0; i < NUM_PATHS; i++) {
+        d = i % NUM_DIRS;
+        f = (i * 7) % NUM_PER_DIR;
+        sprintf(path, "/batch%d/f%03d", d, f * 2);
+        paths[i] = malloc(strlen(path) + 1);
+        strcpy(paths[i], path);
+    }
+}
+
+static void test_create_many(void)
+{
+    int ret, i, fd;
+    int rets[NUM_PATHS];
+    char path[64];
+    const char * again[3];
+    struct toku_fs_dir_usage before, after;
+
+    for (i = 0; i < NUM_DIRS; i++) {
+        sprintf(path, "/batch%d", i);
+        ret = toku_fs_mkdir(path, 0755);
+        assert(ret == 0);
+    }
+    // one of them is already there
+    fd = toku_fs_open(paths[5], O_CREAT, 0644);
+    assert(fd >= 0);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    ret = toku_fs_dir_usage("/", &before);
+    assert(ret == 0);
+
+    ret = toku_fs_create_many((const char **) paths, NUM_PATHS, 0600, rets);
+    assert(ret == 0);
+    for (i = 0; i < NUM_PATHS; i++) {
+        assert(rets[i] == (i == 5 ? -EEXIST : 0));
+    }
+    ret = toku_fs_dir_usage("/", &after);
+    assert(ret == 0);
+    assert(after.files == before.files + NUM_PATHS - 1);
+    ret = toku_fs_dir_usage("/batch1", &after);
+    assert(ret == 0);
+    assert(after.files == NUM_PER_DIR);
+
+    // the same path twice in one batch is created once
+    again[0] = "/batch0/new";
+    again[1] = paths[0];
+    again[2] = "/batch0/new";
+    ret = toku_fs_create_many(again, 3, 0600, rets);
+    assert(ret == 0);
+    assert(rets[0] == 0);
+    assert(rets[1] == -EEXIST);
+    assert(rets[2] == -EEXIST);
+    ret = toku_fs_unlink("/batch0/new");
+    assert(ret == 0);
+}
+
+static void test_stat_many(void)
+{
+    int ret, i;
+    int rets[NUM_PATHS + 2];
+    struct stat sts[NUM_PATHS + 2];
+    const char * all[NUM_PATHS + 2];
+
+    for (i = 0; i < NUM_PATHS; i++) {
+        all[i] = paths[i];
+    }
+    // between two existing files, and past all of them
+    all[NUM_PATHS] = "/batch1/f001";
+    all[NUM_PATHS + 1] = "/batch9/f000";
+
+    ret = toku_fs_stat_many(all, NUM_PATHS + 2, sts, rets);
+    assert(ret == 0);
+    for (i = 0; i < NUM_PATHS; i++) {
+        assert(rets[i] == 0);
+        assert(sts[i].st_mode == (i == 5 ? 0644 : 0600));
+    }
+    assert(rets[NUM_PATHS] == -ENOENT);
+    assert(rets[NUM_PATHS + 1] == -ENOENT);
+
+    // a single path, and nothing at all
+    ret = toku_fs_stat_many(all, 1, sts, rets);
+    assert(ret == 0);
+    assert(rets[0] == 0);
+    ret = toku_fs_stat_many(all, 0, sts, rets);
+    assert(ret == 0);
+}
+
+static void test_unlink_many(void)
+{
+    int ret, i;
+    int rets[NUM_PATHS];
+    char path[64];
+    const char * some[4];
+    struct stat sts[NUM_PATHS];
+    struct toku_fs_dir_usage usage;
+
+    some[0] = paths[0];
+    some[1] = "/batch0/nope";
+    some[2] = "/batch0";
+    some[3] = paths[0];
+    ret = toku_fs_unlink_many(some, 4, rets);
+    assert(ret == 0);
+    assert(rets[0] == 0);
+    assert(rets[1] == -ENOENT);
+    assert(rets[2] == -EISDIR);
+    assert(rets[3] == -ENOENT);
+
+    ret = toku_fs_unlink_many((const char **) paths, NUM_PATHS, rets);
+    assert(ret == 0);
+    for (i = 0; i < NUM_PATHS; i++) {
+        assert(rets[i] == (i == 0 ? -ENOENT : 0));
+    }
+    ret = toku_fs_stat_many((const char **) paths, NUM_PATHS, sts, rets);
+    assert(ret == 0);
+    for (i = 0; i < NUM_PATHS; i++) {
+        assert(rets[i] == -ENOENT);
+    }
+    for (i = 0; i < NUM_DIRS; i++) {
+        sprintf(path, "/batch%d", i);
+        ret = toku_fs_dir_usage(path, &usage);
+        assert(ret == 0);
+        assert(usage.files == 0);
+    }
+}
+
+int main(void)
+{
+    int ret, i;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+
+    make_paths();
+    test_create_many();
+    test_stat_many();
+    test_unlink_many();
+    for (i = 0; i < NUM_PATHS; i++) {
+        free(paths[i]);
+    }
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
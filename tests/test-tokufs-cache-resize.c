@@ -0,0 +1,155 @@
+#define _XOPEN_SOURCE 600
+
+#include <pthread.h>
+
+#include "tokufs-test.h"
+
+#define NUM_FILES 8
+#define FILE_SIZE (64 * 1024)
+#define NUM_RESIZES 10
+
+static int writers_stopping;
+
+static void fill(char * buf, int file, int round)
+{
+    for (int i = 0; i < FILE_SIZE; i++) {
+        buf[i] = (char) (file * 31 + round + i / 512);
+    }
+}
+
+static void check_file(int fd, int file, int round)
+{
+    int ret;
+    char expect[FILE_SIZE], buf[FILE_SIZE];
+
+    fill(expect, file, round);
+    ret = toku_fs_pread(fd, buf, FILE_SIZE, 0);
+    assert(ret == FILE_SIZE);
+    assert(memcmp(buf, expect, FILE_SIZE) == 0);
+}
+
+/* Files open across a resize keep working, and keep their data. */
+static void test_open_files(void)
+{
+    int ret, i;
+    int fds[NUM_FILES];
+    char path[32], buf[FILE_SIZE];
+
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/resize%d", i);
+        fds[i] = toku_fs_open(path, O_CREAT, 0644);
+        assert(fds[i] >= 0);
+        fill(buf, i, 0);
+        ret = toku_fs_pwrite(fds[i], buf, FILE_SIZE, 0);
+        assert(ret == FILE_SIZE);
+    }
+
+    // grow, then shrink below where it started
+    ret = toku_fs_set_cachesize(256 << 20);
+    assert(ret == 0);
+    assert(toku_fs_get_cachesize() == 256 << 20);
+    for (i = 0; i < NUM_FILES; i++) {
+        check_file(fds[i], i, 0);
+    }
+    ret = toku_fs_set_cachesize(8 << 20);
+    assert(ret == 0);
+    assert(toku_fs_get_cachesize() == 8 << 20);
+    for (i = 0; i < NUM_FILES; i++) {
+        check_file(fds[i], i, 0);
+        fill(buf, i, 1);
+        ret = toku_fs_pwrite(fds[i], buf, FILE_SIZE, 0);
+        assert(ret == FILE_SIZE);
+        ret = toku_fs_close(fds[i]);
+        assert(ret == 0);
+    }
+}
+
+static void * writer_fn(void * arg)
+{
+    int ret, fd, round;
+    int file = (int) (long) arg;
+    char path[32], buf[FILE_SIZE];
+
+    sprintf(path, "/resize%d", file);
+    fd = toku_fs_open(path, 0, 0);
+    assert(fd >= 0);
+    for (round = 1; !__sync_fetch_and_add(&writers_stopping, 0); round++) {
+        check_file(fd, file, round);
+        fill(buf, file, round + 1);
+        ret = toku_fs_pwrite(fd, buf, FILE_SIZE, 0);
+        assert(ret == FILE_SIZE);
+    }
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+
+    return (void *) (long) round;
+}
+
+/* Resizes wait for reads and writes going on in other threads. */
+static void test_concurrent(void)
+{
+    int ret, i, fd;
+    char path[32];
+    void * rounds;
+    pthread_t threads[NUM_FILES];
+
+    for (i = 0; i < NUM_FILES; i++) {
+        ret = pthread_create(&threads[i], NULL, writer_fn, (void *) (long) i);
+        assert(ret == 0);
+    }
+    for (i = 0; i < NUM_RESIZES; i++) {
+        ret = toku_fs_set_cachesize((i % 2 == 0 ? 16 : 64) << 20);
+        assert(ret == 0);
+    }
+    __sync_fetch_and_add(&writers_stopping, 1);
+    for (i = 0; i < NUM_FILES; i++) {
+        ret = pthread_join(threads[i], &rounds);
+        assert(ret == 0);
+        sprintf(path, "/resize%d", i);
+        fd = toku_fs_open(path, 0, 0);
+        assert(fd >= 0);
+        check_file(fd, i, (int) (long) rounds);
+        ret = toku_fs_close(fd);
+        assert(ret == 0);
+    }
+}
+
+/* The cache can't shrink into the metadata's share. */
+static void test_too_small(void)
+{
+    int ret;
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_options_parse(&opts, "cachesize=32m,meta_cachesize=4m");
+    assert(ret == 0);
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == 0);
+
+    ret = toku_fs_set_cachesize(4 << 20);
+    assert(ret == -EINVAL);
+    ret = toku_fs_set_cachesize(0);
+    assert(ret == -EINVAL);
+    assert(toku_fs_get_cachesize() == 32 << 20);
+    ret = toku_fs_set_cachesize(5 << 20);
+    assert(ret == 0);
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+}
+
+int main(void)
+{
+    int ret;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+    test_open_files();
+    test_concurrent();
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    test_too_small();
+
+    return 0;
+}
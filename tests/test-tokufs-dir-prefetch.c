@@ -0,0 +1,156 @@
+#define _XOPEN_SOURCE 600
+
+#include "tokufs-test.h"
+
+#define DIR "/dir"
+#define FILES 40
+#define SMALL_SIZE 100
+#define BIG_SIZE (3 * 4096 + 17)
+
+static char buf[BIG_SIZE];
+static struct toku_fs_stats stats;
+
+static void mount_with(const char * str)
+{
+    int ret;
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_options_parse(&opts, str);
+    assert(ret == 0);
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == 0);
+}
+
+static void get_stats(void)
+{
+    int ret;
+
+    ret = toku_fs_get_stats(&stats);
+    assert(ret == 0);
+}
+
+static void file_path(char * path, int i)
+{
+    sprintf(path, DIR "/f%02d", i);
+}
+
+/* Every other file is too big to keep inline. */
+static size_t file_size(int i)
+{
+    return i % 2 == 0 ? SMALL_SIZE : BIG_SIZE;
+}
+
+static char file_byte(int i, size_t offset)
+{
+    return 'a' + (i + offset / 4096) % 26;
+}
+
+static void write_files(void)
+{
+    int ret;
+    char path[64];
+    size_t j;
+
+    ret = toku_fs_mkdir(DIR, 0755);
+    assert(ret == 0);
+    // a subdirectory among the files, with blocks of its own
+    ret = toku_fs_mkdir(DIR "/f10sub", 0755);
+    assert(ret == 0);
+    memset(buf, 's', BIG_SIZE);
+    ret = toku_fs_put_file(DIR "/f10sub/x", buf, BIG_SIZE, 0644);
+    assert(ret == 0);
+    for (int i = 0; i < FILES; i++) {
+        for (j = 0; j < file_size(i); j++) {
+            buf[j] = file_byte(i, j);
+        }
+        file_path(path, i);
+        ret = toku_fs_put_file(path, buf, file_size(i), 0644);
+        assert(ret == 0);
+    }
+}
+
+static void read_file(int i)
+{
+    int ret, fd;
+    char path[64];
+
+    file_path(path, i);
+    fd = toku_fs_open(path, 0, 0);
+    assert(fd >= 0);
+    memset(buf, 0, BIG_SIZE);
+    ret = toku_fs_pread(fd, buf, file_size(i), 0);
+    assert(ret == (int) file_size(i));
+    for (size_t j = 0; j < file_size(i); j++) {
+        assert(buf[j] == file_byte(i, j));
+    }
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+}
+
+/* Read every file in order, which must not sweep. */
+static void read_in_order(void)
+{
+    int ret;
+    char path[64];
+
+    ret = toku_fs_reset_stats();
+    assert(ret == 0);
+    for (int i = 0; i < FILES; i++) {
+        file_path(path, i);
+        ret = toku_fs_get_file(path, buf, BIG_SIZE);
+        assert(ret == (int) file_size(i));
+        assert(buf[0] == file_byte(i, 0));
+    }
+    get_stats();
+    assert(stats.dir_prefetches == 0);
+}
+
+int main(void)
+{
+    int ret;
+
+    mount_with("dir_prefetch=8");
+    write_files();
+
+    // out of order opens don't sweep
+    ret = toku_fs_reset_stats();
+    assert(ret == 0);
+    for (int i = FILES - 1; i >= 0; i--) {
+        read_file(i);
+    }
+    get_stats();
+    assert(stats.dir_prefetches == 0);
+    assert(stats.dir_prefetches_dropped == 0);
+
+    // in order they do, at the third open and then every fourth.
+    // f00 was the last opened, so it doesn't add to the streak.
+    ret = toku_fs_reset_stats();
+    assert(ret == 0);
+    for (int i = 0; i < FILES; i++) {
+        read_file(i);
+    }
+    get_stats();
+    assert(stats.dir_prefetches + stats.dir_prefetches_dropped == 10);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    // the sweeps are done once unmounted
+    get_stats();
+    assert(stats.dir_prefetch_files > 0);
+    assert(stats.dir_prefetch_files <= stats.dir_prefetches * 8);
+
+    // nor with it off, however the files are read
+    mount_with("dir_prefetch=0");
+    read_in_order();
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    // nor when nothing read is to be kept
+    mount_with("fadvise=dontneed");
+    read_in_order();
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
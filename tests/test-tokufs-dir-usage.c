@@ -0,0 +1,187 @@
+#include "tokufs-test.h"
+
+static void check_usage(const char * path, uint64_t bytes, uint64_t files)
+{
+    int ret;
+    struct toku_fs_dir_usage usage;
+
+    ret = toku_fs_dir_usage(path, &usage);
+    assert(ret == 0);
+    if (usage.bytes != bytes || usage.files != files) {
+        printf("%s: wanted %lu bytes %lu files, got %lu bytes %lu files\n",
+                path, bytes, files, usage.bytes, usage.files);
+    }
+    assert(usage.bytes == bytes);
+    assert(usage.files == files);
+}
+
+static void write_file(const char * path, size_t size, off_t offset)
+{
+    int ret, fd;
+    char * buf = malloc(size);
+
+    fd = toku_fs_open(path, O_CREAT, 0644);
+    assert(fd >= 0);
+    memset(buf, 'u', size);
+    ret = toku_fs_pwrite(fd, buf, size, offset);
+    assert(ret == (int) size);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    free(buf);
+}
+
+static void test_usage(void)
+{
+    int ret;
+    struct toku_fs_dir_usage root, usage;
+
+    ret = toku_fs_dir_usage("/", &root);
+    assert(ret == 0);
+
+    ret = toku_fs_mkdir("/du", 0755);
+    assert(ret == 0);
+    ret = toku_fs_mkdir("/du/sub", 0755);
+    assert(ret == 0);
+    check_usage("/du", 0, 1);
+    check_usage("/du/sub", 0, 0);
+
+    // small files are inline, big ones are in blocks
+    write_file("/du/small", 100, 0);
+    write_file("/du/sub/big", 10000, 0);
+    check_usage("/du", 10100, 3);
+    check_usage("/du/sub", 10000, 1);
+
+    // overwriting doesn't change the size, extending does
+    write_file("/du/small", 50, 0);
+    write_file("/du/sub/big", 1000, 9500);
+    check_usage("/du", 10600, 3);
+    check_usage("/du/sub", 10500, 1);
+
+    // truncating up counts, and so does truncating down
+    ret = toku_fs_truncate("/du/sub/big", 20000);
+    assert(ret == 0);
+    ret = toku_fs_truncate("/du/small", 1000);
+    assert(ret == 0);
+    ret = toku_fs_truncate("/du/small", 10);
+    assert(ret == 0);
+    check_usage("/du", 20010, 3);
+    check_usage("/du/sub", 20000, 1);
+
+    ret = toku_fs_symlink("/du/small", "/du/link");
+    assert(ret == 0);
+    check_usage("/du", 20010 + strlen("/du/small"), 4);
+
+    ret = toku_fs_mkdir("/du/empty", 0755);
+    assert(ret == 0);
+    write_file("/du/empty/file", 10, 0);
+    check_usage("/du", 20020 + strlen("/du/small"), 6);
+
+    // unlink won't take a directory, which would lose its usage
+    ret = toku_fs_unlink("/du/empty");
+    assert(ret == -EISDIR);
+    check_usage("/du", 20020 + strlen("/du/small"), 6);
+    check_usage("/du/empty", 10, 1);
+    // nor will rename put a file over one, or a directory over
+    // one that isn't empty
+    ret = toku_fs_rename("/du/link", "/du/empty");
+    assert(ret == -EISDIR);
+    ret = toku_fs_rename("/du/empty", "/du/sub");
+    assert(ret == -ENOTEMPTY);
+    check_usage("/du", 20020 + strlen("/du/small"), 6);
+
+    ret = toku_fs_unlink("/du/link");
+    assert(ret == 0);
+    ret = toku_fs_unlink("/du/empty/file");
+    assert(ret == 0);
+    ret = toku_fs_rmdir("/du/empty");
+    assert(ret == 0);
+    check_usage("/du", 20010, 3);
+
+    // the root sees everything
+    ret = toku_fs_dir_usage("/", &usage);
+    assert(ret == 0);
+    assert(usage.bytes == root.bytes + 20010);
+    assert(usage.files == root.files + 4);
+
+    ret = toku_fs_dir_usage("/du/small", &usage);
+    assert(ret == -ENOTDIR);
+    ret = toku_fs_dir_usage("/du/nope", &usage);
+    assert(ret == -ENOENT);
+}
+
+/**
+ * Appends to a file in blocks send blind metadata updates. Only
+ * the first one after a shrink reads the size, whichever
+ * descriptor it comes through.
+ */
+static void test_appends(void)
+{
+    int ret, fd, fd2;
+    uint64_t gets;
+    char buf[1000];
+    struct toku_fs_stats stats;
+
+    ret = toku_fs_mkdir("/app", 0755);
+    assert(ret == 0);
+    write_file("/app/log", 10000, 0);
+    fd = toku_fs_open("/app/log", 0, 0);
+    assert(fd >= 0);
+    fd2 = toku_fs_open("/app/log", 0, 0);
+    assert(fd2 >= 0);
+    memset(buf, 'a', sizeof(buf));
+    // each descriptor checks once whether the file is inline
+    ret = toku_fs_pwrite(fd, buf, sizeof(buf), 0);
+    assert(ret == sizeof(buf));
+    ret = toku_fs_pwrite(fd2, buf, sizeof(buf), 0);
+    assert(ret == sizeof(buf));
+
+    ret = toku_fs_reset_stats();
+    assert(ret == 0);
+    ret = toku_fs_get_stats(&stats);
+    assert(ret == 0);
+    gets = stats.ops[TOKU_FS_OP_BSTORE_META_GET].calls;
+    for (int i = 0; i < 20; i++) {
+        ret = toku_fs_pwrite(i % 2 ? fd : fd2, buf, sizeof(buf),
+                10000 + i * sizeof(buf));
+        assert(ret == sizeof(buf));
+    }
+    ret = toku_fs_get_stats(&stats);
+    assert(ret == 0);
+    assert(stats.ops[TOKU_FS_OP_BSTORE_META_GET].calls == gets);
+    check_usage("/app", 30000, 1);
+
+    // a shrink makes the next growth look again
+    ret = toku_fs_truncate("/app/log", 5000);
+    assert(ret == 0);
+    check_usage("/app", 5000, 1);
+    ret = toku_fs_pwrite(fd, buf, sizeof(buf), 5500);
+    assert(ret == sizeof(buf));
+    check_usage("/app", 6500, 1);
+    // and so does growing some other way
+    ret = toku_fs_truncate("/app/log", 8000);
+    assert(ret == 0);
+    ret = toku_fs_pwrite(fd2, buf, sizeof(buf), 8500);
+    assert(ret == sizeof(buf));
+    check_usage("/app", 9500, 1);
+
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    ret = toku_fs_close(fd2);
+    assert(ret == 0);
+}
+
+int main(void)
+{
+    int ret;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+
+    test_usage();
+    test_appends();
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
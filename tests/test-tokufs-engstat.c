@@ -0,0 +1,123 @@
+#include "tokufs-test.h"
+
+#define FILE_BLOCKS 8
+#define SMALL_FILE 100
+
+static struct toku_fs_engine_status status;
+
+static void get_status(void)
+{
+    int ret;
+
+    ret = toku_fs_engine_status(&status);
+    assert(ret == 0);
+}
+
+static double ratio(uint64_t a, uint64_t b)
+{
+    return b > 0 ? (double) a / b : 0;
+}
+
+/* The derived metrics follow from the counters next to them. */
+static void check_derived(void)
+{
+    assert(status.write_amplification ==
+            ratio(status.disk_bytes_written, status.bytes_written));
+    assert(status.space_amplification ==
+            ratio(status.data.disk_bytes + status.meta.disk_bytes,
+                status.file_bytes));
+    assert(status.data.compression ==
+            ratio(status.data.logical_bytes, status.data.disk_bytes));
+    assert(status.meta.compression ==
+            ratio(status.meta.logical_bytes, status.meta.disk_bytes));
+}
+
+/* Every line of a dump is a comment, a field or an engine row. */
+static void check_dump(uint64_t bytes_written)
+{
+    int ret, fields = 0, saw_bytes_written = 0;
+    char line[1024], name[128];
+    unsigned long value;
+    FILE * f = tmpfile();
+
+    assert(f != NULL);
+    ret = toku_fs_dump_engine_status(f);
+    assert(ret == 0);
+    rewind(f);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#') {
+            continue;
+        }
+        if (strncmp(line, "engine ", 7) == 0) {
+            ret = sscanf(line + 7, "%127s %lu", name, &value);
+            assert(ret == 2);
+            continue;
+        }
+        ret = sscanf(line, "%127s %lu", name, &value);
+        assert(ret == 2);
+        if (strcmp(name, "bytes_written") == 0) {
+            assert(value == bytes_written);
+            saw_bytes_written = 1;
+        }
+        fields++;
+    }
+    assert(saw_bytes_written);
+    assert(fields == 16);
+    fclose(f);
+}
+
+int main(void)
+{
+    int ret, fd;
+    char * buf;
+    size_t blocksize = toku_fs_get_blocksize();
+    uint64_t written = FILE_BLOCKS * blocksize + SMALL_FILE;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+    ret = toku_fs_reset_stats();
+    assert(ret == 0);
+    get_status();
+    assert(status.bytes_written == 0);
+    assert(status.data.messages == 0);
+    check_derived();
+
+    buf = malloc(FILE_BLOCKS * blocksize);
+    memset(buf, 'e', FILE_BLOCKS * blocksize);
+    fd = toku_fs_open("/big", O_CREAT, 0644);
+    assert(fd >= 0);
+    ret = toku_fs_pwrite(fd, buf, FILE_BLOCKS * blocksize, 0);
+    assert(ret == (int) (FILE_BLOCKS * blocksize));
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    ret = toku_fs_put_file("/small", buf, SMALL_FILE, 0644);
+    assert(ret == 0);
+
+    // written through pwrite and put_file, counted by the op stats
+    get_status();
+    assert(status.bytes_written == written);
+    assert(status.data.messages >= FILE_BLOCKS);
+    assert(status.meta.messages > 0);
+    assert(status.file_bytes >= written);
+    assert(status.data.logical_bytes >= FILE_BLOCKS * blocksize);
+    check_derived();
+    check_dump(written);
+
+    // counters start over, the rest stay
+    ret = toku_fs_reset_stats();
+    assert(ret == 0);
+    get_status();
+    assert(status.bytes_written == 0);
+    assert(status.data.messages == 0);
+    assert(status.meta.messages == 0);
+    assert(status.write_amplification == 0);
+    assert(status.file_bytes >= written);
+    check_derived();
+    check_dump(0);
+
+    free(buf);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
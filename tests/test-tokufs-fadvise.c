@@ -0,0 +1,137 @@
+#include "tokufs-test.h"
+
+// enough blocks that a warm is still going at unmount
+#define BIG_SIZE (4 << 20)
+
+static char * big;
+
+static void create_big(const char * path)
+{
+    int ret, fd;
+    size_t i;
+
+    big = malloc(BIG_SIZE);
+    for (i = 0; i < BIG_SIZE; i++) {
+        big[i] = 'a' + i % 26;
+    }
+    fd = toku_fs_open(path, O_CREAT, 0644);
+    assert(fd >= 0);
+    ret = toku_fs_pwrite(fd, big, BIG_SIZE, 0);
+    assert(ret == BIG_SIZE);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+}
+
+static void verify_reads(int fd)
+{
+    int ret;
+    size_t n;
+    off_t offset;
+    char buf[10000];
+
+    // front to back, then a few scattered
+    for (offset = 0; offset < BIG_SIZE; offset += sizeof(buf)) {
+        ret = toku_fs_pread(fd, buf, sizeof(buf), offset);
+        assert(ret == sizeof(buf));
+        n = BIG_SIZE - offset < (off_t) sizeof(buf) ?
+            (size_t) (BIG_SIZE - offset) : sizeof(buf);
+        assert(memcmp(buf, big + offset, n) == 0);
+    }
+    for (offset = BIG_SIZE - 12345; offset > 0; offset -= 654321) {
+        ret = toku_fs_pread(fd, buf, 100, offset);
+        assert(ret == 100);
+        assert(memcmp(buf, big + offset, 100) == 0);
+    }
+}
+
+/* Advice changes how much gets prefetched, never what's read. */
+static void test_advice(void)
+{
+    int ret, fd;
+    enum toku_fs_advice advice;
+
+    fd = toku_fs_open("/advised", 0, 0);
+    assert(fd >= 0);
+    for (advice = TOKU_FS_ADVICE_NORMAL;
+            advice <= TOKU_FS_ADVICE_DONTNEED; advice++) {
+        ret = toku_fs_fadvise(fd, 0, 0, advice);
+        assert(ret == 0);
+        verify_reads(fd);
+    }
+    // a range past the end warms nothing
+    ret = toku_fs_fadvise(fd, BIG_SIZE * 2, 100, TOKU_FS_ADVICE_WILLNEED);
+    assert(ret == 0);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+}
+
+static void test_fadvise_errors(void)
+{
+    int ret, fd;
+
+    ret = toku_fs_fadvise(-1, 0, 0, TOKU_FS_ADVICE_NORMAL);
+    assert(ret == -EBADF);
+    ret = toku_fs_fadvise(1000000, 0, 0, TOKU_FS_ADVICE_NORMAL);
+    assert(ret == -EBADF);
+
+    fd = toku_fs_open("/advised", 0, 0);
+    assert(fd >= 0);
+    ret = toku_fs_fadvise(fd, -1, 0, TOKU_FS_ADVICE_NORMAL);
+    assert(ret == -EINVAL);
+    ret = toku_fs_fadvise(fd, 0, -1, TOKU_FS_ADVICE_NORMAL);
+    assert(ret == -EINVAL);
+    ret = toku_fs_fadvise(fd, 0, 0, TOKU_FS_ADVICE_DONTNEED + 1);
+    assert(ret == -EINVAL);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+}
+
+static void test_mount_option(void)
+{
+    int ret, fd;
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    assert(opts.advice == TOKU_FS_ADVICE_NORMAL);
+    ret = toku_fs_mount_options_parse(&opts, "fadvise=willneed");
+    assert(ret == -EINVAL);
+    ret = toku_fs_mount_options_parse(&opts, "fadvise=sequential");
+    assert(ret == 0);
+    assert(opts.advice == TOKU_FS_ADVICE_SEQUENTIAL);
+
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == 0);
+    fd = toku_fs_open("/advised", 0, 0);
+    assert(fd >= 0);
+    verify_reads(fd);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+}
+
+int main(void)
+{
+    int ret, fd;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+    create_big("/advised");
+    test_advice();
+    test_fadvise_errors();
+
+    // unmount stops a warm that's still going
+    fd = toku_fs_open("/advised", 0, 0);
+    assert(fd >= 0);
+    ret = toku_fs_fadvise(fd, 0, 0, TOKU_FS_ADVICE_WILLNEED);
+    assert(ret == 0);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    test_mount_option();
+    free(big);
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include "tokufs-test.h"
+
+static size_t blocksize;
+
+// small files keep their data inline, so write far enough
+// in that the file is stored in blocks.
+static off_t base;
+
+static uint64_t zero_bytes_elided;
+
+static uint64_t zero_blocks_elided(void)
+{
+    int ret;
+    struct toku_fs_stats stats;
+
+    ret = toku_fs_get_stats(&stats);
+    assert(ret == 0);
+    zero_bytes_elided = stats.zero_bytes_elided;
+
+    return stats.zero_blocks_elided;
+}
+
+static void verify_bytes(const char * buf, char c, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (buf[i] != c) {
+            printf("index %lu wanted %d got %d\n", i, c, buf[i]);
+        }
+        assert(buf[i] == c);
+    }
+}
+
+/* Write data, zeros, data. The zeros should be elided but still
+ * read back as zeros. */
+static void test_zero_blocks_elided(void)
+{
+    int ret, fd;
+    uint64_t before, before_bytes;
+    char * buf = malloc(blocksize * 3);
+
+    fd = toku_fs_open("/test-holes.file", O_CREAT, 0644);
+    assert(fd >= 0);
+
+    before = zero_blocks_elided();
+    before_bytes = zero_bytes_elided;
+    memset(buf, 'a', blocksize);
+    memset(buf + blocksize, 0, blocksize);
+    memset(buf + 2 * blocksize, 'b', blocksize);
+    ret = toku_fs_pwrite(fd, buf, blocksize * 3, base);
+    assert(ret == (int) blocksize * 3);
+    assert(zero_blocks_elided() == before + 1);
+    assert(zero_bytes_elided == before_bytes + blocksize);
+
+    memset(buf, 1, blocksize * 3);
+    ret = toku_fs_pread(fd, buf, blocksize * 3, base);
+    assert(ret == (int) blocksize * 3);
+    verify_bytes(buf, 'a', blocksize);
+    verify_bytes(buf + blocksize, 0, blocksize);
+    verify_bytes(buf + 2 * blocksize, 'b', blocksize);
+
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    free(buf);
+}
+
+/* Zero out a stored block in two unaligned pieces. The second
+ * piece turns it into a hole, which only elides its own bytes. */
+static void test_zeroed_block_becomes_hole(void)
+{
+    int ret, fd;
+    uint64_t before, before_bytes, blocks;
+    char * buf = malloc(blocksize);
+
+    fd = toku_fs_open("/test-holes.file", 0, 0644);
+    assert(fd >= 0);
+
+    before = zero_blocks_elided();
+    before_bytes = zero_bytes_elided;
+    memset(buf, 0, blocksize);
+    ret = toku_fs_pwrite(fd, buf, blocksize / 2, base);
+    assert(ret == (int) blocksize / 2);
+    ret = toku_fs_pwrite(fd, buf, blocksize / 2,
+            base + blocksize / 2);
+    assert(ret == (int) blocksize / 2);
+    blocks = zero_blocks_elided() - before;
+    assert(blocks > 0);
+    // the engine may apply the update more than once
+    assert(zero_bytes_elided - before_bytes == blocks * (blocksize / 2));
+
+    memset(buf, 1, blocksize);
+    ret = toku_fs_pread(fd, buf, blocksize, base);
+    assert(ret == (int) blocksize);
+    verify_bytes(buf, 0, blocksize);
+
+    // the rest of the file is unchanged
+    ret = toku_fs_pread(fd, buf, blocksize, base + blocksize * 2);
+    assert(ret == (int) blocksize);
+    verify_bytes(buf, 'b', blocksize);
+
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    free(buf);
+}
+
+/* A sparse write far past the end keeps the file size and
+ * reads zeros for everything in between. */
+static void test_sparse_write(void)
+{
+    int ret, fd;
+    struct stat st;
+    char * buf = malloc(blocksize);
+    const off_t offset = 1000 * blocksize + 7;
+
+    fd = toku_fs_open("/test-holes-sparse.file", O_CREAT, 0644);
+    assert(fd >= 0);
+
+    memset(buf, 'c', blocksize);
+    ret = toku_fs_pwrite(fd, buf, blocksize, offset);
+    assert(ret == (int) blocksize);
+    ret = toku_fs_stat("/test-holes-sparse.file", &st);
+    assert(ret == 0);
+    assert(st.st_size == offset + (off_t) blocksize);
+
+    ret = toku_fs_pread(fd, buf, blocksize, 500 * blocksize);
+    assert(ret == (int) blocksize);
+    verify_bytes(buf, 0, blocksize);
+    ret = toku_fs_pread(fd, buf, blocksize, offset);
+    assert(ret == (int) blocksize);
+    verify_bytes(buf, 'c', blocksize);
+
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    free(buf);
+}
+
+int main(void)
+{
+    int ret;
+
+    blocksize = toku_fs_get_blocksize();
+    base = 64 * 1024;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+
+    test_zero_blocks_elided();
+    test_zeroed_block_becomes_hole();
+    test_sparse_write();
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
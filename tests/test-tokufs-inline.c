@@ -0,0 +1,184 @@
+#include "tokufs-test.h"
+
+// a bit less than the inline limit in src/metadata.h
+#define SMALL_SIZE (2000)
+#define BIG_SIZE (8192)
+
+static void verify_bytes(const char * buf, char c, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (buf[i] != c) {
+            printf("index %lu wanted %d got %d\n", i, c, buf[i]);
+        }
+        assert(buf[i] == c);
+    }
+}
+
+/* Small writes stay inline and read back, with zeros
+ * past what was written. */
+static void test_small_file(void)
+{
+    int ret, fd;
+    struct stat st;
+    char buf[SMALL_SIZE * 2];
+
+    fd = toku_fs_open("/inline.file", O_CREAT, 0644);
+    assert(fd >= 0);
+
+    memset(buf, 'a', 100);
+    ret = toku_fs_pwrite(fd, buf, 100, 0);
+    assert(ret == 100);
+    // leave a gap, which should read as zeros
+    memset(buf, 'b', 100);
+    ret = toku_fs_pwrite(fd, buf, 100, SMALL_SIZE - 100);
+    assert(ret == 100);
+    ret = toku_fs_stat("/inline.file", &st);
+    assert(ret == 0);
+    assert(st.st_size == SMALL_SIZE);
+
+    memset(buf, 1, sizeof(buf));
+    ret = toku_fs_pread(fd, buf, sizeof(buf), 0);
+    assert(ret == (int) sizeof(buf));
+    verify_bytes(buf, 'a', 100);
+    verify_bytes(buf + 100, 0, SMALL_SIZE - 200);
+    verify_bytes(buf + SMALL_SIZE - 100, 'b', 100);
+    verify_bytes(buf + SMALL_SIZE, 0, SMALL_SIZE);
+
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+}
+
+/* Writing past the inline limit moves the data to blocks
+ * without losing any of it. */
+static void test_promote(void)
+{
+    int ret, fd;
+    struct stat st;
+    char buf[BIG_SIZE];
+
+    // a second descriptor still thinks the file may be inline
+    fd = toku_fs_open("/inline.file", 0, 0644);
+    assert(fd >= 0);
+    int fd2 = toku_fs_open("/inline.file", 0, 0644);
+    assert(fd2 >= 0);
+
+    memset(buf, 'c', BIG_SIZE);
+    ret = toku_fs_pwrite(fd, buf, BIG_SIZE - SMALL_SIZE, SMALL_SIZE);
+    assert(ret == BIG_SIZE - SMALL_SIZE);
+    ret = toku_fs_stat("/inline.file", &st);
+    assert(ret == 0);
+    assert(st.st_size == BIG_SIZE);
+
+    memset(buf, 1, BIG_SIZE);
+    ret = toku_fs_pread(fd2, buf, BIG_SIZE, 0);
+    assert(ret == BIG_SIZE);
+    verify_bytes(buf, 'a', 100);
+    verify_bytes(buf + 100, 0, SMALL_SIZE - 200);
+    verify_bytes(buf + SMALL_SIZE - 100, 'b', 100);
+    verify_bytes(buf + SMALL_SIZE, 'c', BIG_SIZE - SMALL_SIZE);
+
+    // small writes to the promoted file go to blocks
+    memset(buf, 'd', 10);
+    ret = toku_fs_pwrite(fd2, buf, 10, 0);
+    assert(ret == 10);
+    ret = toku_fs_pread(fd, buf, 20, 0);
+    assert(ret == 20);
+    verify_bytes(buf, 'd', 10);
+    verify_bytes(buf + 10, 'a', 10);
+
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    ret = toku_fs_close(fd2);
+    assert(ret == 0);
+}
+
+/* Truncating an inline file trims its data, and truncating
+ * back up reads zeros. */
+static void test_truncate(void)
+{
+    int ret, fd;
+    struct stat st;
+    char buf[SMALL_SIZE];
+
+    fd = toku_fs_open("/inline-truncate.file", O_CREAT, 0644);
+    assert(fd >= 0);
+    memset(buf, 'e', SMALL_SIZE);
+    ret = toku_fs_pwrite(fd, buf, SMALL_SIZE, 0);
+    assert(ret == SMALL_SIZE);
+
+    ret = toku_fs_truncate("/inline-truncate.file", 10);
+    assert(ret == 0);
+    ret = toku_fs_truncate("/inline-truncate.file", SMALL_SIZE);
+    assert(ret == 0);
+    ret = toku_fs_stat("/inline-truncate.file", &st);
+    assert(ret == 0);
+    assert(st.st_size == SMALL_SIZE);
+
+    memset(buf, 1, SMALL_SIZE);
+    ret = toku_fs_pread(fd, buf, SMALL_SIZE, 0);
+    assert(ret == SMALL_SIZE);
+    verify_bytes(buf, 'e', 10);
+    verify_bytes(buf + 10, 0, SMALL_SIZE - 10);
+
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    ret = toku_fs_unlink("/inline-truncate.file");
+    assert(ret == 0);
+    ret = toku_fs_stat("/inline-truncate.file", &st);
+    assert(ret == -ENOENT);
+}
+
+/* Symlink targets live inline, and readlink always
+ * null terminates. */
+static void test_symlink(void)
+{
+    int ret;
+    struct stat st;
+    char buf[64];
+    const char * target = "/some/where/else";
+
+    ret = toku_fs_symlink(target, "/inline.link");
+    assert(ret == 0);
+    ret = toku_fs_symlink(target, "/inline.link");
+    assert(ret == -EEXIST);
+    ret = toku_fs_stat("/inline.link", &st);
+    assert(ret == 0);
+    assert(S_ISLNK(st.st_mode));
+    assert(st.st_size == (off_t) strlen(target));
+
+    memset(buf, 1, sizeof(buf));
+    ret = toku_fs_readlink("/inline.link", buf, sizeof(buf));
+    assert(ret == 0);
+    assert(strcmp(buf, target) == 0);
+
+    // too small a buffer truncates
+    ret = toku_fs_readlink("/inline.link", buf, 6);
+    assert(ret == 0);
+    assert(strcmp(buf, "/some") == 0);
+
+    ret = toku_fs_readlink("/inline.file", buf, sizeof(buf));
+    assert(ret == -EINVAL);
+
+    ret = toku_fs_unlink("/inline.link");
+    assert(ret == 0);
+}
+
+int main(void)
+{
+    int ret;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+
+    test_small_file();
+    test_promote();
+    test_truncate();
+    test_symlink();
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
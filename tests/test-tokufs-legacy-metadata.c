@@ -0,0 +1,205 @@
+#define _XOPEN_SOURCE 600
+
+#include <sys/stat.h>
+
+#include "tokufs-test.h"
+#include "../src/bstore.h"
+#include "../src/metadata.h"
+#include "../include/toku/str.h"
+
+#define FILE "/legacy"
+#define LINK "/legacy-link"
+#define TARGET "/some/where/else"
+
+/**
+ * The key order tokufs has always used: data keys, which end in
+ * the magic byte, by memcmp, and metadata by depth, then memcmp.
+ */
+static int keycmp(DB * db, const DBT * a, const DBT * b)
+{
+    int c;
+    const char * k1 = a->data, * k2 = b->data;
+    (void) db;
+
+    if (k1[a->size - 1] != DATA_DB_KEY_MAGIC) {
+        c = toku_strcount(k1, '/') - toku_strcount(k2, '/');
+        if (c != 0) {
+            return c;
+        }
+    }
+    c = memcmp(k1, k2, a->size < b->size ? a->size : b->size);
+    if (c != 0) {
+        return c;
+    }
+    return a->size < b->size ? -1 : a->size > b->size;
+}
+
+/**
+ * Before metadata was encoded, a value was a bare struct stat.
+ * Write one the way that code did.
+ */
+static int legacy_update_cb(const DBT * oldval, DBT * newval, void * extra)
+{
+    (void) oldval;
+    newval->data = malloc(sizeof(struct stat));
+    newval->size = sizeof(struct stat);
+    memcpy(newval->data, extra, sizeof(struct stat));
+    return 0;
+}
+
+static void legacy_put(const char * name, mode_t mode, off_t size)
+{
+    int ret;
+    struct stat st;
+
+    memset(&st, 0, sizeof(st));
+    st.st_mode = mode;
+    st.st_nlink = 1;
+    st.st_size = size;
+    st.st_mtime = 1234;
+    ret = toku_bstore_meta_update(name, &st, sizeof(st));
+    assert(ret == 0);
+}
+
+/**
+ * Symlink targets were kept in the first data block.
+ */
+static void legacy_symlink(const char * name, const char * target)
+{
+    int ret;
+    char block[BSTORE_BLOCKSIZE];
+    struct bstore_s bstore;
+
+    legacy_put(name, S_IFLNK | 0777, strlen(target) + 1);
+    memset(block, 0, BSTORE_BLOCKSIZE);
+    strcpy(block, target);
+    ret = toku_bstore_open(&bstore, name);
+    assert(ret == 0);
+    ret = toku_bstore_put(&bstore, 0, block);
+    assert(ret == 0);
+    ret = toku_bstore_close(&bstore);
+    assert(ret == 0);
+}
+
+static void check_usage(const char * path, uint64_t bytes, uint64_t files)
+{
+    int ret;
+    struct toku_fs_dir_usage usage;
+
+    ret = toku_fs_dir_usage(path, &usage);
+    assert(ret == 0);
+    assert(usage.bytes == bytes);
+    assert(usage.files == files);
+}
+
+static size_t meta_size(const char * name, unsigned char * first)
+{
+    int ret;
+    size_t size;
+    char buf[METADATA_ENCODED_MAX];
+
+    ret = toku_bstore_meta_get(name, buf, sizeof(buf), &size);
+    assert(ret == 0);
+    *first = buf[0];
+    return size;
+}
+
+int main(void)
+{
+    int ret, fd;
+    struct stat st;
+    struct toku_fs_statfs sfs;
+    unsigned char first;
+    char buf[32];
+
+    // an env written in the old format, with a root and an empty file
+    ret = system("rm -rf " MOUNT_PATH);
+    assert(ret == 0);
+    ret = toku_bstore_env_open(MOUNT_PATH, keycmp, legacy_update_cb);
+    assert(ret == 0);
+    legacy_put("/", S_IFDIR | 0755, 0);
+    legacy_put(FILE, S_IFREG | 0644, 0);
+    legacy_symlink(LINK, TARGET);
+    legacy_put("/d", S_IFDIR | 0755, 0);
+    legacy_put("/d/f", S_IFREG | 0644, 100);
+    legacy_put("/d/e", S_IFDIR | 0755, 0);
+    legacy_put("/d/e/g", S_IFREG | 0644, 7);
+    assert(meta_size(FILE, &first) == sizeof(struct stat));
+    ret = toku_bstore_env_close();
+    assert(ret == 0);
+
+    // it mounts, and the old records read back as they were
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+    ret = toku_fs_stat("/", &st);
+    assert(ret == 0);
+    assert(S_ISDIR(st.st_mode));
+    ret = toku_fs_stat(FILE, &st);
+    assert(ret == 0);
+    assert(st.st_mode == (S_IFREG | 0644));
+    assert(st.st_size == 0);
+    assert(st.st_mtime == 1234);
+
+    // the old directories had no usage, so it was counted at mount
+    check_usage("/d/e", 7, 1);
+    check_usage("/d", 107, 3);
+    check_usage("/", sizeof(TARGET) + 107, 6);
+
+    // and is kept from then on
+    ret = toku_fs_unlink("/d/f");
+    assert(ret == 0);
+    check_usage("/d", 7, 2);
+    check_usage("/", sizeof(TARGET) + 7, 5);
+    ret = toku_fs_statfs(&sfs);
+    assert(ret == 0);
+    assert(sfs.bytes == sizeof(TARGET) + 7);
+    assert(sfs.files == 6);
+
+    // old symlinks read their target from the data block
+    ret = toku_fs_readlink(LINK, buf, sizeof(buf));
+    assert(ret == 0);
+    assert(strcmp(buf, TARGET) == 0);
+    ret = toku_fs_readlink(LINK, buf, 5);
+    assert(ret == 0);
+    assert(strcmp(buf, "/som") == 0);
+
+    // and the first update rewrites them in the new format
+    ret = toku_fs_chmod(FILE, S_IFREG | 0600);
+    assert(ret == 0);
+    fd = toku_fs_open(FILE, O_RDWR, 0);
+    assert(fd >= 0);
+    ret = toku_fs_pwrite(fd, "hello", 5, 0);
+    assert(ret == 5);
+    memset(buf, 0, sizeof(buf));
+    ret = toku_fs_pread(fd, buf, 5, 0);
+    assert(ret == 5);
+    assert(strcmp(buf, "hello") == 0);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    ret = toku_fs_stat(FILE, &st);
+    assert(ret == 0);
+    assert(st.st_mode == (S_IFREG | 0600));
+    assert(st.st_size == 5);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    ret = toku_bstore_env_open(MOUNT_PATH, keycmp, legacy_update_cb);
+    assert(ret == 0);
+    assert(meta_size(FILE, &first) != sizeof(struct stat));
+    assert(first == METADATA_MAGIC);
+    ret = toku_bstore_env_close();
+    assert(ret == 0);
+
+    // still readable after a remount
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+    ret = toku_fs_stat(FILE, &st);
+    assert(ret == 0);
+    assert(st.st_mode == (S_IFREG | 0600));
+    assert(st.st_size == 5);
+    check_usage("/", sizeof(TARGET) + 7 + 5, 5);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
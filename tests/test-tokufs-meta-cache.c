@@ -0,0 +1,144 @@
+#include "tokufs-test.h"
+
+#define NUM_FILES 50
+
+static void get_stats(struct toku_fs_stats * stats)
+{
+    int ret;
+
+    ret = toku_fs_get_stats(stats);
+    assert(ret == 0);
+}
+
+static void stat_all(const char * dir, mode_t mode)
+{
+    int ret, i;
+    char path[64];
+    struct stat st;
+
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "%s/f%d", dir, i);
+        ret = toku_fs_stat(path, &st);
+        assert(ret == 0);
+        assert(st.st_mode == mode);
+    }
+}
+
+/* Stats of the same files again are answered by the cache. */
+static void test_hits(void)
+{
+    int ret, i, fd;
+    char path[64];
+    struct toku_fs_stats before, after;
+
+    ret = toku_fs_mkdir("/mc", 0755);
+    assert(ret == 0);
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/mc/f%d", i);
+        fd = toku_fs_open(path, O_CREAT, 0644);
+        assert(fd >= 0);
+        ret = toku_fs_close(fd);
+        assert(ret == 0);
+    }
+
+    stat_all("/mc", 0644);
+    get_stats(&before);
+    stat_all("/mc", 0644);
+    get_stats(&after);
+    assert(after.meta_cache_hits >= before.meta_cache_hits + NUM_FILES);
+    assert(after.meta_cache_misses >= before.meta_cache_misses);
+}
+
+/* Every kind of metadata change shows up in the next stat. */
+static void test_coherent(void)
+{
+    int ret, i, fd;
+    char path[64];
+    struct stat st;
+
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/mc/f%d", i);
+        ret = toku_fs_chmod(path, 0600);
+        assert(ret == 0);
+    }
+    stat_all("/mc", 0600);
+
+    // a write changes the size
+    fd = toku_fs_open("/mc/f0", 0, 0);
+    assert(fd >= 0);
+    ret = toku_fs_pwrite(fd, "hello", 5, 0);
+    assert(ret == 5);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    ret = toku_fs_stat("/mc/f0", &st);
+    assert(ret == 0);
+    assert(st.st_size == 5);
+
+    // a rename moves everything under the directory
+    ret = toku_fs_rename("/mc", "/mc2");
+    assert(ret == 0);
+    ret = toku_fs_stat("/mc/f1", &st);
+    assert(ret == -ENOENT);
+    stat_all("/mc2", 0600);
+
+    // an unlinked file is gone
+    ret = toku_fs_unlink("/mc2/f1");
+    assert(ret == 0);
+    ret = toku_fs_stat("/mc2/f1", &st);
+    assert(ret == -ENOENT);
+}
+
+static void test_meta_cache(void)
+{
+    int ret;
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_options_parse(&opts, "cachesize=64m,meta_cachesize=1m");
+    assert(ret == 0);
+    assert(opts.meta_cachesize == 1 << 20);
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == 0);
+
+    test_hits();
+    test_coherent();
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+}
+
+/* Without a reserved share, metadata only uses the engine cache. */
+static void test_no_meta_cache(void)
+{
+    int ret;
+    struct stat st;
+    struct toku_fs_stats before, after;
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == 0);
+    get_stats(&before);
+    ret = toku_fs_stat("/mc2/f0", &st);
+    assert(ret == 0);
+    assert(st.st_size == 5);
+    get_stats(&after);
+    assert(after.meta_cache_hits == before.meta_cache_hits);
+    assert(after.meta_cache_misses == before.meta_cache_misses);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    // the share has to leave something for data
+    ret = toku_fs_mount_options_parse(&opts, "cachesize=1m,meta_cachesize=1m");
+    assert(ret == 0);
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == -EINVAL);
+}
+
+int main(void)
+{
+    test_meta_cache();
+    test_no_meta_cache();
+
+    return 0;
+}
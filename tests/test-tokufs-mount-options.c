@@ -0,0 +1,165 @@
+#include "tokufs-test.h"
+
+#include <sys/stat.h>
+
+#define BUF_SIZE (4096)
+
+static void test_parse(void)
+{
+    int ret;
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    assert(opts.cachesize == toku_fs_get_cachesize());
+    assert(opts.data.nodesize == 0);
+    assert(opts.meta.fanout == 0);
+
+    ret = toku_fs_mount_options_parse(&opts,
+            "data_nodesize=4M,data_basementsize=128k,meta_fanout=16");
+    assert(ret == 0);
+    assert(opts.data.nodesize == 4L * 1024 * 1024);
+    assert(opts.data.basementsize == 128L * 1024);
+    assert(opts.data.fanout == 0);
+    assert(opts.meta.fanout == 16);
+
+    assert(opts.data.compression == TOKU_FS_COMPRESSION_DEFAULT);
+    ret = toku_fs_mount_options_parse(&opts,
+            "data_compression=lzma,meta_compression=none");
+    assert(ret == 0);
+    assert(opts.data.compression == TOKU_FS_COMPRESSION_LZMA);
+    assert(opts.meta.compression == TOKU_FS_COMPRESSION_NONE);
+
+    ret = toku_fs_mount_options_parse(&opts, "cachesize=1g");
+    assert(ret == 0);
+    assert(opts.cachesize == 1L * 1024 * 1024 * 1024);
+
+    // abuse the parser
+    ret = toku_fs_mount_options_parse(&opts, "data_nodesize");
+    assert(ret == -EINVAL);
+    ret = toku_fs_mount_options_parse(&opts, "data_nodesize=");
+    assert(ret == -EINVAL);
+    ret = toku_fs_mount_options_parse(&opts, "data_nodesize=4x");
+    assert(ret == -EINVAL);
+    ret = toku_fs_mount_options_parse(&opts, "data_nodesize=0");
+    assert(ret == -EINVAL);
+    ret = toku_fs_mount_options_parse(&opts, "data_bogus=1");
+    assert(ret == -EINVAL);
+    ret = toku_fs_mount_options_parse(&opts, "bogus=1");
+    assert(ret == -EINVAL);
+    ret = toku_fs_mount_options_parse(&opts, "data_compression=gzip");
+    assert(ret == -EINVAL);
+    // sizes that don't fit are rejected, not wrapped
+    ret = toku_fs_mount_options_parse(&opts, "cachesize=17179869185g");
+    assert(ret == -EINVAL);
+    ret = toku_fs_mount_options_parse(&opts,
+            "cachesize=99999999999999999999999");
+    assert(ret == -EINVAL);
+    assert(opts.cachesize == 1L * 1024 * 1024 * 1024);
+    assert(opts.data.nodesize == 4L * 1024 * 1024);
+    assert(opts.data.compression == TOKU_FS_COMPRESSION_LZMA);
+}
+
+static void test_load(void)
+{
+    int ret, line;
+    FILE * fp;
+    struct toku_fs_mount_options opts;
+    const char * config = MOUNT_PATH "/" TOKU_FS_CONFIG_FILE;
+    const char * bad_config = MOUNT_PATH "/bad.conf";
+
+    ret = mkdir(MOUNT_PATH, 0755);
+    assert(ret == 0 || errno == EEXIST);
+    fp = fopen(config, "w");
+    assert(fp != NULL);
+    fprintf(fp, "# tuned for big sequential files\n");
+    fprintf(fp, "data_nodesize = 16M\n");
+    fprintf(fp, "\n");
+    fprintf(fp, "  meta_nodesize=1m  \n");
+    fclose(fp);
+
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_options_load(&opts, config, &line);
+    assert(ret == 0);
+    assert(line == 0);
+    assert(opts.data.nodesize == 16L * 1024 * 1024);
+    assert(opts.meta.nodesize == 1L * 1024 * 1024);
+
+    ret = toku_fs_mount_options_load(&opts, MOUNT_PATH "/nope.conf", NULL);
+    assert(ret == -ENOENT);
+
+    // a bad option says which line it's on
+    fp = fopen(bad_config, "w");
+    assert(fp != NULL);
+    fprintf(fp, "data_nodesize = 16M\n");
+    fprintf(fp, "\n");
+    fprintf(fp, "meta_nodesize = lots\n");
+    fclose(fp);
+    ret = toku_fs_mount_options_load(&opts, bad_config, &line);
+    assert(ret == -EINVAL);
+    assert(line == 3);
+    ret = unlink(bad_config);
+    assert(ret == 0);
+}
+
+static void test_mount_with_options(void)
+{
+    int ret, fd;
+    size_t cachesize;
+    char buf[BUF_SIZE], rbuf[BUF_SIZE];
+    struct toku_fs_mount_options opts;
+
+    // basement nodes can't be bigger than nodes
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_options_parse(&opts,
+            "data_nodesize=64k,data_basementsize=128k");
+    assert(ret == 0);
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == -EINVAL);
+
+    // a mount that fails changes nothing, not even the cache size
+    cachesize = toku_fs_get_cachesize();
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_options_parse(&opts,
+            "cachesize=64m,meta_cachesize=64m");
+    assert(ret == 0);
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == -EINVAL);
+    assert(toku_fs_get_cachesize() == cachesize);
+
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_options_parse(&opts,
+            "data_nodesize=8M,data_basementsize=256k,data_fanout=8,"
+            "data_compression=zlib,meta_compression=quicklz");
+    assert(ret == 0);
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == 0);
+
+    fd = toku_fs_open("/tuned.file", O_CREAT, 0644);
+    assert(fd >= 0);
+    memset(buf, 'x', BUF_SIZE);
+    ret = toku_fs_pwrite(fd, buf, BUF_SIZE, 0);
+    assert(ret == BUF_SIZE);
+    ret = toku_fs_pread(fd, rbuf, BUF_SIZE, 0);
+    assert(ret == BUF_SIZE);
+    assert(memcmp(buf, rbuf, BUF_SIZE) == 0);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    // a plain mount picks up the config file written by test_load
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+}
+
+int main(void)
+{
+    test_parse();
+    test_load();
+    test_mount_with_options();
+
+    return 0;
+}
@@ -0,0 +1,161 @@
+#define _XOPEN_SOURCE 600
+
+#include <pthread.h>
+
+#include "tokufs-test.h"
+
+#define NUM_THREADS 4
+#define NUM_STATS 100
+#define NUM_WRITES 10
+
+static struct toku_fs_stats stats;
+
+static void get_stats(void)
+{
+    int ret;
+
+    ret = toku_fs_get_stats(&stats);
+    assert(ret == 0);
+}
+
+static uint64_t latency_calls(enum toku_fs_op op)
+{
+    uint64_t calls = 0;
+
+    for (int i = 0; i < TOKU_FS_LATENCY_BUCKETS; i++) {
+        calls += stats.ops[op].latency[i];
+    }
+    return calls;
+}
+
+/* Calls, errors, bytes and upserts of a few ops, down to the engine. */
+static void test_counts(void)
+{
+    int ret, i, fd;
+    char buf[4096];
+    struct stat st;
+
+    ret = toku_fs_reset_stats();
+    assert(ret == 0);
+    fd = toku_fs_open("/ops", O_CREAT, 0644);
+    assert(fd >= 0);
+    memset(buf, 'a', sizeof(buf));
+    for (i = 0; i < NUM_WRITES; i++) {
+        ret = toku_fs_pwrite(fd, buf, sizeof(buf), i * sizeof(buf));
+        assert(ret == sizeof(buf));
+    }
+    ret = toku_fs_pread(fd, buf, sizeof(buf), 0);
+    assert(ret == sizeof(buf));
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    ret = toku_fs_stat("/ops", &st);
+    assert(ret == 0);
+    ret = toku_fs_stat("/nope", &st);
+    assert(ret == -ENOENT);
+
+    get_stats();
+    assert(stats.ops[TOKU_FS_OP_OPEN].calls == 1);
+    assert(stats.ops[TOKU_FS_OP_PWRITE].calls == NUM_WRITES);
+    assert(stats.ops[TOKU_FS_OP_PWRITE].bytes == NUM_WRITES * sizeof(buf));
+    assert(stats.ops[TOKU_FS_OP_PWRITE].errors == 0);
+    assert(stats.ops[TOKU_FS_OP_PREAD].calls == 1);
+    assert(stats.ops[TOKU_FS_OP_PREAD].bytes == sizeof(buf));
+    assert(stats.ops[TOKU_FS_OP_STAT].calls == 2);
+    assert(stats.ops[TOKU_FS_OP_STAT].errors == 1);
+    assert(latency_calls(TOKU_FS_OP_PWRITE) == NUM_WRITES);
+    assert(stats.ops[TOKU_FS_OP_PWRITE].nsec > 0);
+    // the data got to the engine somehow, and the size by upsert
+    assert(stats.ops[TOKU_FS_OP_BSTORE_PUT_BLOCKS].blocks +
+            stats.ops[TOKU_FS_OP_BSTORE_PUT].blocks +
+            stats.ops[TOKU_FS_OP_BSTORE_UPDATE].blocks > 0);
+    assert(stats.ops[TOKU_FS_OP_BSTORE_META_UPDATE].upserts > 0);
+    assert(stats.ops[TOKU_FS_OP_BSTORE_META_GET].calls > 0);
+    assert(stats.ops[TOKU_FS_OP_UNLINK].calls == 0);
+}
+
+static void * stat_thread(void * arg)
+{
+    int ret, i;
+    struct stat st;
+    (void) arg;
+
+    for (i = 0; i < NUM_STATS; i++) {
+        ret = toku_fs_stat("/ops", &st);
+        assert(ret == 0);
+    }
+    return NULL;
+}
+
+/* Threads that exited still count, and reset starts over. */
+static void test_threads(void)
+{
+    int ret, i;
+    pthread_t threads[NUM_THREADS];
+
+    ret = toku_fs_reset_stats();
+    assert(ret == 0);
+    get_stats();
+    assert(stats.ops[TOKU_FS_OP_STAT].calls == 0);
+    assert(latency_calls(TOKU_FS_OP_STAT) == 0);
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        ret = pthread_create(&threads[i], NULL, stat_thread, NULL);
+        assert(ret == 0);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        ret = pthread_join(threads[i], NULL);
+        assert(ret == 0);
+    }
+    get_stats();
+    assert(stats.ops[TOKU_FS_OP_STAT].calls == NUM_THREADS * NUM_STATS);
+    assert(latency_calls(TOKU_FS_OP_STAT) == NUM_THREADS * NUM_STATS);
+}
+
+/* The dump has a line per op, named the way toku_fs_op_name says. */
+static void test_dump(void)
+{
+    int ret, lines = 0;
+    char line[1024], name[64];
+    unsigned long calls, stat_calls = 0;
+    FILE * f;
+
+    assert(strcmp(toku_fs_op_name(TOKU_FS_OP_PREAD), "pread") == 0);
+    assert(strcmp(toku_fs_op_name(TOKU_FS_OP_BSTORE_GET), "bstore_get") == 0);
+
+    f = tmpfile();
+    assert(f != NULL);
+    ret = toku_fs_dump_stats(f);
+    assert(ret == 0);
+    rewind(f);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#') {
+            continue;
+        }
+        ret = sscanf(line, "%63s %lu", name, &calls);
+        assert(ret == 2);
+        if (strcmp(name, toku_fs_op_name(TOKU_FS_OP_STAT)) == 0) {
+            stat_calls = calls;
+        }
+        lines++;
+    }
+    fclose(f);
+    assert(lines == TOKU_FS_OPS);
+    assert(stat_calls == NUM_THREADS * NUM_STATS);
+}
+
+int main(void)
+{
+    int ret;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+
+    test_counts();
+    test_threads();
+    test_dump();
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
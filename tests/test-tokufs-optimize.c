@@ -0,0 +1,128 @@
+#define _XOPEN_SOURCE 600
+
+#include "tokufs-test.h"
+
+#define NUM_FILES 20
+#define FILE_SIZE 8192
+
+static void get_stats(struct toku_fs_stats * stats)
+{
+    int ret;
+
+    ret = toku_fs_get_stats(stats);
+    assert(ret == 0);
+}
+
+static void write_files(char c)
+{
+    int ret, i, fd;
+    char path[32], buf[FILE_SIZE];
+
+    memset(buf, c, sizeof(buf));
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/opt%d", i);
+        fd = toku_fs_open(path, O_CREAT, 0644);
+        assert(fd >= 0);
+        ret = toku_fs_pwrite(fd, buf, sizeof(buf), 0);
+        assert(ret == sizeof(buf));
+        ret = toku_fs_close(fd);
+        assert(ret == 0);
+    }
+}
+
+static void verify_files(char c)
+{
+    int ret, i, j, fd;
+    char path[32], buf[FILE_SIZE];
+
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/opt%d", i);
+        fd = toku_fs_open(path, 0, 0);
+        assert(fd >= 0);
+        ret = toku_fs_pread(fd, buf, sizeof(buf), 0);
+        assert(ret == sizeof(buf));
+        for (j = 0; j < FILE_SIZE; j++) {
+            assert(buf[j] == c);
+        }
+        ret = toku_fs_close(fd);
+        assert(ret == 0);
+    }
+}
+
+/* Wait a while for the optimizer to get through n more passes. */
+static void wait_for_passes(uint64_t n)
+{
+    int i;
+    struct toku_fs_stats start, stats;
+
+    get_stats(&start);
+    for (i = 0; i < 100; i++) {
+        get_stats(&stats);
+        if (stats.optimize_passes >= start.optimize_passes + n) {
+            break;
+        }
+        usleep(100 * 1000);
+    }
+    assert(stats.optimize_passes >= start.optimize_passes + n);
+}
+
+static void mount_with(const char * str)
+{
+    int ret;
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_options_parse(&opts, str);
+    assert(ret == 0);
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == 0);
+}
+
+/* Once writes stop, both dictionaries get optimized. */
+static void test_optimize_idle(void)
+{
+    struct toku_fs_stats stats;
+
+    mount_with("optimize_idle=1");
+    write_files('i');
+    wait_for_passes(2);
+    get_stats(&stats);
+    assert(stats.optimize_ranges >= 2);
+    verify_files('i');
+    assert(toku_fs_unmount() == 0);
+}
+
+/* A backlog sets it off while writes are still coming. */
+static void test_optimize_backlog(void)
+{
+    mount_with("optimize_backlog=10,optimize_rate=1m");
+    write_files('b');
+    wait_for_passes(1);
+    verify_files('b');
+    assert(toku_fs_unmount() == 0);
+}
+
+/* Without either, there's no optimizer at all. */
+static void test_optimize_off(void)
+{
+    struct toku_fs_stats before, after;
+
+    get_stats(&before);
+    mount_with("optimize_rate=1m");
+    write_files('o');
+    sleep(2);
+    get_stats(&after);
+    assert(after.optimize_passes == before.optimize_passes);
+    assert(after.optimize_progress == 0);
+    verify_files('o');
+    assert(toku_fs_unmount() == 0);
+}
+
+int main(void)
+{
+    test_optimize_idle();
+    test_optimize_backlog();
+    test_optimize_off();
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+#define _XOPEN_SOURCE 600
+
+#include "tokufs-test.h"
+
+#define PATH "/parallel"
+#define FILE_SIZE (64 * 1024 + 100)
+#define HOLE_START (8 * 1024)
+#define HOLE_END (20 * 1024 + 300)
+
+static char expected[FILE_SIZE + 4096];
+
+static void mount_with(const char * str)
+{
+    int ret;
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_options_parse(&opts, str);
+    assert(ret == 0);
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == 0);
+}
+
+/* Every block different, with a hole in the middle. */
+static void write_file(void)
+{
+    int ret, fd;
+
+    for (int i = 0; i < FILE_SIZE; i++) {
+        expected[i] = i / 512 + i % 7 + 1;
+    }
+    memset(expected + HOLE_START, 0, HOLE_END - HOLE_START);
+    fd = toku_fs_open(PATH, O_CREAT, 0644);
+    assert(fd >= 0);
+    ret = toku_fs_pwrite(fd, expected, HOLE_START, 0);
+    assert(ret == HOLE_START);
+    ret = toku_fs_pwrite(fd, expected + HOLE_END, FILE_SIZE - HOLE_END,
+            HOLE_END);
+    assert(ret == FILE_SIZE - HOLE_END);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+}
+
+/*
+ * Reads of every size and alignment, including ones that cross
+ * the hole and the end of the file, come back the same however
+ * they were split.
+ */
+static void check_reads(void)
+{
+    int ret, fd;
+    char * buf = malloc(sizeof(expected));
+    size_t sizes[] = { 100, 4096, 5000, 16 * 1024 + 1, FILE_SIZE,
+        sizeof(expected) };
+    off_t offsets[] = { 0, 1, 511, 4096, HOLE_START + 10, HOLE_END - 1,
+        FILE_SIZE - 50 };
+
+    fd = toku_fs_open(PATH, 0, 0);
+    assert(fd >= 0);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (size_t j = 0; j < sizeof(offsets) / sizeof(offsets[0]); j++) {
+            size_t size = sizes[i];
+            off_t offset = offsets[j];
+            if (offset + size > sizeof(expected)) {
+                size = sizeof(expected) - offset;
+            }
+            memset(buf, 'x', sizeof(expected));
+            ret = toku_fs_pread(fd, buf, size, offset);
+            assert(ret == (int) size);
+            assert(memcmp(buf, expected + offset, size) == 0);
+            // and nothing past what was asked for
+            if (offset + size < sizeof(expected)) {
+                assert(buf[size] == 'x');
+            }
+        }
+    }
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    free(buf);
+}
+
+/* How many cursors one read of the whole file used. */
+static uint64_t scans_per_read(void)
+{
+    int ret, fd;
+    char * buf = malloc(FILE_SIZE);
+    struct toku_fs_stats stats;
+
+    fd = toku_fs_open(PATH, 0, 0);
+    assert(fd >= 0);
+    ret = toku_fs_reset_stats();
+    assert(ret == 0);
+    ret = toku_fs_pread(fd, buf, FILE_SIZE, 0);
+    assert(ret == FILE_SIZE);
+    ret = toku_fs_get_stats(&stats);
+    assert(ret == 0);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    free(buf);
+
+    return stats.ops[TOKU_FS_OP_BSTORE_SCAN].calls;
+}
+
+int main(void)
+{
+    int ret;
+
+    mount_with("parallel_read=4k,workers=4");
+    write_file();
+    check_reads();
+    // two slices per thread, the four workers and the caller
+    assert(scans_per_read() == 10);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    // the smallest pieces, on one worker and the caller
+    mount_with("parallel_read=512,workers=1");
+    check_reads();
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    // reads that are not split give the same answers
+    mount_with("parallel_read=1g,fadvise=sequential");
+    check_reads();
+    assert(scans_per_read() == 1);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+#define _XOPEN_SOURCE 600
+
+#include "tokufs-test.h"
+
+#define PATH "/parallel"
+#define FILE_SIZE (64 * 1024 + 100)
+#define ZEROS_START (8 * 1024)
+#define ZEROS_END (20 * 1024 + 300)
+
+static char expected[FILE_SIZE];
+
+static void mount_with(const char * str)
+{
+    int ret;
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_options_parse(&opts, str);
+    assert(ret == 0);
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == 0);
+}
+
+static void fill(char * buf, size_t size, int seed)
+{
+    for (size_t i = 0; i < size; i++) {
+        buf[i] = (i / 512 + i % 7 + seed) % 255 + 1;
+    }
+}
+
+/* Write at offset, both to the file and to what we expect. */
+static void write_at(int fd, const char * buf, size_t size, off_t offset)
+{
+    int ret;
+
+    ret = toku_fs_pwrite(fd, buf, size, offset);
+    assert(ret == (int) size);
+    memcpy(expected + offset, buf, size);
+}
+
+static void check_file(void)
+{
+    int ret, fd;
+    char * buf = malloc(FILE_SIZE);
+    struct stat st;
+
+    ret = toku_fs_stat(PATH, &st);
+    assert(ret == 0);
+    assert(st.st_size == FILE_SIZE);
+    fd = toku_fs_open(PATH, 0, 0);
+    assert(fd >= 0);
+    ret = toku_fs_pread(fd, buf, FILE_SIZE, 0);
+    assert(ret == FILE_SIZE);
+    assert(memcmp(buf, expected, FILE_SIZE) == 0);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    free(buf);
+}
+
+/*
+ * Big writes over the whole file and over parts of it, starting
+ * and ending inside blocks, and some of all zeros, land the same
+ * however they were split.
+ */
+static void write_file(int seed)
+{
+    int ret, fd;
+    char * buf = malloc(FILE_SIZE);
+
+    fd = toku_fs_open(PATH, O_CREAT, 0644);
+    assert(fd >= 0);
+    fill(buf, FILE_SIZE, seed);
+    write_at(fd, buf, FILE_SIZE, 0);
+    fill(buf, FILE_SIZE, seed + 1);
+    write_at(fd, buf, FILE_SIZE - 1000, 511);
+    fill(buf, FILE_SIZE, seed + 2);
+    write_at(fd, buf, 5000, FILE_SIZE - 5000);
+    memset(buf, 0, ZEROS_END - ZEROS_START);
+    write_at(fd, buf, ZEROS_END - ZEROS_START, ZEROS_START);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    free(buf);
+}
+
+/* The counters for one write of the whole file. */
+static void write_whole(struct toku_fs_stats * stats)
+{
+    int ret, fd;
+    char * buf = malloc(FILE_SIZE);
+
+    fill(buf, FILE_SIZE, 0);
+    fd = toku_fs_open(PATH, 0, 0);
+    assert(fd >= 0);
+    ret = toku_fs_reset_stats();
+    assert(ret == 0);
+    write_at(fd, buf, FILE_SIZE, 0);
+    ret = toku_fs_get_stats(stats);
+    assert(ret == 0);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    free(buf);
+}
+
+int main(void)
+{
+    int ret;
+    struct toku_fs_stats stats;
+    uint64_t puts = FILE_SIZE / toku_fs_get_blocksize();
+
+    mount_with("parallel_write=4k,workers=4");
+    write_file(0);
+    check_file();
+    // it was split, and the puts made on every thread are counted
+    write_whole(&stats);
+    assert(stats.parallel_slices > 1);
+    assert(stats.ops[TOKU_FS_OP_BSTORE_PUT].calls == puts);
+    check_file();
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    // the smallest pieces, on one worker and the caller
+    mount_with("parallel_write=512,workers=1");
+    check_file();
+    write_file(10);
+    check_file();
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    // writes that are not split give the same file
+    mount_with("parallel_write=1g");
+    check_file();
+    write_file(20);
+    check_file();
+    write_whole(&stats);
+    assert(stats.parallel_slices == 0);
+    assert(stats.ops[TOKU_FS_OP_BSTORE_PUT].calls == puts);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
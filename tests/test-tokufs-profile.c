@@ -0,0 +1,110 @@
+#include "tokufs-test.h"
+
+#define FILE_BLOCKS 16
+
+static struct toku_fs_profile profile;
+
+/* Calls of a phase under every operation and in the background. */
+static uint64_t phase_calls(enum toku_fs_phase phase)
+{
+    uint64_t calls = profile.background[phase].calls;
+
+    for (int op = 0; op < TOKU_FS_OPS; op++) {
+        calls += profile.ops[op][phase].calls;
+    }
+    return calls;
+}
+
+/* Sampling starts over at a reset, so each thread times the
+ * first of every sample_rate calls it makes from then on. Only
+ * the operation rows are checked: nothing is in an operation at
+ * the reset, but engine threads counting under background may be
+ * in the middle of a phase. */
+static void check_sampling(void)
+{
+    const struct toku_fs_phase_stats * p = &profile.ops[0][0];
+
+    for (int i = 0; i < TOKU_FS_OPS * TOKU_FS_PHASES; i++, p++) {
+        assert(p->sampled <= p->calls);
+        // the first call is always timed
+        assert(p->calls == 0 || p->sampled > 0);
+        assert(p->sampled * profile.sample_rate >= p->calls);
+    }
+}
+
+int main(void)
+{
+    int ret, fd;
+    char * buf;
+    struct stat st;
+    size_t blocksize = toku_fs_get_blocksize();
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+
+    // the names are there either way
+    assert(strcmp(toku_fs_phase_name(TOKU_FS_PHASE_KEYCMP), "keycmp") == 0);
+    assert(toku_fs_phase_name(TOKU_FS_PHASES) == NULL);
+
+    ret = toku_fs_get_profile(&profile);
+    if (ret == -ENOSYS) {
+        // built without the profiler, which make check-profile
+        // builds in to run the rest
+        assert(toku_fs_print_profile(stdout) == -ENOSYS);
+        goto out;
+    }
+    assert(ret == 0);
+    assert(profile.sample_rate > 0);
+
+    ret = toku_fs_reset_stats();
+    assert(ret == 0);
+    ret = toku_fs_get_profile(&profile);
+    assert(ret == 0);
+    assert(profile.ops[TOKU_FS_OP_PREAD][TOKU_FS_PHASE_ZERO_FILL].calls == 0);
+
+    // a block at the start and half of one at the end, with a hole
+    // between. the file is too big to be inline, so the half block
+    // is written by upsert.
+    fd = toku_fs_open("/profile", O_CREAT, 0644);
+    assert(fd >= 0);
+    buf = malloc(FILE_BLOCKS * blocksize);
+    memset(buf, 'p', FILE_BLOCKS * blocksize);
+    ret = toku_fs_pwrite(fd, buf, blocksize, 0);
+    assert(ret == (int) blocksize);
+    ret = toku_fs_pwrite(fd, buf, blocksize / 2,
+            (FILE_BLOCKS - 1) * blocksize + blocksize / 2);
+    assert(ret == (int) blocksize / 2);
+    ret = toku_fs_pread(fd, buf, FILE_BLOCKS * blocksize, 0);
+    assert(ret == (int) (FILE_BLOCKS * blocksize));
+    assert(buf[blocksize] == 0);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    free(buf);
+
+    ret = toku_fs_get_profile(&profile);
+    assert(ret == 0);
+    check_sampling();
+    assert(profile.ops[TOKU_FS_OP_PREAD][TOKU_FS_PHASE_ZERO_FILL].calls > 0);
+    assert(profile.ops[TOKU_FS_OP_PWRITE][TOKU_FS_PHASE_ZERO_FILL].calls == 0);
+    assert(phase_calls(TOKU_FS_PHASE_KEYCMP) > 0);
+    assert(phase_calls(TOKU_FS_PHASE_ENV_UPDATE_CB) > 0);
+    assert(phase_calls(TOKU_FS_PHASE_BLOCK_UPDATE_CB) > 0);
+    assert(phase_calls(TOKU_FS_PHASE_BLOCK_UPDATE_CB) <=
+            phase_calls(TOKU_FS_PHASE_ENV_UPDATE_CB));
+    assert(toku_fs_print_profile(stdout) == 0);
+
+    // a second reset starts sampling over again
+    ret = toku_fs_reset_stats();
+    assert(ret == 0);
+    ret = toku_fs_stat("/profile", &st);
+    assert(ret == 0);
+    ret = toku_fs_get_profile(&profile);
+    assert(ret == 0);
+    check_sampling();
+
+out:
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include "tokufs-test.h"
+
+// bigger than the inline limit, so these files have blocks
+#define BIG_SIZE (8192)
+
+static void fill(char * buf, size_t size, int seed)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        buf[i] = 'a' + (i + seed) % 26;
+    }
+}
+
+static void verify_file(const char * path, const char * expected,
+        size_t size)
+{
+    int ret, fd;
+    ssize_t n;
+    struct stat st;
+    char buf[BIG_SIZE * 2];
+
+    ret = toku_fs_stat(path, &st);
+    assert(ret == 0);
+    assert(st.st_size == (off_t) size);
+
+    // get_file stops at the end of the file
+    memset(buf, 1, sizeof(buf));
+    n = toku_fs_get_file(path, buf, sizeof(buf));
+    assert(n == (ssize_t) size);
+    assert(memcmp(buf, expected, size) == 0);
+    assert(buf[size] == 1);
+
+    // and agrees with pread
+    memset(buf, 1, sizeof(buf));
+    fd = toku_fs_open(path, 0, 0);
+    assert(fd >= 0);
+    n = toku_fs_pread(fd, buf, size, 0);
+    assert(n == (ssize_t) size);
+    assert(memcmp(buf, expected, size) == 0);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+}
+
+static void test_put_get(void)
+{
+    int ret;
+    struct stat st;
+    char small[100], big[BIG_SIZE], part[10];
+    struct toku_fs_dir_usage before, after;
+
+    ret = toku_fs_mkdir("/put", 0755);
+    assert(ret == 0);
+    ret = toku_fs_dir_usage("/put", &before);
+    assert(ret == 0);
+
+    fill(small, sizeof(small), 0);
+    ret = toku_fs_put_file("/put/small", small, sizeof(small), 0640);
+    assert(ret == 0);
+    ret = toku_fs_stat("/put/small", &st);
+    assert(ret == 0);
+    assert(st.st_mode == 0640);
+    verify_file("/put/small", small, sizeof(small));
+
+    // a hole in the middle of a block file
+    fill(big, sizeof(big), 1);
+    memset(big + 1024, 0, 2048);
+    ret = toku_fs_put_file("/put/big", big, sizeof(big), 0644);
+    assert(ret == 0);
+    verify_file("/put/big", big, sizeof(big));
+
+    ret = toku_fs_dir_usage("/put", &after);
+    assert(ret == 0);
+    assert(after.files == before.files + 2);
+    assert(after.bytes == before.bytes + sizeof(small) + sizeof(big));
+
+    // reading just the front
+    ret = toku_fs_get_file("/put/big", part, sizeof(part));
+    assert(ret == sizeof(part));
+    assert(memcmp(part, big, sizeof(part)) == 0);
+
+    // an empty file
+    ret = toku_fs_put_file("/put/empty", NULL, 0, 0644);
+    assert(ret == 0);
+    verify_file("/put/empty", NULL, 0);
+}
+
+/* Putting over an existing file replaces all of its contents. */
+static void test_replace(void)
+{
+    int ret;
+    struct stat st;
+    char small[100], big[BIG_SIZE];
+    struct toku_fs_dir_usage before, after;
+
+    ret = toku_fs_dir_usage("/put", &before);
+    assert(ret == 0);
+
+    // inline to blocks
+    fill(big, sizeof(big), 2);
+    ret = toku_fs_put_file("/put/small", big, sizeof(big), 0600);
+    assert(ret == 0);
+    verify_file("/put/small", big, sizeof(big));
+    // the mode stays
+    ret = toku_fs_stat("/put/small", &st);
+    assert(ret == 0);
+    assert(st.st_mode == 0640);
+
+    // blocks to a shorter file
+    fill(small, sizeof(small), 3);
+    ret = toku_fs_put_file("/put/big", small, sizeof(small), 0644);
+    assert(ret == 0);
+    verify_file("/put/big", small, sizeof(small));
+
+    // growing it again must not bring back the old blocks
+    ret = toku_fs_truncate("/put/big", BIG_SIZE);
+    assert(ret == 0);
+    memset(big, 0, sizeof(big));
+    memcpy(big, small, sizeof(small));
+    verify_file("/put/big", big, sizeof(big));
+
+    ret = toku_fs_dir_usage("/put", &after);
+    assert(ret == 0);
+    assert(after.files == before.files);
+    // only the first file grew
+    assert(after.bytes == before.bytes + BIG_SIZE - sizeof(small));
+}
+
+static void test_put_get_errors(void)
+{
+    int ret;
+    char buf[10];
+
+    ret = toku_fs_get_file("/put/nope", buf, sizeof(buf));
+    assert(ret == -ENOENT);
+    ret = toku_fs_get_file("/put", buf, sizeof(buf));
+    assert(ret == -EISDIR);
+    ret = toku_fs_put_file("/put", buf, sizeof(buf), 0644);
+    assert(ret == -EISDIR);
+}
+
+int main(void)
+{
+    int ret;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+
+    test_put_get();
+    test_replace();
+    test_put_get_errors();
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+#define _XOPEN_SOURCE 600
+
+#include "tokufs-test.h"
+
+// bigger than the inline limit, so these files have blocks
+#define BIG_SIZE (8192)
+
+static void create_file(const char * path, char c, size_t size)
+{
+    int ret, fd;
+    char * buf = malloc(size);
+
+    fd = toku_fs_open(path, O_CREAT, 0644);
+    assert(fd >= 0);
+    memset(buf, c, size);
+    ret = toku_fs_pwrite(fd, buf, size, 0);
+    assert(ret == (int) size);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    free(buf);
+}
+
+static void make_dir(const char * path)
+{
+    int ret;
+
+    ret = toku_fs_mkdir(path, 0755);
+    assert(ret == 0);
+}
+
+static void create_tree(void)
+{
+    int ret;
+
+    make_dir("/rt");
+    make_dir("/rt/a");
+    make_dir("/rt/a/b");
+    make_dir("/rt/empty");
+    create_file("/rt/big", 'x', BIG_SIZE);
+    create_file("/rt/small", 's', 10);
+    create_file("/rt/a/big", 'y', BIG_SIZE);
+    create_file("/rt/a/b/big", 'z', BIG_SIZE);
+    ret = toku_fs_symlink("/rt/big", "/rt/a/link");
+    assert(ret == 0);
+    // a sibling that shares the name as a prefix
+    create_file("/rtx", 'k', BIG_SIZE);
+}
+
+static void wait_for_reclaim(void)
+{
+    int ret;
+    struct toku_fs_stats stats;
+
+    do {
+        ret = toku_fs_get_stats(&stats);
+        assert(ret == 0);
+        if (stats.reclaims_pending > 0) {
+            usleep(1000);
+        }
+    } while (stats.reclaims_pending > 0);
+}
+
+static void verify_bytes(const char * buf, char c, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (buf[i] != c) {
+            printf("index %lu wanted %d got %d\n", i, c, buf[i]);
+        }
+        assert(buf[i] == c);
+    }
+}
+
+/* Everything under the tree is gone as soon as the call
+ * returns, and the usage above it drops by all of it. */
+static void test_remove_tree(void)
+{
+    int ret;
+    struct stat st;
+    struct toku_fs_dir_usage before, after;
+    const char * paths[] = { "/rt", "/rt/a", "/rt/a/b", "/rt/empty",
+        "/rt/big", "/rt/small", "/rt/a/big", "/rt/a/b/big", "/rt/a/link" };
+    size_t i;
+
+    create_tree();
+    ret = toku_fs_dir_usage("/", &before);
+    assert(ret == 0);
+
+    ret = toku_fs_remove_tree("/rt");
+    assert(ret == 0);
+    for (i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        ret = toku_fs_stat(paths[i], &st);
+        assert(ret == -ENOENT);
+    }
+    ret = toku_fs_dir_usage("/", &after);
+    assert(ret == 0);
+    assert(after.files == before.files - 9);
+    assert(after.bytes == before.bytes - 3 * BIG_SIZE - 10 -
+            strlen("/rt/big"));
+
+    // the sibling is untouched
+    ret = toku_fs_stat("/rtx", &st);
+    assert(ret == 0);
+    assert(st.st_size == BIG_SIZE);
+
+    wait_for_reclaim();
+}
+
+/* A file created again before its old blocks are reclaimed
+ * must not see them. */
+static void test_recreate(void)
+{
+    int ret, fd;
+    char buf[BIG_SIZE];
+
+    create_tree();
+    ret = toku_fs_remove_tree("/rt");
+    assert(ret == 0);
+
+    make_dir("/rt");
+    fd = toku_fs_open("/rt/big", O_CREAT, 0644);
+    assert(fd >= 0);
+    // one byte at the end makes a block file with a hole before it
+    ret = toku_fs_pwrite(fd, "q", 1, BIG_SIZE - 1);
+    assert(ret == 1);
+    wait_for_reclaim();
+    memset(buf, 1, sizeof(buf));
+    ret = toku_fs_pread(fd, buf, BIG_SIZE, 0);
+    assert(ret == BIG_SIZE);
+    verify_bytes(buf, 0, BIG_SIZE - 1);
+    assert(buf[BIG_SIZE - 1] == 'q');
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+
+    memset(buf, 1, sizeof(buf));
+    fd = toku_fs_open("/rtx", 0, 0644);
+    assert(fd >= 0);
+    ret = toku_fs_pread(fd, buf, BIG_SIZE, 0);
+    assert(ret == BIG_SIZE);
+    verify_bytes(buf, 'k', BIG_SIZE);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+}
+
+static void test_remove_tree_errors(void)
+{
+    int ret;
+    struct stat st;
+
+    ret = toku_fs_remove_tree("/");
+    assert(ret == -EINVAL);
+    ret = toku_fs_remove_tree("/nope");
+    assert(ret == -ENOENT);
+
+    // a file is just unlinked
+    ret = toku_fs_remove_tree("/rt/big");
+    assert(ret == 0);
+    ret = toku_fs_stat("/rt/big", &st);
+    assert(ret == -ENOENT);
+}
+
+int main(void)
+{
+    int ret;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+
+    test_remove_tree();
+    test_recreate();
+    test_remove_tree_errors();
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
@@ -96,6 +96,56 @@ static void test_basic_stat(void)
     assert(st2.st_mode == mode2);
 }
 
+/* Metadata is varint encoded on disk. Make sure big and
+ * odd values survive, through both stat and readdir. */
+static void test_encoding_round_trip(void)
+{
+    int fd;
+    int ret;
+    int entries_read;
+    struct stat st;
+    struct utimbuf times;
+    struct toku_dircursor cursor;
+    struct toku_dirent dirent;
+
+    ret = toku_fs_mkdir("/roundtrip", 0755);
+    assert(ret == 0);
+    fd = toku_fs_open("/roundtrip/file", O_CREAT, 0640);
+    assert(fd >= 0);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+
+    ret = toku_fs_chown("/roundtrip/file", 4000000000U, 0);
+    assert(ret == 0);
+    times.actime = 0;
+    times.modtime = (time_t) 1 << 40;
+    ret = toku_fs_utime("/roundtrip/file", &times);
+    assert(ret == 0);
+    ret = toku_fs_truncate("/roundtrip/file", (off_t) 1 << 33);
+    assert(ret == 0);
+
+    ret = toku_fs_stat("/roundtrip/file", &st);
+    assert(ret == 0);
+    assert(st.st_mode == 0640);
+    assert(st.st_uid == 4000000000U);
+    assert(st.st_gid == 0);
+    assert(st.st_atime == 0);
+    assert(st.st_mtime == (time_t) 1 << 40);
+    assert(st.st_size == (off_t) 1 << 33);
+    assert((size_t) st.st_blksize == toku_fs_get_blocksize());
+
+    ret = toku_fs_opendir("/roundtrip", &cursor);
+    assert(ret == 0);
+    ret = toku_fs_readdir(&cursor, &dirent, 1, &entries_read);
+    assert(ret >= 0);
+    assert(entries_read == 1);
+    assert(strcmp(dirent.filename, "/roundtrip/file") == 0);
+    assert(memcmp(&dirent.st, &st, sizeof(struct stat)) == 0);
+    free(dirent.filename);
+    ret = toku_fs_closedir(&cursor);
+    assert(ret == 0);
+}
+
 int main(void)
 {
     int ret;
@@ -105,6 +155,7 @@ int main(void)
     
     test_basic_stat();
     test_file_op_stat();
+    test_encoding_round_trip();
 
     ret = toku_fs_unmount();
     assert(ret == 0);
@@ -0,0 +1,67 @@
+#include "tokufs-test.h"
+
+static void test_statfs(void)
+{
+    int ret, fd;
+    char buf[100];
+    struct toku_fs_statfs before, after;
+
+    ret = toku_fs_statfs(&before);
+    assert(ret == 0);
+    // at least the root
+    assert(before.files >= 1);
+    assert(before.disk_bytes > 0);
+
+    ret = toku_fs_mkdir("/statfs", 0755);
+    assert(ret == 0);
+    fd = toku_fs_open("/statfs/file", O_CREAT, 0644);
+    assert(fd >= 0);
+    memset(buf, 's', sizeof(buf));
+    ret = toku_fs_pwrite(fd, buf, sizeof(buf), 0);
+    assert(ret == sizeof(buf));
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+
+    ret = toku_fs_statfs(&after);
+    assert(ret == 0);
+    assert(after.files == before.files + 2);
+    assert(after.bytes == before.bytes + sizeof(buf));
+    // stored bytes is the engine's estimate, which may not move
+    // until the new data is flushed
+    assert(after.stored_bytes >= before.stored_bytes);
+
+    // the counts live in the root's metadata, so they
+    // survive a remount
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+    ret = toku_fs_statfs(&after);
+    assert(ret == 0);
+    assert(after.files == before.files + 2);
+    assert(after.bytes == before.bytes + sizeof(buf));
+
+    ret = toku_fs_unlink("/statfs/file");
+    assert(ret == 0);
+    ret = toku_fs_rmdir("/statfs");
+    assert(ret == 0);
+    ret = toku_fs_statfs(&after);
+    assert(ret == 0);
+    assert(after.files == before.files);
+    assert(after.bytes == before.bytes);
+}
+
+int main(void)
+{
+    int ret;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+
+    test_statfs();
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+#define _XOPEN_SOURCE 600
+
+#include <pthread.h>
+
+#include "tokufs-test.h"
+
+#define PATH "/trace"
+#define READ_OFFSET 100
+#define READ_SIZE 1000
+
+struct thread_records {
+    struct toku_fs_trace_thread thread;
+    struct toku_fs_trace_record * records;
+};
+
+static struct toku_fs_trace_header header;
+static struct thread_records * threads;
+
+static void * stat_thread(void * arg)
+{
+    int ret;
+    struct stat st;
+    (void) arg;
+
+    ret = toku_fs_stat(PATH, &st);
+    assert(ret == 0);
+    return NULL;
+}
+
+static void read_dump(FILE * f)
+{
+    size_t n;
+    char c;
+    struct toku_fs_trace_event * events;
+
+    rewind(f);
+    n = fread(&header, sizeof(header), 1, f);
+    assert(n == 1);
+    assert(memcmp(header.magic, TOKU_FS_TRACE_MAGIC,
+                sizeof(header.magic)) == 0);
+    assert(header.record_size == sizeof(struct toku_fs_trace_record));
+    assert(header.events > TOKU_FS_OPS);
+
+    events = malloc(header.events * sizeof(struct toku_fs_trace_event));
+    n = fread(events, sizeof(struct toku_fs_trace_event), header.events, f);
+    assert(n == header.events);
+    assert(strcmp(events[TOKU_FS_OP_PREAD].name,
+                toku_fs_op_name(TOKU_FS_OP_PREAD)) == 0);
+    assert(strcmp(events[TOKU_FS_OP_PREAD].a, "offset") == 0);
+    free(events);
+
+    threads = calloc(header.threads, sizeof(struct thread_records));
+    for (uint32_t t = 0; t < header.threads; t++) {
+        struct thread_records * tr = &threads[t];
+        n = fread(&tr->thread, sizeof(tr->thread), 1, f);
+        assert(n == 1);
+        tr->records = malloc(tr->thread.records *
+                sizeof(struct toku_fs_trace_record));
+        n = fread(tr->records, sizeof(struct toku_fs_trace_record),
+                tr->thread.records, f);
+        assert(n == tr->thread.records);
+        // each ring is oldest first
+        for (uint64_t i = 1; i < tr->thread.records; i++) {
+            assert(tr->records[i].seq > tr->records[i - 1].seq);
+            assert(tr->records[i].nsec >= tr->records[i - 1].nsec);
+        }
+    }
+    // and nothing after the last thread
+    n = fread(&c, 1, 1, f);
+    assert(n == 0);
+}
+
+/**
+ * Find the thread that began op with args about path, a and b,
+ * then ended it. Returns its tid, or 0 if none did.
+ */
+static uint64_t find_op(enum toku_fs_op op, const char * path,
+        uint64_t a, uint64_t b)
+{
+    uint64_t i, j, hash = toku_fs_trace_path_hash(path);
+    struct toku_fs_trace_record * r, * args;
+
+    for (uint32_t t = 0; t < header.threads; t++) {
+        struct thread_records * tr = &threads[t];
+        for (i = 0; i < tr->thread.records; i++) {
+            if (tr->records[i].event != op ||
+                    tr->records[i].kind != TOKU_FS_TRACE_BEGIN) {
+                continue;
+            }
+            // lower level records may come between
+            args = NULL;
+            for (j = i + 1; j < tr->thread.records; j++) {
+                r = &tr->records[j];
+                if (r->event != op) {
+                    continue;
+                }
+                if (r->kind == TOKU_FS_TRACE_ARGS && args == NULL) {
+                    args = r;
+                } else if (r->kind == TOKU_FS_TRACE_END) {
+                    break;
+                }
+            }
+            if (j < tr->thread.records && args != NULL &&
+                    args->path == hash && args->a == a && args->b == b) {
+                assert(tr->records[j].a == 0);
+                return tr->thread.tid;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int ret, fd;
+    char buf[4096];
+    uint64_t reader, stater;
+    pthread_t thread;
+    FILE * f;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+
+    assert(toku_fs_trace_path_hash(PATH) != 0);
+    assert(toku_fs_trace_path_hash(PATH) == toku_fs_trace_path_hash(PATH));
+    assert(toku_fs_trace_path_hash(PATH) != toku_fs_trace_path_hash("/"));
+
+    fd = toku_fs_open(PATH, O_CREAT, 0644);
+    assert(fd >= 0);
+    memset(buf, 't', sizeof(buf));
+    ret = toku_fs_pwrite(fd, buf, sizeof(buf), 0);
+    assert(ret == sizeof(buf));
+    ret = toku_fs_pread(fd, buf, READ_SIZE, READ_OFFSET);
+    assert(ret == READ_SIZE);
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+
+    ret = pthread_create(&thread, NULL, stat_thread, NULL);
+    assert(ret == 0);
+    ret = pthread_join(thread, NULL);
+    assert(ret == 0);
+
+    f = tmpfile();
+    assert(f != NULL);
+    ret = toku_fs_trace_dump(f);
+    assert(ret == 0);
+    read_dump(f);
+    fclose(f);
+
+    if (header.level == 0) {
+        // built without tracing, the dump is empty
+        for (uint32_t t = 0; t < header.threads; t++) {
+            assert(threads[t].thread.records == 0);
+        }
+        goto out;
+    }
+    reader = find_op(TOKU_FS_OP_PREAD, PATH, READ_OFFSET, READ_SIZE);
+    assert(reader != 0);
+    assert(find_op(TOKU_FS_OP_PWRITE, PATH, 0, sizeof(buf)) == reader);
+    // the stat thread exited, but its ring is kept
+    stater = find_op(TOKU_FS_OP_STAT, PATH, 0, 0);
+    assert(stater != 0);
+    assert(stater != reader);
+
+out:
+    for (uint32_t t = 0; t < header.threads; t++) {
+        free(threads[t].records);
+    }
+    free(threads);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
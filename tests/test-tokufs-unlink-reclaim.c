@@ -0,0 +1,248 @@
+#define _XOPEN_SOURCE 600
+
+#include "tokufs-test.h"
+#include "../src/bstore.h"
+
+// bigger than the inline limit, so these files have blocks
+#define BIG_SIZE (8192)
+#define NUM_FILES 3
+// more than the reclaim queue's table starts with
+#define NUM_MANY 200
+
+static void create_file(const char * path, char c)
+{
+    int ret, fd;
+    char buf[BIG_SIZE];
+
+    fd = toku_fs_open(path, O_CREAT, 0644);
+    assert(fd >= 0);
+    memset(buf, c, sizeof(buf));
+    ret = toku_fs_pwrite(fd, buf, sizeof(buf), 0);
+    assert(ret == sizeof(buf));
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+}
+
+static uint64_t reclaims_pending(void)
+{
+    int ret;
+    struct toku_fs_stats stats;
+
+    ret = toku_fs_get_stats(&stats);
+    assert(ret == 0);
+    return stats.reclaims_pending;
+}
+
+static void wait_for_reclaim(void)
+{
+    while (reclaims_pending() > 0) {
+        usleep(1000);
+    }
+}
+
+/* True if any data blocks are stored under exactly this name. */
+static int has_blocks(const char * path)
+{
+    int n, found;
+    char * name;
+
+    n = toku_bstore_scan_names(path, NULL, &name, 1);
+    if (n == 0) {
+        return 0;
+    }
+    found = strcmp(name, path) == 0;
+    free(name);
+    return found;
+}
+
+/* A file created where a reclaimed one was reads as a hole. */
+static void verify_reclaimed(const char * path)
+{
+    int ret, fd, i;
+    char buf[BIG_SIZE];
+
+    fd = toku_fs_open(path, O_CREAT, 0644);
+    assert(fd >= 0);
+    ret = toku_fs_pwrite(fd, "q", 1, BIG_SIZE - 1);
+    assert(ret == 1);
+    memset(buf, 1, sizeof(buf));
+    ret = toku_fs_pread(fd, buf, BIG_SIZE, 0);
+    assert(ret == BIG_SIZE);
+    for (i = 0; i < BIG_SIZE - 1; i++) {
+        assert(buf[i] == 0);
+    }
+    assert(buf[BIG_SIZE - 1] == 'q');
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    ret = toku_fs_unlink(path);
+    assert(ret == 0);
+}
+
+/* The file is gone as soon as unlink returns, and its blocks
+ * follow in the background. */
+static void test_unlink_reclaim(void)
+{
+    int ret;
+    struct stat st;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+
+    create_file("/reclaim", 'r');
+    assert(has_blocks("/reclaim"));
+    ret = toku_fs_unlink("/reclaim");
+    assert(ret == 0);
+    ret = toku_fs_stat("/reclaim", &st);
+    assert(ret == -ENOENT);
+    wait_for_reclaim();
+    assert(!has_blocks("/reclaim"));
+    verify_reclaimed("/reclaim");
+
+    // unlinked and created again before the reclaim gets to it
+    create_file("/reclaim", 'r');
+    ret = toku_fs_unlink("/reclaim");
+    assert(ret == 0);
+    verify_reclaimed("/reclaim");
+    wait_for_reclaim();
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+}
+
+/* A reclaim too slow to finish before unmount picks up where
+ * it left off at the next mount. */
+static void test_reclaim_resumes(void)
+{
+    int ret, i;
+    char path[32];
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_options_parse(&opts, "reclaim_rate=1");
+    assert(ret == 0);
+    assert(opts.reclaim_rate == 1);
+
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == 0);
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/slow%d", i);
+        create_file(path, 's');
+    }
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/slow%d", i);
+        ret = toku_fs_unlink(path);
+        assert(ret == 0);
+    }
+    // at one byte per second, the first file holds up the rest
+    assert(reclaims_pending() >= NUM_FILES - 1);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == 0);
+    assert(reclaims_pending() >= NUM_FILES - 1);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+    wait_for_reclaim();
+    for (i = 0; i < NUM_FILES; i++) {
+        sprintf(path, "/slow%d", i);
+        assert(!has_blocks(path));
+        verify_reclaimed(path);
+    }
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+}
+
+/* A crash between queueing an unlinked file and deleting its
+ * metadata leaves the name queued with the file still there.
+ * The reclaim at the next mount leaves its blocks alone. */
+static void test_reclaim_skips_existing(void)
+{
+    int ret, fd, i;
+    char buf[BIG_SIZE];
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+    create_file("/kept", 'k');
+    ret = toku_bstore_reclaim_put("/kept");
+    assert(ret == 0);
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+    wait_for_reclaim();
+    assert(has_blocks("/kept"));
+    fd = toku_fs_open("/kept", 0, 0);
+    assert(fd >= 0);
+    ret = toku_fs_pread(fd, buf, BIG_SIZE, 0);
+    assert(ret == BIG_SIZE);
+    for (i = 0; i < BIG_SIZE; i++) {
+        assert(buf[i] == 'k');
+    }
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    ret = toku_fs_unlink("/kept");
+    assert(ret == 0);
+    wait_for_reclaim();
+    assert(!has_blocks("/kept"));
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+}
+
+/* Many queued names, some of them twice, are each still seen
+ * as queued until their own reclaim is done. */
+static void test_many_reclaims(void)
+{
+    int ret, i;
+    char path[32];
+    struct toku_fs_mount_options opts;
+
+    toku_fs_mount_options_init(&opts);
+    ret = toku_fs_mount_options_parse(&opts, "reclaim_rate=1");
+    assert(ret == 0);
+    ret = toku_fs_mount_with_options(MOUNT_PATH, &opts);
+    assert(ret == 0);
+    for (i = 0; i < NUM_MANY; i++) {
+        sprintf(path, "/many%d", i);
+        create_file(path, 'm');
+        ret = toku_fs_unlink(path);
+        assert(ret == 0);
+    }
+    for (i = 0; i < NUM_MANY; i += 2) {
+        sprintf(path, "/many%d", i);
+        create_file(path, 'm');
+        ret = toku_fs_unlink(path);
+        assert(ret == 0);
+    }
+    assert(reclaims_pending() >= NUM_MANY);
+    for (i = 0; i < NUM_MANY; i += 7) {
+        sprintf(path, "/many%d", i);
+        verify_reclaimed(path);
+    }
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+    wait_for_reclaim();
+    for (i = 0; i < NUM_MANY; i++) {
+        sprintf(path, "/many%d", i);
+        assert(!has_blocks(path));
+    }
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+}
+
+int main(void)
+{
+    test_unlink_reclaim();
+    test_reclaim_resumes();
+    test_reclaim_skips_existing();
+    test_many_reclaims();
+
+    return 0;
+}
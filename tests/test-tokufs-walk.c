@@ -0,0 +1,263 @@
+#define _XOPEN_SOURCE 600
+
+#include "tokufs-test.h"
+
+#define MAX_FOUND 256
+
+struct found {
+    char * paths[MAX_FOUND];
+    int depths[MAX_FOUND];
+    int n;
+    int stop_after;
+};
+
+static int count_slashes(const char * path)
+{
+    int n = 0;
+
+    for (; *path != '\0'; path++) {
+        n += *path == '/';
+    }
+    return n;
+}
+
+static int found_cb(const char * path, const struct stat * st, void * extra)
+{
+    struct found * found = extra;
+
+    (void) st;
+    assert(found->n < MAX_FOUND);
+    found->paths[found->n] = malloc(strlen(path) + 1);
+    strcpy(found->paths[found->n], path);
+    found->depths[found->n] = count_slashes(path);
+    found->n++;
+
+    return found->stop_after == found->n ? 42 : 0;
+}
+
+static void found_reset(struct found * found)
+{
+    int i;
+
+    for (i = 0; i < found->n; i++) {
+        free(found->paths[i]);
+    }
+    memset(found, 0, sizeof(struct found));
+}
+
+static int found_has(struct found * found, const char * path)
+{
+    int i;
+
+    for (i = 0; i < found->n; i++) {
+        if (strcmp(found->paths[i], path) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void create_file(const char * path, size_t size)
+{
+    int ret, fd;
+    char * buf = malloc(size + 1);
+
+    fd = toku_fs_open(path, O_CREAT, 0644);
+    assert(fd >= 0);
+    if (size > 0) {
+        memset(buf, 'w', size);
+        ret = toku_fs_pwrite(fd, buf, size, 0);
+        assert(ret == (int) size);
+    }
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    free(buf);
+}
+
+static void make_dir(const char * path)
+{
+    int ret;
+
+    ret = toku_fs_mkdir(path, 0755);
+    assert(ret == 0);
+}
+
+/* Names starting with bytes below '/' sort in between
+ * the directories we walk, so include a few. */
+static void create_tree(void)
+{
+    make_dir("/walk");
+    make_dir("/walk/a");
+    make_dir("/walk/a/b");
+    make_dir("/walk/-dash");
+    make_dir("/walk/.hidden");
+    make_dir("/walk/-dash/!deep");
+    create_file("/walk/f1.txt", 10);
+    create_file("/walk/a/f2.txt", 100);
+    create_file("/walk/a/b/f3.dat", 1000);
+    create_file("/walk/-dash/x.txt", 5);
+    create_file("/walk/-dash/!deep/y.txt", 50);
+    create_file("/walk/.hidden/z.dat", 0);
+    // siblings of the root must not show up
+    create_file("/walker", 1);
+    make_dir("/walk-other");
+    create_file("/walk-other/no.txt", 1);
+}
+
+/* Everything under the root comes back, one level at a time. */
+static void test_walk_all(void)
+{
+    int ret, i;
+    struct found found;
+
+    memset(&found, 0, sizeof(found));
+    ret = toku_fs_walk("/walk", NULL, found_cb, &found);
+    assert(ret == 0);
+    assert(found.n == 12);
+    assert(strcmp(found.paths[0], "/walk") == 0);
+    for (i = 1; i < found.n; i++) {
+        assert(found.depths[i] >= found.depths[i - 1]);
+    }
+    assert(found_has(&found, "/walk/-dash/!deep/y.txt"));
+    assert(found_has(&found, "/walk/.hidden/z.dat"));
+    assert(!found_has(&found, "/walker"));
+    assert(!found_has(&found, "/walk-other/no.txt"));
+    found_reset(&found);
+
+    // the whole file system from the root
+    ret = toku_fs_walk("/", NULL, found_cb, &found);
+    assert(ret == 0);
+    assert(found_has(&found, "/"));
+    assert(found_has(&found, "/walk-other/no.txt"));
+    assert(found_has(&found, "/walk/a/b/f3.dat"));
+    found_reset(&found);
+}
+
+/* Filters are applied during the scan. */
+static void test_walk_filters(void)
+{
+    int ret;
+    struct found found;
+    struct toku_fs_walk_filter filter;
+    struct utimbuf times;
+
+    memset(&found, 0, sizeof(found));
+    memset(&filter, 0, sizeof(filter));
+    filter.name = "*.txt";
+    ret = toku_fs_walk("/walk", &filter, found_cb, &found);
+    assert(ret == 0);
+    assert(found.n == 4);
+    assert(!found_has(&found, "/walk/a/b/f3.dat"));
+    found_reset(&found);
+
+    memset(&filter, 0, sizeof(filter));
+    filter.type = S_IFDIR;
+    filter.min_depth = 1;
+    ret = toku_fs_walk("/walk", &filter, found_cb, &found);
+    assert(ret == 0);
+    assert(found.n == 5);
+    assert(!found_has(&found, "/walk"));
+    found_reset(&found);
+
+    memset(&filter, 0, sizeof(filter));
+    filter.type = S_IFREG;
+    filter.min_size = 10;
+    filter.max_size = 100;
+    ret = toku_fs_walk("/walk", &filter, found_cb, &found);
+    assert(ret == 0);
+    assert(found.n == 3);
+    assert(found_has(&found, "/walk/f1.txt"));
+    assert(found_has(&found, "/walk/a/f2.txt"));
+    assert(found_has(&found, "/walk/-dash/!deep/y.txt"));
+    found_reset(&found);
+
+    memset(&filter, 0, sizeof(filter));
+    filter.max_depth = 1;
+    ret = toku_fs_walk("/walk", &filter, found_cb, &found);
+    assert(ret == 0);
+    assert(found.n == 5);
+    assert(!found_has(&found, "/walk/a/f2.txt"));
+    found_reset(&found);
+
+    times.actime = 1000;
+    times.modtime = 1000;
+    ret = toku_fs_utime("/walk/a/f2.txt", &times);
+    assert(ret == 0);
+    memset(&filter, 0, sizeof(filter));
+    filter.min_mtime = 500;
+    filter.max_mtime = 1500;
+    ret = toku_fs_walk("/walk", &filter, found_cb, &found);
+    assert(ret == 0);
+    assert(found.n == 1);
+    assert(found_has(&found, "/walk/a/f2.txt"));
+    found_reset(&found);
+}
+
+/* Levels wider than one batch, and stopping early. */
+static void test_walk_batches(void)
+{
+    int ret, i;
+    char path[64];
+    struct found found;
+    struct toku_fs_walk_filter filter;
+
+    make_dir("/wide");
+    for (i = 0; i < 150; i++) {
+        sprintf(path, "/wide/%03d", i);
+        create_file(path, 0);
+    }
+
+    memset(&found, 0, sizeof(found));
+    memset(&filter, 0, sizeof(filter));
+    filter.min_depth = 1;
+    ret = toku_fs_walk("/wide", &filter, found_cb, &found);
+    assert(ret == 0);
+    assert(found.n == 150);
+    for (i = 0; i < 150; i++) {
+        sprintf(path, "/wide/%03d", i);
+        assert(strcmp(found.paths[i], path) == 0);
+    }
+    found_reset(&found);
+
+    found.stop_after = 70;
+    ret = toku_fs_walk("/wide", NULL, found_cb, &found);
+    assert(ret == 42);
+    assert(found.n == 70);
+    found_reset(&found);
+}
+
+static void test_walk_errors(void)
+{
+    int ret;
+    struct found found;
+
+    memset(&found, 0, sizeof(found));
+    ret = toku_fs_walk("/nope", NULL, found_cb, &found);
+    assert(ret == -ENOENT);
+    assert(found.n == 0);
+
+    // walking a file just reports the file
+    ret = toku_fs_walk("/walker", NULL, found_cb, &found);
+    assert(ret == 0);
+    assert(found.n == 1);
+    found_reset(&found);
+}
+
+int main(void)
+{
+    int ret;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+
+    create_tree();
+    test_walk_all();
+    test_walk_filters();
+    test_walk_batches();
+    test_walk_errors();
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
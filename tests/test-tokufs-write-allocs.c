@@ -0,0 +1,66 @@
+#include "tokufs-test.h"
+
+#define NUM_WRITES (1000)
+
+static uint64_t heap_allocs(void)
+{
+    int ret;
+    struct toku_fs_stats stats;
+
+    ret = toku_fs_get_stats(&stats);
+    assert(ret == 0);
+
+    return stats.heap_allocs;
+}
+
+/* Once the thread's buffers are warm, partial block writes
+ * and the updates they generate shouldn't allocate. */
+static void test_partial_writes_dont_allocate(void)
+{
+    int ret, fd, i;
+    uint64_t before;
+    size_t blocksize = toku_fs_get_blocksize();
+    char * buf = malloc(blocksize * 4);
+    // far enough out that the file is stored in blocks
+    const off_t base = 64 * 1024;
+
+    fd = toku_fs_open("/write-allocs.file", O_CREAT, 0644);
+    assert(fd >= 0);
+    memset(buf, 'a', blocksize * 4);
+
+    // warm up, including writes to blocks that don't exist yet
+    for (i = 0; i < 8; i++) {
+        ret = toku_fs_pwrite(fd, buf, blocksize / 2,
+                base + i * blocksize + 1);
+        assert(ret == (int) blocksize / 2);
+    }
+
+    before = heap_allocs();
+    for (i = 0; i < NUM_WRITES; i++) {
+        off_t offset = base + (i % 64) * blocksize + i % 7;
+        ret = toku_fs_pwrite(fd, buf, blocksize / 3, offset);
+        assert(ret == (int) blocksize / 3);
+    }
+    printf("%lu heap allocations for %d writes\n",
+            heap_allocs() - before, NUM_WRITES);
+    assert(heap_allocs() == before);
+
+    ret = toku_fs_close(fd);
+    assert(ret == 0);
+    free(buf);
+}
+
+int main(void)
+{
+    int ret;
+
+    ret = toku_fs_mount(MOUNT_PATH);
+    assert(ret == 0);
+
+    test_partial_writes_dont_allocate();
+
+    ret = toku_fs_unmount();
+    assert(ret == 0);
+
+    return 0;
+}
@@ -0,0 +1,280 @@
+/**
+ * TokuFS
+ *
+ * Print the engine status from a toku_fs_dump_engine_status()
+ * dump, or from the FUSE mount's /.tokufs_engine file, with what
+ * it costs to store what was written: write and space amplification
+ * and each dictionary's compression. Given a second dump taken
+ * earlier, print what happened in between.
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#define MAX_FIELDS 64
+#define MAX_ROWS 1024
+
+struct field {
+    char name[128];
+    char legend[256];
+    uint64_t value;
+};
+
+struct dump {
+    int num_fields;
+    int num_rows;
+    struct field fields[MAX_FIELDS];
+    // the engine's own rows
+    struct field rows[MAX_ROWS];
+};
+
+/**
+ * Fields that count up. The rest show how things are now, so
+ * they aren't subtracted.
+ */
+static const char * counters[] = {
+    "bytes_written", "disk_bytes_written", "cache_misses",
+    "cache_evictions", "checkpoints", "checkpoint_secs",
+    "data_messages", "meta_messages",
+};
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: tokufs-engstat [-a] <dump> [<earlier dump>]\n"
+            "    -a  also print every row of the engine's status\n");
+}
+
+static int read_dump(const char * path, struct dump * dump)
+{
+    char line[1024], * tok, * saveptr, * rest;
+    struct field * field;
+    FILE * f;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    dump->num_fields = 0;
+    dump->num_rows = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        tok = strtok_r(line, " \n", &saveptr);
+        if (strcmp(tok, "engine") == 0) {
+            if (dump->num_rows == MAX_ROWS) {
+                continue;
+            }
+            field = &dump->rows[dump->num_rows++];
+            tok = strtok_r(NULL, " \n", &saveptr);
+        } else {
+            if (dump->num_fields == MAX_FIELDS) {
+                continue;
+            }
+            field = &dump->fields[dump->num_fields++];
+        }
+        snprintf(field->name, sizeof(field->name), "%s",
+                tok != NULL ? tok : "");
+        tok = strtok_r(NULL, " \n", &saveptr);
+        field->value = tok != NULL ? strtoull(tok, NULL, 10) : 0;
+        rest = strtok_r(NULL, "\n", &saveptr);
+        snprintf(field->legend, sizeof(field->legend), "%s",
+                rest != NULL ? rest : "");
+    }
+    fclose(f);
+
+    return 0;
+}
+
+static struct field * find_field(struct field * fields, int n,
+        const char * name)
+{
+    for (int i = 0; i < n; i++) {
+        if (strcmp(fields[i].name, name) == 0) {
+            return &fields[i];
+        }
+    }
+    return NULL;
+}
+
+static uint64_t get(struct dump * dump, const char * name)
+{
+    struct field * field = find_field(dump->fields, dump->num_fields, name);
+    return field != NULL ? field->value : 0;
+}
+
+static int is_counter(const char * name)
+{
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        if (strcmp(counters[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Take what an earlier dump counted off a later one. A counter
+ * that went down started over in between, so it's left alone.
+ */
+static void subtract(struct dump * dump, struct dump * earlier)
+{
+    int i;
+    struct field * before;
+
+    for (i = 0; i < dump->num_fields; i++) {
+        before = find_field(earlier->fields, earlier->num_fields,
+                dump->fields[i].name);
+        if (before != NULL && is_counter(dump->fields[i].name) &&
+                dump->fields[i].value >= before->value) {
+            dump->fields[i].value -= before->value;
+        }
+    }
+}
+
+/**
+ * Print a byte count with a unit that fits it.
+ */
+static void format_bytes(char * buf, size_t size, double bytes)
+{
+    if (bytes < 1024) {
+        snprintf(buf, size, "%.0fB", bytes);
+    } else if (bytes < 1024 * 1024) {
+        snprintf(buf, size, "%.1fK", bytes / 1024);
+    } else if (bytes < 1024 * 1024 * 1024) {
+        snprintf(buf, size, "%.1fM", bytes / (1024 * 1024));
+    } else {
+        snprintf(buf, size, "%.2fG", bytes / (1024 * 1024 * 1024));
+    }
+}
+
+static void format_ratio(char * buf, size_t size, uint64_t a, uint64_t b)
+{
+    if (b > 0) {
+        snprintf(buf, size, "%.2f", (double) a / b);
+    } else {
+        snprintf(buf, size, "-");
+    }
+}
+
+static void print_bytes(const char * what, uint64_t bytes)
+{
+    char buf[16];
+
+    format_bytes(buf, sizeof(buf), bytes);
+    printf("%-22s %12s\n", what, buf);
+}
+
+static void print_dict(struct dump * dump, const char * dict)
+{
+    char name[64], logical[16], disk[16], compression[16];
+    uint64_t logical_bytes, disk_bytes;
+
+    snprintf(name, sizeof(name), "%s_logical_bytes", dict);
+    logical_bytes = get(dump, name);
+    snprintf(name, sizeof(name), "%s_disk_bytes", dict);
+    disk_bytes = get(dump, name);
+    snprintf(name, sizeof(name), "%s_messages", dict);
+    format_bytes(logical, sizeof(logical), logical_bytes);
+    format_bytes(disk, sizeof(disk), disk_bytes);
+    format_ratio(compression, sizeof(compression), logical_bytes, disk_bytes);
+    printf("%-10s %12s %12s %12s %12" PRIu64 "\n", dict, logical, disk,
+            compression, get(dump, name));
+}
+
+static void print_status(struct dump * dump)
+{
+    char buf[16];
+    uint64_t disk_bytes = get(dump, "data_disk_bytes") +
+        get(dump, "meta_disk_bytes");
+
+    print_bytes("bytes written", get(dump, "bytes_written"));
+    print_bytes("disk bytes written", get(dump, "disk_bytes_written"));
+    format_ratio(buf, sizeof(buf), get(dump, "disk_bytes_written"),
+            get(dump, "bytes_written"));
+    printf("%-22s %12s\n", "write amplification", buf);
+    print_bytes("file bytes", get(dump, "file_bytes"));
+    print_bytes("disk bytes", disk_bytes);
+    format_ratio(buf, sizeof(buf), disk_bytes, get(dump, "file_bytes"));
+    printf("%-22s %12s\n", "space amplification", buf);
+    print_bytes("messages buffered", get(dump, "buffered_bytes"));
+    print_bytes("cache used", get(dump, "cache_bytes"));
+    print_bytes("cache limit", get(dump, "cache_limit"));
+    printf("%-22s %12" PRIu64 "\n", "cache misses",
+            get(dump, "cache_misses"));
+    printf("%-22s %12" PRIu64 "\n", "cache evictions",
+            get(dump, "cache_evictions"));
+    printf("%-22s %12" PRIu64 "\n", "checkpoints", get(dump, "checkpoints"));
+    printf("%-22s %12" PRIu64 "\n", "checkpoint seconds",
+            get(dump, "checkpoint_secs"));
+
+    printf("\n%-10s %12s %12s %12s %12s\n", "dictionary", "logical",
+            "disk", "compression", "messages");
+    print_dict(dump, "data");
+    print_dict(dump, "meta");
+}
+
+/**
+ * Print the engine's rows, with how much each changed since the
+ * earlier dump if there is one.
+ */
+static void print_rows(struct dump * dump, struct dump * earlier)
+{
+    int i;
+    struct field * row, * before;
+
+    printf("\n");
+    for (i = 0; i < dump->num_rows; i++) {
+        row = &dump->rows[i];
+        printf("%-44s %16" PRIu64, row->name, row->value);
+        before = earlier != NULL ? find_field(earlier->rows,
+                earlier->num_rows, row->name) : NULL;
+        if (before != NULL && row->value != before->value) {
+            printf(" %+16" PRId64, (int64_t) (row->value - before->value));
+        } else if (earlier != NULL) {
+            printf(" %16s", "");
+        }
+        printf("  %s\n", row->legend);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    int arg = 1, all = 0;
+    struct dump * dump, * earlier = NULL;
+
+    if (argc > 1 && strcmp(argv[1], "-a") == 0) {
+        all = 1;
+        arg = 2;
+    }
+    if (argc - arg < 1 || argc - arg > 2) {
+        usage();
+        return 1;
+    }
+    dump = malloc(sizeof(struct dump));
+    if (read_dump(argv[arg], dump) != 0) {
+        return 1;
+    }
+    if (argc - arg == 2) {
+        earlier = malloc(sizeof(struct dump));
+        if (read_dump(argv[arg + 1], earlier) != 0) {
+            return 1;
+        }
+        subtract(dump, earlier);
+    }
+
+    print_status(dump);
+    if (all) {
+        print_rows(dump, earlier);
+    }
+    free(dump);
+    free(earlier);
+
+    return 0;
+}
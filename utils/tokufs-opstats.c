@@ -0,0 +1,225 @@
+/**
+ * TokuFS
+ *
+ * Print the operation counters from a toku_fs_dump_stats() dump,
+ * or from the FUSE mount's /.tokufs_stats file. Given a second
+ * dump taken earlier, print what happened in between.
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "../include/tokufs.h"
+
+// counters on a line before the latency buckets
+#define COUNTERS 8
+
+struct op_line {
+    char name[64];
+    uint64_t counters[COUNTERS];
+    uint64_t latency[TOKU_FS_LATENCY_BUCKETS];
+};
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: tokufs-opstats [-l op] <dump> [<earlier dump>]\n"
+            "    -l op  also print the latency histogram of op\n");
+}
+
+/**
+ * Read every op line of a dump into ops, which has room for max.
+ * Returns how many there were, or -1 if the file can't be read.
+ */
+static int read_dump(const char * path, struct op_line * ops, int max)
+{
+    int i, n = 0;
+    char line[1024], * tok, * saveptr;
+    FILE * f;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    while (n < max && fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        memset(&ops[n], 0, sizeof(struct op_line));
+        tok = strtok_r(line, " \n", &saveptr);
+        snprintf(ops[n].name, sizeof(ops[n].name), "%s", tok);
+        for (i = 0; i < COUNTERS + TOKU_FS_LATENCY_BUCKETS; i++) {
+            tok = strtok_r(NULL, " \n", &saveptr);
+            if (tok == NULL) {
+                break;
+            }
+            if (i < COUNTERS) {
+                ops[n].counters[i] = strtoull(tok, NULL, 10);
+            } else {
+                ops[n].latency[i - COUNTERS] = strtoull(tok, NULL, 10);
+            }
+        }
+        n++;
+    }
+    fclose(f);
+
+    return n;
+}
+
+static struct op_line * find_op(struct op_line * ops, int n,
+        const char * name)
+{
+    for (int i = 0; i < n; i++) {
+        if (strcmp(ops[i].name, name) == 0) {
+            return &ops[i];
+        }
+    }
+    return NULL;
+}
+
+static void subtract(struct op_line * a, const struct op_line * b)
+{
+    int i;
+
+    for (i = 0; i < COUNTERS; i++) {
+        a->counters[i] -= b->counters[i];
+    }
+    for (i = 0; i < TOKU_FS_LATENCY_BUCKETS; i++) {
+        a->latency[i] -= b->latency[i];
+    }
+}
+
+/**
+ * Print a duration in nanoseconds with a unit that fits it.
+ */
+static void format_nsec(char * buf, size_t size, double nsec)
+{
+    if (nsec < 1000) {
+        snprintf(buf, size, "%.0fns", nsec);
+    } else if (nsec < 1000000) {
+        snprintf(buf, size, "%.1fus", nsec / 1000);
+    } else if (nsec < 1000000000) {
+        snprintf(buf, size, "%.1fms", nsec / 1000000);
+    } else {
+        snprintf(buf, size, "%.2fs", nsec / 1000000000);
+    }
+}
+
+/**
+ * The upper bound of the bucket the given fraction of calls
+ * falls in.
+ */
+static double percentile(const struct op_line * op, double fraction)
+{
+    int i;
+    uint64_t seen = 0, calls = op->counters[0];
+
+    for (i = 0; i < TOKU_FS_LATENCY_BUCKETS; i++) {
+        seen += op->latency[i];
+        if (seen > 0 && seen >= fraction * calls) {
+            break;
+        }
+    }
+    if (i == TOKU_FS_LATENCY_BUCKETS) {
+        i--;
+    }
+
+    return (double) (1ULL << i);
+}
+
+static void print_op(const struct op_line * op)
+{
+    char mean[16], p50[16], p99[16], max[16], hits[16];
+    uint64_t calls = op->counters[0];
+    int i;
+
+    format_nsec(mean, sizeof(mean), (double) op->counters[7] / calls);
+    format_nsec(p50, sizeof(p50), percentile(op, 0.50));
+    format_nsec(p99, sizeof(p99), percentile(op, 0.99));
+    format_nsec(max, sizeof(max), percentile(op, 1.0));
+    if (op->counters[5] + op->counters[6] > 0) {
+        snprintf(hits, sizeof(hits), "%.1f%%", 100.0 * op->counters[5] /
+                (op->counters[5] + op->counters[6]));
+    } else {
+        snprintf(hits, sizeof(hits), "-");
+    }
+    printf("%-22s", op->name);
+    for (i = 0; i < 5; i++) {
+        printf(" %12" PRIu64, op->counters[i]);
+    }
+    printf(" %7s %9s %9s %9s %9s\n", hits, mean, p50, p99, max);
+}
+
+static void print_histogram(const struct op_line * op)
+{
+    int i;
+    char bound[16];
+    uint64_t calls = op->counters[0];
+
+    printf("\n%s latency\n", op->name);
+    for (i = 0; i < TOKU_FS_LATENCY_BUCKETS; i++) {
+        if (op->latency[i] == 0) {
+            continue;
+        }
+        format_nsec(bound, sizeof(bound), (double) (1ULL << i));
+        printf("  < %-9s %12" PRIu64 " %5.1f%%\n", bound, op->latency[i],
+                100.0 * op->latency[i] / calls);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    int i, n, m, arg = 1;
+    const char * histogram = NULL;
+    struct op_line * before, * op;
+    struct op_line ops[TOKU_FS_OPS * 2], earlier[TOKU_FS_OPS * 2];
+
+    if (argc > 2 && strcmp(argv[1], "-l") == 0) {
+        histogram = argv[2];
+        arg = 3;
+    }
+    if (argc - arg < 1 || argc - arg > 2) {
+        usage();
+        return 1;
+    }
+    n = read_dump(argv[arg], ops, TOKU_FS_OPS * 2);
+    if (n < 0) {
+        return 1;
+    }
+    if (argc - arg == 2) {
+        m = read_dump(argv[arg + 1], earlier, TOKU_FS_OPS * 2);
+        if (m < 0) {
+            return 1;
+        }
+        for (i = 0; i < n; i++) {
+            before = find_op(earlier, m, ops[i].name);
+            if (before != NULL) {
+                subtract(&ops[i], before);
+            }
+        }
+    }
+
+    printf("%-22s %12s %12s %12s %12s %12s %7s %9s %9s %9s %9s\n",
+            "op", "calls", "errors", "bytes", "blocks", "upserts",
+            "hits", "mean", "p50", "p99", "max");
+    for (i = 0; i < n; i++) {
+        if (ops[i].counters[0] > 0) {
+            print_op(&ops[i]);
+        }
+    }
+    if (histogram != NULL) {
+        op = find_op(ops, n, histogram);
+        if (op == NULL || op->counters[0] == 0) {
+            fprintf(stderr, "no calls to %s\n", histogram);
+            return 1;
+        }
+        print_histogram(op);
+    }
+
+    return 0;
+}
@@ -0,0 +1,317 @@
+/**
+ * TokuFS
+ *
+ * Print a toku_fs_trace_dump() dump, or the FUSE mount's
+ * /.tokufs_trace file, as text sorted by time, or as JSON for
+ * chrome://tracing and Perfetto.
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "../include/tokufs.h"
+
+struct record {
+    uint64_t tid;
+    // position in the dump, to keep the sort stable
+    uint64_t index;
+    // one more than where the args record of a begin is, or 0
+    uint64_t args;
+    int attached;
+    struct toku_fs_trace_record r;
+};
+
+static struct toku_fs_trace_event * events;
+static struct toku_fs_trace_header header;
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: tokufs-trace [-j] <dump>\n"
+            "    -j  print JSON for chrome://tracing instead of text\n");
+}
+
+static const char * event_name(const struct toku_fs_trace_record * r)
+{
+    return r->event < header.events ? events[r->event].name : "?";
+}
+
+/**
+ * What the a or b value of a record is called, or NULL if the
+ * event doesn't use it.
+ */
+static const char * arg_name(const struct toku_fs_trace_record * r,
+        int which)
+{
+    const char * name;
+
+    if (r->event >= header.events) {
+        return which == 0 ? "a" : "b";
+    }
+    name = which == 0 ? events[r->event].a : events[r->event].b;
+    return name[0] != '\0' ? name : NULL;
+}
+
+/**
+ * The begin records of each thread are followed, not always
+ * right away, by the args of the op. Point each begin at its
+ * args, so they print together.
+ */
+static void attach_args(struct record * records, uint64_t n)
+{
+    uint64_t i, j, depth = 0;
+    struct record ** begins = malloc(n * sizeof(struct record *));
+
+    for (i = 0; i < n; i++) {
+        struct record * rec = &records[i];
+        if (i > 0 && rec->tid != records[i - 1].tid) {
+            depth = 0;
+        }
+        switch (rec->r.kind) {
+            case TOKU_FS_TRACE_BEGIN:
+                begins[depth++] = rec;
+                break;
+            case TOKU_FS_TRACE_END:
+                if (depth > 0 && begins[depth - 1]->r.event == rec->r.event) {
+                    depth--;
+                }
+                break;
+            case TOKU_FS_TRACE_ARGS:
+                for (j = depth; j > 0; j--) {
+                    struct record * begin = begins[j - 1];
+                    if (begin->r.event == rec->r.event &&
+                            begin->args == 0) {
+                        begin->args = rec->index + 1;
+                        rec->attached = 1;
+                        break;
+                    }
+                }
+                break;
+        }
+    }
+    free(begins);
+}
+
+static int compare_records(const void * a, const void * b)
+{
+    const struct record * x = a, * y = b;
+
+    if (x->r.nsec != y->r.nsec) {
+        return x->r.nsec < y->r.nsec ? -1 : 1;
+    }
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/**
+ * Read a whole dump. Returns the records, sorted by time, with
+ * their count in *n, or NULL if the dump can't be read.
+ */
+static struct record * read_dump(const char * path, uint64_t * n)
+{
+    uint32_t t;
+    uint64_t i, count = 0;
+    struct toku_fs_trace_thread thread;
+    struct record * records = NULL;
+    FILE * f;
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+            memcmp(header.magic, TOKU_FS_TRACE_MAGIC,
+                sizeof(header.magic)) != 0 ||
+            header.record_size != sizeof(struct toku_fs_trace_record)) {
+        fprintf(stderr, "%s: not a trace dump\n", path);
+        goto err;
+    }
+    events = malloc(header.events * sizeof(struct toku_fs_trace_event));
+    if (fread(events, sizeof(struct toku_fs_trace_event),
+                header.events, f) != header.events) {
+        goto truncated;
+    }
+    for (i = 0; i < header.events; i++) {
+        events[i].name[sizeof(events[i].name) - 1] = '\0';
+        events[i].a[sizeof(events[i].a) - 1] = '\0';
+        events[i].b[sizeof(events[i].b) - 1] = '\0';
+    }
+    for (t = 0; t < header.threads; t++) {
+        if (fread(&thread, sizeof(thread), 1, f) != 1) {
+            goto truncated;
+        }
+        records = realloc(records,
+                (count + thread.records) * sizeof(struct record));
+        for (i = 0; i < thread.records; i++) {
+            struct record * rec = &records[count];
+            if (fread(&rec->r, sizeof(rec->r), 1, f) != 1) {
+                goto truncated;
+            }
+            rec->tid = thread.tid;
+            rec->index = count++;
+            rec->args = 0;
+            rec->attached = 0;
+        }
+    }
+    fclose(f);
+
+    attach_args(records, count);
+    qsort(records, count, sizeof(struct record), compare_records);
+    // the args records moved, follow them
+    uint64_t * where = malloc(count * sizeof(uint64_t));
+    for (i = 0; i < count; i++) {
+        where[records[i].index] = i;
+    }
+    for (i = 0; i < count; i++) {
+        if (records[i].args != 0) {
+            records[i].args = where[records[i].args - 1] + 1;
+        }
+    }
+    free(where);
+    *n = count;
+
+    return records;
+
+truncated:
+    fprintf(stderr, "%s: truncated\n", path);
+err:
+    free(records);
+    fclose(f);
+    return NULL;
+}
+
+static void print_args_text(const struct toku_fs_trace_record * r)
+{
+    const char * name;
+
+    if (r->path != 0) {
+        printf(" path=%016" PRIx64, r->path);
+    }
+    if ((name = arg_name(r, 0)) != NULL) {
+        printf(" %s=%" PRIu64, name, r->a);
+    }
+    if ((name = arg_name(r, 1)) != NULL) {
+        printf(" %s=%" PRIu64, name, r->b);
+    }
+}
+
+static void print_text(const struct record * records, uint64_t n)
+{
+    static const char * kinds[] = { "begin", "end", "args", "" };
+    uint64_t i;
+
+    for (i = 0; i < n; i++) {
+        const struct record * rec = &records[i];
+        const struct toku_fs_trace_record * r = &rec->r;
+        if (rec->attached) {
+            continue;
+        }
+        printf("%14.6f [%" PRIu64 "] %s",
+                (r->nsec - records[0].r.nsec) / 1e9, rec->tid,
+                event_name(r));
+        if (r->kind <= TOKU_FS_TRACE_ARGS) {
+            printf(" %s", kinds[r->kind]);
+        }
+        if (r->kind == TOKU_FS_TRACE_END) {
+            if (r->a) {
+                printf(" failed");
+            }
+        } else if (rec->args != 0) {
+            print_args_text(&records[rec->args - 1].r);
+        } else if (r->kind != TOKU_FS_TRACE_BEGIN) {
+            print_args_text(r);
+        }
+        printf("\n");
+    }
+}
+
+static void print_args_json(const struct toku_fs_trace_record * r)
+{
+    const char * name;
+    const char * sep = "";
+
+    printf(", \"args\": {");
+    if (r->path != 0) {
+        printf("\"path\": \"%016" PRIx64 "\"", r->path);
+        sep = ", ";
+    }
+    if ((name = arg_name(r, 0)) != NULL) {
+        printf("%s\"%s\": %" PRIu64, sep, name, r->a);
+        sep = ", ";
+    }
+    if ((name = arg_name(r, 1)) != NULL) {
+        printf("%s\"%s\": %" PRIu64, sep, name, r->b);
+    }
+    printf("}");
+}
+
+/**
+ * The trace event format: begin and end records become duration
+ * events, everything else instant events, in microseconds.
+ */
+static void print_json(const struct record * records, uint64_t n)
+{
+    uint64_t i;
+    const char * sep = "";
+
+    printf("{\"traceEvents\": [\n");
+    for (i = 0; i < n; i++) {
+        const struct record * rec = &records[i];
+        const struct toku_fs_trace_record * r = &rec->r;
+        const char * ph;
+        if (rec->attached) {
+            continue;
+        }
+        ph = r->kind == TOKU_FS_TRACE_BEGIN ? "B" :
+            r->kind == TOKU_FS_TRACE_END ? "E" : "i";
+        printf("%s{\"name\": \"%s\", \"ph\": \"%s\", \"ts\": %.3f, "
+                "\"pid\": 1, \"tid\": %" PRIu64, sep, event_name(r), ph,
+                r->nsec / 1e3, rec->tid);
+        if (r->kind == TOKU_FS_TRACE_END) {
+            if (r->a) {
+                printf(", \"args\": {\"failed\": 1}");
+            }
+        } else if (rec->args != 0) {
+            print_args_json(&records[rec->args - 1].r);
+        } else if (r->kind != TOKU_FS_TRACE_BEGIN) {
+            printf(", \"s\": \"t\"");
+            print_args_json(r);
+        }
+        printf("}");
+        sep = ",\n";
+    }
+    printf("\n]}\n");
+}
+
+int main(int argc, char * argv[])
+{
+    int json = 0, arg = 1;
+    uint64_t n;
+    struct record * records;
+
+    if (argc > 1 && strcmp(argv[1], "-j") == 0) {
+        json = 1;
+        arg = 2;
+    }
+    if (argc - arg != 1) {
+        usage();
+        return 1;
+    }
+    records = read_dump(argv[arg], &n);
+    if (records == NULL) {
+        return 1;
+    }
+    if (json) {
+        print_json(records, n);
+    } else {
+        print_text(records, n);
+    }
+    free(records);
+    free(events);
+
+    return 0;
+}